@@ -19,6 +19,7 @@
 #include <string>
 
 #include "paddle/fluid/distributed/ps/service/coordinator_client.h"
+#include "paddle/fluid/distributed/ps/service/sparse_key_codec.h"
 #include "paddle/fluid/framework/archive.h"
 #include "paddle/fluid/string/split.h"
 
@@ -78,6 +79,19 @@ DEFINE_int32(pserver_sparse_table_shard_num,
              1000,
              "sparse table shard for save & load");
 
+DEFINE_bool(pserver_pull_sparse_varint_key,
+            false,
+            "pull sparse keys are sent as varint encoded deltas, the servers "
+            "of older builds only read the raw keys");
+
+DEFINE_int32(pserver_pull_sparse_chunk_size,
+             100000,
+             "max unique keys of one pull sparse sub request");
+
+DEFINE_int32(pserver_pull_sparse_thread_num,
+             8,
+             "threads to partition and sort keys of large pull sparse");
+
 inline size_t get_sparse_shard(uint32_t shard_num,
                                uint32_t server_num,
                                uint64_t key) {
@@ -363,6 +377,9 @@ int32_t BrpcPsClient::Initialize() {
   profiler.register_profiler("pserver_client_push_dense_rpc");
   profiler.register_profiler("pserver_client_push_dense_send");
 
+  _pull_sparse_pool.reset(
+      new ::ThreadPool(std::max(FLAGS_pserver_pull_sparse_thread_num, 1)));
+
   _running = true;
   _flushing = false;
   // 启动异步push线程
@@ -1132,6 +1149,54 @@ std::future<int32_t> BrpcPsClient::PushGlobalStep(int table_id,
   return fut;
 }
 
+void PullSparseChunkClosure::Run() {
+  int ret = 0;
+  if (_cntl.Failed()) {
+    LOG(ERROR) << "resquest cmd_id:" << PS_PULL_SPARSE_TABLE
+               << " failed, err:" << _cntl.ErrorText();
+    ret = -1;
+  } else if (_response.err_code() != 0) {
+    LOG(ERROR) << "response ret bad, server_idx:" << _shard_id
+               << "cmd_id:" << PS_PULL_SPARSE_TABLE
+               << " err_code:" << _response.err_code()
+               << " err_msg:" << _response.err_msg();
+    ret = -1;
+  } else {
+    auto &request_kvs = _context->shard_kvs[_shard_id];
+    size_t value_size = _context->value_size;
+    butil::IOBufBytesIterator io_buffer_itr(_cntl.response_attachment());
+    uint64_t last_key = UINT64_MAX;
+    float *last_value_data = NULL;
+    for (size_t kv_idx = _kv_begin; kv_idx < _kv_end; ++kv_idx) {
+      auto *kv_pair = &(request_kvs[kv_idx]);
+      if (kv_pair->first == last_key) {
+        memcpy(reinterpret_cast<void *>(kv_pair->second),
+               reinterpret_cast<void *>(last_value_data),
+               value_size);
+      } else {
+        last_key = kv_pair->first;
+        last_value_data = kv_pair->second;
+        if (value_size !=
+            io_buffer_itr.copy_and_forward(
+                reinterpret_cast<void *>(last_value_data), value_size)) {
+          LOG(WARNING) << "res data is lack or not in format";
+          ret = -1;
+          break;
+        }
+      }
+    }
+  }
+  if (ret != 0) {
+    _context->ret = ret;
+  }
+  auto context = _context;
+  delete this;
+  if (context->waiting_num.fetch_sub(1) == 1) {
+    context->timer.reset();
+    context->promise->set_value(context->ret.load());
+  }
+}
+
 std::future<int32_t> BrpcPsClient::PullSparse(float **select_values,
                                               size_t table_id,
                                               const uint64_t *keys,
@@ -1142,9 +1207,9 @@ std::future<int32_t> BrpcPsClient::PullSparse(float **select_values,
       std::make_shared<CostTimer>("pserver_client_pull_sparse_local");
   size_t request_call_num = _server_channels.size();
 
-  auto shard_sorted_kvs = std::make_shared<
-      std::vector<std::vector<std::pair<uint64_t, float *>>>>();
-  shard_sorted_kvs->resize(request_call_num);
+  auto context = std::make_shared<PullSparseContext>();
+  auto &shard_sorted_kvs = context->shard_kvs;
+  shard_sorted_kvs.resize(request_call_num);
 
   const auto &server_param = _config.server_param().downpour_server_param();
   uint64_t shard_num = FLAGS_pserver_sparse_table_shard_num;
@@ -1156,105 +1221,161 @@ std::future<int32_t> BrpcPsClient::PullSparse(float **select_values,
     }
   }
 
-  for (size_t i = 0; i < num; ++i) {
-    size_t shard_id = get_sparse_shard(shard_num, request_call_num, keys[i]);
-    shard_sorted_kvs->at(shard_id).push_back({keys[i], select_values[i]});
+  // partition keys by server: count, prefix sum, then scatter, large pulls
+  // are split into key blocks handled in parallel
+  size_t block_num = 1;
+  if (num >= 100000 && _pull_sparse_pool != nullptr) {
+    block_num = std::max(FLAGS_pserver_pull_sparse_thread_num, 1);
   }
+  size_t block_size = (num + block_num - 1) / block_num;
+  std::vector<uint32_t> shard_ids(num);
+  std::vector<std::vector<size_t>> block_offsets(
+      block_num, std::vector<size_t>(request_call_num, 0));
+  auto run_blocks = [this, block_num](std::function<void(size_t)> func) {
+    if (block_num == 1) {
+      func(0);
+      return;
+    }
+    std::vector<std::future<void>> wait_futures;
+    for (size_t b = 0; b < block_num; ++b) {
+      wait_futures.emplace_back(_pull_sparse_pool->enqueue(func, b));
+    }
+    for (auto &f : wait_futures) {
+      f.wait();
+    }
+  };
+  run_blocks([&](size_t b) {
+    size_t begin = std::min(num, b * block_size);
+    size_t end = std::min(num, begin + block_size);
+    auto &counts = block_offsets[b];
+    for (size_t i = begin; i < end; ++i) {
+      shard_ids[i] = get_sparse_shard(shard_num, request_call_num, keys[i]);
+      ++counts[shard_ids[i]];
+    }
+  });
+  for (size_t i = 0; i < request_call_num; ++i) {
+    size_t offset = 0;
+    for (size_t b = 0; b < block_num; ++b) {
+      size_t cnt = block_offsets[b][i];
+      block_offsets[b][i] = offset;
+      offset += cnt;
+    }
+    shard_sorted_kvs[i].resize(offset);
+  }
+  run_blocks([&](size_t b) {
+    size_t begin = std::min(num, b * block_size);
+    size_t end = std::min(num, begin + block_size);
+    auto &offsets = block_offsets[b];
+    for (size_t i = begin; i < end; ++i) {
+      shard_sorted_kvs[shard_ids[i]][offsets[shard_ids[i]]++] = {
+          keys[i], select_values[i]};
+    }
+  });
 
-  auto *accessor = GetTableAccessor(table_id);
-
-  size_t value_size = accessor->GetAccessorInfo().select_size;
-
-  DownpourBrpcClosure *closure = new DownpourBrpcClosure(
-      request_call_num, [shard_sorted_kvs, value_size](void *done) {
-        int ret = 0;
-        auto *closure = reinterpret_cast<DownpourBrpcClosure *>(done);
-        for (size_t i = 0; i < shard_sorted_kvs->size(); ++i) {
-          if (closure->check_response(i, PS_PULL_SPARSE_TABLE) != 0) {
-            ret = -1;
-            break;
-          }
-
-          auto &request_kvs = shard_sorted_kvs->at(i);
-          auto &res_io_buffer = closure->cntl(i)->response_attachment();
-          butil::IOBufBytesIterator io_buffer_itr(res_io_buffer);
-          uint64_t last_key = UINT64_MAX;
-          float *last_value_data = NULL;
-
-          for (size_t kv_idx = 0; kv_idx < request_kvs.size(); ++kv_idx) {
-            auto *kv_pair = &(request_kvs[kv_idx]);
-            if (kv_pair->first == last_key) {
-              memcpy(reinterpret_cast<void *>(kv_pair->second),
-                     reinterpret_cast<void *>(last_value_data),
-                     value_size);
-            } else {
-              last_key = kv_pair->first;
-              last_value_data = kv_pair->second;
-              if (value_size !=
-                  io_buffer_itr.copy_and_forward(
-                      reinterpret_cast<void *>(last_value_data), value_size)) {
-                LOG(WARNING) << "res data is lack or not in format";
-                ret = -1;
-                break;
-              }
-            }
-          }
-        }
-        closure->set_promise_value(ret);
-      });
-  closure->add_timer(timer);
-  auto promise = std::make_shared<std::promise<int32_t>>();
-  closure->add_promise(promise);
-  std::future<int> fut = promise->get_future();
-
+  // sort keys of each server by radix, the order of duplicate keys is kept
+  std::vector<std::future<void>> sort_futures;
   for (size_t i = 0; i < request_call_num; ++i) {
-    auto &sorted_kvs = shard_sorted_kvs->at(i);
-    std::sort(sorted_kvs.begin(),
-              sorted_kvs.end(),
-              [](const std::pair<uint64_t, float *> &k1,
-                 const std::pair<uint64_t, float *> &k2) {
-                return k1.first < k2.first;
-              });
+    auto sort_func = [&shard_sorted_kvs, i]() {
+      thread_local std::vector<std::pair<uint64_t, float *>> tmp;
+      RadixSortKeyValues(&shard_sorted_kvs[i], &tmp);
+    };
+    if (block_num > 1) {
+      sort_futures.emplace_back(_pull_sparse_pool->enqueue(sort_func));
+    } else {
+      sort_func();
+    }
+  }
+  for (auto &f : sort_futures) {
+    f.wait();
+  }
 
-    uint64_t last_key = UINT64_MAX;
-    uint32_t kv_request_count = 0;
+  auto *accessor = GetTableAccessor(table_id);
+  context->value_size = accessor->GetAccessorInfo().select_size;
+  context->timer = timer;
+  context->promise = std::make_shared<std::promise<int32_t>>();
+  std::future<int> fut = context->promise->get_future();
+
+  // dedup and cut the unique keys of each server into sub requests
+  const size_t chunk_size =
+      std::max(FLAGS_pserver_pull_sparse_chunk_size, 1);
+  std::vector<PullSparseChunkClosure *> closures;
+  std::vector<size_t> closure_shard_ids;
+  std::vector<uint64_t> unique_keys;
+  std::vector<uint32_t> keys_counter;
+  size_t request_bytes = 0;
+  for (size_t i = 0; i < request_call_num; ++i) {
+    auto &sorted_kvs = shard_sorted_kvs[i];
     size_t sorted_kv_size = sorted_kvs.size();
-    auto &request_buffer = closure->cntl(i)->request_attachment();
-
-    request_buffer.append(reinterpret_cast<void *>(&is_training), sizeof(bool));
-    std::vector<uint32_t> keys_counter;
-    keys_counter.reserve(sorted_kv_size);
-
-    for (size_t kv_idx = 0; kv_idx < sorted_kv_size; ++kv_idx) {
-      ++kv_request_count;
-      uint32_t keys = 1;
-      last_key = sorted_kvs[kv_idx].first;
-      request_buffer.append(reinterpret_cast<void *>(&last_key),
-                            sizeof(uint64_t));
-      while (kv_idx < sorted_kv_size - 1 &&
-             last_key == sorted_kvs[kv_idx + 1].first) {
+    size_t kv_idx = 0;
+    while (kv_idx < sorted_kv_size) {
+      size_t kv_begin = kv_idx;
+      unique_keys.clear();
+      keys_counter.clear();
+      while (kv_idx < sorted_kv_size && unique_keys.size() < chunk_size) {
+        uint32_t key_num = 1;
+        uint64_t last_key = sorted_kvs[kv_idx].first;
+        while (kv_idx < sorted_kv_size - 1 &&
+               last_key == sorted_kvs[kv_idx + 1].first) {
+          ++kv_idx;
+          ++key_num;
+        }
         ++kv_idx;
-        ++keys;
+        unique_keys.push_back(last_key);
+        keys_counter.push_back(key_num);
       }
-      keys_counter.push_back(keys);
+      uint32_t kv_request_count = unique_keys.size();
+      auto *closure =
+          new PullSparseChunkClosure(context, i, kv_begin, kv_idx);
+      auto &request_buffer = closure->cntl()->request_attachment();
+      request_buffer.append(reinterpret_cast<void *>(&is_training),
+                            sizeof(bool));
+      if (FLAGS_pserver_pull_sparse_varint_key) {
+        thread_local std::string encoded_keys;
+        encoded_keys.clear();
+        EncodeSortedKeys(unique_keys.data(), unique_keys.size(), &encoded_keys);
+        uint32_t encoded_len = encoded_keys.size();
+        request_buffer.append(reinterpret_cast<void *>(&encoded_len),
+                              sizeof(uint32_t));
+        request_buffer.append(encoded_keys.data(), encoded_keys.size());
+      } else {
+        request_buffer.append(reinterpret_cast<void *>(unique_keys.data()),
+                              sizeof(uint64_t) * unique_keys.size());
+      }
+      request_buffer.append(reinterpret_cast<void *>(keys_counter.data()),
+                            sizeof(uint32_t) * keys_counter.size());
+      request_bytes += request_buffer.size();
+
+      closure->request()->set_cmd_id(PS_PULL_SPARSE_TABLE);
+      closure->request()->set_table_id(table_id);
+      closure->request()->set_client_id(_client_id);
+      closure->request()->add_params((char *)&kv_request_count,  // NOLINT
+                                     sizeof(uint32_t));
+      if (FLAGS_pserver_pull_sparse_varint_key) {
+        uint32_t key_format = 1;
+        closure->request()->add_params((char *)&key_format,  // NOLINT
+                                       sizeof(uint32_t));
+      }
+      closure->cntl()->set_log_id(butil::gettimeofday_ms());
+      closures.push_back(closure);
+      closure_shard_ids.push_back(i);
     }
+  }
+  local_timer.reset();
+  VLOG(3) << "pull sparse table:" << table_id << ", keys:" << num
+          << ", sub requests:" << closures.size()
+          << ", request bytes:" << request_bytes;
 
-    request_buffer.append(reinterpret_cast<void *>(keys_counter.data()),
-                          sizeof(uint32_t) * keys_counter.size());
-
-    if (kv_request_count == 0) {
-      closure->Run();
-    } else {
-      closure->request(i)->set_cmd_id(PS_PULL_SPARSE_TABLE);
-      closure->request(i)->set_table_id(table_id);
-      closure->request(i)->set_client_id(_client_id);
-      closure->request(i)->add_params((char *)&kv_request_count,  // NOLINT
-                                      sizeof(uint32_t));
-      PsService_Stub rpc_stub(GetCmdChannel(i));
-      closure->cntl(i)->set_log_id(butil::gettimeofday_ms());
-      rpc_stub.service(
-          closure->cntl(i), closure->request(i), closure->response(i), closure);
-    }
+  if (closures.empty()) {
+    context->promise->set_value(0);
+    return fut;
+  }
+  // all sub requests must be counted before any of them returns
+  context->waiting_num = closures.size();
+  for (size_t c = 0; c < closures.size(); ++c) {
+    auto *closure = closures[c];
+    PsService_Stub rpc_stub(GetCmdChannel(closure_shard_ids[c]));
+    rpc_stub.service(
+        closure->cntl(), closure->request(), closure->response(), closure);
   }
   return fut;
 }
@@ -156,6 +156,46 @@ class DownpourBrpcClosure : public PSClientClosure {
   std::vector<std::shared_ptr<brpc::Controller>> _cntls;
 };
 
+// shared state of one PullSparse, split into sub requests by server and
+// key chunk
+struct PullSparseContext {
+  // (key, output) sorted by key of each server
+  std::vector<std::vector<std::pair<uint64_t, float *>>> shard_kvs;
+  size_t value_size = 0;
+  std::atomic<int32_t> waiting_num{0};
+  std::atomic<int32_t> ret{0};
+  std::shared_ptr<std::promise<int32_t>> promise;
+  std::shared_ptr<CostTimer> timer;
+};
+
+// closure of one PullSparse sub request, the values are scattered as soon as
+// its response arrives, the last finished one sets the promise
+class PullSparseChunkClosure : public google::protobuf::Closure {
+ public:
+  PullSparseChunkClosure(std::shared_ptr<PullSparseContext> context,
+                         size_t shard_id,
+                         size_t kv_begin,
+                         size_t kv_end)
+      : _context(context),
+        _shard_id(shard_id),
+        _kv_begin(kv_begin),
+        _kv_end(kv_end) {}
+  virtual ~PullSparseChunkClosure() {}
+  void Run() override;
+  PsRequestMessage *request() { return &_request; }
+  PsResponseMessage *response() { return &_response; }
+  brpc::Controller *cntl() { return &_cntl; }
+
+ private:
+  std::shared_ptr<PullSparseContext> _context;
+  size_t _shard_id;
+  size_t _kv_begin;
+  size_t _kv_end;
+  PsRequestMessage _request;
+  PsResponseMessage _response;
+  brpc::Controller _cntl;
+};
+
 struct SharedSparsePushData {
   SharedSparsePushData() {}
   ~SharedSparsePushData() noexcept {}
@@ -379,6 +419,8 @@ class BrpcPsClient : public PSClient {
       ValueAccessor *accessor);
 
   SparseTaskPool _sparse_task_pool;
+  // partition and sort keys of large PullSparse
+  std::unique_ptr<::ThreadPool> _pull_sparse_pool{nullptr};
 
   std::vector<std::shared_ptr<brpc::Channel>>
       _client_channels;  // client2client
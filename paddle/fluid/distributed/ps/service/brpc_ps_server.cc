@@ -18,6 +18,7 @@
 
 #include "butil/object_pool.h"
 #include "paddle/fluid/distributed/common/cost_timer.h"
+#include "paddle/fluid/distributed/ps/service/sparse_key_codec.h"
 #include "paddle/fluid/distributed/ps/table/depends/sparse_utils.h"
 #include "paddle/fluid/distributed/ps/table/table.h"
 #include "paddle/fluid/framework/archive.h"
@@ -532,7 +533,40 @@ int32_t BrpcPsService::PullSparse(Table *table,
 
   auto value = PullSparseValue(num, dim);
 
-  value.DeserializeFromBytes(const_cast<void *>(data));
+  if (request.params_size() > 1 &&
+      *(reinterpret_cast<const uint32_t *>(request.params(1).c_str())) == 1) {
+    // varint encoded delta keys
+    thread_local std::vector<uint64_t> keys;
+    thread_local std::vector<uint32_t> frequencies;
+    const char *begin = reinterpret_cast<const char *>(data);
+    const size_t header_size = sizeof(bool) + sizeof(uint32_t);
+    uint32_t encoded_len = 0;
+    if (req_buffer_size >= header_size) {
+      memcpy(&encoded_len, begin + sizeof(bool), sizeof(uint32_t));
+    }
+    if (req_buffer_size < header_size ||
+        req_buffer_size !=
+            header_size + encoded_len + sizeof(uint32_t) * num) {
+      set_response_code(response, -1, "req attachment is not in format");
+      return 0;
+    }
+    keys.resize(num);
+    frequencies.resize(num);
+    if (DecodeSortedKeys(
+            begin + header_size, encoded_len, num, keys.data()) !=
+        encoded_len) {
+      set_response_code(response, -1, "req keys are not in format");
+      return 0;
+    }
+    memcpy(frequencies.data(),
+           begin + header_size + encoded_len,
+           sizeof(uint32_t) * num);
+    value.is_training_ = reinterpret_cast<const bool *>(begin)[0];
+    value.feasigns_ = keys.data();
+    value.frequencies_ = frequencies.data();
+  } else {
+    value.DeserializeFromBytes(const_cast<void *>(data));
+  }
 
   auto res_data = butil::get_object<std::vector<float>>();
   res_data->resize(num * dim);
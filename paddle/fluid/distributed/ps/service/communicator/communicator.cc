@@ -22,6 +22,9 @@ limitations under the License. */
 #include "paddle/fluid/platform/profiler.h"
 #include "paddle/fluid/string/string_helper.h"
 
+DECLARE_bool(communicator_sparse_coalesce);
+DECLARE_int32(communicator_sparse_coalesce_interval_ms);
+
 #define LEARNING_RATE_DECAY_COUNTER "@LR_DECAY_COUNTER@"
 #define STEP_COUNTER "@PS_STEP_COUNTER@"
 
@@ -542,7 +545,11 @@ void AsyncCommunicator::SendByCommunicator() {
             1,
             platform::errors::InvalidArgument(
                 "sparse variables can only be merged by one variables"));
-        RpcSendSparse(varnames[0], table_id, *send_scope_);
+        if (FLAGS_communicator_sparse_coalesce) {
+          CoalesceSendSparse(varnames[0], table_id, *send_scope_);
+        } else {
+          RpcSendSparse(varnames[0], table_id, *send_scope_);
+        }
       } else {
         RpcSendDense(ctx, *send_scope_);
         if (!independent_recv_ &&
@@ -580,11 +587,167 @@ void AsyncCommunicator::MainThread() {
 
   while (running_) {
     SendByCommunicator();
+    FlushSparseCoalescer(false);
     RpcProfilerControl();
   }
   VLOG(1) << "communicator stopped, send thread exit";
 }
 
+std::shared_ptr<SparsePushCoalescer> AsyncCommunicator::GetSparseCoalescer(
+    uint64_t table_id, size_t value_dim, size_t skip_dim, bool raw_gradient) {
+  std::shared_ptr<SparsePushCoalescer> coalescer = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(coalescer_mutex_);
+    auto &ptr = raw_gradient ? raw_sparse_coalescers_[table_id]
+                             : sparse_coalescers_[table_id];
+    if (ptr == nullptr) {
+      ptr.reset(new SparsePushCoalescer(value_dim, skip_dim));
+    }
+    coalescer = ptr;
+  }
+  PADDLE_ENFORCE_EQ(coalescer->value_dim(),
+                    value_dim,
+                    platform::errors::InvalidArgument(
+                        "sparse push dim of table %d mismatch, %d vs %d",
+                        table_id,
+                        coalescer->value_dim(),
+                        value_dim));
+  return coalescer;
+}
+
+void AsyncCommunicator::CoalesceSendSparse(const std::string &var_name,
+                                           int table_id,
+                                           const Scope &scope) {
+  platform::RecordEvent record_event("Communicator->CoalesceSendSparse",
+                                     platform::TracerEventType::Communication,
+                                     1);
+  auto *send_var = scope.FindVar(var_name);
+  auto *tensor = send_var->GetMutable<phi::SelectedRows>();
+  auto dim = tensor->value().dims()[1];
+  size_t num = tensor->rows().size();
+  std::vector<uint64_t> sparse_push_keys(num);
+  std::vector<const float *> push_g_vec(num);
+  const float *value = tensor->value().data<float>();
+  for (size_t i = 0; i < num; ++i) {
+    sparse_push_keys[i] = static_cast<uint64_t>(tensor->rows()[i]);
+    push_g_vec[i] = value + i * dim;
+  }
+  // all columns are summed, same as MergeVars does for the duplicate rows
+  auto coalescer = GetSparseCoalescer(table_id, dim, 0, true);
+  coalescer->Add(sparse_push_keys.data(), push_g_vec.data(), num);
+}
+
+void AsyncCommunicator::FlushSparseCoalescer(bool force) {
+  struct FlushTable {
+    uint64_t table_id;
+    std::shared_ptr<SparsePushCoalescer> coalescer;
+    bool raw_gradient;
+  };
+  std::vector<FlushTable> tables;
+  {
+    std::lock_guard<std::mutex> lock(coalescer_mutex_);
+    double now = GetCurrentUS();
+    if (!force && now - last_coalesce_flush_us_ <
+                      FLAGS_communicator_sparse_coalesce_interval_ms * 1000.0) {
+      return;
+    }
+    last_coalesce_flush_us_ = now;
+    for (auto &it : sparse_coalescers_) {
+      tables.push_back({it.first, it.second, false});
+    }
+    for (auto &it : raw_sparse_coalescers_) {
+      tables.push_back({it.first, it.second, true});
+    }
+  }
+  platform::RecordEvent record_event("Communicator->FlushSparseCoalescer",
+                                     platform::TracerEventType::Communication,
+                                     1);
+  thread_local std::vector<uint64_t> keys;
+  thread_local std::vector<float> values;
+  thread_local std::vector<const float *> value_ptrs;
+  std::vector<std::future<int32_t>> status;
+  for (auto &table : tables) {
+    auto &coalescer = table.coalescer;
+    size_t num = coalescer->Flush(&keys, &values);
+    coalesce_input_num_.fetch_add(coalescer->TakeInputNum(),
+                                  std::memory_order_relaxed);
+    if (num == 0) {
+      continue;
+    }
+    size_t dim = coalescer->value_dim();
+    value_ptrs.resize(num);
+    for (size_t i = 0; i < num; ++i) {
+      value_ptrs[i] = &values[i * dim];
+    }
+    // client copies keys and values into its push request or task before
+    // return
+    if (table.raw_gradient) {
+      size_t request_call_num = _worker_ptr->GetServerNums();
+      ++_async_call_num;
+      DownpourBrpcClosure *closure = new DownpourBrpcClosure(
+          request_call_num, [this, request_call_num](void *done) {
+            int ret = 0;
+            auto *closure = (DownpourBrpcClosure *)done;  // NOLINT
+            for (size_t i = 0; i < request_call_num; ++i) {
+              if (closure->check_response(i, PS_PUSH_SPARSE_TABLE) != 0) {
+                ret = -1;
+                break;
+              }
+            }
+            closure->set_promise_value(ret);
+            --_async_call_num;
+          });
+      status.push_back(_worker_ptr->PushSparseRawGradient(
+          table.table_id, keys.data(), value_ptrs.data(), num, closure));
+    } else {
+      status.push_back(_worker_ptr->PushSparse(
+          table.table_id, keys.data(), value_ptrs.data(), num));
+    }
+    coalesce_output_num_.fetch_add(num, std::memory_order_relaxed);
+    sparse_push_rpc_num_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::lock_guard<std::mutex> lock(push_status_mutex_);
+  for (auto &s : status) {
+    push_status_.push_back(std::move(s));
+  }
+  // reap the finished pushes, a forced flush waits all of them
+  size_t pending = 0;
+  for (size_t i = 0; i < push_status_.size(); ++i) {
+    auto &s = push_status_[i];
+    if (!force && s.wait_for(std::chrono::seconds(0)) !=
+                      std::future_status::ready) {
+      if (pending != i) {
+        push_status_[pending] = std::move(s);
+      }
+      ++pending;
+      continue;
+    }
+    int32_t ret = s.get();
+    if (ret != 0) {
+      LOG(WARNING) << "coalesced sparse push failed, ret: " << ret;
+    }
+  }
+  push_status_.resize(pending);
+}
+
+std::unordered_map<std::string, double>
+AsyncCommunicator::GetSparseCoalesceStat() {
+  std::unordered_map<std::string, double> stat;
+  double now = GetCurrentUS();
+  double span_sec = (now - coalesce_stat_begin_us_) / 1e+6;
+  uint64_t input_num = coalesce_input_num_.exchange(0);
+  uint64_t output_num = coalesce_output_num_.exchange(0);
+  uint64_t rpc_num = sparse_push_rpc_num_.exchange(0);
+  coalesce_stat_begin_us_ = now;
+  stat["input_keys"] = static_cast<double>(input_num);
+  stat["output_keys"] = static_cast<double>(output_num);
+  stat["coalesce_ratio"] =
+      (output_num > 0) ? static_cast<double>(input_num) / output_num : 0.0;
+  stat["rpc_per_second"] = (span_sec > 0) ? rpc_num / span_sec : 0.0;
+  return stat;
+}
+
 void AsyncCommunicator::PullSparseToTensorSync(
     const uint64_t table_id,
     int fea_dim,
@@ -767,10 +930,22 @@ void AsyncCommunicator::PushSparseFromTensorAsync(
       true,
       platform::errors::InvalidArgument(
           "can not find table: %s, please check your config", table_id));
+  if (FLAGS_communicator_sparse_coalesce) {
+    // slot column is not merged
+    auto coalescer = GetSparseCoalescer(table_id, fea_dim + 1, 1, false);
+    coalescer->Add(push_keys.data(),
+                   (const float **)push_g_vec.data(),
+                   push_keys.size());
+    FlushSparseCoalescer(false);
+    return;
+  }
   auto status = _worker_ptr->PushSparse(table_id,
                                         push_keys.data(),
                                         (const float **)push_g_vec.data(),
                                         push_keys.size());
+  coalesce_input_num_.fetch_add(push_keys.size(), std::memory_order_relaxed);
+  coalesce_output_num_.fetch_add(push_keys.size(), std::memory_order_relaxed);
+  sparse_push_rpc_num_.fetch_add(1, std::memory_order_relaxed);
 }
 
 void HalfAsyncCommunicator::MainThread() {
@@ -809,6 +984,7 @@ void AsyncCommunicator::InitImpl(const RpcCtxMap &send_varname_to_ctx,
     }
   }
   send_threadpool_.reset(new ::ThreadPool(thread_pool_size_));
+  coalesce_stat_begin_us_ = GetCurrentUS();
 }
 
 AsyncCommunicator::~AsyncCommunicator() {
@@ -855,6 +1031,7 @@ void AsyncCommunicator::Stop() {
       main_thread_->join();
       main_thread_.reset(nullptr);
     }
+    FlushSparseCoalescer(true);
   }
   VLOG(1) << "Communicator stop done";
 }
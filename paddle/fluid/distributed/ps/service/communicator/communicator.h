@@ -31,6 +31,7 @@ limitations under the License. */
 
 #include "gflags/gflags.h"
 #include "paddle/fluid/distributed/ps/service/communicator/communicator_common.h"
+#include "paddle/fluid/distributed/ps/service/communicator/sparse_coalescer.h"
 #include "paddle/fluid/distributed/ps/service/coordinator_client.h"
 #include "paddle/fluid/distributed/ps/service/ps_client.h"
 #include "paddle/fluid/framework/channel.h"
@@ -283,6 +284,10 @@ class Communicator {
                               int batches,
                               Scope *send_scope);
 
+  virtual std::unordered_map<std::string, double> GetSparseCoalesceStat() {
+    return {};
+  }
+
   virtual std::unordered_map<uint32_t, std::string> QueryFLClientsInfo() {
     return {};
   }
@@ -497,6 +502,12 @@ class AsyncCommunicator : public Communicator {
       const framework::LoDTensor *clicks,
       std::vector<framework::LoDTensor *> *outputs);
 
+  // send the coalesced sparse push of every table, not forced sends only
+  // after the coalesce interval, forced sends wait all pushes in flight
+  void FlushSparseCoalescer(bool force);
+
+  std::unordered_map<std::string, double> GetSparseCoalesceStat() override;
+
  protected:
   std::unordered_map<std::string,
                      std::shared_ptr<BlockingQueue<std::shared_ptr<Variable>>>>
@@ -518,6 +529,32 @@ class AsyncCommunicator : public Communicator {
 
   std::unique_ptr<Scope> send_scope_;  // an independent scope
   std::atomic_uint grad_num_{0};  // the num of gradient sent since last recv
+
+  std::shared_ptr<SparsePushCoalescer> GetSparseCoalescer(uint64_t table_id,
+                                                          size_t value_dim,
+                                                          size_t skip_dim,
+                                                          bool raw_gradient);
+  // add the merged sparse var into the coalescer of its table instead of
+  // sending it by RpcSendSparse
+  void CoalesceSendSparse(const std::string &var_name,
+                          int table_id,
+                          const Scope &scope);
+
+  // sparse push coalesced by table, the raw gradients of the send queues are
+  // kept apart as they are pushed by PushSparseRawGradient
+  std::mutex coalescer_mutex_;
+  std::unordered_map<uint64_t, std::shared_ptr<SparsePushCoalescer>>
+      sparse_coalescers_;
+  std::unordered_map<uint64_t, std::shared_ptr<SparsePushCoalescer>>
+      raw_sparse_coalescers_;
+  // the coalesced pushes in flight
+  std::mutex push_status_mutex_;
+  std::vector<std::future<int32_t>> push_status_;
+  double last_coalesce_flush_us_ = 0;
+  double coalesce_stat_begin_us_ = 0;
+  std::atomic<uint64_t> coalesce_input_num_{0};
+  std::atomic<uint64_t> coalesce_output_num_{0};
+  std::atomic<uint64_t> sparse_push_rpc_num_{0};
 };
 
 class HalfAsyncCommunicator : public AsyncCommunicator {
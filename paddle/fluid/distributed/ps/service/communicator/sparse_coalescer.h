@@ -0,0 +1,136 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <mutex>  // NOLINT
+#include <vector>
+
+#include "Eigen/Core"
+#include "glog/logging.h"
+
+namespace paddle {
+namespace distributed {
+
+constexpr uint32_t kCoalesceEmpty = 0xFFFFFFFF;
+constexpr size_t kCoalesceMinCapacity = 1024;
+
+// SparsePushCoalescer merges the sparse push values of one table across
+// vars and queued steps. Duplicate keys are aggregated in an open addressing
+// hash index over one contiguous value matrix, the leading `skip_dim`
+// columns (slot) keep the value of the first occurrence, the rest are summed,
+// same as the accessor Merge on server side.
+class SparsePushCoalescer {
+ public:
+  SparsePushCoalescer(size_t value_dim, size_t skip_dim)
+      : value_dim_(value_dim), skip_dim_(skip_dim) {
+    CHECK(skip_dim_ <= value_dim_);
+    ResetIndex(kCoalesceMinCapacity);
+  }
+
+  size_t value_dim() const { return value_dim_; }
+
+  void Add(const uint64_t *keys, const float *const *values, size_t num) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < num; ++i) {
+      AddUnlocked(keys[i], values[i]);
+    }
+    input_num_ += num;
+  }
+
+  // swap out the merged keys and values, return the merged key num
+  size_t Flush(std::vector<uint64_t> *keys, std::vector<float> *values) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    keys->clear();
+    values->clear();
+    keys->swap(keys_);
+    values->swap(values_);
+    std::fill(index_.begin(), index_.end(), kCoalesceEmpty);
+    return keys->size();
+  }
+
+  // total input keys, it is reset after read
+  uint64_t TakeInputNum() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t num = input_num_;
+    input_num_ = 0;
+    return num;
+  }
+
+  bool Empty() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return keys_.empty();
+  }
+
+ private:
+  static inline uint64_t HashKey(uint64_t key) {
+    // murmur3 fmix64
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+  }
+
+  void ResetIndex(size_t capacity) {
+    index_.assign(capacity, kCoalesceEmpty);
+    mask_ = capacity - 1;
+    for (size_t row = 0; row < keys_.size(); ++row) {
+      size_t pos = HashKey(keys_[row]) & mask_;
+      while (index_[pos] != kCoalesceEmpty) {
+        pos = (pos + 1) & mask_;
+      }
+      index_[pos] = static_cast<uint32_t>(row);
+    }
+  }
+
+  void AddUnlocked(uint64_t key, const float *value) {
+    // keep load factor under 0.5
+    if ((keys_.size() + 1) * 2 > index_.size()) {
+      ResetIndex(index_.size() * 2);
+    }
+    size_t pos = HashKey(key) & mask_;
+    while (index_[pos] != kCoalesceEmpty) {
+      uint32_t row = index_[pos];
+      if (keys_[row] == key) {
+        size_t len = value_dim_ - skip_dim_;
+        Eigen::Map<Eigen::VectorXf> dst(&values_[row * value_dim_ + skip_dim_],
+                                        len);
+        dst += Eigen::Map<const Eigen::VectorXf>(value + skip_dim_, len);
+        return;
+      }
+      pos = (pos + 1) & mask_;
+    }
+    index_[pos] = static_cast<uint32_t>(keys_.size());
+    keys_.push_back(key);
+    values_.insert(values_.end(), value, value + value_dim_);
+  }
+
+ private:
+  std::mutex mutex_;
+  size_t value_dim_;
+  size_t skip_dim_;
+  size_t mask_ = 0;
+  uint64_t input_num_ = 0;
+  std::vector<uint32_t> index_;
+  std::vector<uint64_t> keys_;
+  std::vector<float> values_;
+};
+
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,128 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace paddle {
+namespace distributed {
+
+// Sparse key helpers of PullSparse request, the unique keys of one request
+// are sorted, so they are sent as varint encoded deltas:
+// |---isTraining--------------------|
+// |---4B(encoded key bytes len)-----|
+// |---varint(key[i] - key[i-1])-----|
+// |---4*{num}B(Frequencies)---------|
+
+// append the delta + varint encoding of sorted keys
+inline void EncodeSortedKeys(const uint64_t *keys,
+                             size_t num,
+                             std::string *out) {
+  uint64_t last = 0;
+  char buf[10];
+  for (size_t i = 0; i < num; ++i) {
+    uint64_t delta = keys[i] - last;
+    last = keys[i];
+    int len = 0;
+    while (delta >= 0x80) {
+      buf[len++] = static_cast<char>((delta & 0x7F) | 0x80);
+      delta >>= 7;
+    }
+    buf[len++] = static_cast<char>(delta);
+    out->append(buf, len);
+  }
+}
+
+// decode num keys, return the consumed bytes, 0 when data is not in format
+inline size_t DecodeSortedKeys(const char *data,
+                               size_t len,
+                               size_t num,
+                               uint64_t *keys) {
+  const uint8_t *ptr = reinterpret_cast<const uint8_t *>(data);
+  const uint8_t *end = ptr + len;
+  uint64_t last = 0;
+  for (size_t i = 0; i < num; ++i) {
+    uint64_t delta = 0;
+    int shift = 0;
+    while (true) {
+      if (ptr >= end || shift > 63) {
+        return 0;
+      }
+      uint8_t byte = *ptr++;
+      delta |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) {
+        break;
+      }
+      shift += 7;
+    }
+    last += delta;
+    keys[i] = last;
+  }
+  return ptr - reinterpret_cast<const uint8_t *>(data);
+}
+
+// stable LSD radix sort of (key, value) pairs by 64bit key, the bytes all
+// keys share are skipped
+template <typename V>
+void RadixSortKeyValues(std::vector<std::pair<uint64_t, V>> *kvs,
+                        std::vector<std::pair<uint64_t, V>> *tmp) {
+  const size_t num = kvs->size();
+  if (num < 256) {
+    std::stable_sort(
+        kvs->begin(),
+        kvs->end(),
+        [](const std::pair<uint64_t, V> &a, const std::pair<uint64_t, V> &b) {
+          return a.first < b.first;
+        });
+    return;
+  }
+  tmp->resize(num);
+  auto *src = kvs->data();
+  auto *dst = tmp->data();
+  size_t counts[256];
+  for (int shift = 0; shift < 64; shift += 8) {
+    memset(counts, 0, sizeof(counts));
+    for (size_t i = 0; i < num; ++i) {
+      ++counts[(src[i].first >> shift) & 0xFF];
+    }
+    if (counts[(src[0].first >> shift) & 0xFF] == num) {
+      continue;
+    }
+    size_t offset = 0;
+    for (int b = 0; b < 256; ++b) {
+      size_t cnt = counts[b];
+      counts[b] = offset;
+      offset += cnt;
+    }
+    for (size_t i = 0; i < num; ++i) {
+      dst[counts[(src[i].first >> shift) & 0xFF]++] = src[i];
+    }
+    std::swap(src, dst);
+  }
+  if (src != kvs->data()) {
+    memcpy(reinterpret_cast<void *>(kvs->data()),
+           reinterpret_cast<const void *>(src),
+           sizeof(std::pair<uint64_t, V>) * num);
+  }
+}
+
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,74 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace paddle {
+namespace distributed {
+
+// The keys of a shard touched since the last Clear(). The shard keys have no
+// dense index to keep a bitmap of, Add() appends the key and the duplicates
+// are dropped when the appended keys outgrow the distinct ones, so the set
+// takes at most about twice the memory of its distinct keys. Not thread safe,
+// a shard is only touched by the task thread of the shard.
+class DirtyKeySet {
+ public:
+  void Add(uint64_t key) {
+    _keys.push_back(key);
+    if (_keys.size() >= 2 * _sorted_size + kMinCompactSize) {
+      Compact();
+    }
+  }
+
+  // the sorted distinct keys
+  const std::vector<uint64_t>& Keys() {
+    Compact();
+    return _keys;
+  }
+
+  size_t Size() {
+    Compact();
+    return _keys.size();
+  }
+
+  void Clear() {
+    std::vector<uint64_t>().swap(_keys);
+    _sorted_size = 0;
+  }
+
+ private:
+  static const size_t kMinCompactSize = 1024;
+
+  // the first _sorted_size keys are sorted and distinct
+  void Compact() {
+    if (_keys.size() == _sorted_size) {
+      return;
+    }
+    auto mid = _keys.begin() + _sorted_size;
+    std::sort(mid, _keys.end());
+    std::inplace_merge(_keys.begin(), mid, _keys.end());
+    _keys.erase(std::unique(_keys.begin(), _keys.end()), _keys.end());
+    _sorted_size = _keys.size();
+  }
+
+  std::vector<uint64_t> _keys;
+  size_t _sorted_size = 0;
+};
+
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,92 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <mutex>  // NOLINT
+#include <shared_mutex>
+
+#include "paddle/fluid/distributed/ps/table/depends/feature_value.h"
+#include "paddle/fluid/memory/allocation/spin_lock.h"
+
+namespace paddle {
+namespace distributed {
+
+// The locks of a SparseTableShard read and written by several threads. A key
+// is found under the shared lock of its bucket and inserted or erased under
+// the exclusive one and the allocator lock of the shard. A value is read and
+// updated under the spin lock of its stripe, so the update of a value is
+// atomic to the other readers and writers while the other keys of the bucket
+// are read and updated in parallel.
+struct SparseShardLocks {
+  static const size_t kValueLockNum = 1024;
+
+  std::shared_timed_mutex buckets[CTR_SPARSE_SHARD_BUCKET_NUM];
+  paddle::memory::SpinLock values[kValueLockNum];
+  // the values of all the buckets come from one ChunkAllocator
+  std::mutex alloc;
+  // the other state of the shard kept by the table
+  std::mutex state;
+};
+
+// Holds the locks of a key of a shard, nothing when locks is NULL. It starts
+// with the bucket shared and the value stripe locked, LockBucket() trades
+// them for the bucket exclusive and the allocator to insert or erase the
+// key, the iterators found before are stale then.
+class SparseShardKeyLock {
+ public:
+  SparseShardKeyLock(SparseShardLocks* locks, size_t hash, size_t bucket)
+      : _locks(locks),
+        _value_lock(hash % SparseShardLocks::kValueLockNum),
+        _bucket(bucket) {
+    if (_locks != NULL) {
+      _locks->buckets[_bucket].lock_shared();
+      _locks->values[_value_lock].lock();
+    }
+  }
+  ~SparseShardKeyLock() {
+    if (_locks == NULL) {
+      return;
+    }
+    if (_exclusive) {
+      _locks->alloc.unlock();
+      _locks->buckets[_bucket].unlock();
+    } else {
+      _locks->values[_value_lock].unlock();
+      _locks->buckets[_bucket].unlock_shared();
+    }
+  }
+
+  void LockBucket() {
+    if (_locks == NULL || _exclusive) {
+      return;
+    }
+    _locks->values[_value_lock].unlock();
+    _locks->buckets[_bucket].unlock_shared();
+    _locks->buckets[_bucket].lock();
+    _locks->alloc.lock();
+    _exclusive = true;
+  }
+
+  DISABLE_COPY_AND_ASSIGN(SparseShardKeyLock);
+
+ private:
+  SparseShardLocks* _locks;
+  size_t _value_lock;
+  size_t _bucket;
+  bool _exclusive = false;
+};
+
+}  // namespace distributed
+}  // namespace paddle
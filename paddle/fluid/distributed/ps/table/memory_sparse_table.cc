@@ -13,7 +13,12 @@
 // limitations under the License.
 
 #include <omp.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <ctime>
 #include <sstream>
+#include <thread>  // NOLINT
 
 #include "glog/logging.h"
 #include "paddle/fluid/distributed/common/cost_timer.h"
@@ -21,6 +26,7 @@
 #include "paddle/fluid/distributed/common/topk_calculator.h"
 #include "paddle/fluid/distributed/ps/table/memory_sparse_table.h"
 #include "paddle/fluid/framework/archive.h"
+#include "paddle/fluid/framework/channel.h"
 #include "paddle/fluid/framework/io/fs.h"
 
 // #include "boost/lexical_cast.hpp"
@@ -36,6 +42,25 @@ DEFINE_bool(pserver_enable_create_feasign_randomly,
             false,
             "pserver_enable_create_feasign_randomly");
 DEFINE_int32(pserver_table_save_max_retry, 3, "pserver_table_save_max_retry");
+DEFINE_int32(pserver_table_save_block_size,
+             1024,
+             "feasign num of a block the save stages pass on");
+DEFINE_int32(pserver_table_save_queue_size,
+             16,
+             "blocks queued between two save stages of a shard, a slow fs "
+             "write blocks the shard walk when the queues are full");
+DEFINE_bool(pserver_table_delta_save_dirty_only,
+            false,
+            "keep the keys pushed since the last xbox save of every shard and "
+            "let the xbox delta saves only visit them");
+DEFINE_bool(pserver_table_incremental_shrink,
+            false,
+            "shrink the keys pushed or created since the last shrink in "
+            "Shrink and the other keys in a background sweep");
+DEFINE_bool(pserver_table_concurrent_shard,
+            false,
+            "lock the keys of the shards so the pulls and pushes of a shard "
+            "run on all the task threads in parallel instead of one");
 
 namespace paddle {
 namespace distributed {
@@ -74,6 +99,20 @@ int32_t MemorySparseTable::InitializeValue() {
           << " _task_pool_size:" << _task_pool_size;
 
   _local_shards.reset(new shard_type[_real_local_shard_num]);
+  _save_dirty_keys.clear();
+  _save_dirty_keys.resize(_real_local_shard_num);
+  _save_dirty_keys_complete = false;
+  _shrink_dirty_keys.clear();
+  _shrink_dirty_keys.resize(_real_local_shard_num);
+  _shrink_done_keys.clear();
+  _shrink_done_keys.resize(_real_local_shard_num);
+  if (FLAGS_pserver_table_concurrent_shard) {
+    CHECK(!_config.enable_revert())
+        << "MemorySparseTable concurrent shard does not support revert";
+    _shard_locks.reset(new SparseShardLocks[_real_local_shard_num]);
+  } else {
+    _shard_locks.reset();
+  }
 
   if (_config.enable_revert()) {
     // calculate merged shard number based on config param;
@@ -104,6 +143,7 @@ int32_t MemorySparseTable::InitializeValue() {
 
 int32_t MemorySparseTable::Load(const std::string& path,
                                 const std::string& param) {
+  WaitShrinkSweep();
   std::string table_path = TableDir(path);
   auto file_list = _afs_client.list(table_path);
 
@@ -136,6 +176,11 @@ int32_t MemorySparseTable::Load(const std::string& path,
 
   size_t feature_value_size =
       _value_accesor->GetAccessorInfo().size / sizeof(float);
+  // the loaded delta scores are unknown to the dirty keys
+  for (auto& dirty_keys : _save_dirty_keys) {
+    dirty_keys.Clear();
+  }
+  _save_dirty_keys_complete = false;
 #if defined(PADDLE_WITH_MKLML)
   int thread_num = _real_local_shard_num < 15 ? _real_local_shard_num : 15;
   omp_set_num_threads(thread_num);
@@ -207,6 +252,7 @@ int32_t MemorySparseTable::LoadPatch(const std::vector<std::string>& file_list,
     LOG(INFO) << "MemorySparseTable should be enabled revert.";
     return 0;
   }
+  WaitShrinkSweep();
   // 聚合分片数据索引
   int start_idx = _shard_idx * _m_avg_local_shard_num;
   int end_idx = start_idx + _m_real_local_shard_num;
@@ -221,6 +267,11 @@ int32_t MemorySparseTable::LoadPatch(const std::vector<std::string>& file_list,
       _value_accesor->GetAccessorInfo().size / sizeof(float);
   end_idx =
       end_idx < _m_sparse_table_shard_num ? end_idx : _m_sparse_table_shard_num;
+  // the patched values are unknown to the dirty keys as for Load
+  for (auto& dirty_keys : _save_dirty_keys) {
+    dirty_keys.Clear();
+  }
+  _save_dirty_keys_complete = false;
 #if defined(PADDLE_WITH_MKLML)
   int thread_num = (end_idx - start_idx) < 15 ? (end_idx - start_idx) : 15;
   omp_set_num_threads(thread_num);
@@ -331,14 +382,27 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
     return 0;
   }
 
+  WaitShrinkSweep();
+  auto wall_start = std::chrono::steady_clock::now();
+  std::clock_t cpu_start = std::clock();
   // cache model
+  bool enable_cache = _config.enable_sparse_table_cache() &&
+                      (save_param == 1 || save_param == 2);
   int64_t tk_size = LocalSize() * _config.sparse_table_cache_rate();
   TopkCalculator tk(_real_local_shard_num, tk_size);
+  // A key not pushed since an xbox save keeps the delta score the save left
+  // it, below the delta threshold, and its show only decays, so the delta
+  // saves only visit the dirty keys.
+  bool dirty_only =
+      FLAGS_pserver_table_delta_save_dirty_only && save_param == 1 &&
+      _save_dirty_keys_complete &&
+      _config.accessor().ctr_accessor_param().delta_threshold() > 0;
 
   std::string table_path = TableDir(dirname);
   _afs_client.remove(paddle::string::format_string(
       "%s/part-%03d-*", table_path.c_str(), _shard_idx));
   std::atomic<uint32_t> feasign_size_all{0};
+  std::atomic<uint64_t> visit_size_all{0};
 
   size_t file_start_idx = _avg_local_shard_num * _shard_idx;
 
@@ -369,38 +433,27 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
     channel_config.deconverter =
         _value_accesor->Converter(save_param).deconverter;
     bool is_write_failed = false;
-    int feasign_size = 0;
+    int64_t feasign_size = 0;
     int retry_num = 0;
     int err_no = 0;
     auto& shard = _local_shards[i];
+    const std::vector<uint64_t>* keys =
+        dirty_only ? &_save_dirty_keys[i].Keys() : nullptr;
     do {
       err_no = 0;
-      feasign_size = 0;
       is_write_failed = false;
       auto write_channel =
           _afs_client.open_w(channel_config, 1024 * 1024 * 40, &err_no);
-      for (auto it = shard.begin(); it != shard.end(); ++it) {
-        if (_config.enable_sparse_table_cache() &&
-            (save_param == 1 || save_param == 2) &&
-            _value_accesor->Save(it.value().data(), 4)) {
-          CostTimer timer10("sprase table top push");
-          tk.push(i, _value_accesor->GetField(it.value().data(), "show"));
-        }
-
-        if (_value_accesor->Save(it.value().data(), save_param)) {
-          std::string format_value = _value_accesor->ParseToString(
-              it.value().data(), it.value().size());
-          if (0 != write_channel->write_line(paddle::string::format_string(
-                       "%lu %s", it.key(), format_value.c_str()))) {
-            ++retry_num;
-            is_write_failed = true;
-            LOG(ERROR)
-                << "MemorySparseTable save prefix failed, retry it! path:"
-                << channel_config.path << " , retry_num=" << retry_num;
-            break;
-          }
-          ++feasign_size;
-        }
+      feasign_size = SaveShard(i,
+                               save_param,
+                               keys,
+                               enable_cache ? &tk : nullptr,
+                               write_channel.get());
+      if (feasign_size < 0) {
+        ++retry_num;
+        is_write_failed = true;
+        LOG(ERROR) << "MemorySparseTable save prefix failed, retry it! path:"
+                   << channel_config.path << " , retry_num=" << retry_num;
       }
       write_channel->close();
       if (err_no == -1) {
@@ -419,22 +472,152 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
       }
     } while (is_write_failed);
     feasign_size_all += feasign_size;
-    for (auto it = shard.begin(); it != shard.end(); ++it) {
-      _value_accesor->UpdateStatAfterSave(it.value().data(), save_param);
+    if (keys != nullptr) {
+      for (auto key : *keys) {
+        auto it = shard.find(key);
+        if (it != shard.end()) {
+          _value_accesor->UpdateStatAfterSave(it.value().data(), save_param);
+        }
+      }
+      visit_size_all += keys->size();
+    } else {
+      for (auto it = shard.begin(); it != shard.end(); ++it) {
+        _value_accesor->UpdateStatAfterSave(it.value().data(), save_param);
+      }
+      visit_size_all += shard.size();
+    }
+    if (save_param == 1 || save_param == 2) {
+      _save_dirty_keys[i].Clear();
     }
     LOG(INFO) << "MemorySparseTable save prefix success, path: "
               << channel_config.path << " feasign_size: " << feasign_size;
   }
-  _local_show_threshold = tk.top();
+  if (save_param == 1 || save_param == 2) {
+    _save_dirty_keys_complete = true;
+  }
+  if (dirty_only) {
+    // the cache threshold of the dirty keys, the shows of the others did not
+    // grow since the save that visited them
+    _local_show_threshold =
+        std::max(_local_show_threshold, static_cast<double>(tk.top()));
+  } else {
+    _local_show_threshold = tk.top();
+  }
+  LOG(INFO) << "MemorySparseTable save param: " << save_param
+            << ", dirty only: " << dirty_only
+            << ", visited: " << visit_size_all
+            << ", feasign_size: " << feasign_size_all << ", wall time: "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             wall_start)
+                   .count()
+            << "s, cpu time: "
+            << static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC
+            << "s";
   // int32 may overflow need to change return value
   return 0;
 }
 
+int64_t MemorySparseTable::SaveShard(int shard_id,
+                                     int save_param,
+                                     const std::vector<uint64_t>* keys,
+                                     TopkCalculator* tk,
+                                     FsWriteChannel* write_channel) {
+  // The calling thread walks the shard and picks the values to save, a format
+  // thread turns blocks of them into text and a write thread writes the text
+  // to the fs channel, whose converter pipe compresses and uploads. The
+  // bounded channels between the stages hold the walk when the writes are
+  // slow, a failed write closes them to stop the stages before it.
+  struct SaveBlock {
+    std::vector<std::pair<uint64_t, FixedFeatureValue*>> values;
+    std::string text;
+  };
+  using BlockPtr = std::shared_ptr<SaveBlock>;
+  auto format_channel = paddle::framework::MakeChannel<BlockPtr>();
+  format_channel->SetCapacity(FLAGS_pserver_table_save_queue_size);
+  auto write_channel_queue = paddle::framework::MakeChannel<BlockPtr>();
+  write_channel_queue->SetCapacity(FLAGS_pserver_table_save_queue_size);
+
+  std::thread format_thread([this, &format_channel, &write_channel_queue]() {
+    BlockPtr block;
+    while (format_channel->Get(block)) {
+      for (auto& value : block->values) {
+        if (!block->text.empty()) {
+          block->text.push_back('\n');
+        }
+        block->text.append(std::to_string(value.first));
+        block->text.push_back(' ');
+        block->text.append(_value_accesor->ParseToString(
+            value.second->data(), value.second->size()));
+      }
+      if (!write_channel_queue->Put(std::move(block))) {
+        break;
+      }
+    }
+    format_channel->Close();
+    write_channel_queue->Close();
+  });
+
+  bool is_write_failed = false;
+  int64_t feasign_size = 0;
+  std::thread write_thread([&]() {
+    BlockPtr block;
+    while (write_channel_queue->Get(block)) {
+      if (0 != write_channel->write_line(block->text)) {
+        is_write_failed = true;
+        write_channel_queue->Close();
+        break;
+      }
+      feasign_size += block->values.size();
+    }
+  });
+
+  auto& shard = _local_shards[shard_id];
+  auto block = std::make_shared<SaveBlock>();
+  auto visit = [&](uint64_t key, FixedFeatureValue* value) {
+    if (tk != nullptr && _value_accesor->Save(value->data(), 4)) {
+      tk->push(shard_id, _value_accesor->GetField(value->data(), "show"));
+    }
+    if (!_value_accesor->Save(value->data(), save_param)) {
+      return true;
+    }
+    block->values.emplace_back(key, value);
+    if (block->values.size() <
+        static_cast<size_t>(FLAGS_pserver_table_save_block_size)) {
+      return true;
+    }
+    bool ok = format_channel->Put(std::move(block));
+    block = std::make_shared<SaveBlock>();
+    return ok;
+  };
+  if (keys == nullptr) {
+    for (auto it = shard.begin(); it != shard.end(); ++it) {
+      if (!visit(it.key(), it.value_ptr())) {
+        break;
+      }
+    }
+  } else {
+    for (auto key : *keys) {
+      auto it = shard.find(key);
+      if (it != shard.end() && !visit(key, it.value_ptr())) {
+        break;
+      }
+    }
+  }
+  if (!block->values.empty()) {
+    format_channel->Put(std::move(block));
+  }
+  format_channel->Close();
+  format_thread.join();
+  write_thread.join();
+  return is_write_failed ? -1 : feasign_size;
+}
+
 int32_t MemorySparseTable::SavePatch(const std::string& path, int save_param) {
   if (!_config.enable_revert()) {
     LOG(INFO) << "MemorySparseTable should be enabled revert.";
     return 0;
   }
+  WaitShrinkSweep();
   size_t file_start_idx = _m_avg_local_shard_num * _shard_idx;
   std::string table_path = TableDir(path);
   _afs_client.remove(paddle::string::format_string(
@@ -529,6 +712,14 @@ int64_t MemorySparseTable::CacheShuffle(
         shuffled_channel,
     const std::vector<Table*>& table_ptrs) {
   LOG(INFO) << "cache shuffle with cache threshold: " << cache_threshold;
+  // the shards of all the tables are walked by the omp threads below
+  for (auto* table_ptr : table_ptrs) {
+    auto* sparse_table = dynamic_cast<MemorySparseTable*>(table_ptr);
+    if (sparse_table != NULL) {
+      sparse_table->WaitShrinkSweep();
+    }
+  }
+  WaitShrinkSweep();
   int save_param = atoi(param.c_str());  // batch_model:0  xbox:1
   if (!_config.enable_sparse_table_cache() || cache_threshold < 0) {
     LOG(WARNING)
@@ -643,6 +834,7 @@ int32_t MemorySparseTable::SaveCache(
   if (_shard_idx >= _config.sparse_table_cache_file_num()) {
     return 0;
   }
+  WaitShrinkSweep();
   int save_param = atoi(param.c_str());  // batch_model:0  xbox:1
   size_t file_start_idx = _avg_local_shard_num * _shard_idx;
   std::string table_path = paddle::string::format_string(
@@ -772,9 +964,10 @@ int32_t MemorySparseTable::PullSparse(float* pull_values,
                    _avg_local_shard_num;
     task_keys[shard_id].push_back({pull_value.feasigns_[i], i});
   }
+  size_t pool_offset = ShardTaskPoolOffset();
   for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
     tasks[shard_id] =
-        _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
+        _shards_task_pool[(shard_id + pool_offset) % _task_pool_size]->enqueue(
             [this,
              shard_id,
              &task_keys,
@@ -783,26 +976,36 @@ int32_t MemorySparseTable::PullSparse(float* pull_values,
              mf_value_size,
              select_value_size]() -> int {
               auto& local_shard = _local_shards[shard_id];
+              auto* locks = ShardLocks(shard_id);
               float data_buffer[value_size];  // NOLINT
               float* data_buffer_ptr = data_buffer;
 
               auto& keys = task_keys[shard_id];
               for (size_t i = 0; i < keys.size(); i++) {
                 uint64_t key = keys[i].first;
+                size_t hash = std::hash<uint64_t>()(key);
+                SparseShardKeyLock key_lock(
+                    locks, hash, local_shard.compute_bucket(hash));
                 auto itr = local_shard.find(key);
                 size_t data_size = value_size - mf_value_size;
-                if (itr == local_shard.end()) {
-                  // ++missed_keys;
-                  if (FLAGS_pserver_create_value_when_push) {
-                    memset(data_buffer, 0, sizeof(float) * data_size);
-                  } else {
-                    auto& feature_value = local_shard[key];
+                if (itr == local_shard.end() &&
+                    !FLAGS_pserver_create_value_when_push) {
+                  key_lock.LockBucket();
+                  auto& feature_value = local_shard[key];
+                  // another pull may have created it after the find
+                  if (feature_value.size() == 0) {
                     feature_value.resize(data_size);
                     float* data_ptr = feature_value.data();
                     _value_accesor->Create(&data_buffer_ptr, 1);
                     memcpy(
                         data_ptr, data_buffer_ptr, data_size * sizeof(float));
+                    MarkDirtyKey(shard_id, key, false);
                   }
+                  itr = local_shard.find(key);
+                }
+                if (itr == local_shard.end()) {
+                  // ++missed_keys;
+                  memset(data_buffer, 0, sizeof(float) * data_size);
                 } else {
                   data_size = itr.value().size();
                   memcpy(data_buffer_ptr,
@@ -832,6 +1035,11 @@ int32_t MemorySparseTable::PullSparsePtr(char** pull_values,
                                          const uint64_t* keys,
                                          size_t num) {
   CostTimer timer("pscore_sparse_select_all");
+  if (FLAGS_pserver_table_incremental_shrink) {
+    // the values are held by pointer until the next shrink, the sweep of the
+    // last shrink may not erase them
+    WaitShrinkSweep();
+  }
   size_t value_size = _value_accesor->GetAccessorInfo().size / sizeof(float);
   size_t mf_value_size =
       _value_accesor->GetAccessorInfo().mf_size / sizeof(float);
@@ -844,9 +1052,10 @@ int32_t MemorySparseTable::PullSparsePtr(char** pull_values,
     task_keys[shard_id].push_back({keys[i], i});
   }
   // std::atomic<uint32_t> missed_keys{0};
+  size_t pool_offset = ShardTaskPoolOffset();
   for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
     tasks[shard_id] =
-        _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
+        _shards_task_pool[(shard_id + pool_offset) % _task_pool_size]->enqueue(
             [this,
              shard_id,
              &task_keys,
@@ -855,20 +1064,30 @@ int32_t MemorySparseTable::PullSparsePtr(char** pull_values,
              mf_value_size]() -> int {
               auto& keys = task_keys[shard_id];
               auto& local_shard = _local_shards[shard_id];
+              auto* locks = ShardLocks(shard_id);
               float data_buffer[value_size];  // NOLINT
               float* data_buffer_ptr = data_buffer;
               for (size_t i = 0; i < keys.size(); ++i) {
                 uint64_t key = keys[i].first;
+                // the returned values are read and written out of the locks
+                size_t hash = std::hash<uint64_t>()(key);
+                SparseShardKeyLock key_lock(
+                    locks, hash, local_shard.compute_bucket(hash));
                 auto itr = local_shard.find(key);
                 size_t data_size = value_size - mf_value_size;
                 FixedFeatureValue* ret = NULL;
                 if (itr == local_shard.end()) {
                   // ++missed_keys;
+                  key_lock.LockBucket();
                   auto& feature_value = local_shard[key];
-                  feature_value.resize(data_size);
-                  float* data_ptr = feature_value.data();
-                  _value_accesor->Create(&data_buffer_ptr, 1);
-                  memcpy(data_ptr, data_buffer_ptr, data_size * sizeof(float));
+                  if (feature_value.size() == 0) {
+                    feature_value.resize(data_size);
+                    float* data_ptr = feature_value.data();
+                    _value_accesor->Create(&data_buffer_ptr, 1);
+                    memcpy(
+                        data_ptr, data_buffer_ptr, data_size * sizeof(float));
+                    MarkDirtyKey(shard_id, key, false);
+                  }
                   ret = &feature_value;
                 } else {
                   ret = itr.value_ptr();
@@ -904,8 +1123,10 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
   size_t update_value_col =
       _value_accesor->GetAccessorInfo().update_size / sizeof(float);
 
+  size_t pool_offset = ShardTaskPoolOffset();
   for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
-    tasks[shard_id] = _shards_task_pool[shard_id % _task_pool_size]->enqueue(
+    tasks[shard_id] =
+        _shards_task_pool[(shard_id + pool_offset) % _task_pool_size]->enqueue(
         [this,
          shard_id,
          value_col,
@@ -916,6 +1137,7 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
           auto& keys = task_keys[shard_id];
           auto& local_shard = _local_shards[shard_id];
           auto& local_shard_new = _local_shards_new[shard_id];
+          auto* locks = ShardLocks(shard_id);
           float data_buffer[value_col];  // NOLINT
           float* data_buffer_ptr = data_buffer;
           for (size_t i = 0; i < keys.size(); ++i) {
@@ -923,22 +1145,30 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
             uint64_t push_data_idx = keys[i].second;
             const float* update_data =
                 values + push_data_idx * update_value_col;
+            size_t hash = std::hash<uint64_t>()(key);
+            SparseShardKeyLock key_lock(
+                locks, hash, local_shard.compute_bucket(hash));
             auto itr = local_shard.find(key);
             if (itr == local_shard.end()) {
               if (FLAGS_pserver_enable_create_feasign_randomly &&
                   !_value_accesor->CreateValue(1, update_data)) {
                 continue;
               }
+              // the new key is updated under the exclusive bucket lock
+              key_lock.LockBucket();
               auto value_size = value_col - mf_value_col;
               auto& feature_value = local_shard[key];
-              feature_value.resize(value_size);
-              _value_accesor->Create(&data_buffer_ptr, 1);
-              memcpy(feature_value.data(),
-                     data_buffer_ptr,
-                     value_size * sizeof(float));
+              if (feature_value.size() == 0) {
+                feature_value.resize(value_size);
+                _value_accesor->Create(&data_buffer_ptr, 1);
+                memcpy(feature_value.data(),
+                       data_buffer_ptr,
+                       value_size * sizeof(float));
+              }
               itr = local_shard.find(key);
             }
 
+            MarkDirtyKey(shard_id, key, true);
             auto& feature_value = itr.value();
             float* value_data = feature_value.data();
             size_t value_size = feature_value.size();
@@ -993,8 +1223,10 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
   size_t update_value_col =
       _value_accesor->GetAccessorInfo().update_size / sizeof(float);
 
+  size_t pool_offset = ShardTaskPoolOffset();
   for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
-    tasks[shard_id] = _shards_task_pool[shard_id % _task_pool_size]->enqueue(
+    tasks[shard_id] =
+        _shards_task_pool[(shard_id + pool_offset) % _task_pool_size]->enqueue(
         [this,
          shard_id,
          value_col,
@@ -1004,27 +1236,36 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
          &task_keys]() -> int {
           auto& keys = task_keys[shard_id];
           auto& local_shard = _local_shards[shard_id];
+          auto* locks = ShardLocks(shard_id);
           float data_buffer[value_col];  // NOLINT
           float* data_buffer_ptr = data_buffer;
           for (size_t i = 0; i < keys.size(); ++i) {
             uint64_t key = keys[i].first;
             uint64_t push_data_idx = keys[i].second;
             const float* update_data = values[push_data_idx];
+            size_t hash = std::hash<uint64_t>()(key);
+            SparseShardKeyLock key_lock(
+                locks, hash, local_shard.compute_bucket(hash));
             auto itr = local_shard.find(key);
             if (itr == local_shard.end()) {
               if (FLAGS_pserver_enable_create_feasign_randomly &&
                   !_value_accesor->CreateValue(1, update_data)) {
                 continue;
               }
+              // the new key is updated under the exclusive bucket lock
+              key_lock.LockBucket();
               auto value_size = value_col - mf_value_col;
               auto& feature_value = local_shard[key];
-              feature_value.resize(value_size);
-              _value_accesor->Create(&data_buffer_ptr, 1);
-              memcpy(feature_value.data(),
-                     data_buffer_ptr,
-                     value_size * sizeof(float));
+              if (feature_value.size() == 0) {
+                feature_value.resize(value_size);
+                _value_accesor->Create(&data_buffer_ptr, 1);
+                memcpy(feature_value.data(),
+                       data_buffer_ptr,
+                       value_size * sizeof(float));
+              }
               itr = local_shard.find(key);
             }
+            MarkDirtyKey(shard_id, key, true);
             auto& feature_value = itr.value();
             float* value_data = feature_value.data();
             size_t value_size = feature_value.size();
@@ -1056,21 +1297,146 @@ int32_t MemorySparseTable::Flush() { return 0; }
 
 int32_t MemorySparseTable::Shrink(const std::string& param) {
   VLOG(0) << "MemorySparseTable::Shrink";
-  // TODO(zhaocaibei123): implement with multi-thread
-  for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
-    // Shrink
-    auto& shard = _local_shards[shard_id];
-    for (auto it = shard.begin(); it != shard.end();) {
-      if (_value_accesor->Shrink(it.value().data())) {
-        it = shard.erase(it);
-      } else {
-        ++it;
+  WaitShrinkSweep();
+  if (!FLAGS_pserver_table_incremental_shrink) {
+    // TODO(zhaocaibei123): implement with multi-thread
+    for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+      // Shrink
+      auto& shard = _local_shards[shard_id];
+      for (auto it = shard.begin(); it != shard.end();) {
+        if (_value_accesor->Shrink(it.value().data())) {
+          it = shard.erase(it);
+        } else {
+          ++it;
+        }
       }
     }
+    return 0;
+  }
+  // The keys pushed or created since the last shrink are shrunk here, the
+  // others are left to ShrinkSweep. A key pushed before the sweep reaches
+  // it decays after the push.
+  auto start = std::chrono::steady_clock::now();
+  std::atomic<uint64_t> shrink_size{0};
+  std::vector<std::future<int>> tasks(_real_local_shard_num);
+  for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+    tasks[shard_id] =
+        _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
+            [this, shard_id, &shrink_size]() -> int {
+              auto& shard = _local_shards[shard_id];
+              auto* locks = ShardLocks(shard_id);
+              auto& done_keys = _shrink_done_keys[shard_id];
+              {
+                std::unique_lock<std::mutex> state_lock;
+                if (locks != NULL) {
+                  state_lock = std::unique_lock<std::mutex>(locks->state);
+                }
+                done_keys = _shrink_dirty_keys[shard_id].Keys();
+                _shrink_dirty_keys[shard_id].Clear();
+              }
+              for (auto key : done_keys) {
+                size_t hash = std::hash<uint64_t>()(key);
+                SparseShardKeyLock key_lock(
+                    locks, hash, shard.compute_bucket(hash));
+                key_lock.LockBucket();
+                auto it = shard.find(key);
+                if (it != shard.end() &&
+                    _value_accesor->Shrink(it.value().data())) {
+                  shard.quick_erase(it);
+                }
+              }
+              shrink_size += done_keys.size();
+              return 0;
+            });
   }
+  for (size_t shard_id = 0; shard_id < tasks.size(); ++shard_id) {
+    tasks[shard_id].wait();
+  }
+  LOG(INFO) << "MemorySparseTable shrink " << shrink_size
+            << " keys touched since the last shrink in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             start)
+                   .count()
+            << "s, the others are left to the sweep";
+  std::lock_guard<std::mutex> lock(_shrink_sweep_mutex);
+  _shrink_sweep_thread = std::thread(&MemorySparseTable::ShrinkSweep, this);
   return 0;
 }
 
+void MemorySparseTable::ShrinkSweep() {
+  auto start = std::chrono::steady_clock::now();
+  for (size_t bucket = 0;
+       bucket < CTR_SPARSE_SHARD_BUCKET_NUM && !_stop_shrink_sweep;
+       ++bucket) {
+    std::vector<std::future<int>> tasks(_real_local_shard_num);
+    for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+      tasks[shard_id] =
+          _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
+              [this, shard_id, bucket]() -> int {
+                auto& shard = _local_shards[shard_id];
+                auto& done_keys = _shrink_done_keys[shard_id];
+                auto* locks = ShardLocks(shard_id);
+                // the pulls and pushes of the concurrent shard wait the
+                // bucket
+                std::unique_lock<std::shared_timed_mutex> bucket_lock;
+                if (locks != NULL) {
+                  bucket_lock = std::unique_lock<std::shared_timed_mutex>(
+                      locks->buckets[bucket]);
+                }
+                for (auto it = shard.begin(bucket); it != shard.end(bucket);) {
+                  if (!std::binary_search(
+                          done_keys.begin(), done_keys.end(), it.key()) &&
+                      _value_accesor->Shrink(it.value().data())) {
+                    std::unique_lock<std::mutex> alloc_lock;
+                    if (locks != NULL) {
+                      alloc_lock = std::unique_lock<std::mutex>(locks->alloc);
+                    }
+                    it = shard.erase(bucket, it);
+                  } else {
+                    ++it;
+                  }
+                }
+                return 0;
+              });
+    }
+    for (size_t shard_id = 0; shard_id < tasks.size(); ++shard_id) {
+      tasks[shard_id].wait();
+    }
+  }
+  for (auto& done_keys : _shrink_done_keys) {
+    std::vector<uint64_t>().swap(done_keys);
+  }
+  LOG(INFO) << "MemorySparseTable shrink sweep done in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             start)
+                   .count()
+            << "s";
+}
+
+void MemorySparseTable::MarkDirtyKey(int shard_id, uint64_t key, bool pushed) {
+  bool save_dirty = pushed && FLAGS_pserver_table_delta_save_dirty_only;
+  if (!save_dirty && !FLAGS_pserver_table_incremental_shrink) {
+    return;
+  }
+  std::unique_lock<std::mutex> state_lock;
+  if (ShardLocks(shard_id) != NULL) {
+    state_lock = std::unique_lock<std::mutex>(ShardLocks(shard_id)->state);
+  }
+  if (save_dirty) {
+    _save_dirty_keys[shard_id].Add(key);
+  }
+  if (FLAGS_pserver_table_incremental_shrink) {
+    _shrink_dirty_keys[shard_id].Add(key);
+  }
+}
+
+void MemorySparseTable::WaitShrinkSweep() {
+  std::lock_guard<std::mutex> lock(_shrink_sweep_mutex);
+  if (_shrink_sweep_thread.joinable()) {
+    _shrink_sweep_thread.join();
+  }
+}
+
 void MemorySparseTable::Clear() { VLOG(0) << "clear coming soon"; }
 
 }  // namespace distributed
@@ -18,9 +18,11 @@
 #include <assert.h>
 #include <pthread.h>
 
+#include <atomic>
 #include <memory>
 #include <mutex>  // NOLINT
 #include <string>
+#include <thread>  // NOLINT
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -28,7 +30,9 @@
 #include "Eigen/Dense"
 #include "paddle/fluid/distributed/ps/table/accessor.h"
 #include "paddle/fluid/distributed/ps/table/common_table.h"
+#include "paddle/fluid/distributed/ps/table/depends/dirty_key_set.h"
 #include "paddle/fluid/distributed/ps/table/depends/feature_value.h"
+#include "paddle/fluid/distributed/ps/table/depends/shard_locks.h"
 #include "paddle/fluid/string/string_helper.h"
 
 #define PSERVER_SAVE_SUFFIX ".shard"
@@ -36,11 +40,16 @@
 namespace paddle {
 namespace distributed {
 
+class TopkCalculator;
+
 class MemorySparseTable : public Table {
  public:
   typedef SparseTableShard<uint64_t, FixedFeatureValue> shard_type;
   MemorySparseTable() {}
-  virtual ~MemorySparseTable() {}
+  virtual ~MemorySparseTable() {
+    _stop_shrink_sweep = true;
+    WaitShrinkSweep();
+  }
 
   // unused method end
   static int32_t sparse_local_shard_num(uint32_t shard_num,
@@ -99,6 +108,10 @@ class MemorySparseTable : public Table {
   int32_t Flush() override;
   int32_t Shrink(const std::string& param) override;
   void Clear() override;
+  // waits the background shrink sweep of the keys not touched since the
+  // shrink before, the callers walking the shards out of the shard task
+  // threads wait it first, GetShard does not wait it
+  void WaitShrinkSweep();
 
   void* GetShard(size_t shard_idx) override {
     return &_local_shards[shard_idx];
@@ -111,6 +124,31 @@ class MemorySparseTable : public Table {
   virtual int32_t SavePatch(const std::string& path, int save_param);
   virtual int32_t LoadPatch(const std::vector<std::string>& file_list,
                             int save_param);
+  // Writes the values of shard_id to save through the streaming exporter,
+  // only the keys of keys when it is not null. Returns the saved feasign num
+  // or -1 if the write failed.
+  int64_t SaveShard(int shard_id,
+                    int save_param,
+                    const std::vector<uint64_t>* keys,
+                    TopkCalculator* tk,
+                    FsWriteChannel* write_channel);
+  // decays and shrinks the keys of every shard the last Shrink left, one
+  // bucket of every shard per task of the shard task threads
+  void ShrinkSweep();
+  // keeps key of shard_id for the incremental shrink, and for the delta
+  // saves when pushed
+  void MarkDirtyKey(int shard_id, uint64_t key, bool pushed);
+  // the locks of shard_id, NULL without the concurrent shard
+  SparseShardLocks* ShardLocks(int shard_id) {
+    return _shard_locks ? &_shard_locks[shard_id] : NULL;
+  }
+  // the task thread of the task of shard_id is
+  // _shards_task_pool[(shard_id + offset) % _task_pool_size], the concurrent
+  // shard gives every call another offset so the tasks of a shard from
+  // concurrent calls run on different threads
+  size_t ShardTaskPoolOffset() {
+    return _shard_locks ? _next_task_pool_offset++ : 0;
+  }
 
   int _task_pool_size = 24;
   int _avg_local_shard_num;
@@ -118,6 +156,24 @@ class MemorySparseTable : public Table {
   int _sparse_table_shard_num;
   std::vector<std::shared_ptr<::ThreadPool>> _shards_task_pool;
   std::unique_ptr<shard_type[]> _local_shards;
+  // the keys of every shard pushed since the last xbox save, kept with
+  // FLAGS_pserver_table_delta_save_dirty_only
+  std::vector<DirtyKeySet> _save_dirty_keys;
+  // whether an xbox save visited every key since the start or the last load,
+  // the delta saves may only visit the dirty keys after that
+  bool _save_dirty_keys_complete{false};
+  // the keys of every shard pushed or created since the last shrink, kept
+  // with FLAGS_pserver_table_incremental_shrink
+  std::vector<DirtyKeySet> _shrink_dirty_keys;
+  // the sorted keys of every shard the last Shrink shrunk, the sweep skips
+  std::vector<std::vector<uint64_t>> _shrink_done_keys;
+  std::thread _shrink_sweep_thread;
+  // several threads may wait the sweep at once
+  std::mutex _shrink_sweep_mutex;
+  std::atomic<bool> _stop_shrink_sweep{false};
+  // the locks of every shard with FLAGS_pserver_table_concurrent_shard
+  std::unique_ptr<SparseShardLocks[]> _shard_locks;
+  std::atomic<size_t> _next_task_pool_offset{0};
 
   // for patch model
   int _m_avg_local_shard_num;
@@ -17,6 +17,12 @@ limitations under the License. */
 #include <ThreadPool.h>
 #include <unistd.h>
 
+#include <chrono>  // NOLINT
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
 #include <string>
 #include <thread>  // NOLINT
 
@@ -25,6 +31,10 @@ limitations under the License. */
 #include "paddle/fluid/distributed/ps/table/table.h"
 #include "paddle/fluid/distributed/the_one_ps.pb.h"
 
+DECLARE_bool(pserver_table_delta_save_dirty_only);
+DECLARE_bool(pserver_table_incremental_shrink);
+DECLARE_bool(pserver_table_concurrent_shard);
+
 namespace paddle {
 namespace distributed {
 
@@ -152,5 +162,349 @@ TEST(MemorySparseTable, SGD) {
   }
 }
 
+static Table *MakeCtrTable(int shard_num, float decay_rate = 0.99) {
+  TableParameter table_config;
+  table_config.set_table_class("MemorySparseTable");
+  table_config.set_shard_num(shard_num);
+  table_config.set_compress_in_save(false);
+  FsClientParameter fs_config;
+  Table *table = new MemorySparseTable();
+  table->SetShard(0, 1);
+
+  TableAccessorParameter *accessor_config = table_config.mutable_accessor();
+  accessor_config->set_accessor_class("CtrCommonAccessor");
+  accessor_config->set_fea_dim(11);
+  accessor_config->set_embedx_dim(8);
+  accessor_config->set_embedx_threshold(5);
+  auto *ctr_param = accessor_config->mutable_ctr_accessor_param();
+  ctr_param->set_nonclk_coeff(0.2);
+  ctr_param->set_click_coeff(1);
+  ctr_param->set_base_threshold(0.5);
+  ctr_param->set_delta_threshold(0.2);
+  ctr_param->set_delta_keep_days(16);
+  ctr_param->set_show_click_decay_rate(decay_rate);
+  for (auto *sgd_param : {accessor_config->mutable_embed_sgd_param(),
+                          accessor_config->mutable_embedx_sgd_param()}) {
+    sgd_param->set_name("SparseNaiveSGDRule");
+    auto *naive_param = sgd_param->mutable_naive();
+    naive_param->set_learning_rate(0.1);
+    naive_param->set_initial_range(0.3);
+    naive_param->add_weight_bounds(-10.0);
+    naive_param->add_weight_bounds(10.0);
+  }
+  EXPECT_EQ(table->Initialize(table_config, fs_config), 0);
+  return table;
+}
+
+// one show and one click of every key, enough for the delta threshold
+static void PushClicks(Table *table, const std::vector<uint64_t> &keys) {
+  const int emb_dim = 8;
+  std::vector<float> values;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    values.push_back(0);  // slot
+    values.push_back(1);  // show
+    values.push_back(1);  // click
+    for (int k = 0; k < emb_dim + 1; ++k) {
+      values.push_back(0.01);
+    }
+  }
+  TableContext table_context;
+  table_context.value_type = Sparse;
+  table_context.push_context.keys = keys.data();
+  table_context.push_context.values = values.data();
+  table_context.num = keys.size();
+  table->Push(table_context);
+}
+
+// the sorted lines of every part file of a save
+static std::vector<std::string> ReadSave(const std::string &dirname,
+                                         int shard_num) {
+  std::vector<std::string> lines;
+  for (int i = 0; i < shard_num; ++i) {
+    std::ifstream part(paddle::string::format_string(
+        "%s/000/part-000-%05d", dirname.c_str(), i));
+    std::string line;
+    while (std::getline(part, line)) {
+      lines.push_back(line);
+    }
+  }
+  std::sort(lines.begin(), lines.end());
+  return lines;
+}
+
+TEST(MemorySparseTable, DeltaSaveDirtyOnly) {
+  const int shard_num = 10;
+  const uint64_t key_num = 5000;
+  std::unique_ptr<Table> tables[2] = {
+      std::unique_ptr<Table>(MakeCtrTable(shard_num)),
+      std::unique_ptr<Table>(MakeCtrTable(shard_num))};
+  // table 1 keeps the dirty keys, both see the same pushes and saves
+  auto run = [&](const std::function<void(Table *, int)> &func) {
+    for (int t = 0; t < 2; ++t) {
+      FLAGS_pserver_table_delta_save_dirty_only = (t == 1);
+      func(tables[t].get(), t);
+    }
+    FLAGS_pserver_table_delta_save_dirty_only = false;
+  };
+  auto push = [&](uint64_t step) {
+    std::vector<uint64_t> keys;
+    for (uint64_t key = 0; key < key_num; key += step) {
+      keys.push_back(key);
+    }
+    run([&](Table *table, int t) { PushClicks(table, keys); });
+  };
+  auto save = [&](int round, const std::string &param) {
+    std::string dirs[2];
+    run([&](Table *table, int t) {
+      dirs[t] = paddle::string::format_string(
+          "/tmp/memory_sparse_table_test/%d_%d", round, t);
+      ASSERT_EQ(table->Save(dirs[t], param), 0);
+    });
+    auto lines = ReadSave(dirs[0], shard_num);
+    EXPECT_EQ(lines, ReadSave(dirs[1], shard_num)) << "round " << round;
+    return lines.size();
+  };
+
+  push(1);
+  // the first delta save of table 1 still visits every key
+  EXPECT_EQ(save(0, "1"), key_num);
+  push(10);
+  EXPECT_EQ(save(1, "1"), key_num / 10);
+  // nothing pushed, nothing saved
+  EXPECT_EQ(save(2, "1"), 0UL);
+  push(7);
+  save(3, "2");
+  push(3);
+  EXPECT_EQ(save(4, "1"), (key_num + 2) / 3);
+  EXPECT_EQ(save(5, "0"), key_num);
+}
+
+// delta save time and cpu by the fraction of the keys pushed since the last
+// xbox save
+TEST(MemorySparseTable, DeltaSaveBenchmark) {
+  const int shard_num = 20;
+  const uint64_t key_num = 1000000;
+  std::vector<uint64_t> keys(key_num);
+  for (uint64_t key = 0; key < key_num; ++key) {
+    keys[key] = key;
+  }
+  for (bool dirty_only : {false, true}) {
+    FLAGS_pserver_table_delta_save_dirty_only = dirty_only;
+    std::unique_ptr<Table> table(MakeCtrTable(shard_num));
+    PushClicks(table.get(), keys);
+    ASSERT_EQ(table->Save("/tmp/memory_sparse_table_test/bench", "1"), 0);
+    for (uint64_t step : {100, 10, 1}) {
+      std::vector<uint64_t> touched;
+      for (uint64_t key = 0; key < key_num; key += step) {
+        touched.push_back(key);
+      }
+      PushClicks(table.get(), touched);
+      auto wall_start = std::chrono::steady_clock::now();
+      std::clock_t cpu_start = std::clock();
+      ASSERT_EQ(table->Save("/tmp/memory_sparse_table_test/bench", "1"), 0);
+      LOG(INFO) << "dirty only: " << dirty_only << ", touched " << 100 / step
+                << "% of " << key_num << " keys, delta save wall time: "
+                << std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - wall_start)
+                       .count()
+                << "s, cpu time: "
+                << static_cast<double>(std::clock() - cpu_start) /
+                       CLOCKS_PER_SEC
+                << "s";
+    }
+  }
+  FLAGS_pserver_table_delta_save_dirty_only = false;
+}
+
+TEST(MemorySparseTable, IncrementalShrink) {
+  const int shard_num = 10;
+  const uint64_t key_num = 5000;
+  // a key pushed once is shrunk after two shrinks, after one if pushed
+  // before the last shrink only
+  std::unique_ptr<Table> tables[2] = {
+      std::unique_ptr<Table>(MakeCtrTable(shard_num, 0.5)),
+      std::unique_ptr<Table>(MakeCtrTable(shard_num, 0.5))};
+  // table 1 shrinks incrementally, both see the same pushes and shrinks
+  auto run = [&](const std::function<void(Table *)> &func) {
+    for (int t = 0; t < 2; ++t) {
+      FLAGS_pserver_table_incremental_shrink = (t == 1);
+      func(tables[t].get());
+    }
+    FLAGS_pserver_table_incremental_shrink = false;
+  };
+  auto push = [&](uint64_t step) {
+    std::vector<uint64_t> keys;
+    for (uint64_t key = 0; key < key_num; key += step) {
+      keys.push_back(key);
+    }
+    run([&](Table *table) { PushClicks(table, keys); });
+  };
+  auto check = [&](int round) {
+    std::string dirs[2];
+    for (int t = 0; t < 2; ++t) {
+      dirs[t] = paddle::string::format_string(
+          "/tmp/memory_sparse_table_test/shrink_%d_%d", round, t);
+      EXPECT_EQ(tables[t]->Save(dirs[t], "0"), 0);
+    }
+    auto lines = ReadSave(dirs[0], shard_num);
+    EXPECT_EQ(lines, ReadSave(dirs[1], shard_num)) << "round " << round;
+    return lines.size();
+  };
+
+  push(1);
+  push(1);
+  run([](Table *table) { table->Shrink(""); });
+  EXPECT_EQ(check(0), key_num);
+  push(3);
+  run([](Table *table) { table->Shrink(""); });
+  EXPECT_EQ(check(1), (key_num + 2) / 3);
+  // the shrink waits the sweep of the last one
+  push(7);
+  run([](Table *table) { table->Shrink(""); });
+  run([](Table *table) { table->Shrink(""); });
+  EXPECT_EQ(check(2), 0UL);
+}
+
+// the time Shrink blocks and the time of the sweep after it by the fraction
+// of the keys pushed since the last shrink
+TEST(MemorySparseTable, ShrinkBenchmark) {
+  const int shard_num = 20;
+  const uint64_t key_num = 1000000;
+  std::vector<uint64_t> keys(key_num);
+  for (uint64_t key = 0; key < key_num; ++key) {
+    keys[key] = key;
+  }
+  for (bool incremental : {false, true}) {
+    FLAGS_pserver_table_incremental_shrink = incremental;
+    std::unique_ptr<MemorySparseTable> table(
+        dynamic_cast<MemorySparseTable *>(MakeCtrTable(shard_num)));
+    PushClicks(table.get(), keys);
+    table->Shrink("");
+    for (uint64_t step : {100, 10, 1}) {
+      std::vector<uint64_t> touched;
+      for (uint64_t key = 0; key < key_num; key += step) {
+        touched.push_back(key);
+      }
+      PushClicks(table.get(), touched);
+      table->WaitShrinkSweep();
+      auto start = std::chrono::steady_clock::now();
+      table->Shrink("");
+      auto blocked = std::chrono::steady_clock::now();
+      table->WaitShrinkSweep();
+      LOG(INFO) << "incremental: " << incremental << ", touched "
+                << 100 / step << "% of " << key_num
+                << " keys, shrink blocked: "
+                << std::chrono::duration<double>(blocked - start).count()
+                << "s, sweep: "
+                << std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - blocked)
+                       .count()
+                << "s";
+    }
+  }
+  FLAGS_pserver_table_incremental_shrink = false;
+}
+
+static void PullValues(Table *table, const std::vector<uint64_t> &keys) {
+  const int emb_dim = 8;
+  std::vector<uint32_t> fres(keys.size(), 1);
+  std::vector<float> values(keys.size() * (emb_dim + 3));
+  TableContext table_context;
+  table_context.value_type = Sparse;
+  table_context.pull_context.pull_value =
+      PullSparseValue(keys, fres, emb_dim);
+  table_context.pull_context.values = values.data();
+  table->Pull(table_context);
+}
+
+// the keys of the shards spread over the buckets
+static std::vector<uint64_t> SpreadKeys(uint64_t key_num) {
+  std::vector<uint64_t> keys(key_num);
+  for (uint64_t i = 0; i < key_num; ++i) {
+    keys[i] = i * 0x9E3779B97F4A7C15UL;
+  }
+  return keys;
+}
+
+TEST(MemorySparseTable, ConcurrentShard) {
+  const int shard_num = 4;
+  const int thread_num = 8;
+  const int round_num = 10;
+  FLAGS_pserver_table_concurrent_shard = true;
+  std::unique_ptr<Table> table(MakeCtrTable(shard_num));
+  FLAGS_pserver_table_concurrent_shard = false;
+  // every thread pulls and pushes every key, the first push of any thread
+  // creates it
+  auto keys = SpreadKeys(5000);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_num; ++t) {
+    threads.emplace_back([&]() {
+      for (int round = 0; round < round_num; ++round) {
+        PullValues(table.get(), keys);
+        PushClicks(table.get(), keys);
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(table->Save("/tmp/memory_sparse_table_test/concurrent", "0"), 0);
+  auto lines = ReadSave("/tmp/memory_sparse_table_test/concurrent", shard_num);
+  ASSERT_EQ(lines.size(), keys.size());
+  // key slot unseen_days delta_score show click ...
+  for (auto &line : lines) {
+    auto fields = paddle::string::split_string<std::string>(line, " ");
+    ASSERT_GT(fields.size(), 5UL);
+    EXPECT_EQ(std::stof(fields[4]), thread_num * round_num) << line;
+    EXPECT_EQ(std::stof(fields[5]), thread_num * round_num) << line;
+  }
+}
+
+// pulls and pushes per second of the threads pulling and pushing the same
+// keys of a few shards
+TEST(MemorySparseTable, MixedPullPushBenchmark) {
+  const int shard_num = 4;
+  const size_t batch_size = 1000;
+  const int round_num = 20;
+  auto keys = SpreadKeys(100000);
+  for (bool concurrent : {false, true}) {
+    FLAGS_pserver_table_concurrent_shard = concurrent;
+    std::unique_ptr<Table> table(MakeCtrTable(shard_num));
+    FLAGS_pserver_table_concurrent_shard = false;
+    PushClicks(table.get(), keys);
+    for (int thread_num : {1, 2, 4, 8, 16, 32, 64}) {
+      auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for (int t = 0; t < thread_num; ++t) {
+        threads.emplace_back([&, t]() {
+          std::mt19937_64 engine(t);
+          std::vector<uint64_t> batch(batch_size);
+          for (int round = 0; round < round_num; ++round) {
+            for (auto &key : batch) {
+              key = keys[engine() % keys.size()];
+            }
+            // three pulls for a push
+            if (round % 4 == 3) {
+              PushClicks(table.get(), batch);
+            } else {
+              PullValues(table.get(), batch);
+            }
+          }
+        });
+      }
+      for (auto &t : threads) {
+        t.join();
+      }
+      double seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+      LOG(INFO) << "concurrent shard: " << concurrent << ", " << thread_num
+                << " threads, "
+                << thread_num * round_num * batch_size / seconds
+                << " keys pulled or pushed per second";
+    }
+  }
+}
+
 }  // namespace distributed
 }  // namespace paddle
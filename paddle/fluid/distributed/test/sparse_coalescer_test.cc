@@ -0,0 +1,75 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/distributed/ps/service/communicator/sparse_coalescer.h"
+
+#include <map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace distributed {
+
+TEST(sparse_coalescer_test, merge_duplicate_keys) {
+  const size_t kDim = 5;
+  const size_t kKeyNum = 3000;
+  SparsePushCoalescer coalescer(kDim, 1);
+  std::map<uint64_t, std::vector<float>> expect;
+
+  // push several steps with duplicate keys
+  for (int step = 0; step < 4; ++step) {
+    std::vector<uint64_t> keys;
+    std::vector<std::vector<float>> values;
+    for (size_t i = 0; i < kKeyNum; ++i) {
+      uint64_t key = (i * 7 + step) % 1000;
+      keys.push_back(key);
+      std::vector<float> value(kDim, 1.0);
+      value[0] = static_cast<float>(key % 13);  // slot
+      value[kDim - 1] = static_cast<float>(step);
+      values.push_back(value);
+      auto& e = expect[key];
+      if (e.empty()) {
+        e = value;
+      } else {
+        for (size_t j = 1; j < kDim; ++j) {
+          e[j] += value[j];
+        }
+      }
+    }
+    std::vector<const float*> ptrs;
+    for (auto& v : values) {
+      ptrs.push_back(v.data());
+    }
+    coalescer.Add(keys.data(), ptrs.data(), keys.size());
+  }
+  ASSERT_EQ(coalescer.TakeInputNum(), 4 * kKeyNum);
+
+  std::vector<uint64_t> keys;
+  std::vector<float> values;
+  size_t num = coalescer.Flush(&keys, &values);
+  ASSERT_EQ(num, expect.size());
+  ASSERT_EQ(values.size(), num * kDim);
+  for (size_t i = 0; i < num; ++i) {
+    auto& e = expect[keys[i]];
+    for (size_t j = 0; j < kDim; ++j) {
+      ASSERT_FLOAT_EQ(values[i * kDim + j], e[j]);
+    }
+  }
+  ASSERT_TRUE(coalescer.Empty());
+  ASSERT_EQ(coalescer.Flush(&keys, &values), 0UL);
+}
+
+}  // namespace distributed
+}  // namespace paddle
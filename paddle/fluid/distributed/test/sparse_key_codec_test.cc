@@ -0,0 +1,79 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/distributed/ps/service/sparse_key_codec.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace distributed {
+
+TEST(sparse_key_codec_test, varint_delta_keys) {
+  std::mt19937_64 rng(0);
+  std::vector<uint64_t> keys(10000);
+  for (auto& k : keys) {
+    k = rng();
+  }
+  keys[0] = 0;
+  keys[1] = UINT64_MAX;
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+  std::string buf;
+  EncodeSortedKeys(keys.data(), keys.size(), &buf);
+  std::vector<uint64_t> out(keys.size());
+  size_t len = DecodeSortedKeys(buf.data(), buf.size(), out.size(), out.data());
+  ASSERT_EQ(len, buf.size());
+  ASSERT_EQ(out, keys);
+  // truncated data
+  ASSERT_EQ(
+      DecodeSortedKeys(buf.data(), buf.size() - 1, out.size(), out.data()), 0);
+
+  // dense keys need far less than 8 bytes
+  std::vector<uint64_t> dense(10000);
+  for (size_t i = 0; i < dense.size(); ++i) {
+    dense[i] = (1UL << 40) + i * 3;
+  }
+  buf.clear();
+  EncodeSortedKeys(dense.data(), dense.size(), &buf);
+  ASSERT_LT(buf.size(), dense.size() * 2);
+}
+
+TEST(sparse_key_codec_test, radix_sort_stable) {
+  std::mt19937_64 rng(1);
+  for (size_t num : {10UL, 1000UL, 100000UL}) {
+    std::vector<std::pair<uint64_t, int>> kvs(num);
+    for (size_t i = 0; i < num; ++i) {
+      kvs[i] = {rng() % (num / 2 + 1), static_cast<int>(i)};
+    }
+    auto expect = kvs;
+    std::stable_sort(expect.begin(),
+                     expect.end(),
+                     [](const std::pair<uint64_t, int>& a,
+                        const std::pair<uint64_t, int>& b) {
+                       return a.first < b.first;
+                     });
+    std::vector<std::pair<uint64_t, int>> tmp;
+    RadixSortKeyValues(&kvs, &tmp);
+    ASSERT_EQ(kvs, expect);
+  }
+}
+
+}  // namespace distributed
+}  // namespace paddle
@@ -266,6 +266,39 @@ class ArchiveBase {
     AdvanceFinish(sizeof(T));
   }
 
+  // LEB128 varint, 7 bits a byte, a uint64_t takes at most 10 bytes
+  static size_t VarintSize(uint64_t x) {
+    size_t size = 1;
+    while (x >= 0x80) {
+      x >>= 7;
+      ++size;
+    }
+    return size;
+  }
+
+  void PutVarint(uint64_t x) {
+    PrepareWrite(10);
+    while (x >= 0x80) {
+      *finish_++ = static_cast<char>(x | 0x80);
+      x >>= 7;
+    }
+    *finish_++ = static_cast<char>(x);
+  }
+
+  uint64_t GetVarint() {
+    uint64_t x = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      PrepareRead(1);
+      uint8_t b = static_cast<uint8_t>(*cursor_++);
+      x |= static_cast<uint64_t>(b & 0x7F) << shift;
+      if (!(b & 0x80)) {
+        return x;
+      }
+    }
+    CHECK(false) << "varint is longer than 10 bytes";
+    return x;
+  }
+
  protected:
   char* buffer_ = NULL;
   char* cursor_ = NULL;
@@ -0,0 +1,413 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+namespace paddle {
+namespace framework {
+
+// BlockRing is the bounded lock free multi producer multi consumer queue of
+// Dmitry Vyukov. Every cell has a sequence number telling whether it is free
+// for the producer of a position or full for the consumer of it.
+template <class T>
+class BlockRing {
+ public:
+  explicit BlockRing(size_t size) : cells_(size), mask_(size - 1) {
+    CHECK(size >= 2 && (size & (size - 1)) == 0)
+        << "ring size must be a power of 2";
+    for (size_t i = 0; i < size; ++i) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool TryPush(T value) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& cell = cells_[pos & mask_];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          cell.value = std::move(value);
+          cell.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // false while a push is still filling its cell
+  bool Empty() const {
+    return enqueue_pos_.load(std::memory_order_acquire) ==
+           dequeue_pos_.load(std::memory_order_acquire);
+  }
+
+  bool TryPop(T* value) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& cell = cells_[pos & mask_];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      intptr_t diff =
+          static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          *value = std::move(cell.value);
+          cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  std::vector<Cell> cells_;
+  size_t mask_;
+  // the producers and the consumers write different cache lines
+  char pad0_[64];
+  std::atomic<size_t> enqueue_pos_{0};
+  char pad1_[64];
+  std::atomic<size_t> dequeue_pos_{0};
+  char pad2_[64];
+};
+
+// BlockChannelCore keeps the data of a block channel. A write packs up to
+// block size values into one block and hands the block to the readers
+// through a BlockRing, so the producers and consumers only meet on the two
+// positions of the ring once per block. The blocks that do not fit into the
+// ring spill into a locked deque, the ring keeps the older blocks and takes
+// new blocks again once the spilled ones are read. A reader that needs only
+// part of a block returns the rest to the front for the next reader, so the
+// values of one writer keep their order for a single reader, but with many
+// readers a reader may get the rest of an older block after a newer one.
+//
+// The mutex and the condition variables are only used to sleep on an empty
+// or full channel.
+template <class T>
+class BlockChannelCore {
+ public:
+  static constexpr size_t kRingSize = 4096;
+
+  BlockChannelCore() : ring_(kRingSize), free_(kRingSize) {}
+
+  ~BlockChannelCore() {
+    Clear();
+    Block* block = nullptr;
+    while (free_.TryPop(&block)) {
+      delete block;
+    }
+  }
+
+  void SetCapacity(size_t capacity) {
+    capacity_.store(capacity);
+    NotifyAll();
+  }
+  size_t Capacity() const { return capacity_.load(); }
+  void SetBlockSize(size_t block_size) { block_size_.store(block_size); }
+  size_t BlockSize() const { return block_size_.load(); }
+
+  bool Closed() const { return closed_.load(); }
+  void Open() {
+    closed_.store(false);
+    NotifyAll();
+  }
+  void Close() {
+    closed_.store(true);
+    NotifyAll();
+  }
+
+  size_t Size() const { return size_.load(); }
+
+  void Clear() {
+    Block* block = nullptr;
+    while ((block = TakeBlock()) != nullptr) {
+      size_.fetch_sub(block->data.size() - block->pos);
+      holding_.fetch_sub(1);
+      delete block;
+    }
+    NotifyAll();
+  }
+
+  // returns less than n if the channel is closed
+  size_t Write(size_t n, const T* p) {
+    return WriteBlocks(n, [p](Block* block, size_t begin, size_t end) {
+      block->data.assign(p + begin, p + end);
+    });
+  }
+
+  // moves the written values out of p
+  size_t WriteMove(size_t n, T* p) {
+    return WriteBlocks(n, [p](Block* block, size_t begin, size_t end) {
+      block->data.assign(std::make_move_iterator(p + begin),
+                         std::make_move_iterator(p + end));
+    });
+  }
+
+  // returns 0 if the channel is closed and empty, once returns as soon as
+  // some values are read
+  size_t Read(size_t n, T* p, bool once) {
+    size_t finished = 0;
+    reading_.fetch_add(n);
+    // a reader makes room on a channel of zero capacity
+    NotifyWriters();
+    while (finished < n) {
+      Block* block = TakeBlock();
+      if (block == nullptr) {
+        if (once && finished > 0) {
+          break;
+        }
+        if (!WaitForRead()) {
+          break;
+        }
+        continue;
+      }
+      size_t m = std::min(n - finished, block->data.size() - block->pos);
+      for (size_t i = 0; i < m; ++i) {
+        p[finished++] = std::move(block->data[block->pos++]);
+      }
+      size_.fetch_sub(m);
+      reading_.fetch_sub(m);
+      if (block->pos < block->data.size()) {
+        ReturnBlock(block);
+      } else {
+        FreeBlock(block);
+      }
+      if (holding_.fetch_sub(1) == 1 && closed_.load()) {
+        // readers waiting for the rest of the block on a closed channel
+        NotifyAll();
+      }
+      NotifyWriters();
+    }
+    reading_.fetch_sub(n - finished);
+    return finished;
+  }
+
+ private:
+  struct Block {
+    std::vector<T> data;
+    size_t pos = 0;
+  };
+
+  template <class Fill>
+  size_t WriteBlocks(size_t n, Fill fill) {
+    size_t finished = 0;
+    writers_.fetch_add(1);
+    while (finished < n) {
+      size_t m = Reserve(n - finished);
+      if (m == 0) {
+        break;
+      }
+      Block* block = NewBlock();
+      fill(block, finished, finished + m);
+      finished += m;
+      PushBlock(block);
+    }
+    if (writers_.fetch_sub(1) == 1 && closed_.load()) {
+      // readers waiting for the last writer of a closed channel
+      NotifyAll();
+    }
+    return finished;
+  }
+
+  // reserve room for up to n values of one block, 0 if the channel is closed
+  size_t Reserve(size_t n) {
+    for (;;) {
+      if (closed_.load()) {
+        return 0;
+      }
+      size_t size = size_.load();
+      size_t limit = capacity_.load() + reading_.load();
+      if (size < limit) {
+        size_t m = std::min(std::min(n, limit - size), block_size_.load());
+        if (size_.compare_exchange_weak(size, size + m)) {
+          return m;
+        }
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      full_waiters_.fetch_add(1);
+      full_cond_.wait(lock, [this] {
+        return closed_.load() ||
+               size_.load() < capacity_.load() + reading_.load();
+      });
+      full_waiters_.fetch_sub(1);
+    }
+  }
+
+  // false if the channel is closed, empty and not written any more
+  bool WaitForRead() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    empty_waiters_.fetch_add(1);
+    empty_cond_.wait(lock, [this] {
+      return ready_.load() > 0 || (closed_.load() && writers_.load() == 0 &&
+                                   holding_.load() == 0);
+    });
+    empty_waiters_.fetch_sub(1);
+    return ready_.load() > 0;
+  }
+
+  Block* NewBlock() {
+    Block* block = nullptr;
+    if (!free_.TryPop(&block)) {
+      block = new Block();
+    }
+    block->data.clear();
+    block->pos = 0;
+    return block;
+  }
+
+  void FreeBlock(Block* block) {
+    if (!free_.TryPush(block)) {
+      delete block;
+    }
+  }
+
+  void PushBlock(Block* block) {
+    if (spilled_.load() > 0 || !ring_.TryPush(block)) {
+      std::lock_guard<std::mutex> lock(spill_mutex_);
+      spill_.push_back(block);
+      spilled_.fetch_add(1);
+    }
+    ready_.fetch_add(1);
+    NotifyReaders();
+  }
+
+  void ReturnBlock(Block* block) {
+    {
+      std::lock_guard<std::mutex> lock(spill_mutex_);
+      returned_.push_front(block);
+      returned_num_.fetch_add(1);
+    }
+    ready_.fetch_add(1);
+    NotifyReaders();
+  }
+
+  Block* TakeBlock() {
+    Block* block = nullptr;
+    if (returned_num_.load() > 0) {
+      std::lock_guard<std::mutex> lock(spill_mutex_);
+      if (!returned_.empty()) {
+        block = returned_.front();
+        returned_.pop_front();
+        returned_num_.fetch_sub(1);
+      }
+    }
+    if (block == nullptr && !PopRing(&block) && spilled_.load() > 0) {
+      std::lock_guard<std::mutex> lock(spill_mutex_);
+      if (!spill_.empty()) {
+        block = spill_.front();
+        spill_.pop_front();
+        // move the older spilled blocks back to the ring while the writers
+        // still spill, the order of the blocks stays the same
+        while (!spill_.empty() && ring_.TryPush(spill_.front())) {
+          spill_.pop_front();
+        }
+        spilled_.store(spill_.size());
+      }
+    }
+    if (block != nullptr) {
+      holding_.fetch_add(1);
+      ready_.fetch_sub(1);
+    }
+    return block;
+  }
+
+  // the spilled blocks are newer than every block of the ring, a block still
+  // being pushed into the ring is waited for
+  bool PopRing(Block** block) {
+    while (!ring_.TryPop(block)) {
+      if (ring_.Empty()) {
+        return false;
+      }
+      std::this_thread::yield();
+    }
+    return true;
+  }
+
+  void NotifyReaders() {
+    if (empty_waiters_.load() > 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      empty_cond_.notify_one();
+    }
+  }
+
+  void NotifyWriters() {
+    if (full_waiters_.load() > 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      full_cond_.notify_all();
+    }
+  }
+
+  void NotifyAll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    empty_cond_.notify_all();
+    full_cond_.notify_all();
+  }
+
+  BlockRing<Block*> ring_;
+  BlockRing<Block*> free_;
+  std::mutex spill_mutex_;
+  std::deque<Block*> spill_;
+  std::deque<Block*> returned_;
+  std::atomic<size_t> spilled_{0};
+  std::atomic<size_t> returned_num_{0};
+
+  // values written and not read yet, including the blocks being written
+  std::atomic<size_t> size_{0};
+  // blocks that can be taken
+  std::atomic<size_t> ready_{0};
+  // values the blocked readers still wait for
+  std::atomic<size_t> reading_{0};
+  // writers and readers that may still put blocks into the channel
+  std::atomic<int> writers_{0};
+  std::atomic<int> holding_{0};
+  std::atomic<size_t> capacity_{0};
+  std::atomic<size_t> block_size_{1024};
+  std::atomic<bool> closed_{false};
+
+  std::mutex mutex_;
+  std::atomic<int> empty_waiters_{0};
+  std::atomic<int> full_waiters_{0};
+  std::condition_variable empty_cond_;
+  std::condition_variable full_cond_;
+};
+
+}  // namespace framework
+}  // namespace paddle
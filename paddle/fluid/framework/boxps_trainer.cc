@@ -281,6 +281,9 @@ void BoxPSTrainer::RemoveOtherDeviceVars(const ProgramDesc& main_program,
 
 void BoxPSTrainer::Run() {
   VLOG(3) << "Going to run";
+  platform::RecordEvent record_event("BoxPSTrainer::Run",
+                                     platform::TracerEventType::UserDefined,
+                                     BoxTracer::kBoxTraceLevel);
   auto pool = GetThreadPool(thread_num_);
   wait_futures_.clear();
   CHECK(static_cast<int>(pool.size()) == thread_num_);
@@ -16,12 +16,17 @@ limitations under the License. */
 #include "paddle/fluid/framework/device_worker.h"
 #include "paddle/fluid/framework/executor_gc_helper.h"
 #include "paddle/fluid/framework/fleet/box_wrapper.h"
+#include "paddle/fluid/framework/fleet/gloo_wrapper.h"
 #include "paddle/fluid/framework/garbage_collector.h"
 #include "paddle/fluid/framework/tensor_util.h"
 #include "paddle/fluid/framework/trainer_desc.pb.h"
+#include "paddle/fluid/memory/allocation/allocator_facade.h"
+#include "paddle/fluid/memory/allocation/batch_arena_allocator.h"
 #include "paddle/fluid/platform/cpu_helper.h"
 #include "paddle/fluid/platform/device_context.h"
 #include "paddle/fluid/platform/lodtensor_printer.h"
+#include "paddle/phi/common/bfloat16.h"
+#include "paddle/phi/common/float16.h"
 #if defined(PADDLE_WITH_CUDA)
 #include "paddle/fluid/platform/collective_helper.h"
 #include "paddle/fluid/platform/device/gpu/nccl_helper.h"
@@ -56,6 +61,23 @@ PADDLE_DEFINE_EXPORTED_bool(
     "enable sharding stage step1 only param and grad split, default false");
 PADDLE_DEFINE_EXPORTED_string(
     padbox_dump_debug_lineid, "", "config dump debug lineid, default is empty");
+PADDLE_DEFINE_EXPORTED_bool(padbox_enable_op_run_cache,
+                            true,
+                            "enable paddlebox op runtime context cache, "
+                            "default true");
+PADDLE_DEFINE_EXPORTED_int32(
+    padbox_gloo_sync_chunk_size,
+    1048576,
+    "cpu dense param sync chunk size(float num) by gloo, default 1M");
+PADDLE_DEFINE_EXPORTED_string(
+    padbox_gloo_sync_compress,
+    "none",
+    "cpu dense param sync payload compress type: none, fp16, bf16");
+PADDLE_DEFINE_EXPORTED_int32(
+    padbox_batch_arena_chunk_mb,
+    0,
+    "cpu batch temporaries arena chunk size(MB), the temporaries of one batch "
+    "are served from the chunks, 0 disables the arena, default 0");
 namespace paddle {
 namespace framework {
 BoxPSAsynDenseTable::BoxPSAsynDenseTable(const int device_num)
@@ -852,11 +874,71 @@ void BoxPSWorker::CreateThreadOperators(const ProgramDesc& program) {
     // add op gc vars
     unused_vars_ = GetUnusedVars(block, ops_, skip_vars_, &unpersist_vars_);
   }
+  BuildOpRunPlan();
   VLOG(3) << "device[" << device_id_ << "] total op count=" << block.OpSize()
           << ", create op count=" << ops_.size()
           << ", skip vars count=" << skip_vars_.size()
           << ", unused vars count=" << unused_vars_.size();
 }
+// the cached runtime context keeps the variable pointers of the first run,
+// which is valid only when every variable of the op is found in the thread
+// scope, not in a kid scope dropped after each batch, and the op runs no sub
+// block in scopes of its own
+bool BoxPSWorker::CanCacheOpRun(const OperatorBase* op) const {
+  if (dynamic_cast<const OperatorWithKernel*>(op) == nullptr) {
+    return false;
+  }
+  for (auto& attr : op->Attrs()) {
+    auto type = AttrTypeID(attr.second);
+    if (type == proto::AttrType::BLOCK || type == proto::AttrType::BLOCKS) {
+      return false;
+    }
+  }
+  for (auto* var_map : {&op->Inputs(), &op->Outputs()}) {
+    for (auto& it : *var_map) {
+      for (auto& name : it.second) {
+        if (name != kEmptyVarName && thread_scope_->FindVar(name) == nullptr) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+void BoxPSWorker::BuildOpRunPlan(void) {
+  op_plans_.clear();
+  op_plans_.resize(ops_.size());
+  size_t gc_var_num = 0;
+  size_t cache_op_num = 0;
+  for (size_t op_id = 0; op_id < ops_.size(); ++op_id) {
+    auto& plan = op_plans_[op_id];
+    plan.op = ops_[op_id].get();
+    plan.sync_point = (sync_points_.find(plan.op) != sync_points_.end());
+    // thread scope vars live across batches, the runtime context and kernel
+    // can be cached after the first run
+    if (FLAGS_padbox_enable_op_run_cache && CanCacheOpRun(plan.op)) {
+      plan.op->SetAttr(kEnableCacheRuntimeContext, true);
+      ++cache_op_num;
+    }
+    auto it = unused_vars_.find(plan.op);
+    if (it == unused_vars_.end()) {
+      continue;
+    }
+    for (auto& name : it->second) {
+      Variable* var = thread_scope_->FindVar(name);
+      if (var == nullptr) {
+        continue;
+      }
+      plan.gc_vars.push_back(var);
+      plan.gc_var_names.push_back(name);
+    }
+    gc_var_num += plan.gc_vars.size();
+  }
+  VLOG(3) << "device[" << device_id_ << "] build op run plan count="
+          << op_plans_.size() << ", gc vars count=" << gc_var_num
+          << ", sync points=" << sync_points_.size()
+          << ", cache op count=" << cache_op_num;
+}
 void BoxPSWorker::CreateThreadScopeForAsync(const ProgramDesc& program) {
   AllocParamTensorAsync(program);
 
@@ -1188,9 +1270,160 @@ void BoxPSWorker::CreateDeviceResource(const ProgramDesc& main_prog) {
     WriteToFile(filename, str_os.str());
   }
 }
+#ifdef PADDLE_WITH_GLOO
+template <typename T>
+static void GlooHalfSum(void* c, const void* a, const void* b, size_t n) {
+  T* out = reinterpret_cast<T*>(c);
+  const T* x = reinterpret_cast<const T*>(a);
+  const T* y = reinterpret_cast<const T*>(b);
+  for (size_t i = 0; i < n; ++i) {
+    out[i] =
+        static_cast<T>(static_cast<float>(x[i]) + static_cast<float>(y[i]));
+  }
+}
+/**
+ * @brief chunked ring all reduce by gloo, the communication of chunk N is
+ * overlapped with the scale (and compress/decompress) of chunk N-1/N+1,
+ * T is the payload type float, float16 or bfloat16
+ */
+template <typename T>
+static void GlooChunkAllReduce(GlooWrapper* gloo,
+                               float* data,
+                               const int64_t& numel,
+                               const int64_t& chunk_size,
+                               const float& scale,
+                               paddle::framework::ThreadPool* pool,
+                               T* buffer) {
+  const bool compress = !std::is_same<T, float>::value;
+  const int64_t chunk_num = (numel + chunk_size - 1) / chunk_size;
+  auto chunk_len = [&](int64_t i) {
+    return std::min(chunk_size, numel - i * chunk_size);
+  };
+  // compress chunk i into double buffer
+  auto pack = [&](int64_t i) {
+    if (!compress || i >= chunk_num) {
+      return;
+    }
+    const float* src = &data[i * chunk_size];
+    T* dst = &buffer[(i % 2) * chunk_size];
+    int64_t len = chunk_len(i);
+    for (int64_t k = 0; k < len; ++k) {
+      dst[k] = static_cast<T>(src[k]);
+    }
+  };
+  // decompress and average chunk i
+  auto unpack = [&](int64_t i) {
+    if (i < 0) {
+      return;
+    }
+    float* dst = &data[i * chunk_size];
+    int64_t len = chunk_len(i);
+    if (compress) {
+      const T* src = &buffer[(i % 2) * chunk_size];
+      for (int64_t k = 0; k < len; ++k) {
+        dst[k] = static_cast<float>(src[k]) * scale;
+      }
+    } else {
+      for (int64_t k = 0; k < len; ++k) {
+        dst[k] *= scale;
+      }
+    }
+  };
+  pack(0);
+  for (int64_t i = 0; i < chunk_num; ++i) {
+    auto wait = pool->Run([&unpack, &pack, i]() {
+      unpack(i - 1);
+      pack(i + 1);
+    });
+    int64_t len = chunk_len(i);
+    T* ptr = (compress) ? &buffer[(i % 2) * chunk_size]
+                        : reinterpret_cast<T*>(&data[i * chunk_size]);
+    // gloo allreduce is ring reduce-scatter + allgather
+    gloo::AllreduceOptions opts(gloo->GetContext());
+    opts.setInput(ptr, len);
+    opts.setOutput(ptr, len);
+    if (compress) {
+      opts.setReduceFunction(
+          static_cast<void (*)(void*, const void*, const void*, size_t)>(
+              &GlooHalfSum<T>));
+    } else {
+      opts.setReduceFunction(
+          static_cast<void (*)(void*, const void*, const void*, size_t)>(
+              &gloo::sum<T>));
+    }
+    gloo::allreduce(opts);
+    wait.get();
+  }
+  unpack(chunk_num - 1);
+}
+#endif
+void BoxPSWorker::SyncParamByGloo(void) {
+#ifdef PADDLE_WITH_GLOO
+  // cpu worker threads share one param buffer, only sync between nodes
+  auto gloo = GlooWrapper::GetInstance();
+  if (device_id_ != 0 || !gloo->IsInitialized() || gloo->Size() <= 1) {
+    return;
+  }
+  auto box_ptr = BoxWrapper::GetInstance();
+  box_ptr->DenseNcclTimer(device_id_, false, 0x03);
+  box_ptr->DenseNcclTimer(device_id_, true, 0x02);
+
+  int64_t numel = param_sync_.numel();
+  float* sendbuff = param_sync_.data<float>();
+  int64_t chunk_size = std::max(FLAGS_padbox_gloo_sync_chunk_size, 1);
+  chunk_size = std::min(numel, chunk_size);
+  const float scale = 1.0 / gloo->Size();
+  if (gloo_sync_pool_ == nullptr) {
+    gloo_sync_pool_.reset(new paddle::framework::ThreadPool(1));
+  }
+  const std::string& compress = FLAGS_padbox_gloo_sync_compress;
+  if (compress == "fp16" || compress == "bf16") {
+    gloo_sync_buffer_.resize(chunk_size * 2);
+  }
+  if (compress == "fp16") {
+    GlooChunkAllReduce<phi::dtype::float16>(
+        gloo.get(),
+        sendbuff,
+        numel,
+        chunk_size,
+        scale,
+        gloo_sync_pool_.get(),
+        reinterpret_cast<phi::dtype::float16*>(gloo_sync_buffer_.data()));
+  } else if (compress == "bf16") {
+    GlooChunkAllReduce<phi::dtype::bfloat16>(
+        gloo.get(),
+        sendbuff,
+        numel,
+        chunk_size,
+        scale,
+        gloo_sync_pool_.get(),
+        reinterpret_cast<phi::dtype::bfloat16*>(gloo_sync_buffer_.data()));
+  } else {
+    GlooChunkAllReduce<float>(gloo.get(),
+                              sendbuff,
+                              numel,
+                              chunk_size,
+                              scale,
+                              gloo_sync_pool_.get(),
+                              nullptr);
+  }
+  box_ptr->DenseNcclTimer(device_id_, true, 0x01);
+  VLOG(3) << "device[" << device_id_ << "] gloo sync param numel=" << numel
+          << ", chunk size=" << chunk_size << ", compress=" << compress
+          << ", nodes=" << gloo->Size();
+#else
+  LOG(WARNING) << "SyncParam does nothing on cpu when WITH_GLOO=OFF";
+#endif
+}
 void BoxPSWorker::SyncParam(void) {
-  if (param_sync_.numel() == 0 ||
-      sync_mode_ == DenseKStepNode && node_size_ == 1) {
+  if (param_sync_.numel() == 0) {
+    return;
+  }
+  if (platform::is_cpu_place(place_)) {
+    SyncParamByGloo();
+    return;
+  }
+  if (sync_mode_ == DenseKStepNode && node_size_ == 1) {
     return;
   }
 
@@ -1293,25 +1526,54 @@ void BoxPSWorker::TrainFiles() {
   if (FLAGS_padbox_enable_gc && max_memory_size >= 0 && !unused_vars_.empty()) {
     gc = CreateGarbageCollector(place_, max_memory_size);
   }
-  while ((batch_size = PackBatchTask()) > 0) {
+  // the cpu temporaries of a batch come from one arena, which is rewound
+  // when the batch scope is dropped
+  if (platform::is_cpu_place(place_) && FLAGS_padbox_batch_arena_chunk_mb > 0 &&
+      batch_arena_ == nullptr) {
+    size_t chunk_size = static_cast<size_t>(FLAGS_padbox_batch_arena_chunk_mb)
+                        << 20;
+    batch_arena_ = std::make_shared<memory::allocation::BatchArena>(
+        memory::allocation::AllocatorFacade::Instance().GetAllocator(place_),
+        place_,
+        chunk_size,
+        chunk_size / 4);
+  }
+  memory::allocation::BatchArena::Stat arena_stat;
+  int64_t batch_id = 0;
+  while (true) {
+    // the events of the batch are recorded when the batch is sampled
+    BoxTracer::BatchScope trace_batch(batch_id++);
+    platform::RecordEvent batch_event("BoxPSWorker::Batch",
+                                      platform::TracerEventType::ProfileStep,
+                                      BoxTracer::Level());
+    memory::allocation::BatchArenaGuard arena_guard(batch_arena_.get());
+    {
+      platform::RecordEvent record_event("BoxPSWorker::PackBatchTask",
+                                         platform::TracerEventType::Dataloader,
+                                         BoxTracer::Level());
+      batch_size = PackBatchTask();
+    }
+    if (batch_size <= 0) {
+      break;
+    }
     VLOG(2) << "[" << device_id_
             << "]begin running ops, batch size:" << batch_size
             << ", batch id=" << step;
     if (dense_table_) {
       dense_table_->PullDense(place_, &param_async_.tensor());
     }
-    for (auto& op : ops_) {
+    for (auto& plan : op_plans_) {
       if (FLAGS_padbox_enable_print_op_debug) {
         VLOG(0) << "thread id=" << thread_id_ << ", "
-                << op->DebugStringEx(thread_scope_);
+                << plan.op->DebugStringEx(thread_scope_);
       }
       // add stream sync
-      if (sync_points_.find(op.get()) != sync_points_.end()) {
+      if (plan.sync_point) {
         dev_ctx_->Wait();
       }
-      op->Run(*thread_scope_, place_);
-      if (gc) {
-        DeleteUnusedTensors(*thread_scope_, op.get(), unused_vars_, gc.get());
+      plan.op->Run(*thread_scope_, place_);
+      if (gc && !plan.gc_vars.empty()) {
+        DeleteUnusedTensors(plan.gc_vars, plan.gc_var_names, gc.get());
       }
     }
     if (dense_table_) {
@@ -1319,6 +1581,10 @@ void BoxPSWorker::TrainFiles() {
     } else if (sync_mode_ > 0) {
       if (step > param_sync_step_) {
         step = 0;
+        platform::RecordEvent record_event(
+            "BoxPSWorker::SyncParam",
+            platform::TracerEventType::Communication,
+            BoxTracer::Level());
         SyncParam();
       }
     }
@@ -1334,7 +1600,12 @@ void BoxPSWorker::TrainFiles() {
       }
     }
 #endif
-    AddAucMonitor(thread_scope_, place_);
+    {
+      platform::RecordEvent record_event("BoxPSWorker::AddAucMonitor",
+                                         platform::TracerEventType::UserDefined,
+                                         BoxTracer::Level());
+      AddAucMonitor(thread_scope_, place_);
+    }
 
     accum_num += batch_size;
     if (gc) {
@@ -1342,10 +1613,33 @@ void BoxPSWorker::TrainFiles() {
     } else {
       thread_scope_->DropKids();
     }
+    if (batch_arena_ != nullptr) {
+      auto stat = batch_arena_->Reset();
+      arena_stat.arena_allocs += stat.arena_allocs;
+      arena_stat.fallback_allocs += stat.fallback_allocs;
+      arena_stat.arena_bytes += stat.arena_bytes;
+      arena_stat.chunk_allocs += stat.chunk_allocs;
+    }
     ++step;
   }
+  if (batch_arena_ != nullptr && batch_id > 1) {
+    // the last batch id is the empty batch which ends the loop
+    int64_t batch_num = batch_id - 1;
+    VLOG(0) << "[" << device_id_ << "]batch arena, batch num: " << batch_num
+            << ", arena allocs per batch: "
+            << arena_stat.arena_allocs / batch_num
+            << ", fallback allocs per batch: "
+            << arena_stat.fallback_allocs / batch_num
+            << ", arena bytes per batch: " << arena_stat.arena_bytes / batch_num
+            << ", chunk allocs: " << arena_stat.chunk_allocs
+            << ", chunks: " << batch_arena_->chunk_num();
+  }
   // sync param step
   if (sync_mode_ > 0) {
+    platform::RecordEvent record_event(
+        "BoxPSWorker::SyncParam",
+        platform::TracerEventType::Communication,
+        BoxTracer::Level());
     SyncParam();
   }
   dev_ctx_->Wait();
@@ -1371,14 +1665,14 @@ void BoxPSWorker::TrainFilesWithProfiler() {
   platform::Timer dump_timer;
 
   std::vector<double> op_total_time;
+  // host time of the op Run call, before the device work is waited
+  std::vector<double> op_dispatch_time;
   std::vector<std::string> op_name;
-  for (auto& op : ops_) {
-    op_name.push_back(op->Type());
-  }
-  op_total_time.resize(ops_.size());
-  for (size_t i = 0; i < op_total_time.size(); ++i) {
-    op_total_time[i] = 0.0;
+  for (auto& plan : op_plans_) {
+    op_name.push_back(plan.op->Type());
   }
+  op_total_time.resize(op_plans_.size(), 0.0);
+  op_dispatch_time.resize(op_plans_.size(), 0.0);
   platform::Timer timeline;
   device_reader_->Start();
 
@@ -1404,16 +1698,19 @@ void BoxPSWorker::TrainFilesWithProfiler() {
             << ", batch id=" << step_cnt;
 
     cal_timer.Resume();
-    int op_id = 0;
     dev_ctx_->Wait();
-    for (auto& op : ops_) {
+    for (size_t op_id = 0; op_id < op_plans_.size(); ++op_id) {
+      auto& plan = op_plans_[op_id];
       timeline.Start();
-      op->Run(*thread_scope_, place_);
+      plan.op->Run(*thread_scope_, place_);
+      timeline.Pause();
+      op_dispatch_time[op_id] += timeline.ElapsedUS();
+      timeline.Resume();
       dev_ctx_->Wait();
       timeline.Pause();
-      op_total_time[op_id++] += timeline.ElapsedUS();
-      if (gc) {
-        DeleteUnusedTensors(*thread_scope_, op.get(), unused_vars_, gc.get());
+      op_total_time[op_id] += timeline.ElapsedUS();
+      if (gc && !plan.gc_vars.empty()) {
+        DeleteUnusedTensors(plan.gc_vars, plan.gc_var_names, gc.get());
       }
     }
     dev_ctx_->Wait();
@@ -1472,10 +1769,20 @@ void BoxPSWorker::TrainFilesWithProfiler() {
              << " main_time:" << main_timer.ElapsedUS()
              << " outer_time:" << outer_timer.ElapsedUS()
              << " dump_timer:" << dump_timer.ElapsedUS();
-  for (size_t i = 0; i < ops_.size(); ++i) {
+  double dispatch_sum = 0.0;
+  for (size_t i = 0; i < op_plans_.size(); ++i) {
     LOG(ERROR) << "card:" << device_id_ << ", op: " << op_name[i]
                << ", mean time: " << op_total_time[i] / accum_num
-               << "us, sum:" << op_total_time[i] / 1000000.0 << "sec";
+               << "us, sum:" << op_total_time[i] / 1000000.0 << "sec"
+               << ", mean dispatch: " << op_dispatch_time[i] / step_cnt
+               << "us";
+    dispatch_sum += op_dispatch_time[i];
+  }
+  if (step_cnt > 0 && !op_plans_.empty()) {
+    LOG(ERROR) << "card:" << device_id_
+               << ", op run cache: " << FLAGS_padbox_enable_op_run_cache
+               << ", per op dispatch: "
+               << dispatch_sum / step_cnt / op_plans_.size() << "us";
   }
   auto box_ptr = BoxWrapper::GetInstance();
   box_ptr->PrintSyncTimer(device_id_, outer_timer.ElapsedSec());
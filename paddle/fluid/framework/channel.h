@@ -30,6 +30,7 @@
 #include <utility>
 #include <vector>
 
+#include "paddle/fluid/framework/block_channel.h"
 #include "paddle/fluid/framework/expect.h"
 
 namespace paddle {
@@ -45,8 +46,28 @@ class ChannelObject {
     capacity_ = (std::min)(MaxCapacity(), capacity);
   }
 
-  const std::deque<T>& GetData() const { return data_; }
+  // a block channel hands the written values to the readers in blocks
+  // through a lock free ring instead of the locked deque, see
+  // BlockChannelCore. It does not support GetData.
+  ChannelObject(size_t capacity, bool block) : ChannelObject(capacity) {
+    if (block) {
+      core_.reset(new BlockChannelCore<T>());
+      core_->SetCapacity(capacity_);
+      core_->SetBlockSize(block_size_);
+    }
+  }
+
+  bool IsBlockChannel() const { return core_ != nullptr; }
+
+  const std::deque<T>& GetData() const {
+    CHECK(core_ == nullptr) << "GetData is not supported by block channel";
+    return data_;
+  }
   void Clear() {
+    if (core_ != nullptr) {
+      core_->Clear();
+      return;
+    }
     std::unique_lock<std::mutex> lock(mutex_);
     data_.clear();
     data_.shrink_to_fit();
@@ -57,6 +78,11 @@ class ChannelObject {
   }
 
   void SetCapacity(size_t x) {  // capacity can be zero
+    if (core_ != nullptr) {
+      capacity_ = std::min(MaxCapacity(), x);
+      core_->SetCapacity(capacity_);
+      return;
+    }
     std::lock_guard<std::mutex> lock(mutex_);
     capacity_ = std::min(MaxCapacity(), x);
     Notify();
@@ -70,6 +96,9 @@ class ChannelObject {
     CHECK(x >= 1) << "block size must be >= 1";
     std::lock_guard<std::mutex> lock(mutex_);
     block_size_ = x;
+    if (core_ != nullptr) {
+      core_->SetBlockSize(x);
+    }
   }
 
   template <class U>
@@ -77,14 +106,25 @@ class ChannelObject {
     std::lock_guard<std::mutex> lock(mutex_);
     capacity_ = other->Capacity();
     block_size_ = other->BlockSize();
+    if (core_ != nullptr) {
+      core_->SetCapacity(capacity_);
+      core_->SetBlockSize(block_size_);
+    }
   }
 
   bool Closed() {
+    if (core_ != nullptr) {
+      return core_->Closed();
+    }
     return closed_;  // atomic
   }
 
   // open channel, then data can be write() to channel
   void Open() {
+    if (core_ != nullptr) {
+      core_->Open();
+      return;
+    }
     std::lock_guard<std::mutex> lock(mutex_);
     closed_ = false;
     Notify();
@@ -92,17 +132,27 @@ class ChannelObject {
 
   // close channel, then no more data can be write() to channel
   void Close() {
+    if (core_ != nullptr) {
+      core_->Close();
+      return;
+    }
     std::lock_guard<std::mutex> lock(mutex_);
     closed_ = true;
     Notify();
   }
 
   size_t Size() {
+    if (core_ != nullptr) {
+      return core_->Size();
+    }
     std::lock_guard<std::mutex> lock(mutex_);
     return data_.size();
   }
 
   bool Empty() {
+    if (core_ != nullptr) {
+      return core_->Size() == 0;
+    }
     std::lock_guard<std::mutex> lock(mutex_);
     return EmptyUnlocked();
   }
@@ -116,6 +166,9 @@ class ChannelObject {
     if (n == 0) {
       return 0;
     }
+    if (core_ != nullptr) {
+      return core_->Read(n, p, false);
+    }
 
     std::unique_lock<std::mutex> lock(mutex_);
     size_t finished = Read(n, p, lock);
@@ -135,6 +188,9 @@ class ChannelObject {
     if (n == 0) {
       return 0;
     }
+    if (core_ != nullptr) {
+      return core_->Write(n, p);
+    }
     std::unique_lock<std::mutex> lock(mutex_);
     size_t finished = Write(n, p, lock);
     Notify();
@@ -146,6 +202,9 @@ class ChannelObject {
     if (n == 0) {
       return 0;
     }
+    if (core_ != nullptr) {
+      return core_->WriteMove(n, p);
+    }
     std::unique_lock<std::mutex> lock(mutex_);
     size_t finished = WriteMove(n, p, lock);
     Notify();
@@ -164,6 +223,12 @@ class ChannelObject {
     if (size == 0) {
       return 0;
     }
+    if (core_ != nullptr) {
+      p.resize(size);
+      size_t finished = core_->Read(size, &p[0], true);
+      p.resize(finished);
+      return finished;
+    }
     std::unique_lock<std::mutex> lock(mutex_);
     p.resize(size);
     size_t finished = Read(size, &p[0], lock, true);
@@ -205,6 +270,7 @@ class ChannelObject {
   int full_waiters_ = 0;
   std::condition_variable empty_cond_;
   std::condition_variable full_cond_;
+  std::unique_ptr<BlockChannelCore<T>> core_;
 
   static constexpr size_t MaxCapacity() {
     return (std::numeric_limits<size_t>::max)() / 2;
@@ -314,10 +380,17 @@ Channel<T> MakeChannel(size_t capacity = (std::numeric_limits<size_t>::max)()) {
   return std::make_shared<ChannelObject<T>>(capacity);
 }
 
+template <class T>
+Channel<T> MakeBlockChannel(
+    size_t capacity = (std::numeric_limits<size_t>::max)()) {
+  return std::make_shared<ChannelObject<T>>(capacity, true);
+}
+
 template <class T, class U>
 Channel<T> MakeChannel(const Channel<U>& other) {
   CHECK(other != nullptr) << "channel can not be NULL";
-  Channel<T> chan = std::make_shared<ChannelObject<T>>();
+  Channel<T> chan = std::make_shared<ChannelObject<T>>(
+      (std::numeric_limits<size_t>::max)(), other->IsBlockChannel());
   chan->InheritFrom(other);
   return chan;
 }
@@ -0,0 +1,179 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/channel.h"
+
+#include <chrono>  // NOLINT
+#include <thread>  // NOLINT
+
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace framework {
+
+static Channel<int64_t> NewChannel(bool block, size_t capacity) {
+  return block ? MakeBlockChannel<int64_t>(capacity)
+               : MakeChannel<int64_t>(capacity);
+}
+
+class ChannelTest : public ::testing::TestWithParam<bool> {};
+
+TEST_P(ChannelTest, Order) {
+  auto chan = NewChannel(GetParam(), 1000000);
+  chan->SetBlockSize(7);
+  std::vector<int64_t> data(100);
+  for (int64_t i = 0; i < 100; ++i) {
+    data[i] = i;
+  }
+  EXPECT_EQ(chan->Write(data), 100UL);
+  EXPECT_EQ(chan->Size(), 100UL);
+  int64_t value = -1;
+  ASSERT_TRUE(chan->Get(value));
+  EXPECT_EQ(value, 0);
+  std::vector<int64_t> out;
+  EXPECT_EQ(chan->ReadOnce(out, 3), 3UL);
+  EXPECT_EQ(out, std::vector<int64_t>({1, 2, 3}));
+  chan->Close();
+  EXPECT_EQ(chan->Write(data), 0UL);
+  EXPECT_EQ(chan->ReadAll(out), 96UL);
+  for (int64_t i = 0; i < 96; ++i) {
+    ASSERT_EQ(out[i], i + 4);
+  }
+  EXPECT_EQ(chan->Read(out), 0UL);
+  EXPECT_TRUE(chan->Empty());
+
+  chan->Open();
+  EXPECT_EQ(chan->Write(data), 100UL);
+  chan->Clear();
+  EXPECT_EQ(chan->Size(), 0UL);
+}
+
+TEST_P(ChannelTest, Capacity) {
+  auto chan = NewChannel(GetParam(), 0);
+  chan->SetBlockSize(4);
+  // a channel of zero capacity passes the values to the waiting readers
+  std::thread writer([chan]() {
+    std::vector<int64_t> data(1000);
+    for (int64_t i = 0; i < 1000; ++i) {
+      data[i] = i;
+    }
+    EXPECT_EQ(chan->Write(data), 1000UL);
+    chan->Close();
+  });
+  std::vector<int64_t> out;
+  int64_t expect = 0;
+  while (chan->Read(out) > 0) {
+    EXPECT_LE(out.size(), 4UL);
+    for (auto value : out) {
+      ASSERT_EQ(value, expect++);
+    }
+  }
+  writer.join();
+  EXPECT_EQ(expect, 1000);
+
+  auto inherit = MakeChannel<int>(chan);
+  EXPECT_EQ(inherit->IsBlockChannel(), GetParam());
+  EXPECT_EQ(inherit->BlockSize(), 4UL);
+}
+
+// every producer writes its own range of values, the consumers read them
+// all exactly once
+static double RunProducersConsumers(bool block,
+                                    int producer_num,
+                                    int consumer_num,
+                                    int64_t values_per_producer,
+                                    size_t capacity,
+                                    bool check) {
+  auto chan = NewChannel(block, capacity);
+  chan->SetBlockSize(64);
+  std::vector<std::vector<int64_t>> read(consumer_num);
+  std::atomic<int> running{producer_num};
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producer_num; ++p) {
+    threads.emplace_back([&, p]() {
+      ChannelWriter<int64_t> writer(chan.get());
+      for (int64_t i = 0; i < values_per_producer; ++i) {
+        writer << p * values_per_producer + i;
+      }
+      writer.Flush();
+      if (--running == 0) {
+        chan->Close();
+      }
+    });
+  }
+  for (int c = 0; c < consumer_num; ++c) {
+    threads.emplace_back([&, c]() {
+      std::vector<int64_t> out;
+      while (chan->Read(out) > 0) {
+        if (check) {
+          read[c].insert(read[c].end(), out.begin(), out.end());
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  if (check) {
+    std::vector<int> seen(producer_num * values_per_producer, 0);
+    for (auto& values : read) {
+      // the values of one producer keep their order for a single consumer
+      std::vector<int64_t> last(producer_num, -1);
+      for (auto value : values) {
+        ++seen[value];
+        if (consumer_num == 1) {
+          EXPECT_GT(value, last[value / values_per_producer]);
+        }
+        last[value / values_per_producer] = value;
+      }
+    }
+    for (auto count : seen) {
+      EXPECT_EQ(count, 1);
+    }
+  }
+  return seconds;
+}
+
+TEST_P(ChannelTest, ProducersConsumers) {
+  RunProducersConsumers(GetParam(), 8, 8, 100000, 1000000000, true);
+  // a small capacity makes the writers wait for the readers
+  RunProducersConsumers(GetParam(), 8, 3, 100000, 1000, true);
+  // more blocks than the ring holds spill
+  RunProducersConsumers(GetParam(), 4, 1, 500000, 1000000000, true);
+  RunProducersConsumers(GetParam(), 4, 1, 100000, 100, true);
+}
+
+INSTANTIATE_TEST_SUITE_P(Channel,
+                         ChannelTest,
+                         ::testing::Values(false, true));
+
+TEST(ChannelBenchmark, Contention) {
+  const int64_t total = 1 << 22;
+  for (int threads : {1, 4, 16, 64, 128}) {
+    double lock_sec = RunProducersConsumers(
+        false, threads, threads, total / threads, 1 << 20, false);
+    double block_sec = RunProducersConsumers(
+        true, threads, threads, total / threads, 1 << 20, false);
+    LOG(INFO) << threads << " producers and " << threads
+              << " consumers, deque channel " << lock_sec
+              << "s, block channel " << block_sec << "s";
+  }
+}
+
+}  // namespace framework
+}  // namespace paddle
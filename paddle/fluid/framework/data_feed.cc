@@ -36,6 +36,7 @@ limitations under the License. */
 
 USE_INT_STAT(STAT_total_feasign_num_in_mem);
 DECLARE_bool(enable_ins_parser_file);
+DECLARE_int32(padbox_archive_slotrecord_encoding);
 #ifdef PADDLE_WITH_BOX_PS
 #include <dlfcn.h>
 extern "C" {
@@ -2848,7 +2849,7 @@ bool BinaryArchiveWriter::write(const SlotRecord& rec) {
   thread_local BinaryArchive ar;
   mutex_.lock();
   ar.SetWriteBuffer(&buff_[woffset_], capacity_ - woffset_, nullptr);
-  ar << rec;
+  WriteSlotRecord(ar, rec, FLAGS_padbox_archive_slotrecord_encoding);
   woffset_ += ar.Length();
   if (woffset_ < MAX_FILE_BUFF) {
     mutex_.unlock();
@@ -3087,6 +3088,13 @@ void SlotPaddleBoxDataFeed::Init(const DataFeedDesc& data_feed_desc) {
   pipe_command_ = data_feed_desc.pipe_command();
   finish_init_ = true;
   input_type_ = data_feed_desc.input_type();
+#if !(defined(PADDLE_WITH_CUDA) && defined(_LINUX))
+  if (FLAGS_padbox_slotfeed_fill_thread_num > 0 && slot_fill_pool_ == nullptr) {
+    slot_fill_pool_.reset(
+        new ThreadPool(FLAGS_padbox_slotfeed_fill_thread_num));
+  }
+  next_layout_.offsets.resize(use_slot_size_);
+#endif
 
   rank_offset_name_ = data_feed_desc.rank_offset();
   ads_offset_name_ = data_feed_desc.ads_offset();
@@ -3151,6 +3159,11 @@ bool SlotPaddleBoxDataFeed::Start() {
 #if defined(PADDLE_WITH_CUDA) && defined(_LINUX)
   CHECK(paddle::platform::is_gpu_place(this->place_));
   pack_ = BatchGpuPackMgr().get(this->GetPlace(), used_slots_info_);
+#else
+  if (next_layout_future_.valid()) {
+    next_layout_future_.get();
+  }
+  next_layout_.recs = nullptr;
 #endif
   return true;
 }
@@ -3177,6 +3190,7 @@ int SlotPaddleBoxDataFeed::Next() {
     this->batch_size_ = batch.second;
     batch_timer_.Resume();
     PutToFeedSlotVec(&records_[batch.first], this->batch_size_);
+    PrepareNextSlotBatch();
 #if defined(PADDLE_WITH_CUDA) && defined(_LINUX)
     // update set join q value
     if (FLAGS_padbox_slotrecord_extend_dim > 0) {
@@ -3219,6 +3233,7 @@ void SlotPaddleBoxDataFeed::AssignFeedVar(const Scope& scope) {
 void SlotPaddleBoxDataFeed::PutToFeedPvVec(const SlotPvInstance* pvs, int num) {
 #if defined(PADDLE_WITH_CUDA) && defined(_LINUX)
   paddle::platform::SetDeviceId(place_.GetDeviceId());
+  pack_->set_slot_overlay(GetSlotReplaceOverlay());
   pack_->pack_pvinstance(pvs, num);
   int ins_num = pack_->ins_num();
   int pv_num = pack_->pv_num();
@@ -3302,91 +3317,257 @@ void SlotPaddleBoxDataFeed::ExpandSlotRecord(SlotRecord* rec) {
   CHECK(float_total_dims_size_ == static_cast<size_t>(offset));
 }
 
+const SlotReplaceOverlay* SlotPaddleBoxDataFeed::GetSlotReplaceOverlay(
+    void) const {
+  return BoxWrapper::GetInstance()->GetSlotReplaceOverlay();
+}
+
 void SlotPaddleBoxDataFeed::PutToFeedSlotVec(const SlotRecord* ins_vec,
                                              int num) {
 #if defined(PADDLE_WITH_CUDA) && defined(_LINUX)
   paddle::platform::SetDeviceId(place_.GetDeviceId());
+  pack_->set_slot_overlay(GetSlotReplaceOverlay());
   pack_->pack_instance(ins_vec, num);
   BuildSlotBatchGPU(pack_->ins_num());
 #else
+  // wait the count ahead before the overlay is switched
+  if (next_layout_future_.valid()) {
+    next_layout_future_.get();
+  }
+  slot_overlay_ = GetSlotReplaceOverlay();
   batch_ins_num_ = num;
   ins_record_ptr_ = ins_vec;
-  for (int j = 0; j < use_slot_size_; ++j) {
-    auto& feed = feed_vec_[j];
-    if (feed == nullptr) {
-      continue;
+  // use the lod offsets counted ahead when they belong to this batch
+  bool prepared = (next_layout_.recs == ins_vec && next_layout_.num == num &&
+                   next_layout_.overlay == slot_overlay_);
+  next_layout_.recs = nullptr;
+  auto fill_func = [this, ins_vec, num, prepared](int j) {
+    if (feed_vec_[j] == nullptr) {
+      return;
     }
-
     auto& slot_offset = offset_[j];
-    slot_offset.clear();
-    slot_offset.reserve(num + 1);
-    slot_offset.push_back(0);
-
-    int total_instance = 0;
-    auto& info = used_slots_info_[j];
-    // fill slot value with default value 0
-    if (info.type[0] == 'f') {  // float
-      auto& batch_fea = batch_float_feasigns_[j];
-      batch_fea.clear();
+    if (prepared) {
+      slot_offset.swap(next_layout_.offsets[j]);
+    } else {
+      CountSlotOffsets(j, ins_vec, num, slot_overlay_, &slot_offset);
+    }
+    FillSlotTensor(j, ins_vec, num, &slot_offset);
+  };
+  if (slot_fill_pool_ == nullptr || use_slot_size_ <= 1) {
+    for (int j = 0; j < use_slot_size_; ++j) {
+      fill_func(j);
+    }
+    return;
+  }
+  // slots are taken dynamically, the reader thread works as one of the
+  // fill threads
+  std::atomic<int> counter(0);
+  auto worker = [this, &counter, &fill_func](void) {
+    int j = counter++;
+    while (j < use_slot_size_) {
+      fill_func(j);
+      j = counter++;
+    }
+  };
+  int thread_num =
+      std::min(slot_fill_pool_->GetThreadNum(), use_slot_size_ - 1);
+  std::vector<std::future<void>> wait_futures;
+  wait_futures.reserve(thread_num);
+  for (int i = 0; i < thread_num; ++i) {
+    wait_futures.emplace_back(slot_fill_pool_->Run(worker));
+  }
+  worker();
+  for (auto& f : wait_futures) {
+    f.get();
+  }
+#endif
+}
 
-      for (int i = 0; i < num; ++i) {
-        auto r = ins_vec[i];
-        size_t fea_num = 0;
-        float* slot_values =
-            r->slot_float_feasigns_.get_values(info.slot_value_idx, &fea_num);
-        batch_fea.resize(total_instance + fea_num);
-        memcpy(&batch_fea[total_instance], slot_values,
-               sizeof(float) * fea_num);
-        total_instance += fea_num;
-        slot_offset.push_back(total_instance);
+void SlotPaddleBoxDataFeed::PrepareNextSlotBatch(void) {
+#if !(defined(PADDLE_WITH_CUDA) && defined(_LINUX))
+  if (slot_fill_pool_ == nullptr || next_layout_future_.valid() ||
+      offset_index_ >= static_cast<int>(batch_offsets_.size())) {
+    return;
+  }
+  auto& batch = batch_offsets_[offset_index_];
+  next_layout_.recs = &records_[batch.first];
+  next_layout_.num = batch.second;
+  next_layout_.overlay = GetSlotReplaceOverlay();
+  next_layout_future_ = slot_fill_pool_->Run([this](void) {
+    for (int j = 0; j < use_slot_size_; ++j) {
+      if (feed_vec_[j] == nullptr) {
+        continue;
       }
+      CountSlotOffsets(j,
+                       next_layout_.recs,
+                       next_layout_.num,
+                       next_layout_.overlay,
+                       &next_layout_.offsets[j]);
+    }
+  });
+#endif
+}
 
-      float* feasign = batch_fea.data();
-      float* tensor_ptr =
-          feed->mutable_data<float>({total_instance, 1}, this->place_);
-      if (total_instance > 0) {
-        CopyToFeedTensor(tensor_ptr, feasign, total_instance * sizeof(float));
-      }
-    } else if (info.type[0] == 'u') {  // uint64
-      auto& batch_fea = batch_uint64_feasigns_[j];
-      batch_fea.clear();
+#if !(defined(PADDLE_WITH_CUDA) && defined(_LINUX))
+template <typename T>
+static void CountSlotValueOffsets(const SlotRecord* recs,
+                                  int num,
+                                  int slot_value_idx,
+                                  SlotValues<T> SlotRecordObject::*values,
+                                  size_t* offsets) {
+  offsets[0] = 0;
+  for (int i = 0; i < num; ++i) {
+    const uint32_t* slot_offsets = (recs[i]->*values).slot_offsets.data();
+    offsets[i + 1] = offsets[i] + slot_offsets[slot_value_idx + 1] -
+                     slot_offsets[slot_value_idx];
+  }
+}
 
-      for (int i = 0; i < num; ++i) {
-        auto r = ins_vec[i];
-        size_t fea_num = 0;
-        uint64_t* slot_values =
-            r->slot_uint64_feasigns_.get_values(info.slot_value_idx, &fea_num);
-        if (fea_num > 0) {
-          batch_fea.resize(total_instance + fea_num);
-          memcpy(&batch_fea[total_instance], slot_values,
-                 sizeof(uint64_t) * fea_num);
-          total_instance += fea_num;
-        }
-        slot_offset.push_back(total_instance);
-      }
+static void CountOverlayValueOffsets(const SlotRecord* recs,
+                                     int num,
+                                     const SlotReplaceOverlay& overlay,
+                                     int pos,
+                                     size_t* offsets) {
+  offsets[0] = 0;
+  for (int i = 0; i < num; ++i) {
+    offsets[i + 1] = offsets[i] + overlay.Values(recs[i], pos).size();
+  }
+}
 
-      // no uint64_t type in paddlepaddle
-      uint64_t* feasign = batch_fea.data();
-      int64_t* tensor_ptr =
-          feed->mutable_data<int64_t>({total_instance, 1}, this->place_);
-      if (total_instance > 0) {
-        CopyToFeedTensor(tensor_ptr, feasign, total_instance * sizeof(int64_t));
-      }
+static void GatherOverlayValues(const SlotRecord* recs,
+                                int num,
+                                const SlotReplaceOverlay& overlay,
+                                int pos,
+                                const size_t* offsets,
+                                void* dst) {
+  uint64_t* out = reinterpret_cast<uint64_t*>(dst);
+  for (int i = 0; i < num; ++i) {
+    const auto& values = overlay.Values(recs[i], pos);
+    if (values.empty()) {
+      continue;
     }
+    memcpy(&out[offsets[i]], values.data(), sizeof(uint64_t) * values.size());
+  }
+}
 
-    if (info.dense) {
-      if (info.inductive_shape_index != -1) {
-        info.local_shape[info.inductive_shape_index] =
-            total_instance / info.total_dims_without_inductive;
-      }
-      feed->Resize(phi::make_ddim(info.local_shape));
+template <typename T>
+static void GatherSlotValues(const SlotRecord* recs,
+                             int num,
+                             int slot_value_idx,
+                             SlotValues<T> SlotRecordObject::*values,
+                             const size_t* offsets,
+                             void* dst) {
+  T* out = reinterpret_cast<T*>(dst);
+  for (int i = 0; i < num; ++i) {
+    size_t fea_num = offsets[i + 1] - offsets[i];
+    if (fea_num == 0) {
+      continue;
+    }
+    const auto& slot = recs[i]->*values;
+    memcpy(&out[offsets[i]],
+           &slot.slot_values[slot.slot_offsets[slot_value_idx]],
+           sizeof(T) * fea_num);
+  }
+}
+
+void SlotPaddleBoxDataFeed::CountSlotOffsets(int slot_idx,
+                                             const SlotRecord* recs,
+                                             int num,
+                                             const SlotReplaceOverlay* overlay,
+                                             std::vector<size_t>* offsets) {
+  auto& info = used_slots_info_[slot_idx];
+  offsets->resize(num + 1);
+  if (info.type[0] == 'f') {  // float
+    CountSlotValueOffsets(recs,
+                          num,
+                          info.slot_value_idx,
+                          &SlotRecordObject::slot_float_feasigns_,
+                          offsets->data());
+  } else if (info.type[0] == 'u') {  // uint64
+    int pos =
+        (overlay == nullptr) ? -1 : overlay->SlotPos(info.slot_value_idx);
+    if (pos >= 0) {
+      CountOverlayValueOffsets(recs, num, *overlay, pos, offsets->data());
     } else {
-      LoD data_lod{slot_offset};
-      feed_vec_[j]->set_lod(data_lod);
+      CountSlotValueOffsets(recs,
+                            num,
+                            info.slot_value_idx,
+                            &SlotRecordObject::slot_uint64_feasigns_,
+                            offsets->data());
     }
+  } else {
+    offsets->assign(num + 1, 0);
+  }
+}
+
+void SlotPaddleBoxDataFeed::FillSlotTensor(int slot_idx,
+                                           const SlotRecord* recs,
+                                           int num,
+                                           std::vector<size_t>* offsets) {
+  auto& feed = feed_vec_[slot_idx];
+  auto& info = used_slots_info_[slot_idx];
+  const size_t* slot_offset = offsets->data();
+  int total_instance = static_cast<int>(slot_offset[num]);
+  // on cpu the feasigns are written into the tensor without staging
+  bool direct = platform::is_cpu_place(this->place_);
+  if (info.type[0] == 'f') {  // float
+    float* tensor_ptr =
+        feed->mutable_data<float>({total_instance, 1}, this->place_);
+    float* dst = tensor_ptr;
+    if (!direct) {
+      batch_float_feasigns_[slot_idx].resize(total_instance);
+      dst = batch_float_feasigns_[slot_idx].data();
+    }
+    GatherSlotValues(recs,
+                     num,
+                     info.slot_value_idx,
+                     &SlotRecordObject::slot_float_feasigns_,
+                     slot_offset,
+                     dst);
+    if (!direct && total_instance > 0) {
+      CopyToFeedTensor(tensor_ptr, dst, total_instance * sizeof(float));
+    }
+  } else if (info.type[0] == 'u') {  // uint64
+    // no uint64_t type in paddlepaddle
+    int64_t* tensor_ptr =
+        feed->mutable_data<int64_t>({total_instance, 1}, this->place_);
+    void* dst = tensor_ptr;
+    if (!direct) {
+      batch_uint64_feasigns_[slot_idx].resize(total_instance);
+      dst = batch_uint64_feasigns_[slot_idx].data();
+    }
+    int pos = (slot_overlay_ == nullptr)
+                  ? -1
+                  : slot_overlay_->SlotPos(info.slot_value_idx);
+    if (pos >= 0) {
+      GatherOverlayValues(recs, num, *slot_overlay_, pos, slot_offset, dst);
+    } else {
+      GatherSlotValues(recs,
+                       num,
+                       info.slot_value_idx,
+                       &SlotRecordObject::slot_uint64_feasigns_,
+                       slot_offset,
+                       dst);
+    }
+    if (!direct && total_instance > 0) {
+      CopyToFeedTensor(tensor_ptr, dst, total_instance * sizeof(int64_t));
+    }
+  }
+
+  if (info.dense) {
+    if (info.inductive_shape_index != -1) {
+      info.local_shape[info.inductive_shape_index] =
+          total_instance / info.total_dims_without_inductive;
+    }
+    feed->Resize(phi::make_ddim(info.local_shape));
+  } else {
+    // hand the offsets to the tensor, the old lod buffer is reused next batch
+    auto* lod = feed->mutable_lod();
+    lod->resize(1);
+    (*lod)[0].swap(*offsets);
   }
-#endif
 }
+#endif
 
 // template<typename T>
 // void print_vector_data(const std::string &name, const T *values, int size) {
@@ -4717,6 +4898,35 @@ void MiniBatchGpuPack::pack_pvinstance(const SlotPvInstance* pv_ins, int num) {
   pack_instance(&ins_vec_[0], ins_number);
 }
 
+size_t MiniBatchGpuPack::uint64_value_num(SlotRecord r) const {
+#ifdef PADDLE_WITH_BOX_PS
+  if (slot_overlay_ != nullptr) {
+    return slot_overlay_->ValueNum(r);
+  }
+#endif
+  return r->slot_uint64_feasigns_.slot_values.size();
+}
+
+size_t MiniBatchGpuPack::copy_uint64_values(SlotRecord r,
+                                            uint64_t* keys,
+                                            int* offsets) const {
+#ifdef PADDLE_WITH_BOX_PS
+  if (slot_overlay_ != nullptr) {
+    slot_overlay_->CopyValues(r, keys, offsets);
+    return offsets[used_uint64_num_];
+  }
+#endif
+  auto& uint64_feasigns = r->slot_uint64_feasigns_;
+  size_t fea_num = uint64_feasigns.slot_values.size();
+  if (fea_num > 0) {
+    memcpy(keys, uint64_feasigns.slot_values.data(),
+           fea_num * sizeof(uint64_t));
+  }
+  memcpy(offsets, uint64_feasigns.slot_offsets.data(),
+         sizeof(int) * (used_uint64_num_ + 1));
+  return fea_num;
+}
+
 void MiniBatchGpuPack::pack_all_data(const SlotRecord* ins_vec, int num) {
   int uint64_total_num = 0;
   int float_total_num = 0;
@@ -4729,7 +4939,7 @@ void MiniBatchGpuPack::pack_all_data(const SlotRecord* ins_vec, int num) {
   if (enable_pv_) {
     for (int i = 0; i < num; ++i) {
       auto r = ins_vec[i];
-      uint64_total_num += r->slot_uint64_feasigns_.slot_values.size();
+      uint64_total_num += uint64_value_num(r);
       buf_.h_uint64_lens[i + 1] = uint64_total_num;
       float_total_num += r->slot_float_feasigns_.slot_values.size();
       buf_.h_float_lens[i + 1] = float_total_num;
@@ -4740,7 +4950,7 @@ void MiniBatchGpuPack::pack_all_data(const SlotRecord* ins_vec, int num) {
   } else {
     for (int i = 0; i < num; ++i) {
       auto r = ins_vec[i];
-      uint64_total_num += r->slot_uint64_feasigns_.slot_values.size();
+      uint64_total_num += uint64_value_num(r);
       buf_.h_uint64_lens[i + 1] = uint64_total_num;
       float_total_num += r->slot_float_feasigns_.slot_values.size();
       buf_.h_float_lens[i + 1] = float_total_num;
@@ -4760,18 +4970,11 @@ void MiniBatchGpuPack::pack_all_data(const SlotRecord* ins_vec, int num) {
   float_total_num = 0;
   for (int i = 0; i < num; ++i) {
     auto r = ins_vec[i];
-    auto& uint64_feasigns = r->slot_uint64_feasigns_;
-    fea_num = uint64_feasigns.slot_values.size();
-    if (fea_num > 0) {
-      memcpy(&buf_.h_uint64_keys[uint64_total_num],
-             uint64_feasigns.slot_values.data(), fea_num * sizeof(uint64_t));
-
-    }
-    uint64_total_num += fea_num;
-    // copy uint64 offset
-    memcpy(&buf_.h_uint64_offset[i * uint64_cols],
-           uint64_feasigns.slot_offsets.data(), sizeof(int) * uint64_cols);
-
+    // copy uint64 values and offset
+    uint64_total_num +=
+        copy_uint64_values(r,
+                           buf_.h_uint64_keys.data() + uint64_total_num,
+                           &buf_.h_uint64_offset[i * uint64_cols]);
 
     auto& float_feasigns = r->slot_float_feasigns_;
     fea_num = float_feasigns.slot_values.size();
@@ -4804,7 +5007,7 @@ void MiniBatchGpuPack::pack_uint64_data(const SlotRecord* ins_vec, int num) {
   if (enable_pv_) {
     for (int i = 0; i < num; ++i) {
       auto r = ins_vec[i];
-      uint64_total_num += r->slot_uint64_feasigns_.slot_values.size();
+      uint64_total_num += uint64_value_num(r);
       buf_.h_uint64_lens[i + 1] = uint64_total_num;
 
       buf_.h_rank[i] = r->rank;
@@ -4813,7 +5016,7 @@ void MiniBatchGpuPack::pack_uint64_data(const SlotRecord* ins_vec, int num) {
   } else {
     for (int i = 0; i < num; ++i) {
       auto r = ins_vec[i];
-      uint64_total_num += r->slot_uint64_feasigns_.slot_values.size();
+      uint64_total_num += uint64_value_num(r);
       buf_.h_uint64_lens[i + 1] = uint64_total_num;
     }
   }
@@ -4822,22 +5025,14 @@ void MiniBatchGpuPack::pack_uint64_data(const SlotRecord* ins_vec, int num) {
   buf_.h_uint64_offset.resize(uint64_cols * num);
   buf_.h_uint64_keys.resize(uint64_total_num);
 
-  size_t fea_num = 0;
   uint64_total_num = 0;
   for (int i = 0; i < num; ++i) {
     auto r = ins_vec[i];
-    auto& uint64_feasigns = r->slot_uint64_feasigns_;
-    fea_num = uint64_feasigns.slot_values.size();
-    if (fea_num > 0) {
-      memcpy(&buf_.h_uint64_keys[uint64_total_num],
-             uint64_feasigns.slot_values.data(), fea_num * sizeof(uint64_t));
-
-    }
-    uint64_total_num += fea_num;
-    // copy uint64 offset
-    memcpy(&buf_.h_uint64_offset[i * uint64_cols],
-           uint64_feasigns.slot_offsets.data(), sizeof(int) * uint64_cols);
-
+    // copy uint64 values and offset
+    uint64_total_num +=
+        copy_uint64_values(r,
+                           buf_.h_uint64_keys.data() + uint64_total_num,
+                           &buf_.h_uint64_offset[i * uint64_cols]);
   }
   CHECK(uint64_total_num == static_cast<int>(buf_.h_uint64_lens.back()))
       << "uint64 value length error";
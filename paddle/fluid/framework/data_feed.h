@@ -40,6 +40,7 @@ limitations under the License. */
 #include "paddle/fluid/framework/lod_tensor.h"
 #include "paddle/fluid/framework/reader.h"
 #include "paddle/fluid/framework/variable.h"
+#include "paddle/fluid/platform/float16.h"
 #include "paddle/fluid/platform/timer.h"
 #include "paddle/fluid/string/string_helper.h"
 #if defined(PADDLE_WITH_CUDA)
@@ -53,6 +54,7 @@ DECLARE_int32(record_pool_max_size);
 DECLARE_int32(slotpool_thread_num);
 DECLARE_int32(padbox_record_pool_max_size);
 DECLARE_int32(padbox_slotpool_thread_num);
+DECLARE_int32(padbox_slotfeed_fill_thread_num);
 DECLARE_int32(padbox_slotrecord_extend_dim);
 DECLARE_bool(padbox_auc_runner_mode);
 DECLARE_bool(enable_slotpool_wait_release);
@@ -516,6 +518,7 @@ struct BatchGPUValue {
   Tensor d_ad_offset;
 };
 
+class SlotReplaceOverlay;
 class MiniBatchGpuPack {
  public:
   MiniBatchGpuPack(const paddle::platform::Place& place,
@@ -578,12 +581,19 @@ class MiniBatchGpuPack {
   void store_qvalue(const std::vector<Tensor>& qvalue);
   // pack pcoc q to gpu
   void pack_qvalue(void);
+  // the auc runner slots replaced while packing, nullptr for none
+  void set_slot_overlay(const SlotReplaceOverlay* overlay) {
+    slot_overlay_ = overlay;
+  }
 
  private:
   void transfer_to_gpu(void);
   void pack_all_data(const SlotRecord* ins_vec, int num);
   void pack_uint64_data(const SlotRecord* ins_vec, int num);
   void pack_float_data(const SlotRecord* ins_vec, int num);
+  // the uint64 feasigns of a record with the replaced slots of the overlay
+  size_t uint64_value_num(SlotRecord r) const;
+  size_t copy_uint64_values(SlotRecord r, uint64_t* keys, int* offsets) const;
 
  public:
   template <typename T>
@@ -632,6 +642,7 @@ class MiniBatchGpuPack {
   // pcoc
   const int extend_dim_ = FLAGS_padbox_slotrecord_extend_dim;
   LoDTensor* qvalue_tensor_ = nullptr;
+  const SlotReplaceOverlay* slot_overlay_ = nullptr;
 };
 class MiniBatchGpuPackMgr {
   static const int MAX_DEIVCE_NUM = 16;
@@ -1961,6 +1972,83 @@ struct FeasignValuesReplacer {
   }
 };
 
+// SlotReplaceOverlay serves the replaced uint64 slots of the auc runner to the
+// feed by the record id of AucRunnerInfo, the records keep their own feasigns
+// so no slot group is written into them and back out again.
+class SlotReplaceOverlay {
+ public:
+  void Reset(const std::set<uint16_t>& slots, size_t record_num) {
+    slots_.assign(slots.begin(), slots.end());
+    slot_pos_.clear();
+    for (size_t k = 0; k < slots_.size(); ++k) {
+      if (slot_pos_.size() <= slots_[k]) {
+        slot_pos_.resize(slots_[k] + 1, -1);
+      }
+      slot_pos_[slots_[k]] = static_cast<int>(k);
+    }
+    values_.assign(record_num * slots_.size(), nullptr);
+  }
+  void Clear() { Reset(std::set<uint16_t>(), 0); }
+  bool Empty() const { return slots_.empty(); }
+
+  // the candidate has to stay until the overlay is reset
+  void Set(size_t record_id, const FeasignValuesCandidate& candidate) {
+    auto values = &values_[record_id * slots_.size()];
+    for (size_t k = 0; k < slots_.size(); ++k) {
+      values[k] = &candidate.feasign_values_.at(slots_[k]);
+    }
+  }
+  // the position of the uint64 slot in the overlay, -1 if it is not replaced
+  int SlotPos(int slot_idx) const {
+    return slot_idx < static_cast<int>(slot_pos_.size()) ? slot_pos_[slot_idx]
+                                                         : -1;
+  }
+  const std::vector<uint64_t>& Values(SlotRecord r, int pos) const {
+    return *values_[get_auc_runner_info(r)->record_id_ * slots_.size() + pos];
+  }
+  // the uint64 feasign number of the record with its slots replaced
+  size_t ValueNum(SlotRecord r) const {
+    const auto& fea = r->slot_uint64_feasigns_;
+    size_t num = fea.slot_values.size();
+    for (size_t k = 0; k < slots_.size(); ++k) {
+      num += Values(r, k).size();
+      num -= fea.slot_offsets[slots_[k] + 1] - fea.slot_offsets[slots_[k]];
+    }
+    return num;
+  }
+  // copies the uint64 feasigns of the record with its slots replaced, the
+  // offsets take the slot number plus one values
+  void CopyValues(SlotRecord r, uint64_t* keys, int* offsets) const {
+    const auto& fea = r->slot_uint64_feasigns_;
+    int slot_num = static_cast<int>(fea.slot_offsets.size()) - 1;
+    size_t len = 0;
+    for (int s = 0; s < slot_num; ++s) {
+      offsets[s] = static_cast<int>(len);
+      int pos = SlotPos(s);
+      const uint64_t* src = nullptr;
+      size_t num = 0;
+      if (pos < 0) {
+        src = fea.slot_values.data() + fea.slot_offsets[s];
+        num = fea.slot_offsets[s + 1] - fea.slot_offsets[s];
+      } else {
+        src = Values(r, pos).data();
+        num = Values(r, pos).size();
+      }
+      if (num > 0) {
+        memcpy(keys + len, src, num * sizeof(uint64_t));
+      }
+      len += num;
+    }
+    offsets[slot_num] = static_cast<int>(len);
+  }
+
+ private:
+  std::vector<uint16_t> slots_;
+  std::vector<int> slot_pos_;
+  // the replaced values of record id * slot number + position
+  std::vector<const std::vector<uint64_t>*> values_;
+};
+
 class ISlotParser {
  public:
   virtual ~ISlotParser() {}
@@ -2052,6 +2140,10 @@ class SlotPaddleBoxDataFeed : public DataFeed {
                    << "sec";
       pack_ = nullptr;
     }
+#else
+    if (next_layout_future_.valid()) {
+      next_layout_future_.wait();
+    }
 #endif
   }
 
@@ -2126,6 +2218,10 @@ class SlotPaddleBoxDataFeed : public DataFeed {
   void GetRankOffset(const SlotPvInstance* pv_vec, int pv_num, int ins_number);
   void GetAdsOffsetGPU(const int pv_num, const int ins_num);
   bool ParseOneInstance(const std::string& line, SlotRecord* rec);
+  // count the lod offsets of the next batch while the current one is trained
+  void PrepareNextSlotBatch(void);
+  // the auc runner slots replaced in the batch, nullptr for none
+  virtual const SlotReplaceOverlay* GetSlotReplaceOverlay(void) const;
 
  protected:
   // \n split by line
@@ -2160,6 +2256,14 @@ class SlotPaddleBoxDataFeed : public DataFeed {
 
 
                      const UsedSlotGpuType* used_slots);
+#else
+  // two pass cpu batch assembly, the count pass computes the lod offsets of
+  // one slot, the fill pass writes feasigns into the tensor memory directly
+  void CountSlotOffsets(int slot_idx, const SlotRecord* recs, int num,
+                        const SlotReplaceOverlay* overlay,
+                        std::vector<size_t>* offsets);
+  void FillSlotTensor(int slot_idx, const SlotRecord* recs, int num,
+                      std::vector<size_t>* offsets);
 #endif
 
  protected:
@@ -2192,6 +2296,19 @@ class SlotPaddleBoxDataFeed : public DataFeed {
   std::vector<SlotRecord> pv_ins_vec_;
   const SlotRecord *ins_record_ptr_ = nullptr;
   int batch_ins_num_ = 0;
+  // lod offsets of the batch counted ahead by PrepareNextSlotBatch
+  struct SlotBatchLayout {
+    const SlotRecord* recs = nullptr;
+    int num = 0;
+    // the overlay the offsets were counted under
+    const SlotReplaceOverlay* overlay = nullptr;
+    std::vector<std::vector<size_t>> offsets;
+  };
+  SlotBatchLayout next_layout_;
+  std::future<void> next_layout_future_;
+  // the auc runner slots replaced in the batch, nullptr for none
+  const SlotReplaceOverlay* slot_overlay_ = nullptr;
+  std::unique_ptr<ThreadPool> slot_fill_pool_ = nullptr;
 #endif
   int offset_index_ = 0;
   std::vector<std::pair<int, int>> batch_offsets_;
@@ -2303,9 +2420,198 @@ paddle::framework::Archive<AR>& operator<<(paddle::framework::Archive<AR>& ar,
 
   return ar;
 }
+
+// The compact encoding of a SlotRecord starts with a uint32 the legacy
+// encoding above never starts with, the legacy one starts with the float
+// value num of the record. The low byte of the magic is the version.
+static const uint32_t kSlotRecordCompactMagic = 0xFFFFFF00;
+static const uint32_t kSlotRecordCompactVersion = 1;
+
+enum SlotRecordEncoding {
+  kSlotRecordLegacy = 0,
+  // varint nums, delta varint uint64 feasigns
+  kSlotRecordCompact = 1,
+  // kSlotRecordCompact with the float feasigns as float16
+  kSlotRecordCompactHalf = 2,
+};
+
+inline uint64_t ZigZagEncode(uint64_t delta) {
+  return (delta << 1) ^
+         static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+}
+inline uint64_t ZigZagDecode(uint64_t x) { return (x >> 1) ^ (~(x & 1) + 1); }
+
+// slot num, then the value num of every slot
+template <class AR, class T>
+void WriteCompactSlotNums(paddle::framework::Archive<AR>& ar,
+                          const SlotValues<T>& r) {
+  const auto& offsets = r.slot_offsets;
+  ar.PutVarint(offsets.size());
+  for (size_t i = 1; i < offsets.size(); ++i) {
+    ar.PutVarint(offsets[i] - offsets[i - 1]);
+  }
+}
+template <class AR, class T>
+void ReadCompactSlotNums(paddle::framework::Archive<AR>& ar,
+                         SlotValues<T>* r) {
+  auto& offsets = r->slot_offsets;
+  offsets.resize(ar.GetVarint());
+  for (size_t i = 0; i < offsets.size(); ++i) {
+    offsets[i] = (i == 0) ? 0 : offsets[i - 1] + ar.GetVarint();
+  }
+  r->slot_values.resize(offsets.empty() ? 0 : offsets.back());
+}
+// The feasigns of a slot are written as the zigzag varint of the delta to the
+// previous feasign of the slot, a slot whose deltas take more bytes than the
+// raw feasigns, e.g. a slot of hashed feasigns, is written raw. The lowest bit
+// of the value num of a slot marks the raw slots.
+template <class AR>
+void WriteCompactSlotValues(paddle::framework::Archive<AR>& ar,
+                            const SlotValues<uint64_t>& r) {
+  const auto& offsets = r.slot_offsets;
+  ar.PutVarint(offsets.size());
+  for (size_t i = 1; i < offsets.size(); ++i) {
+    const uint64_t* vals = r.slot_values.data() + offsets[i - 1];
+    uint32_t num = offsets[i] - offsets[i - 1];
+    size_t delta_bytes = 0;
+    uint64_t prev = 0;
+    for (uint32_t j = 0; j < num; ++j) {
+      delta_bytes += ArchiveBase::VarintSize(ZigZagEncode(vals[j] - prev));
+      prev = vals[j];
+    }
+    bool raw = delta_bytes >= num * sizeof(uint64_t);
+    ar.PutVarint((static_cast<uint64_t>(num) << 1) | raw);
+    if (raw) {
+      ar.Write(vals, num * sizeof(uint64_t));
+      continue;
+    }
+    prev = 0;
+    for (uint32_t j = 0; j < num; ++j) {
+      ar.PutVarint(ZigZagEncode(vals[j] - prev));
+      prev = vals[j];
+    }
+  }
+}
+template <class AR>
+void ReadCompactSlotValues(paddle::framework::Archive<AR>& ar,
+                           SlotValues<uint64_t>* r) {
+  auto& offsets = r->slot_offsets;
+  auto& values = r->slot_values;
+  offsets.resize(ar.GetVarint());
+  values.clear();
+  for (size_t i = 0; i < offsets.size(); ++i) {
+    if (i == 0) {
+      offsets[i] = 0;
+      continue;
+    }
+    uint64_t head = ar.GetVarint();
+    uint32_t num = static_cast<uint32_t>(head >> 1);
+    offsets[i] = offsets[i - 1] + num;
+    values.resize(offsets[i]);
+    uint64_t* vals = values.data() + offsets[i - 1];
+    if (head & 1) {
+      ar.Read(vals, num * sizeof(uint64_t));
+      continue;
+    }
+    uint64_t prev = 0;
+    for (uint32_t j = 0; j < num; ++j) {
+      prev += ZigZagDecode(ar.GetVarint());
+      vals[j] = prev;
+    }
+  }
+}
+template <class AR>
+void WriteCompactSlotValues(paddle::framework::Archive<AR>& ar,
+                            const SlotValues<float>& r,
+                            bool half) {
+  WriteCompactSlotNums(ar, r);
+  size_t num = r.slot_values.size();
+  if (!half) {
+    ar.Write(r.slot_values.data(), num * sizeof(float));
+    return;
+  }
+  ar.PrepareWrite(num * sizeof(uint16_t));
+  char* out = ar.Finish();
+  for (size_t i = 0; i < num; ++i) {
+    uint16_t x = platform::float16(r.slot_values[i]).x;
+    memcpy(out + i * sizeof(uint16_t), &x, sizeof(uint16_t));
+  }
+  ar.AdvanceFinish(num * sizeof(uint16_t));
+}
+template <class AR>
+void ReadCompactSlotValues(paddle::framework::Archive<AR>& ar,
+                           SlotValues<float>* r,
+                           bool half) {
+  ReadCompactSlotNums(ar, r);
+  size_t num = r->slot_values.size();
+  if (!half) {
+    ar.Read(r->slot_values.data(), num * sizeof(float));
+    return;
+  }
+  ar.PrepareRead(num * sizeof(uint16_t));
+  const char* in = ar.Cursor();
+  for (size_t i = 0; i < num; ++i) {
+    uint16_t x = 0;
+    memcpy(&x, in + i * sizeof(uint16_t), sizeof(uint16_t));
+    r->slot_values[i] =
+        static_cast<float>(platform::raw_uint16_to_float16(x));
+  }
+  ar.AdvanceCursor(num * sizeof(uint16_t));
+}
+
+// Writes r in the encoding of the use site, operator>> reads every encoding.
+template <class AR>
+void WriteSlotRecord(paddle::framework::Archive<AR>& ar,
+                     const SlotRecord& r,
+                     int encoding) {
+  if (encoding == kSlotRecordLegacy) {
+    ar << r;
+    return;
+  }
+  bool half = (encoding == kSlotRecordCompactHalf);
+  ar << (kSlotRecordCompactMagic | kSlotRecordCompactVersion);
+  ar << static_cast<uint8_t>(half);
+  WriteCompactSlotValues(ar, r->slot_float_feasigns_, half);
+  WriteCompactSlotValues(ar, r->slot_uint64_feasigns_);
+  ar.PutVarint(r->ins_id_.size());
+  ar.Write(r->ins_id_.data(), r->ins_id_.size());
+  ar.PutVarint(r->search_id);
+  ar.PutVarint(r->rank);
+  ar.PutVarint(r->cmatch);
+}
+template <class AR>
+void ReadCompactSlotRecord(paddle::framework::Archive<AR>& ar, SlotRecord& r) {
+  uint32_t magic = 0;
+  ar >> magic;
+  PADDLE_ENFORCE_EQ(
+      magic & 0xFF,
+      kSlotRecordCompactVersion,
+      platform::errors::Unimplemented(
+          "Unknown compact SlotRecord encoding version %d.", magic & 0xFF));
+  uint8_t half = 0;
+  ar >> half;
+  ReadCompactSlotValues(ar, &r->slot_float_feasigns_, half != 0);
+  ReadCompactSlotValues(ar, &r->slot_uint64_feasigns_);
+  size_t len = ar.GetVarint();
+  ar.PrepareRead(len);
+  r->ins_id_.assign(ar.Cursor(), len);
+  ar.AdvanceCursor(len);
+  r->search_id = ar.GetVarint();
+  r->rank = static_cast<uint32_t>(ar.GetVarint());
+  r->cmatch = static_cast<uint32_t>(ar.GetVarint());
+}
+
 template <class AR>
 paddle::framework::Archive<AR>& operator>>(paddle::framework::Archive<AR>& ar,
                                            SlotRecord& r) {
+  uint32_t head = 0;
+  if (ar.Finish() - ar.Cursor() >= static_cast<int64_t>(sizeof(head))) {
+    memcpy(&head, ar.Cursor(), sizeof(head));
+  }
+  if ((head & kSlotRecordCompactMagic) == kSlotRecordCompactMagic) {
+    ReadCompactSlotRecord(ar, r);
+    return ar;
+  }
   ar >> r->slot_float_feasigns_;
   ar >> r->slot_uint64_feasigns_;
   ar >> r->ins_id_;
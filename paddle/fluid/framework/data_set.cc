@@ -23,6 +23,8 @@
 #include "paddle/fluid/framework/fleet/box_wrapper.h"
 #include "paddle/fluid/framework/fleet/fleet_wrapper.h"
 #include "paddle/fluid/framework/io/fs.h"
+#include "paddle/fluid/framework/parallel_shuffle.h"
+#include "paddle/fluid/framework/sorted_run_merger.h"
 #include "paddle/fluid/platform/monitor.h"
 #include "paddle/fluid/platform/timer.h"
 
@@ -39,12 +41,28 @@
 USE_INT_STAT(STAT_total_feasign_num_in_mem);
 DECLARE_bool(graph_get_neighbor_id);
 DECLARE_bool(padbox_dataset_enable_unrollinstance);
+DECLARE_bool(padbox_dataset_key_stat);
+DECLARE_int32(padbox_dataset_key_stat_precision);
+DECLARE_int32(padbox_dataset_key_stat_topk);
+DECLARE_bool(padbox_dataset_block_channel);
+DECLARE_int32(dataset_merge_by_insid_memory_mb);
+DECLARE_string(dataset_merge_by_insid_spill_dir);
+DECLARE_uint64(dataset_shuffle_seed);
+DECLARE_int32(padbox_shuffle_slotrecord_encoding);
 PADDLE_DEFINE_EXPORTED_bool(padbox_disable_ins_shuffle,
                             false,
                             "paddle disable ins shuffle ,default false");
 namespace paddle {
 namespace framework {
 
+// a fixed FLAGS_dataset_shuffle_seed makes the shuffles reproducible
+static uint64_t GetShuffleSeed() {
+  if (FLAGS_dataset_shuffle_seed != 0) {
+    return FLAGS_dataset_shuffle_seed;
+  }
+  return framework::FleetWrapper::GetInstance()->LocalRandomEngine()();
+}
+
 // constructor
 template <typename T>
 DatasetImpl<T>::DatasetImpl() {
@@ -674,11 +692,10 @@ void DatasetImpl<T>::LocalShuffle() {
     VLOG(3) << "DatasetImpl<T>::LocalShuffle() end, no data to shuffle";
     return;
   }
-  auto fleet_ptr = framework::FleetWrapper::GetInstance();
   input_channel_->Close();
   std::vector<T> data;
   input_channel_->ReadAll(data);
-  std::shuffle(data.begin(), data.end(), fleet_ptr->LocalRandomEngine());
+  ParallelShuffle(&data, thread_num_, GetShuffleSeed());
   input_channel_->Open();
   input_channel_->Write(std::move(data));
   data.clear();
@@ -783,11 +800,14 @@ void MultiSlotDataset::GlobalShuffle(int thread_num) {
     return;
   }
 
+  if (thread_num == -1) {
+    thread_num = thread_num_;
+  }
   // local shuffle
   input_channel_->Close();
   std::vector<Record> data;
   input_channel_->ReadAll(data);
-  std::shuffle(data.begin(), data.end(), fleet_ptr->LocalRandomEngine());
+  ParallelShuffle(&data, thread_num, GetShuffleSeed());
   input_channel_->Open();
   input_channel_->Write(std::move(data));
   data.clear();
@@ -805,48 +825,49 @@ void MultiSlotDataset::GlobalShuffle(int thread_num) {
     } else if (this->shuffle_by_uid_) {
       return XXH64(data.uid_.data(), data.uid_.length(), 0) %
              this->trainer_num_;
+    } else if (FLAGS_dataset_shuffle_seed != 0 && !data.ins_id_.empty()) {
+      // a fixed seed sends every record to a fixed trainer
+      return XXH64(data.ins_id_.data(),
+                   data.ins_id_.length(),
+                   FLAGS_dataset_shuffle_seed) %
+             this->trainer_num_;
     } else {
       return fleet_ptr->LocalRandomEngine()() % this->trainer_num_;
     }
   };
 
+  // every thread batches fleet_send_batch_size_ records of one trainer into
+  // one message and keeps at most max_sending messages in flight
   auto global_shuffle_func = [this, get_client_id]() {
 #ifdef PADDLE_WITH_PSCORE
     auto fleet_ptr = distributed::FleetWrapper::GetInstance();
 #else
     auto fleet_ptr = framework::FleetWrapper::GetInstance();
 #endif
-    // auto fleet_ptr = framework::FleetWrapper::GetInstance();
+    const size_t max_sending = 2 * this->trainer_num_;
+    std::vector<paddle::framework::BinaryArchive> ars(this->trainer_num_);
+    std::vector<int64_t> ar_num(this->trainer_num_, 0);
+    std::deque<std::future<int32_t>> sending;
+    auto send = [&](int i) {
+      std::string msg(ars[i].Buffer(), ars[i].Length());
+      sending.push_back(fleet_ptr->SendClientToClientMsg(0, i, msg));
+      ars[i].Clear();
+      ar_num[i] = 0;
+      while (sending.size() > max_sending) {
+        sending.front().wait();
+        sending.pop_front();
+      }
+    };
     std::vector<Record> data;
     while (this->input_channel_->Read(data)) {
-      std::vector<paddle::framework::BinaryArchive> ars(this->trainer_num_);
       for (auto& t : data) {
         auto client_id = get_client_id(t);
         ars[client_id] << t;
-      }
-      std::vector<std::future<int32_t>> total_status;
-      std::vector<int> send_index(this->trainer_num_);
-      for (int i = 0; i < this->trainer_num_; ++i) {
-        send_index[i] = i;
-      }
-      std::shuffle(
-          send_index.begin(), send_index.end(), fleet_ptr->LocalRandomEngine());
-      for (int index = 0; index < this->trainer_num_; ++index) {
-        int i = send_index[index];
-        if (ars[i].Length() == 0) {
-          continue;
+        if (++ar_num[client_id] >= this->fleet_send_batch_size_) {
+          send(client_id);
         }
-        std::string msg(ars[i].Buffer(), ars[i].Length());
-        auto ret = fleet_ptr->SendClientToClientMsg(0, i, msg);
-        total_status.push_back(std::move(ret));
-      }
-      for (auto& t : total_status) {
-        t.wait();
       }
-      ars.clear();
-      ars.shrink_to_fit();
       data.clear();
-      data.shrink_to_fit();
       // currently we find bottleneck is server not able to handle large data
       // in time, so we can remove this sleep and set fleet_send_batch_size to
       // 1024, and set server thread to 24.
@@ -854,12 +875,23 @@ void MultiSlotDataset::GlobalShuffle(int thread_num) {
         sleep(this->fleet_send_sleep_seconds_);
       }
     }
+    std::vector<int> send_index(this->trainer_num_);
+    for (int i = 0; i < this->trainer_num_; ++i) {
+      send_index[i] = i;
+    }
+    std::shuffle(
+        send_index.begin(), send_index.end(), fleet_ptr->LocalRandomEngine());
+    for (int i : send_index) {
+      if (ar_num[i] > 0) {
+        send(i);
+      }
+    }
+    for (auto& t : sending) {
+      t.wait();
+    }
   };
 
   std::vector<std::thread> global_shuffle_threads;
-  if (thread_num == -1) {
-    thread_num = thread_num_;
-  }
   VLOG(3) << "start global shuffle threads, num = " << thread_num;
   for (int i = 0; i < thread_num; ++i) {
     global_shuffle_threads.push_back(std::thread(global_shuffle_func));
@@ -1384,45 +1416,18 @@ void MultiSlotDataset::GenerateLocalTablesUnlock(int table_id,
   fleet_ptr_->PullSparseToLocal(table_id, feadim);
 }
 
-void MultiSlotDataset::MergeByInsId() {
-  VLOG(3) << "MultiSlotDataset::MergeByInsId begin";
-  if (!merge_by_insid_) {
-    VLOG(3) << "merge_by_insid=false, will not MergeByInsId";
-    return;
-  }
-  auto multi_slot_desc = data_feed_desc_.multi_slot_desc();
-  std::vector<std::string> use_slots;
-  std::vector<bool> use_slots_is_dense;
-  for (int i = 0; i < multi_slot_desc.slots_size(); ++i) {
-    const auto& slot = multi_slot_desc.slots(i);
-    if (slot.is_used()) {
-      use_slots.push_back(slot.name());
-      use_slots_is_dense.push_back(slot.is_dense());
-    }
-  }
-  CHECK(multi_output_channel_.size() != 0);  // NOLINT
-  auto channel_data = paddle::framework::MakeChannel<Record>();
-  VLOG(3) << "multi_output_channel_.size() " << multi_output_channel_.size();
-  for (size_t i = 0; i < multi_output_channel_.size(); ++i) {
-    std::vector<Record> vec_data;
-    multi_output_channel_[i]->Close();
-    multi_output_channel_[i]->ReadAll(vec_data);
-    channel_data->Write(std::move(vec_data));
-    vec_data.clear();
-    vec_data.shrink_to_fit();
-    multi_output_channel_[i]->Clear();
+bool MultiSlotDataset::MergeInsIdRecords(
+    const std::vector<std::string>& use_slots,
+    const std::vector<bool>& use_slots_is_dense,
+    std::vector<Record>* recs,
+    Record* merged) {
+  size_t i = 0;
+  size_t j = recs->size();
+  if (merge_size_ > 0 && j - i != merge_size_) {
+    LOG(WARNING) << "drop ins " << (*recs)[i].ins_id_ << " size=" << j - i
+                 << ", because merge_size=" << merge_size_;
+    return false;
   }
-  channel_data->Close();
-  std::vector<Record> recs;
-  recs.reserve(channel_data->Size());
-  channel_data->ReadAll(recs);
-  channel_data->Clear();
-  std::sort(recs.begin(), recs.end(), [](const Record& a, const Record& b) {
-    return a.ins_id_ < b.ins_id_;
-  });
-
-  std::vector<Record> results;
-  uint64_t drop_ins_num = 0;
   std::unordered_set<uint16_t> all_int64;
   std::unordered_set<uint16_t> all_float;
   std::unordered_set<uint16_t> local_uint64;
@@ -1432,151 +1437,244 @@ void MultiSlotDataset::MergeByInsId() {
   std::unordered_map<uint16_t, std::vector<FeatureItem>> local_dense_uint64;
   std::unordered_map<uint16_t, std::vector<FeatureItem>> local_dense_float;
   std::unordered_map<uint16_t, bool> dense_empty;
-
-  VLOG(3) << "recs.size() " << recs.size();
-  for (size_t i = 0; i < recs.size();) {
-    size_t j = i + 1;
-    while (j < recs.size() && recs[j].ins_id_ == recs[i].ins_id_) {
-      j++;
-    }
-    if (merge_size_ > 0 && j - i != merge_size_) {
-      drop_ins_num += j - i;
-      LOG(WARNING) << "drop ins " << recs[i].ins_id_ << " size=" << j - i
-                   << ", because merge_size=" << merge_size_;
-      i = j;
-      continue;
-    }
-
-    all_int64.clear();
-    all_float.clear();
-    all_dense_uint64.clear();
-    all_dense_float.clear();
-    bool has_conflict_slot = false;
-    uint16_t conflict_slot = 0;
-
-    Record rec;
-    rec.ins_id_ = recs[i].ins_id_;
-    rec.content_ = recs[i].content_;
-
-    for (size_t k = i; k < j; k++) {
-      dense_empty.clear();
-      local_dense_uint64.clear();
-      local_dense_float.clear();
-      for (auto& feature : recs[k].uint64_feasigns_) {
-        uint16_t slot = feature.slot();
-        if (!use_slots_is_dense[slot]) {
-          continue;
-        }
-        local_dense_uint64[slot].push_back(feature);
-        if (feature.sign().uint64_feasign_ != 0) {
-          dense_empty[slot] = false;
-        } else if (dense_empty.find(slot) == dense_empty.end() &&
-                   all_dense_uint64.find(slot) == all_dense_uint64.end()) {
-          dense_empty[slot] = true;
-        }
+  bool has_conflict_slot = false;
+  uint16_t conflict_slot = 0;
+
+  Record rec;
+  rec.ins_id_ = (*recs)[i].ins_id_;
+  rec.content_ = (*recs)[i].content_;
+
+  for (size_t k = i; k < j; k++) {
+    dense_empty.clear();
+    local_dense_uint64.clear();
+    local_dense_float.clear();
+    for (auto& feature : (*recs)[k].uint64_feasigns_) {
+      uint16_t slot = feature.slot();
+      if (!use_slots_is_dense[slot]) {
+        continue;
       }
-      for (auto& feature : recs[k].float_feasigns_) {
-        uint16_t slot = feature.slot();
-        if (!use_slots_is_dense[slot]) {
-          continue;
-        }
-        local_dense_float[slot].push_back(feature);
-        if (fabs(feature.sign().float_feasign_) >= 1e-6) {
-          dense_empty[slot] = false;
-        } else if (dense_empty.find(slot) == dense_empty.end() &&
-                   all_dense_float.find(slot) == all_dense_float.end()) {
-          dense_empty[slot] = true;
-        }
-      }
-      for (auto& p : dense_empty) {
-        if (local_dense_uint64.find(p.first) != local_dense_uint64.end()) {
-          all_dense_uint64[p.first] = std::move(local_dense_uint64[p.first]);
-        } else if (local_dense_float.find(p.first) != local_dense_float.end()) {
-          all_dense_float[p.first] = std::move(local_dense_float[p.first]);
-        }
+      local_dense_uint64[slot].push_back(feature);
+      if (feature.sign().uint64_feasign_ != 0) {
+        dense_empty[slot] = false;
+      } else if (dense_empty.find(slot) == dense_empty.end() &&
+                 all_dense_uint64.find(slot) == all_dense_uint64.end()) {
+        dense_empty[slot] = true;
       }
     }
-    for (auto& f : all_dense_uint64) {
-      rec.uint64_feasigns_.insert(
-          rec.uint64_feasigns_.end(), f.second.begin(), f.second.end());
+    for (auto& feature : (*recs)[k].float_feasigns_) {
+      uint16_t slot = feature.slot();
+      if (!use_slots_is_dense[slot]) {
+        continue;
+      }
+      local_dense_float[slot].push_back(feature);
+      if (fabs(feature.sign().float_feasign_) >= 1e-6) {
+        dense_empty[slot] = false;
+      } else if (dense_empty.find(slot) == dense_empty.end() &&
+                 all_dense_float.find(slot) == all_dense_float.end()) {
+        dense_empty[slot] = true;
+      }
     }
-    for (auto& f : all_dense_float) {
-      rec.float_feasigns_.insert(
-          rec.float_feasigns_.end(), f.second.begin(), f.second.end());
+    for (auto& p : dense_empty) {
+      if (local_dense_uint64.find(p.first) != local_dense_uint64.end()) {
+        all_dense_uint64[p.first] = std::move(local_dense_uint64[p.first]);
+      } else if (local_dense_float.find(p.first) != local_dense_float.end()) {
+        all_dense_float[p.first] = std::move(local_dense_float[p.first]);
+      }
     }
+  }
+  for (auto& f : all_dense_uint64) {
+    rec.uint64_feasigns_.insert(
+        rec.uint64_feasigns_.end(), f.second.begin(), f.second.end());
+  }
+  for (auto& f : all_dense_float) {
+    rec.float_feasigns_.insert(
+        rec.float_feasigns_.end(), f.second.begin(), f.second.end());
+  }
 
-    for (size_t k = i; k < j; k++) {
-      local_uint64.clear();
-      local_float.clear();
-      for (auto& feature : recs[k].uint64_feasigns_) {
-        uint16_t slot = feature.slot();
-        if (use_slots_is_dense[slot]) {
-          continue;
-        } else if (all_int64.find(slot) != all_int64.end()) {
-          has_conflict_slot = true;
-          conflict_slot = slot;
-          break;
-        }
-        local_uint64.insert(slot);
-        rec.uint64_feasigns_.push_back(std::move(feature));
-      }
-      if (has_conflict_slot) {
+  for (size_t k = i; k < j; k++) {
+    local_uint64.clear();
+    local_float.clear();
+    for (auto& feature : (*recs)[k].uint64_feasigns_) {
+      uint16_t slot = feature.slot();
+      if (use_slots_is_dense[slot]) {
+        continue;
+      } else if (all_int64.find(slot) != all_int64.end()) {
+        has_conflict_slot = true;
+        conflict_slot = slot;
         break;
       }
-      all_int64.insert(local_uint64.begin(), local_uint64.end());
+      local_uint64.insert(slot);
+      rec.uint64_feasigns_.push_back(std::move(feature));
+    }
+    if (has_conflict_slot) {
+      break;
+    }
+    all_int64.insert(local_uint64.begin(), local_uint64.end());
 
-      for (auto& feature : recs[k].float_feasigns_) {
-        uint16_t slot = feature.slot();
-        if (use_slots_is_dense[slot]) {
-          continue;
-        } else if (all_float.find(slot) != all_float.end()) {
-          has_conflict_slot = true;
-          conflict_slot = slot;
-          break;
-        }
-        local_float.insert(slot);
-        rec.float_feasigns_.push_back(std::move(feature));
-      }
-      if (has_conflict_slot) {
+    for (auto& feature : (*recs)[k].float_feasigns_) {
+      uint16_t slot = feature.slot();
+      if (use_slots_is_dense[slot]) {
+        continue;
+      } else if (all_float.find(slot) != all_float.end()) {
+        has_conflict_slot = true;
+        conflict_slot = slot;
         break;
       }
-      all_float.insert(local_float.begin(), local_float.end());
+      local_float.insert(slot);
+      rec.float_feasigns_.push_back(std::move(feature));
     }
-
     if (has_conflict_slot) {
-      LOG(WARNING) << "drop ins " << recs[i].ins_id_ << " size=" << j - i
-                   << ", because conflict_slot=" << use_slots[conflict_slot];
-      drop_ins_num += j - i;
-    } else {
-      results.push_back(std::move(rec));
+      break;
     }
-    i = j;
+    all_float.insert(local_float.begin(), local_float.end());
   }
-  std::vector<Record>().swap(recs);
-  VLOG(3) << "results size " << results.size();
-  LOG(WARNING) << "total drop ins num: " << drop_ins_num;
-  results.shrink_to_fit();
 
-  auto fleet_ptr = framework::FleetWrapper::GetInstance();
-  std::shuffle(results.begin(), results.end(), fleet_ptr->LocalRandomEngine());
-  channel_data->Open();
-  channel_data->Write(std::move(results));
-  channel_data->Close();
-  results.clear();
-  results.shrink_to_fit();
-  VLOG(3) << "channel data size " << channel_data->Size();
-  channel_data->SetBlockSize(channel_data->Size() / channel_num_ + 1);
-  VLOG(3) << "channel data block size " << channel_data->BlockSize();
-  for (size_t i = 0; i < multi_output_channel_.size(); ++i) {
-    std::vector<Record> vec_data;
-    channel_data->Read(vec_data);
+  if (has_conflict_slot) {
+    LOG(WARNING) << "drop ins " << (*recs)[i].ins_id_ << " size=" << j - i
+                 << ", because conflict_slot=" << use_slots[conflict_slot];
+    return false;
+  }
+  *merged = std::move(rec);
+  return true;
+}
+
+void MultiSlotDataset::MergeByInsId() {
+  VLOG(3) << "MultiSlotDataset::MergeByInsId begin";
+  if (!merge_by_insid_) {
+    VLOG(3) << "merge_by_insid=false, will not MergeByInsId";
+    return;
+  }
+  auto multi_slot_desc = data_feed_desc_.multi_slot_desc();
+  std::vector<std::string> use_slots;
+  std::vector<bool> use_slots_is_dense;
+  for (int i = 0; i < multi_slot_desc.slots_size(); ++i) {
+    const auto& slot = multi_slot_desc.slots(i);
+    if (slot.is_used()) {
+      use_slots.push_back(slot.name());
+      use_slots_is_dense.push_back(slot.is_dense());
+    }
+  }
+  CHECK(multi_output_channel_.size() != 0);  // NOLINT
+  VLOG(3) << "multi_output_channel_.size() " << multi_output_channel_.size();
+  platform::Timer timeline;
+  timeline.Start();
+  int channel_num = static_cast<int>(multi_output_channel_.size());
+
+  // the records are sorted by the hash of the ins id, the ins id breaks ties
+  SortedRunMerger<Record>::Funcs funcs;
+  funcs.hash = [](const Record& r) {
+    return XXH64(r.ins_id_.data(), r.ins_id_.length(), 0);
+  };
+  funcs.less = [](const Record& a, const Record& b) {
+    return a.ins_id_ < b.ins_id_;
+  };
+  funcs.bytes = [](const Record& r) {
+    return sizeof(Record) +
+           (r.uint64_feasigns_.capacity() + r.float_feasigns_.capacity()) *
+               sizeof(FeatureItem) +
+           r.ins_id_.capacity() + r.content_.capacity() + r.uid_.capacity();
+  };
+  funcs.write = [](BinaryArchive& ar, const Record& r) {
+    ar << r;
+    ar << r.content_;
+    ar << r.search_id;
+    ar << r.rank;
+    ar << r.cmatch;
+    ar << r.uid_;
+  };
+  funcs.read = [](BinaryArchive& ar, Record* r) {
+    ar >> *r;
+    ar >> r->content_;
+    ar >> r->search_id;
+    ar >> r->rank;
+    ar >> r->cmatch;
+    ar >> r->uid_;
+  };
+  int64_t memory_budget = FLAGS_dataset_merge_by_insid_memory_mb < 0
+                              ? -1
+                              : (static_cast<int64_t>(
+                                     FLAGS_dataset_merge_by_insid_memory_mb)
+                                 << 20);
+  SortedRunMerger<Record> merger(funcs,
+                                 channel_num,
+                                 memory_budget,
+                                 FLAGS_dataset_merge_by_insid_spill_dir);
+
+  // every channel is drained by its own thread and cut into sorted runs
+  // within the memory budget while it is read
+  std::vector<std::thread> threads;
+  for (int i = 0; i < channel_num; ++i) {
+    threads.emplace_back([this, i, channel_num, &merger]() {
+      auto& channel = multi_output_channel_[i];
+      channel->Close();
+      merger.AddRuns(
+          [&channel](std::vector<Record>* block) {
+            return channel->Read(*block);
+          },
+          channel_num);
+      channel->Clear();
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  threads.clear();
+  VLOG(3) << "sort " << merger.RunNum() << " runs, spill "
+          << merger.SpilledRunNum() << " runs of " << merger.SpilledBytes()
+          << " bytes, cost " << timeline.ElapsedSec() << " seconds";
+
+  // every partition streams its merged records to the channels in turn
+  const size_t block_size = 10000;
+  std::atomic<uint64_t> drop_ins_num{0};
+  std::vector<std::vector<Record>> results(channel_num);
+  std::vector<size_t> write_index(channel_num);
+  for (int i = 0; i < channel_num; ++i) {
     multi_output_channel_[i]->Open();
-    multi_output_channel_[i]->Write(std::move(vec_data));
-    vec_data.clear();
-    vec_data.shrink_to_fit();
+    write_index[i] = i;
   }
-  CHECK(channel_data->Size() == 0);  // NOLINT
-  channel_data->Clear();
+  auto write_results = [this, channel_num, &results, &write_index](int p) {
+    if (results[p].empty()) {
+      return;
+    }
+    multi_output_channel_[write_index[p]++ % channel_num]->Write(
+        std::move(results[p]));
+    results[p].clear();
+  };
+  merger.Merge([&](int p, std::vector<Record>* recs) {
+    Record rec;
+    if (MergeInsIdRecords(use_slots, use_slots_is_dense, recs, &rec)) {
+      results[p].push_back(std::move(rec));
+      if (results[p].size() >= block_size) {
+        write_results(p);
+      }
+    } else {
+      drop_ins_num += recs->size();
+    }
+  });
+  for (int p = 0; p < channel_num; ++p) {
+    write_results(p);
+  }
+  LOG(WARNING) << "total drop ins num: " << drop_ins_num.load();
+
+  // the merged records are in the hash order of their ins ids
+  for (int i = 0; i < channel_num; ++i) {
+    threads.emplace_back([this, i]() {
+      std::vector<Record> vec_data;
+      multi_output_channel_[i]->Close();
+      multi_output_channel_[i]->ReadAll(vec_data);
+      auto fleet_ptr = framework::FleetWrapper::GetInstance();
+      std::shuffle(
+          vec_data.begin(), vec_data.end(), fleet_ptr->LocalRandomEngine());
+      multi_output_channel_[i]->Open();
+      multi_output_channel_[i]->Write(std::move(vec_data));
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  timeline.Pause();
+  VLOG(0) << "MultiSlotDataset::MergeByInsId cost " << timeline.ElapsedSec()
+          << " seconds";
   VLOG(3) << "MultiSlotDataset::MergeByInsId end";
 }
 
@@ -1950,12 +2048,16 @@ PadBoxSlotDataset::PadBoxSlotDataset() {
 PadBoxSlotDataset::~PadBoxSlotDataset() {}
 // create input channel and output channel
 void PadBoxSlotDataset::CreateChannel() {
+  auto make_channel = []() {
+    return FLAGS_padbox_dataset_block_channel ? MakeBlockChannel<SlotRecord>()
+                                              : MakeChannel<SlotRecord>();
+  };
   if (input_channel_ == nullptr) {
-    input_channel_ = MakeChannel<SlotRecord>();
+    input_channel_ = make_channel();
     input_channel_->SetBlockSize(OBJPOOL_BLOCK_SIZE);
   }
   if (shuffle_channel_ == nullptr) {
-    shuffle_channel_ = MakeChannel<SlotRecord>();
+    shuffle_channel_ = make_channel();
     shuffle_channel_->SetBlockSize(OBJPOOL_BLOCK_SIZE);
   }
 }
@@ -2011,6 +2113,27 @@ void PadBoxSlotDataset::CheckThreadPool(void) {
   used_fea_index_.clear();
   auto feed_obj = reinterpret_cast<SlotPaddleBoxDataFeed*>(readers_[0].get());
   feed_obj->GetUsedSlotIndex(&used_fea_index_);
+  if (FLAGS_padbox_dataset_key_stat) {
+    // used_fea_index_ holds the positions among the used uint64 slots
+    std::vector<std::string> uint64_slots;
+    const auto& multi_slot_desc = data_feed_desc_.multi_slot_desc();
+    for (int i = 0; i < multi_slot_desc.slots_size(); ++i) {
+      const auto& slot = multi_slot_desc.slots(i);
+      if (slot.is_used() && slot.type()[0] == 'u') {
+        uint64_slots.push_back(slot.name());
+      }
+    }
+    used_fea_names_.clear();
+    for (auto idx : used_fea_index_) {
+      used_fea_names_.push_back(uint64_slots[idx]);
+    }
+    // the previous pass may be fed by another dataset
+    key_stat_.reset(
+        new PassKeyStat(FLAGS_padbox_dataset_key_stat_precision,
+                        16,
+                        FLAGS_padbox_dataset_key_stat_topk,
+                        BoxWrapper::GetInstance()->GetPassKeyHistory()));
+  }
 
   VLOG(0) << "pass id=" << pass_id_ << ", shuffle disable: " << disable_shuffle_
             << ", polling disable: " << disable_polling_
@@ -2117,6 +2240,9 @@ void PadBoxSlotDataset::PreLoadIntoDisk(const std::string& path,
   CHECK(down_pool_ != nullptr) << "down_pool nullptr";
   for (int64_t i = 0; i < thread_num_; ++i) {
     wait_futures_.emplace_back(down_pool_->Run([this, i]() {
+      platform::RecordEvent record_event("PadBoxSlotDataset::ReadIns",
+                                         platform::TracerEventType::Dataloader,
+                                         BoxTracer::kBoxTraceLevel);
       platform::Timer timer;
       timer.Start();
       CHECK(readers_[i] != nullptr) << "reader index=" << i << " nullptr";
@@ -2232,6 +2358,9 @@ void PadBoxSlotDataset::PreLoadIntoMemory() {
   read_ins_ref_ = thread_num_;
   for (int64_t i = 0; i < thread_num_; ++i) {
     wait_futures_.emplace_back(thread_pool_->Run([this, i]() {
+      platform::RecordEvent record_event("PadBoxSlotDataset::ReadIns",
+                                         platform::TracerEventType::Dataloader,
+                                         BoxTracer::kBoxTraceLevel);
       platform::Timer timer;
       timer.Start();
       readers_[i]->LoadIntoMemory();
@@ -2295,10 +2424,17 @@ void PadBoxSlotDataset::MergeInsKeys(const Channel<SlotRecord>& in) {
   input_records_.clear();
   min_merge_ins_span_ = 1000;
   CHECK(p_agent_ != nullptr);
+  if (key_stat_ != nullptr) {
+    key_stat_->BeginPass(pass_id_, used_fea_names_, merge_thread_num_);
+  }
   for (int tid = 0; tid < merge_thread_num_; ++tid) {
     wait_futures_.emplace_back(merge_pool_->Run([this, &in, tid]() {
       //      VLOG(0) << "merge thread id: " << tid << "start";
+      platform::RecordEvent record_event("PadBoxSlotDataset::MergeInsKeys",
+                                         platform::TracerEventType::Dataloader,
+                                         BoxTracer::kBoxTraceLevel);
       platform::Timer timer;
+      platform::Timer stat_timer;
       auto feed_obj =
           reinterpret_cast<SlotPaddleBoxDataFeed*>(readers_[0].get());
       CHECK(feed_obj != nullptr && in != nullptr);
@@ -2306,6 +2442,19 @@ void PadBoxSlotDataset::MergeInsKeys(const Channel<SlotRecord>& in) {
       std::vector<SlotRecord> datas;
       while (in->ReadOnce(datas, OBJPOOL_BLOCK_SIZE)) {
         timer.Resume();
+        if (key_stat_ != nullptr) {
+          stat_timer.Resume();
+          for (auto& rec : datas) {
+            for (size_t j = 0; j < used_fea_index_.size(); ++j) {
+              uint64_t* feas = rec->slot_uint64_feasigns_.get_values(
+                  used_fea_index_[j], &num);
+              if (num > 0) {
+                key_stat_->AddKeys(tid, j, feas, num);
+              }
+            }
+          }
+          stat_timer.Pause();
+        }
         for (auto& rec : datas) {
           for (auto& idx : used_fea_index_) {
             uint64_t* feas = rec->slot_uint64_feasigns_.get_values(idx, &num);
@@ -2333,12 +2482,18 @@ void PadBoxSlotDataset::MergeInsKeys(const Channel<SlotRecord>& in) {
       if (min_merge_ins_span_ > span) {
         min_merge_ins_span_ = span;
       }
+      if (key_stat_ != nullptr) {
+        key_stat_->AddTime(tid, stat_timer.ElapsedSec());
+      }
       // end merge thread
       if (--merge_ins_ref_ == 0) {
         other_timer_.Pause();
         VLOG(0) << "passid = " << pass_id_ << ", merge thread id: " << tid
                 << ", span time: " << span << ", max:" << max_merge_ins_span_
                 << ", min:" << min_merge_ins_span_;
+        if (key_stat_ != nullptr) {
+          key_stat_->EndPass();
+        }
       }
       //      else {
       //          VLOG(0) << "merge thread id: " << tid
@@ -2444,6 +2599,9 @@ void PadBoxSlotDataset::ShuffleData(int thread_num) {
   min_shuffle_span_ = 1000;
   for (int tid = 0; tid < thread_num; ++tid) {
     wait_futures_.emplace_back(shuffle_pool_->Run([this, tid]() {
+      platform::RecordEvent record_event("PadBoxSlotDataset::ShuffleData",
+                                         platform::TracerEventType::Dataloader,
+                                         BoxTracer::kBoxTraceLevel);
       platform::Timer timer;
       std::vector<SlotRecord> data;
       std::vector<SlotRecord> loc_datas;
@@ -2464,7 +2622,8 @@ void PadBoxSlotDataset::ShuffleData(int thread_num) {
             loc_datas.push_back(std::move(t));
             continue;
           }
-          ars[client_id] << t;
+          WriteSlotRecord(
+              ars[client_id], t, FLAGS_padbox_shuffle_slotrecord_encoding);
           releases.push_back(t);
         }
         slot_pool_->put(&releases);
@@ -2775,6 +2934,9 @@ void PadBoxSlotDataset::DynamicAdjustReadersNum(int thread_num) {
 
 // prepare train do something
 void PadBoxSlotDataset::PrepareTrain(void) {
+  platform::RecordEvent record_event("PadBoxSlotDataset::PrepareTrain",
+                                     platform::TracerEventType::Dataloader,
+                                     BoxTracer::kBoxTraceLevel);
   auto box_ptr = paddle::framework::BoxWrapper::GetInstance();
 
   std::vector<std::pair<int, int>> offset;
@@ -2823,6 +2985,9 @@ void PadBoxSlotDataset::PrepareTrain(void) {
 }
 
 void PadBoxSlotDataset::UnrollInstance() {
+  platform::RecordEvent record_event("PadBoxSlotDataset::UnrollInstance",
+                                     platform::TracerEventType::Dataloader,
+                                     BoxTracer::kBoxTraceLevel);
   auto feed_obj = reinterpret_cast<SlotPaddleBoxDataFeed*>(readers_[0].get());
   feed_obj->UnrollInstance(input_records_);
 }
@@ -2853,8 +3018,13 @@ void InputTableDataset::LoadIndexIntoMemory() {
   for (auto& f : wait_futures) {
     f.wait();
   }
+  // build the lookup index once all index data is loaded
+  auto& table = BoxWrapper::GetInstance()->input_table_deque_.back();
+  table.Freeze();
   timer.Pause();
-  VLOG(1) << "end LoadIndexIntoMemory() cost: " << timer.ElapsedSec();
+  VLOG(1) << "end LoadIndexIntoMemory() cost: " << timer.ElapsedSec()
+          << ", keys: " << table.size() << ", load throughput: "
+          << table.size() / std::max(timer.ElapsedSec(), 1e-6) << " keys/s";
 }
 
 #endif
@@ -32,6 +32,7 @@
 #endif
 
 #include "paddle/fluid/framework/data_feed.h"
+#include "paddle/fluid/framework/fleet/pass_key_stat.h"
 #include "paddle/fluid/framework/threadpool.h"
 DECLARE_int32(padbox_dataset_shuffle_thread_num);
 DECLARE_int32(padbox_dataset_merge_thread_num);
@@ -184,6 +185,8 @@ class Dataset {
   virtual void PreLoadIntoDisk(const std::string& path, const int file_num) = 0;
   virtual void WaitLoadDiskDone(void) = 0;
   virtual void SetLoadArchiveFile(bool archive) = 0;
+  // key statistics of the last feed pass
+  virtual PassKeyStat::Summary GetPassKeyStat() = 0;
 
  protected:
   virtual int ReceiveFromClient(int msg_type,
@@ -306,6 +309,9 @@ class DatasetImpl : public Dataset {
   virtual void PreLoadIntoDisk(const std::string& path, const int file_num) {}
   virtual void WaitLoadDiskDone(void) {}
   virtual void SetLoadArchiveFile(bool archive) {}
+  virtual PassKeyStat::Summary GetPassKeyStat() {
+    return PassKeyStat::Summary();
+  }
  protected:
   virtual int ReceiveFromClient(int msg_type,
                                 int client_id,
@@ -413,6 +419,11 @@ class MultiSlotDataset : public DatasetImpl<Record> {
   virtual int ReceiveFromClient(int msg_type,
                                 int client_id,
                                 const std::string& msg);
+  // merges the records of one ins id, returns false if they are dropped
+  bool MergeInsIdRecords(const std::vector<std::string>& use_slots,
+                         const std::vector<bool>& use_slots_is_dense,
+                         std::vector<Record>* recs,
+                         Record* merged);
 };
 class SlotRecordDataset : public DatasetImpl<SlotRecord> {
  public:
@@ -499,6 +510,10 @@ class PadBoxSlotDataset : public DatasetImpl<SlotRecord> {
   double GetOtherTime(void) { return other_timer_.ElapsedSec(); }
   double GetMergeTime(void) { return max_merge_ins_span_; }
   uint16_t GetPassId(void) { return pass_id_; }
+  virtual PassKeyStat::Summary GetPassKeyStat() {
+    return key_stat_ == nullptr ? PassKeyStat::Summary()
+                                : key_stat_->summary();
+  }
   // aucrunner
   std::set<uint16_t> GetSlotsIdx(const std::set<std::string>& str_slots) {
     std::set<uint16_t> slots_idx;
@@ -549,6 +564,9 @@ class PadBoxSlotDataset : public DatasetImpl<SlotRecord> {
   std::atomic<int> merge_ins_ref_{0};
   std::mutex merge_mutex_;
   std::vector<int> used_fea_index_;
+  // the slot names of used_fea_index_ for the key statistics
+  std::vector<std::string> used_fea_names_;
+  std::unique_ptr<PassKeyStat> key_stat_;
   int merge_thread_num_ = FLAGS_padbox_dataset_merge_thread_num;
   paddle::framework::ThreadPool* merge_pool_ = nullptr;
   paddle::framework::ThreadPool* shuffle_pool_ = nullptr;
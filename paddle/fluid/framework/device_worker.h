@@ -56,6 +56,11 @@ namespace framework {
 class ProgramDesc;
 class Scope;
 }  // namespace framework
+namespace memory {
+namespace allocation {
+class BatchArena;
+}  // namespace allocation
+}  // namespace memory
 }  // namespace paddle
 
 #if defined(PADDLE_WITH_NCCL) || defined(PADDLE_WITH_RCCL)
@@ -356,6 +361,32 @@ class DownpourWorker : public HogwildWorker {
   std::set<uint64_t> condvalue_set_;
   bool flag_partial_push_;
 
+  // sparse prefetch: the next batch is read into prefetch_scope_ and its
+  // sparse values are pulled while the current batch runs
+  void InitSparsePrefetch();
+  int NextBatch();
+  void PrefetchNextBatch();
+  void WaitPrefetch();
+  void RefreshPrefetchedValues();
+  int prefetch_staleness_ = -1;
+  bool prefetch_pending_ = false;
+  int prefetch_batch_ = 0;
+  Scope* prefetch_scope_ = nullptr;
+  std::vector<std::string> prefetch_feed_names_;
+  // slots which have embedding of each table
+  std::map<uint64_t, std::vector<std::string>> prefetch_key_names_;
+  std::map<uint64_t, std::vector<uint64_t>> prefetch_features_;
+  std::map<uint64_t, std::vector<std::vector<float>>> prefetch_values_;
+  std::map<uint64_t, std::vector<float*>> prefetch_result_ptr_;
+  std::map<uint64_t, std::future<int32_t>> prefetch_status_;
+  // tables whose prefetch pull of the next batch succeeded
+  std::set<uint64_t> prefetch_ready_;
+  // tables whose values of the current batch are pulled by the prefetch
+  std::set<uint64_t> prefetched_tables_;
+  platform::Timer prefetch_wait_timer_;
+  platform::Timer prefetch_refresh_timer_;
+  platform::Timer sync_pull_timer_;
+
  private:
   // std::vector<std::string> dump_param_;
   // just save the value in param_ for easy access
@@ -870,6 +901,14 @@ class BoxPSWorker : public DeviceWorker {
     size_t len;
     int fileid;
   };
+  // op run plan, build once after thread scope and ops created
+  struct OpRunPlan {
+    OperatorBase* op = nullptr;
+    bool sync_point = false;
+    std::vector<Variable*> gc_vars;
+    // the names of gc_vars, for the gc logs and errors
+    std::vector<std::string> gc_var_names;
+  };
  public:
   BoxPSWorker() {}
   ~BoxPSWorker() override {}
@@ -902,11 +941,14 @@ class BoxPSWorker : public DeviceWorker {
   int64_t AllocParamTensor(const ProgramDesc& program, int64_t* pad_len);
   int64_t AllocParamTensorAsync(const ProgramDesc& program);
   void SyncParam(void);
+  void SyncParamByGloo(void);
   void BuildShardingDepends(const ProgramDesc& program);
   void CreateThreadScopeForAsync(const ProgramDesc& program);
   void CreateThreadScopeForSharding(const ProgramDesc& program);
   void CreateThreadScopeForNorm(const ProgramDesc& program);
   void CreateThreadOperators(const ProgramDesc& program);
+  void BuildOpRunPlan(void);
+  bool CanCacheOpRun(const OperatorBase* op) const;
   int IsParameter(const std::string& name, bool full_match);
 
  protected:
@@ -937,6 +979,9 @@ class BoxPSWorker : public DeviceWorker {
   bool one_ring_ = false;
   int device_num_ = 0;
   int node_size_ = 1;
+  // cpu dense sync by gloo
+  std::shared_ptr<paddle::framework::ThreadPool> gloo_sync_pool_ = nullptr;
+  std::vector<uint16_t> gloo_sync_buffer_;
 
   // skip vars
   std::vector<std::string> skip_vars_;
@@ -957,6 +1002,7 @@ class BoxPSWorker : public DeviceWorker {
   bool sharding_mode_ = false;
   // op extend
   std::unordered_set<const OperatorBase*> sync_points_;
+  std::vector<OpRunPlan> op_plans_;
   // dump file
   int dump_thread_num_ = 20;
   std::string dump_fields_path_ = "";
@@ -964,6 +1010,8 @@ class BoxPSWorker : public DeviceWorker {
   // dump thread
   std::shared_ptr<paddle::framework::ThreadPool> dump_thread_pool_ =
       nullptr;
+  // cpu batch temporaries arena
+  std::shared_ptr<memory::allocation::BatchArena> batch_arena_ = nullptr;
 };
 #endif
 
@@ -12,10 +12,13 @@ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License. */
 
+#include "gflags/gflags.h"
 #include "paddle/fluid/framework/device_worker.h"
 #include "paddle/fluid/framework/fleet/metrics.h"
 #include "paddle/fluid/platform/cpu_helper.h"
 
+DECLARE_int32(downpour_sparse_prefetch_staleness);
+
 namespace phi {
 class DenseTensor;
 }  // namespace phi
@@ -795,13 +798,189 @@ inline void AddAucMonitor(const Scope* scope, const platform::Place& place) {
 }
 #endif
 
+void DownpourWorker::InitSparsePrefetch() {
+  prefetch_staleness_ = FLAGS_downpour_sparse_prefetch_staleness;
+  prefetch_pending_ = false;
+  prefetch_batch_ = 0;
+  prefetch_key_names_.clear();
+  prefetch_ready_.clear();
+  prefetched_tables_.clear();
+  prefetch_wait_timer_.Reset();
+  prefetch_refresh_timer_.Reset();
+  sync_pull_timer_.Reset();
+  if (prefetch_staleness_ < 0) {
+    return;
+  }
+  PADDLE_ENFORCE_LE(
+      prefetch_staleness_,
+      1,
+      platform::errors::InvalidArgument(
+          "The staleness of the sparse prefetch should be 0 or 1, but got %d.",
+          prefetch_staleness_));
+  // the dumped fields take the instance ids of the batch read last
+  if (need_dump_field_) {
+    VLOG(0) << "sparse prefetch is disabled because of dump fields";
+    prefetch_staleness_ = -1;
+    return;
+  }
+  prefetch_feed_names_ = device_reader_->GetUseSlotAlias();
+  std::unordered_set<std::string> feed_names(prefetch_feed_names_.begin(),
+                                             prefetch_feed_names_.end());
+  for (int i = 0; i < param_.program_config(0).pull_sparse_table_id_size();
+       ++i) {
+    uint64_t tid = static_cast<uint64_t>(
+        param_.program_config(0).pull_sparse_table_id(i));
+    auto& key_names = prefetch_key_names_[tid];
+    for (size_t j = 0; j < sparse_key_names_[tid].size(); ++j) {
+      const std::string& name = sparse_key_names_[tid][j];
+      // skip the slots PullSparseVarsSync skips
+      if (thread_scope_->FindVar(name) == nullptr ||
+          thread_scope_->FindVar(sparse_value_names_[tid][j]) == nullptr) {
+        continue;
+      }
+      if (feed_names.count(name) == 0) {
+        VLOG(0) << "sparse prefetch is disabled because slot " << name
+                << " of table " << tid << " is not fed by the data feed";
+        prefetch_staleness_ = -1;
+        return;
+      }
+      key_names.push_back(name);
+    }
+  }
+  if (prefetch_scope_ == nullptr) {
+    prefetch_scope_ = &root_scope_->NewScope();
+  }
+  for (auto& name : prefetch_feed_names_) {
+    prefetch_scope_->Var(name)->GetMutable<LoDTensor>();
+  }
+  VLOG(3) << "sparse prefetch of thread " << thread_id_ << " with staleness "
+          << prefetch_staleness_;
+}
+
+int DownpourWorker::NextBatch() {
+  prefetched_tables_.clear();
+  if (prefetch_staleness_ < 0 || !prefetch_pending_) {
+    return device_reader_->Next();
+  }
+  prefetch_pending_ = false;
+  if (prefetch_batch_ <= 0) {
+    return prefetch_batch_;
+  }
+  WaitPrefetch();
+  prefetched_tables_.swap(prefetch_ready_);
+  prefetch_ready_.clear();
+  for (auto& it : prefetch_features_) {
+    features_[it.first].swap(it.second);
+    feature_values_[it.first].swap(prefetch_values_[it.first]);
+  }
+  // the tensors are swapped, so the data feed never writes the batch in use
+  for (auto& name : prefetch_feed_names_) {
+    LoDTensor* cur = thread_scope_->FindVar(name)->GetMutable<LoDTensor>();
+    LoDTensor* next = prefetch_scope_->FindVar(name)->GetMutable<LoDTensor>();
+    std::swap(*cur, *next);
+  }
+  return prefetch_batch_;
+}
+
+void DownpourWorker::PrefetchNextBatch() {
+  if (prefetch_staleness_ < 0) {
+    return;
+  }
+  device_reader_->AssignFeedVar(*prefetch_scope_);
+  prefetch_batch_ = device_reader_->Next();
+  device_reader_->AssignFeedVar(*thread_scope_);
+  prefetch_pending_ = true;
+  if (prefetch_batch_ <= 0) {
+    return;
+  }
+  for (int i = 0; i < param_.program_config(0).pull_sparse_table_id_size();
+       ++i) {
+    uint64_t tid = static_cast<uint64_t>(
+        param_.program_config(0).pull_sparse_table_id(i));
+    TableParameter table;
+    for (auto j : param_.sparse_table()) {
+      if (j.table_id() == tid) {
+        table = j;
+        break;
+      }
+    }
+    prefetch_status_[tid] =
+        fleet_ptr_->PullSparseVarsAsync(*prefetch_scope_,
+                                        tid,
+                                        prefetch_key_names_[tid],
+                                        &prefetch_features_[tid],
+                                        &prefetch_values_[tid],
+                                        table.fea_dim(),
+                                        &prefetch_result_ptr_[tid]);
+  }
+}
+
+void DownpourWorker::WaitPrefetch() {
+  prefetch_wait_timer_.Resume();
+  for (auto& it : prefetch_status_) {
+    if (!it.second.valid()) {
+      continue;
+    }
+    it.second.wait();
+    int32_t status = -1;
+    try {
+      status = it.second.get();
+    } catch (const std::future_error& e) {
+      VLOG(0) << "Caught a future_error with code" << e.code()
+              << ", Message:" << e.what();
+    }
+    if (status == 0) {
+      prefetch_ready_.insert(it.first);
+    } else {
+      // the table is pulled again in sync mode
+      VLOG(0) << "fleet prefetch pull sparse of table " << it.first
+              << " failed, status[" << status << "]";
+    }
+  }
+  prefetch_wait_timer_.Pause();
+}
+
+void DownpourWorker::RefreshPrefetchedValues() {
+  if (prefetch_staleness_ != 0 || !prefetch_pending_ || prefetch_batch_ <= 0) {
+    return;
+  }
+  WaitPrefetch();
+  prefetch_refresh_timer_.Resume();
+  for (int i = 0; i < param_.program_config(0).push_sparse_table_id_size();
+       ++i) {
+    uint64_t tid = static_cast<uint64_t>(
+        param_.program_config(0).push_sparse_table_id(i));
+    if (prefetch_ready_.count(tid) == 0) {
+      continue;
+    }
+    // the keys of the next batch pushed by this batch are pulled again
+    std::unordered_set<uint64_t> pushed(features_[tid].begin(),
+                                        features_[tid].end());
+    auto& next_keys = prefetch_features_[tid];
+    auto& next_ptr = prefetch_result_ptr_[tid];
+    std::vector<uint64_t> keys;
+    std::vector<float*> values;
+    for (size_t j = 0; j < next_keys.size(); ++j) {
+      if (pushed.count(next_keys[j]) > 0) {
+        keys.push_back(next_keys[j]);
+        values.push_back(next_ptr[j]);
+      }
+    }
+    VLOG(3) << "refresh " << keys.size() << " of " << next_keys.size()
+            << " prefetched keys of table " << tid;
+    fleet_ptr_->PullSparseKeysSync(tid, keys, values);
+  }
+  prefetch_refresh_timer_.Pause();
+}
+
 void DownpourWorker::TrainFiles() {
   VLOG(3) << "Begin to train files";
   platform::SetNumThreads(1);
   device_reader_->Start();
   int batch_cnt = 0;
   int cur_batch;
-  while ((cur_batch = device_reader_->Next()) > 0) {
+  InitSparsePrefetch();
+  while ((cur_batch = NextBatch()) > 0) {
     if (copy_table_config_.need_copy()) {
       if (batch_cnt % copy_table_config_.batch_num() == 0) {
         CopySparseTable();
@@ -821,13 +1000,17 @@ void DownpourWorker::TrainFiles() {
           break;
         }
       }
-      fleet_ptr_->PullSparseVarsSync(*thread_scope_,
-                                     tid,
-                                     sparse_key_names_[tid],
-                                     &features_[tid],
-                                     &feature_values_[tid],
-                                     table.fea_dim(),
-                                     sparse_value_names_[tid]);
+      if (prefetched_tables_.count(tid) == 0) {
+        sync_pull_timer_.Resume();
+        fleet_ptr_->PullSparseVarsSync(*thread_scope_,
+                                       tid,
+                                       sparse_key_names_[tid],
+                                       &features_[tid],
+                                       &feature_values_[tid],
+                                       table.fea_dim(),
+                                       sparse_value_names_[tid]);
+        sync_pull_timer_.Pause();
+      }
       CollectLabelInfo(i);
       FillSparseValue(i);
       auto nid_iter = std::find(sparse_value_names_[tid].begin(),
@@ -838,6 +1021,8 @@ void DownpourWorker::TrainFiles() {
       }
     }
     VLOG(3) << "fill sparse value for all sparse table done.";
+    // the next batch is pulled while this batch runs
+    PrefetchNextBatch();
 
     // do computation here
     for (auto& op : ops_) {
@@ -1034,6 +1219,14 @@ void DownpourWorker::TrainFiles() {
 
     if (need_to_push_sparse_) {
       VLOG(3) << "push sparse gradient done.";
+      if (prefetch_staleness_ >= 0) {
+        // the pull of the batch after next sees this push, with staleness 0
+        // the next batch pulls again the keys pushed by this batch
+        for (auto& t : push_sparse_status_) {
+          t.wait();
+        }
+        RefreshPrefetchedValues();
+      }
       int32_t tmp_push_sparse_wait_times = -1;
       static uint32_t push_sparse_wait_times =
           static_cast<uint32_t>(tmp_push_sparse_wait_times);
@@ -1076,6 +1269,13 @@ void DownpourWorker::TrainFiles() {
     CopyDenseTable();
     CopyDenseVars();
   }
+  if (prefetch_staleness_ >= 0) {
+    VLOG(0) << "thread " << thread_id_ << " sparse prefetch staleness "
+            << prefetch_staleness_ << ", batch " << batch_cnt
+            << ", prefetch wait " << prefetch_wait_timer_.ElapsedSec()
+            << "s, refresh " << prefetch_refresh_timer_.ElapsedSec()
+            << "s, sync pull " << sync_pull_timer_.ElapsedSec() << "s";
+  }
 }
 
 }  // end namespace framework
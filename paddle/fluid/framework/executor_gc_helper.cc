@@ -176,6 +176,34 @@ GetUnusedVars(const BlockDesc &block,
   return result;
 }
 
+static void CollectGarbages(
+    const std::string &var_name,
+    Variable *var,
+    std::deque<std::shared_ptr<memory::Allocation>> *garbages) {
+  VLOG(2) << "Erase variable " << var_name;
+  if (var->IsType<LoDTensor>()) {
+    garbages->emplace_back(var->GetMutable<LoDTensor>()->MoveMemoryHolder());
+  } else if (var->IsType<phi::SelectedRows>()) {
+    garbages->emplace_back(var->GetMutable<phi::SelectedRows>()
+                               ->mutable_value()
+                               ->MoveMemoryHolder());
+  } else if (var->IsType<LoDTensorArray>()) {
+    auto *lod_tensor_arr = var->GetMutable<LoDTensorArray>();
+    for (auto &t : *lod_tensor_arr) {
+      garbages->emplace_back(t.MoveMemoryHolder());
+    }
+    // NOTE(wangxi): need clear the vector, otherwise lod_tensor_arr.size() is
+    // wrong, if size() decrease in next step, an error maybe occur.
+    lod_tensor_arr->clear();
+  } else if (var->IsType<Strings>()) {
+  } else {
+    PADDLE_THROW(platform::errors::Unimplemented(
+        "Type %s of variable %s is not supported eager deletion.",
+        framework::ToTypeName(var->Type()),
+        var_name));
+  }
+}
+
 void DeleteUnusedTensors(const Scope &scope,
                          const std::vector<std::string> &delete_vars,
                          GarbageCollector *gc) {
@@ -186,29 +214,28 @@ void DeleteUnusedTensors(const Scope &scope,
     if (var == nullptr) {
       continue;
     }
+    CollectGarbages(var_name, var, &garbages);
+  }
 
-    VLOG(2) << "Erase variable " << var_name;
-    if (var->IsType<LoDTensor>()) {
-      garbages.emplace_back(var->GetMutable<LoDTensor>()->MoveMemoryHolder());
-    } else if (var->IsType<phi::SelectedRows>()) {
-      garbages.emplace_back(var->GetMutable<phi::SelectedRows>()
-                                ->mutable_value()
-                                ->MoveMemoryHolder());
-    } else if (var->IsType<LoDTensorArray>()) {
-      auto *lod_tensor_arr = var->GetMutable<LoDTensorArray>();
-      for (auto &t : *lod_tensor_arr) {
-        garbages.emplace_back(t.MoveMemoryHolder());
-      }
-      // NOTE(wangxi): need clear the vector, otherwise lod_tensor_arr.size() is
-      // wrong, if size() decrease in next step, an error maybe occur.
-      lod_tensor_arr->clear();
-    } else if (var->IsType<Strings>()) {
-    } else {
-      PADDLE_THROW(platform::errors::Unimplemented(
-          "Type %s of variable %s is not supported eager deletion.",
-          framework::ToTypeName(var->Type()),
-          var_name));
-    }
+  if (!garbages.empty()) {
+    gc->Add(std::move(garbages));
+  }
+}
+
+void DeleteUnusedTensors(const std::vector<Variable *> &delete_vars,
+                         const std::vector<std::string> &var_names,
+                         GarbageCollector *gc) {
+  PADDLE_ENFORCE_EQ(delete_vars.size(),
+                    var_names.size(),
+                    platform::errors::InvalidArgument(
+                        "The number of variables %d and names %d to delete "
+                        "differ",
+                        delete_vars.size(),
+                        var_names.size()));
+  std::deque<std::shared_ptr<memory::Allocation>> garbages;
+
+  for (size_t i = 0; i < delete_vars.size(); ++i) {
+    CollectGarbages(var_names[i], delete_vars[i], &garbages);
   }
 
   if (!garbages.empty()) {
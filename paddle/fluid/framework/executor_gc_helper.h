@@ -56,6 +56,11 @@ void DeleteUnusedTensors(const Scope &scope,
                          const std::vector<std::string> &delete_vars,
                          GarbageCollector *gc);
 
+// Collect unused tensors of resolved variables, var_names are their names
+void DeleteUnusedTensors(const std::vector<Variable *> &delete_vars,
+                         const std::vector<std::string> &var_names,
+                         GarbageCollector *gc);
+
 // Collect unused tensors after op runs
 void DeleteUnusedTensors(
     const Scope &scope,
@@ -0,0 +1,116 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/fleet/box_trace.h"
+
+#include <algorithm>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "paddle/fluid/platform/os_info.h"
+#include "paddle/fluid/platform/profiler.h"
+#include "paddle/fluid/platform/profiler/profiler.h"
+#include "paddle/fluid/string/printf.h"
+
+DECLARE_string(padbox_trace_dir);
+DECLARE_int32(padbox_trace_level);
+DECLARE_int32(padbox_trace_pass_interval);
+DECLARE_int32(padbox_trace_batch_interval);
+
+namespace paddle {
+namespace framework {
+
+constexpr uint32_t BoxTracer::kBoxTraceLevel;
+constexpr uint32_t BoxTracer::kNoTraceLevel;
+thread_local bool BoxTracer::batch_sampled_ = true;
+
+BoxTracer& BoxTracer::GetInstance() {
+  static BoxTracer tracer;
+  return tracer;
+}
+
+BoxTracer::BoxTracer() {}
+
+BoxTracer::~BoxTracer() {}
+
+void BoxTracer::BeginFeedPass() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (in_pass_ || feed_begun_) {
+    return;
+  }
+  feed_begun_ = true;
+  ++pass_id_;
+  StartLocked();
+}
+
+void BoxTracer::BeginPass() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  in_pass_ = true;
+  if (feed_begun_) {
+    feed_begun_ = false;
+    return;
+  }
+  ++pass_id_;
+  StartLocked();
+}
+
+void BoxTracer::StartLocked() {
+  if (FLAGS_padbox_trace_dir.empty() || profiler_ != nullptr) {
+    return;
+  }
+  int interval = std::max(FLAGS_padbox_trace_pass_interval, 1);
+  if (pass_id_ % interval != 0) {
+    return;
+  }
+  platform::ProfilerOptions options;
+  options.trace_switch = 1 << platform::kProfileCPUOptionBit;
+  options.trace_level = FLAGS_padbox_trace_level;
+  profiler_ = platform::Profiler::Create(options);
+  if (profiler_ == nullptr) {
+    LOG(WARNING) << "another profiler is running, pass " << pass_id_
+                 << " is not traced";
+    return;
+  }
+  platform::EnableHostEventRecorder();
+  profiler_->Prepare();
+  profiler_->Start();
+  pass_event_.reset(new platform::RecordEvent(
+      "BoxPS::Pass", platform::TracerEventType::ProfileStep, kBoxTraceLevel));
+}
+
+void BoxTracer::EndPass() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  in_pass_ = false;
+  if (profiler_ == nullptr) {
+    return;
+  }
+  pass_event_->End();
+  pass_event_.reset();
+  auto result = profiler_->Stop();
+  profiler_.reset();
+  std::string path = string::Sprintf("%s/boxps_pass_%d_pid_%d.json",
+                                     FLAGS_padbox_trace_dir,
+                                     pass_id_,
+                                     platform::GetProcessId());
+  result->Save(path, "json");
+  VLOG(0) << "pass " << pass_id_ << " trace saved to " << path;
+}
+
+BoxTracer::BatchScope::BatchScope(int64_t batch_id) {
+  int interval = std::max(FLAGS_padbox_trace_batch_interval, 1);
+  batch_sampled_ = (batch_id % interval == 0);
+}
+
+}  // namespace framework
+}  // namespace paddle
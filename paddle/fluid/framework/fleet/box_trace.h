@@ -0,0 +1,93 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+
+#include "paddle/fluid/platform/profiler/event_tracing.h"
+
+namespace paddle {
+namespace platform {
+class Profiler;
+}  // namespace platform
+
+namespace framework {
+
+// BoxTracer records the BoxPS pass lifecycle as host events of the new
+// profiler and saves every traced pass as one chrome://tracing file in
+// FLAGS_padbox_trace_dir. The trace of a pass spans its feed phase (reading,
+// merging and shuffling the instances, the feed pass of BoxPS) to EndPass.
+//
+// The pass, feed pass and batch stages are RecordEvents at level
+// kBoxTraceLevel, the ops are at level 1, so FLAGS_padbox_trace_level 0
+// records only the BoxPS stages and 1 adds the ops. Only one pass in
+// FLAGS_padbox_trace_pass_interval is traced and inside it the batch events
+// of one batch in FLAGS_padbox_trace_batch_interval, so it can stay on in
+// production. Outside of a traced pass a RecordEvent is one level compare.
+class BoxTracer {
+ public:
+  static constexpr uint32_t kBoxTraceLevel = 0;
+  // never traced, used for the batches that are not sampled
+  static constexpr uint32_t kNoTraceLevel = UINT32_MAX;
+
+  static BoxTracer& GetInstance();
+
+  // start the tracing of a sampled pass at the start of its feed phase,
+  // nothing when tracing is off. A feed phase which overlaps the training of
+  // the previous pass (preload) is recorded in the trace of that pass.
+  void BeginFeedPass();
+  // start the tracing of a sampled pass unless its feed phase did already
+  void BeginPass();
+  // stop the tracing of the pass and save the trace file
+  void EndPass();
+
+  // the level of the events of the calling thread, kNoTraceLevel while the
+  // thread runs a batch which is not sampled
+  static uint32_t Level(uint32_t level = kBoxTraceLevel) {
+    return batch_sampled_ ? level : kNoTraceLevel;
+  }
+
+  // marks the batches of a worker thread as sampled or not for its lifetime
+  class BatchScope {
+   public:
+    explicit BatchScope(int64_t batch_id);
+    ~BatchScope() { batch_sampled_ = true; }
+  };
+
+ private:
+  BoxTracer();
+  ~BoxTracer();
+
+  static thread_local bool batch_sampled_;
+
+  // open the trace window of pass pass_id_ if it is sampled
+  void StartLocked();
+
+  std::mutex mutex_;
+  std::unique_ptr<platform::Profiler> profiler_;
+  std::unique_ptr<platform::RecordEvent> pass_event_;
+  // passes begun so far, the id of the current pass
+  int pass_id_ = -1;
+  // between BeginPass and EndPass
+  bool in_pass_ = false;
+  // the feed phase of the next pass has begun its trace
+  bool feed_begun_ = false;
+};
+
+}  // namespace framework
+}  // namespace paddle
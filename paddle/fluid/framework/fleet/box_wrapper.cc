@@ -27,6 +27,7 @@
 #endif
 
 DECLARE_bool(use_gpu_replica_cache);
+DECLARE_int32(padbox_input_table_lookup_thread_num);
 DECLARE_int32(gpu_replica_cache_dim);
 DECLARE_bool(enable_force_hbm_recyle);
 DECLARE_bool(enable_force_mem_recyle);
@@ -87,6 +88,9 @@ void BoxWrapper::PullSparse(const paddle::platform::Place& place,
                             const int expand_embed_dim,
                             const int skip_offset,
                             bool expand_only) {
+  platform::RecordEvent record_event("BoxWrapper::PullSparse",
+                                     platform::TracerEventType::Communication,
+                                     BoxTracer::Level());
   PullSparseCase(place,
                  keys,
                  values,
@@ -106,6 +110,9 @@ void BoxWrapper::PushSparseGrad(const paddle::platform::Place& place,
                                 const int batch_size,
                                 const int skip_offset,
                                 bool expand_only) {
+  platform::RecordEvent record_event("BoxWrapper::PushSparseGrad",
+                                     platform::TracerEventType::Communication,
+                                     BoxTracer::Level());
   PushSparseGradCase(place,
                      keys,
                      grad_values,
@@ -127,6 +134,9 @@ void BoxWrapper::FeedPass(int date,
 }
 
 void BoxWrapper::BeginFeedPass(int date, boxps::PSAgentBase** agent) {
+  platform::RecordEvent record_event("BoxWrapper::BeginFeedPass",
+                                     platform::TracerEventType::UserDefined,
+                                     BoxTracer::kBoxTraceLevel);
   if (FLAGS_enable_force_mem_recyle) {
     SlotRecordPool().disable_pool(FLAGS_enbale_slotpool_auto_clear);
   } else {
@@ -141,7 +151,8 @@ void BoxWrapper::BeginFeedPass(int date, boxps::PSAgentBase** agent) {
   }
   if (input_table_dim_ > 0) {
     VLOG(3) << "lookup input dim: " << input_table_dim_;
-    input_table_deque_.emplace_back(input_table_dim_);
+    input_table_deque_.emplace_back(
+        input_table_dim_, FLAGS_padbox_input_table_lookup_thread_num);
   }
   PADDLE_ENFORCE_EQ(
       ret,
@@ -150,6 +161,9 @@ void BoxWrapper::BeginFeedPass(int date, boxps::PSAgentBase** agent) {
 }
 
 void BoxWrapper::EndFeedPass(boxps::PSAgentBase* agent) {
+  platform::RecordEvent record_event("BoxWrapper::EndFeedPass",
+                                     platform::TracerEventType::UserDefined,
+                                     BoxTracer::kBoxTraceLevel);
   if (FLAGS_use_gpu_replica_cache) {
     auto& t = gpu_replica_cache.back();
     t.ToHBM();
@@ -298,6 +312,39 @@ void BoxWrapper::RecordReplaceBack(std::vector<SlotRecord>* records,
           << "add feasign num: " << add_num.sum();
 }
 
+void BoxWrapper::RecordOverlay(const std::vector<SlotRecord>& records,
+                               const std::set<uint16_t>& slots) {
+  platform::Timer timer;
+  timer.Start();
+
+  std::lock_guard<std::mutex> lock(mutex4random_pool_);
+  slot_overlay_.Reset(slots, slots.empty() ? 0 : records.size());
+  if (slots.empty()) {
+    return;
+  }
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < auc_runner_thread_num_; ++tid) {
+    threads.push_back(std::thread([this, &records, tid]() {
+      size_t ins_num = records.size();
+      size_t start = tid * ins_num / auc_runner_thread_num_;
+      size_t end = (tid + 1) * ins_num / auc_runner_thread_num_;
+      for (size_t j = start; j < end; ++j) {
+        auto info = get_auc_runner_info(records[j]);
+        auto& random_pool = random_ins_pool_list[info->pool_id_];
+        slot_overlay_.Set(info->record_id_,
+                          random_pool.GetUseReplaceId(info->replaced_id_));
+      }
+    }));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  timer.Pause();
+  VLOG(0) << "RecordOverlay slots: " << slots.size()
+          << ", ins num: " << records.size()
+          << ", cost: " << timer.ElapsedMS();
+}
+
 void BoxWrapper::GetRandomReplace(std::vector<SlotRecord>* records) {
   VLOG(0) << "Begin GetRandomReplace";
   platform::Timer timer;
@@ -39,6 +39,8 @@ limitations under the License. */
 
 #include "paddle/fluid/framework/data_feed.h"
 #include "paddle/fluid/framework/data_set.h"
+#include "paddle/fluid/framework/fleet/box_trace.h"
+#include "paddle/fluid/framework/fleet/input_table.h"
 #include "paddle/fluid/framework/fleet/metrics.h"
 #include "paddle/fluid/framework/lod_tensor.h"
 #include "paddle/fluid/framework/scope.h"
@@ -51,6 +53,7 @@ limitations under the License. */
 #define BUF_SIZE 1024 * 1024
 
 DECLARE_bool(padbox_auc_runner_mode);
+DECLARE_bool(padbox_auc_runner_slot_overlay);
 DECLARE_bool(enable_dense_nccl_barrier);
 DECLARE_int32(padbox_dataset_shuffle_thread_num);
 
@@ -121,80 +124,6 @@ class GpuReplicaCache {
   std::vector<float> h_emb_;
 };
 
-class InputTable {
- public:
-  explicit InputTable(uint64_t dim) : dim_(dim), miss_(0) {
-    // add default vec 0 => [0, 0, ...]
-    std::vector<float> vec(dim_, 0);
-    AddIndexData("-", vec);
-  }
-
-  void AddIndexData(const std::string& key, const std::vector<float>& vec) {
-    PADDLE_ENFORCE_EQ(vec.size(), dim_);
-
-    table_mutex_.lock();
-    key_offset_.emplace(key, table_.size());
-    table_.insert(table_.end(), vec.begin(), vec.end());
-    table_mutex_.unlock();
-  }
-
-  uint64_t GetIndexOffset(const std::string& key) {
-    auto it = key_offset_.find(key);
-    if (it == key_offset_.end()) {
-      ++miss_;
-      return 0;
-    }
-
-    return it->second;
-  }
-
-  void LookupInput(uint64_t* keys,
-                   float* values,
-                   uint64_t num,
-                   size_t device_id) {
-    std::vector<uint64_t> d_keys;
-    std::vector<float> d_values;
-    d_keys.resize(num);
-    d_values.resize(num * dim_);
-#if defined(PADDLE_WITH_CUDA)
-    cudaSetDevice(device_id);
-    cudaMemcpy(d_keys.data(),
-               keys,
-               d_keys.size() * sizeof(uint64_t),
-               cudaMemcpyDeviceToHost);
-#else
-    PADDLE_THROW(phi::errors::Unimplemented("not supported platform."));
-#endif
-    for (size_t i = 0; i < num; ++i) {
-      memcpy(&d_values[i * dim_], &table_[d_keys[i]], dim_ * sizeof(float));
-    }
-#if defined(PADDLE_WITH_CUDA)
-    cudaMemcpy(values,
-               d_values.data(),
-               d_values.size() * sizeof(float),
-               cudaMemcpyHostToDevice);
-#else
-    PADDLE_THROW(phi::errors::Unimplemented("not supported platform."));
-#endif
-  }
-
-  size_t size() const { return key_offset_.size(); }
-
-  size_t miss() const { return miss_; }
-
-  size_t dim() const { return dim_; }
-
-  double CpuMemUsed(void) {
-    return (key_offset_.size() * dim_ * sizeof(float)) / 1024.0 / 1024.0;
-  }
-
- protected:
-  uint64_t dim_;
-  std::mutex table_mutex_;
-  std::unordered_map<std::string, uint64_t> key_offset_;
-  std::vector<float> table_;
-  std::atomic<size_t> miss_;
-};
 class DCacheBuffer {
  public:
   DCacheBuffer() : d_buf_(nullptr), total_bytes_(0), buf_(nullptr) {}
@@ -975,6 +904,7 @@ class BoxWrapper {
     }
     record_replacers_.clear();
     last_slots_idx_.clear();
+    slot_overlay_.Clear();
 
     timer.Pause();
     VLOG(0) << "PopAucRunnerResource cost: " << timer.ElapsedMS();
@@ -987,6 +917,14 @@ class BoxWrapper {
                      const std::set<uint16_t>& slots);
   void RecordReplaceBack(std::vector<SlotRecord>* records,
                          const std::set<uint16_t>& slots);
+  // points the overlay of the feed to the replaced slots of the records
+  void RecordOverlay(const std::vector<SlotRecord>& records,
+                     const std::set<uint16_t>& slots);
+  const SlotReplaceOverlay* GetSlotReplaceOverlay() const {
+    return (mode_ == 1 && !slot_overlay_.Empty()) ? &slot_overlay_ : nullptr;
+  }
+  // the key sketches of the latest passes of all the datasets
+  PassKeyHistory* GetPassKeyHistory() { return &pass_key_history_; }
 
   // aucrunner
   void SetReplacedSlots(const std::set<uint16_t>& slot_index_to_replace) {
@@ -1004,6 +942,8 @@ class BoxWrapper {
 
   std::vector<FeasignValuesCandidateList> random_ins_pool_list;
   std::mutex mutex4random_pool_;
+  SlotReplaceOverlay slot_overlay_;
+  PassKeyHistory pass_key_history_;
   std::set<std::string> slot_eval_set_;
   std::atomic<uint16_t> dataset_id_{0};
   std::atomic<uint16_t> round_id_{0};
@@ -1051,20 +991,32 @@ class BoxHelper {
             << ", day=" << day << ", day id=" << day_id_;
   }
   void BeginPass() {
+    // opens the pass timeline unless its feed phase did already
+    BoxTracer::GetInstance().BeginPass();
 #ifdef PADDLE_WITH_BOX_PS
+    platform::RecordEvent record_event("BoxHelper::BeginPass",
+                                       platform::TracerEventType::UserDefined,
+                                       BoxTracer::kBoxTraceLevel);
     auto box_ptr = BoxWrapper::GetInstance();
     box_ptr->BeginPass();
 #endif
   }
   void EndPass(bool need_save_delta) {
 #ifdef PADDLE_WITH_BOX_PS
-    auto box_ptr = BoxWrapper::GetInstance();
-    box_ptr->EndPass(need_save_delta);
-
-    if (box_ptr->Mode() == 1) {
-      box_ptr->PopAucRunnerResource();
+    {
+      platform::RecordEvent record_event(
+          "BoxHelper::EndPass",
+          platform::TracerEventType::UserDefined,
+          BoxTracer::kBoxTraceLevel);
+      auto box_ptr = BoxWrapper::GetInstance();
+      box_ptr->EndPass(need_save_delta);
+
+      if (box_ptr->Mode() == 1) {
+        box_ptr->PopAucRunnerResource();
+      }
     }
 #endif
+    BoxTracer::GetInstance().EndPass();
   }
 #ifdef PADDLE_WITH_BOX_PS
   void LoadAucRunnerData(PadBoxSlotDataset* dataset,
@@ -1084,6 +1036,10 @@ class BoxHelper {
   }
 #endif
   void ReadData2Memory() {
+    BoxTracer::GetInstance().BeginFeedPass();
+    platform::RecordEvent record_event("BoxHelper::ReadData2Memory",
+                                       platform::TracerEventType::Dataloader,
+                                       BoxTracer::kBoxTraceLevel);
     platform::Timer timer;
     VLOG(3) << "Begin ReadData2Memory(), dataset[" << dataset_ << "]";
 #ifdef PADDLE_WITH_BOX_PS
@@ -1126,6 +1082,10 @@ class BoxHelper {
   }
 
   void LoadIntoMemory() {
+    BoxTracer::GetInstance().BeginFeedPass();
+    platform::RecordEvent record_event("BoxHelper::LoadIntoMemory",
+                                       platform::TracerEventType::Dataloader,
+                                       BoxTracer::kBoxTraceLevel);
     platform::Timer timer;
     VLOG(3) << "Begin LoadIntoMemory(), dataset[" << dataset_ << "]";
     timer.Start();
@@ -1141,6 +1101,10 @@ class BoxHelper {
   }
   void PreLoadIntoMemory() {
 #ifdef PADDLE_WITH_BOX_PS
+    BoxTracer::GetInstance().BeginFeedPass();
+    platform::RecordEvent record_event("BoxHelper::PreLoadIntoMemory",
+                                       platform::TracerEventType::Dataloader,
+                                       BoxTracer::kBoxTraceLevel);
     auto box_ptr = BoxWrapper::GetInstance();
     boxps::PSAgentBase* agent = box_ptr->GetAgent();
     PadBoxSlotDataset* dataset = dynamic_cast<PadBoxSlotDataset*>(dataset_);
@@ -1155,6 +1119,10 @@ class BoxHelper {
   }
   void WaitFeedPassDone() {
 #ifdef PADDLE_WITH_BOX_PS
+    BoxTracer::GetInstance().BeginFeedPass();
+    platform::RecordEvent record_event("BoxHelper::WaitFeedPassDone",
+                                       platform::TracerEventType::Dataloader,
+                                       BoxTracer::kBoxTraceLevel);
     platform::Timer timer;
     timer.Start();
     dataset_->WaitPreLoadDone();
@@ -1194,6 +1162,10 @@ class BoxHelper {
     auto& records = dataset->GetInputRecord();
     auto slot_idx = dataset->GetSlotsIdx(slots_to_replace);
 
+    if (FLAGS_padbox_auc_runner_slot_overlay) {
+      box_ptr->RecordOverlay(records, slot_idx);
+      return;
+    }
     if (box_ptr->record_replacers_.size() != records.size()) {
       box_ptr->record_replacers_.resize(records.size());
     }
@@ -1234,6 +1206,10 @@ class BoxHelper {
   void FeedPass() {
     VLOG(3) << "Begin FeedPass";
 #ifdef PADDLE_WITH_BOX_PS
+    BoxTracer::GetInstance().BeginFeedPass();
+    platform::RecordEvent record_event("BoxHelper::FeedPass",
+                                       platform::TracerEventType::Dataloader,
+                                       BoxTracer::kBoxTraceLevel);
     auto box_ptr = BoxWrapper::GetInstance();
     auto input_channel_ =
         dynamic_cast<MultiSlotDataset*>(dataset_)->GetInputChannel();
@@ -533,6 +533,69 @@ std::future<int32_t> FleetWrapper::PullSparseVarsAsync(
   return std::future<int32_t>();
 }
 
+std::future<int32_t> FleetWrapper::PullSparseVarsAsync(
+    const Scope& scope,
+    const uint64_t table_id,
+    const std::vector<std::string>& var_names,
+    std::vector<uint64_t>* fea_keys,
+    std::vector<std::vector<float>>* fea_values,
+    int fea_value_dim,
+    std::vector<float*>* pull_result_ptr) {
+#ifdef PADDLE_WITH_PSLIB
+  fea_keys->clear();
+  fea_keys->resize(0);
+  fea_keys->reserve(MAX_FEASIGN_NUM);
+  for (auto& name : var_names) {
+    Variable* var = scope.FindVar(name);
+    if (var == nullptr) {
+      continue;
+    }
+    LoDTensor* tensor = var->GetMutable<LoDTensor>();
+    CHECK(tensor != nullptr) << "tensor of var " << name << " is null";
+    int64_t* ids = tensor->data<int64_t>();
+    size_t len = tensor->numel();
+    for (auto i = 0u; i < len; ++i) {
+      if (ids[i] == 0u) {
+        continue;
+      }
+      fea_keys->push_back(static_cast<uint64_t>(ids[i]));
+    }
+  }
+  fea_values->resize(fea_keys->size() + 1);
+  for (auto& t : *fea_values) {
+    t.resize(fea_value_dim);
+  }
+  pull_result_ptr->clear();
+  for (auto& t : *fea_values) {
+    pull_result_ptr->push_back(t.data());
+  }
+  return pslib_ptr_->_worker_ptr->pull_sparse(
+      pull_result_ptr->data(), table_id, fea_keys->data(), fea_keys->size());
+#endif
+  return std::future<int32_t>();
+}
+
+void FleetWrapper::PullSparseKeysSync(const uint64_t table_id,
+                                      const std::vector<uint64_t>& keys,
+                                      const std::vector<float*>& values) {
+#ifdef PADDLE_WITH_PSLIB
+  if (keys.empty()) {
+    return;
+  }
+  CHECK(keys.size() == values.size())
+      << "keys size " << keys.size() << " != values size " << values.size();
+  auto status = pslib_ptr_->_worker_ptr->pull_sparse(
+      const_cast<float**>(values.data()), table_id, keys.data(), keys.size());
+  status.wait();
+  auto ret = status.get();
+  if (ret != 0) {
+    LOG(ERROR) << "fleet pull sparse failed, status[" << ret << "]";
+    sleep(sleep_seconds_before_fail_exit_);
+    exit(-1);
+  }
+#endif
+}
+
 void FleetWrapper::PullSparseVarsSync(
     const Scope& scope,
     const uint64_t table_id,
@@ -140,6 +140,25 @@ class FleetWrapper {
       std::vector<std::vector<float>>* fea_values,
       int fea_dim);
 
+  // Pull sparse variables from server in async mode, pull_result_ptr holds
+  // the value addresses and must live until the returned future is ready
+  // Param<in>: scope, table_id, var_names, fea_keys, fea_dim
+  // Param<out>: fea_values, pull_result_ptr, std::future
+  std::future<int32_t> PullSparseVarsAsync(
+      const Scope& scope,
+      const uint64_t table_id,
+      const std::vector<std::string>& var_names,
+      std::vector<uint64_t>* fea_keys,
+      std::vector<std::vector<float>>* fea_values,
+      int fea_dim,
+      std::vector<float*>* pull_result_ptr);
+
+  // Pull the values of the given keys from server in sync mode, the value of
+  // keys[i] is written to values[i]
+  void PullSparseKeysSync(const uint64_t table_id,
+                          const std::vector<uint64_t>& keys,
+                          const std::vector<float*>& values);
+
   // Pull sparse variables from server in sync mode
   // pull immediately to tensors
   void PullSparseToTensorSync(const uint64_t table_id,
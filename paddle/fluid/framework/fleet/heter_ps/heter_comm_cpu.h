@@ -0,0 +1,561 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "glog/logging.h"
+#include "paddle/fluid/framework/threadpool.h"
+#include "paddle/fluid/platform/enforce.h"
+
+namespace paddle {
+namespace framework {
+
+// HeterCommCpu is the cpu backend of HeterComm. Every device is a thread
+// group bound to the cores of one numa node that owns a hash table and a
+// memory pool, the device of a key is key % dev_num as for HeterComm. Pull
+// and push split the keys to the devices, walk them to the device and back
+// and merge the grads the same way, so the sharding and the update logic run
+// and can be profiled without gpu, and the values are the reference for
+// HeterComm.
+//
+// Like HeterComm every device takes the calls of one caller thread, the
+// callers of different devices run concurrently.
+template <typename KeyType, typename ValType, typename GradType>
+class HeterCommCpu {
+ public:
+  // capacity is the number of keys per device, thread_num the threads of
+  // every device
+  HeterCommCpu(size_t capacity,
+               int dev_num,
+               int thread_num,
+               bool bind_cores = true);
+  ~HeterCommCpu() {}
+  HeterCommCpu(const HeterCommCpu&) = delete;
+  HeterCommCpu& operator=(const HeterCommCpu&) = delete;
+
+  // inserts the keys of the device num, the values are allocated from its
+  // pool in chunks of chunk_size and stream_num threads insert them
+  void build_ps(int num,
+                const KeyType* h_keys,
+                const ValType* h_vals,
+                size_t len,
+                size_t chunk_size,
+                int stream_num);
+  // the keys not in the tables get ValType()
+  void pull_sparse(int num, const KeyType* d_keys, ValType* d_vals, size_t len);
+  // Sgd::update_value(ValType&, const GradType&) updates the value of every
+  // unique key by the sum of its grads, the keys not in the tables are
+  // skipped
+  template <typename Sgd>
+  void push_sparse(int num,
+                   const KeyType* d_keys,
+                   const GradType* d_grads,
+                   size_t len,
+                   Sgd& sgd);  // NOLINT
+
+  // orders the indices of the keys by their device, the keys of device i
+  // are d_idx_ptr[left[i]] to d_idx_ptr[right[i]], -1 for none
+  void split_input_to_shard(const KeyType* d_keys,
+                            int* d_idx_ptr,
+                            size_t len,
+                            int* left,
+                            int* right,
+                            int num);
+  // sorts the keys and sums the grads of every key, the first uniq_len
+  // keys and grads are the result
+  void merge_grad(int num,
+                  KeyType* d_keys,
+                  GradType* d_grads,
+                  size_t len,
+                  int& uniq_len);  // NOLINT
+  void show_one_table(int num);
+  size_t table_size(int num);
+  int dev_num() const { return static_cast<int>(devices_.size()); }
+  int get_index_by_devid(int devid) { return devid; }
+
+  // the cores of the numa node of the device, the devices of one node
+  // split its cores
+  static std::vector<int> device_cores(int dev, int dev_num);
+
+ private:
+  // a part of the table of a device, one thread works on it at a time
+  struct SubTable {
+    std::mutex mutex;
+    std::unordered_map<KeyType, ValType*> map;
+    // the memory pool of the values
+    std::vector<std::unique_ptr<ValType[]>> chunks;
+    size_t chunk_used = 0;
+    size_t chunk_size = 0;
+
+    ValType* alloc() {
+      if (chunks.empty() || chunk_used == chunk_size) {
+        chunks.emplace_back(new ValType[chunk_size]);
+        chunk_used = 0;
+      }
+      return &chunks.back()[chunk_used++];
+    }
+  };
+
+  // the keys and values one caller walked to a device
+  struct LocalStorage {
+    std::vector<KeyType> keys;
+    std::vector<ValType> vals;
+    std::vector<GradType> grads;
+    // the keys bucketed by their sub table, see split_keys_to_tables
+    std::vector<int> table_idx;
+    std::vector<int> table_offsets;
+  };
+
+  struct Device {
+    std::unique_ptr<ThreadPool> pool;
+    std::vector<std::unique_ptr<SubTable>> tables;
+    // indexed by the caller device
+    std::vector<LocalStorage> storage;
+  };
+
+  // the buffers of the calls on one device
+  struct Caller {
+    std::vector<int> idx;
+    std::vector<KeyType> keys;
+    std::vector<ValType> vals;
+    std::vector<GradType> grads;
+    std::vector<int> left;
+    std::vector<int> right;
+  };
+
+  int sub_index(const KeyType& key) const {
+    return static_cast<int>((key / devices_.size()) % thread_num_);
+  }
+
+  // orders the indices of the keys by their sub table with a counting sort,
+  // the keys of table t are keys[idx[offsets[t]]] to
+  // keys[idx[offsets[t + 1] - 1]], so every table task walks its own keys
+  void split_keys_to_tables(const KeyType* keys,
+                            size_t len,
+                            std::vector<int>* idx,
+                            std::vector<int>* offsets) const;
+
+  // runs func(dev, t) for the t-th task of every device that has keys of
+  // the caller and waits
+  template <typename Func>
+  void run_on_devices(const std::vector<int>& left, int task_num, Func func);
+
+  void walk_to_dest(int num,
+                    const int* h_left,
+                    const int* h_right,
+                    const KeyType* src_key,
+                    const GradType* src_grad);
+  void walk_to_src(int num,
+                   const int* h_left,
+                   const int* h_right,
+                   ValType* src_val);
+
+  int thread_num_;
+  std::vector<Device> devices_;
+  std::vector<Caller> callers_;
+};
+
+template <typename KeyType, typename ValType, typename GradType>
+std::vector<int> HeterCommCpu<KeyType, ValType, GradType>::device_cores(
+    int dev, int dev_num) {
+  std::vector<std::vector<int>> nodes;
+  for (int n = 0;; ++n) {
+    std::ifstream fin("/sys/devices/system/node/node" + std::to_string(n) +
+                      "/cpulist");
+    if (!fin) {
+      break;
+    }
+    // for example 0-23,48-71
+    std::string list;
+    std::getline(fin, list);
+    std::vector<int> cores;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+      if (range.empty()) {
+        continue;
+      }
+      size_t pos = range.find('-');
+      int first = std::stoi(range.substr(0, pos));
+      int last =
+          (pos == std::string::npos) ? first : std::stoi(range.substr(pos + 1));
+      for (int c = first; c <= last; ++c) {
+        cores.push_back(c);
+      }
+    }
+    // nodes of memory only
+    if (!cores.empty()) {
+      nodes.push_back(std::move(cores));
+    }
+  }
+  if (nodes.empty()) {
+    nodes.emplace_back();
+    int core_num = static_cast<int>(std::thread::hardware_concurrency());
+    for (int c = 0; c < std::max(core_num, 1); ++c) {
+      nodes[0].push_back(c);
+    }
+  }
+  int node_num = static_cast<int>(nodes.size());
+  auto& cores = nodes[dev % node_num];
+  int share = (dev_num - dev % node_num + node_num - 1) / node_num;
+  int rank = dev / node_num;
+  if (static_cast<int>(cores.size()) < share) {
+    return cores;
+  }
+  size_t begin = cores.size() * rank / share;
+  size_t end = cores.size() * (rank + 1) / share;
+  return std::vector<int>(cores.begin() + begin, cores.begin() + end);
+}
+
+template <typename KeyType, typename ValType, typename GradType>
+HeterCommCpu<KeyType, ValType, GradType>::HeterCommCpu(size_t capacity,
+                                                       int dev_num,
+                                                       int thread_num,
+                                                       bool bind_cores)
+    : thread_num_(std::max(thread_num, 1)), devices_(dev_num),
+      callers_(dev_num) {
+  PADDLE_ENFORCE_GT(dev_num,
+                    0,
+                    platform::errors::InvalidArgument(
+                        "HeterCommCpu needs at least one device."));
+  std::vector<std::future<void>> wait_futures;
+  for (int dev = 0; dev < dev_num; ++dev) {
+    auto& device = devices_[dev];
+    device.pool.reset(new ThreadPool(thread_num_));
+    if (bind_cores) {
+      device.pool->SetCPUAffinity(device_cores(dev, dev_num));
+    }
+    device.storage.resize(dev_num);
+    device.tables.resize(thread_num_);
+    // the device threads touch the tables first, so the pages are placed on
+    // their numa node
+    for (int t = 0; t < thread_num_; ++t) {
+      wait_futures.emplace_back(
+          device.pool->Run([this, &device, t, capacity]() {
+            device.tables[t].reset(new SubTable());
+            device.tables[t]->map.reserve(capacity / thread_num_ + 1);
+            device.tables[t]->chunk_size = 4096;
+          }));
+    }
+  }
+  for (auto& f : wait_futures) {
+    f.get();
+  }
+}
+
+template <typename KeyType, typename ValType, typename GradType>
+void HeterCommCpu<KeyType, ValType, GradType>::build_ps(int num,
+                                                        const KeyType* h_keys,
+                                                        const ValType* h_vals,
+                                                        size_t len,
+                                                        size_t chunk_size,
+                                                        int stream_num) {
+  if (len == 0) {
+    return;
+  }
+  auto& device = devices_[num];
+  std::vector<int> table_idx;
+  std::vector<int> table_offsets;
+  split_keys_to_tables(h_keys, len, &table_idx, &table_offsets);
+  int task_num = std::min(std::max(stream_num, 1), thread_num_);
+  std::vector<std::future<void>> wait_futures;
+  for (int task = 0; task < task_num; ++task) {
+    wait_futures.emplace_back(device.pool->Run([&, task]() {
+      for (int t = task; t < thread_num_; t += task_num) {
+        auto& table = *device.tables[t];
+        std::lock_guard<std::mutex> lock(table.mutex);
+        table.chunk_size = std::max(chunk_size, static_cast<size_t>(1));
+        for (int j = table_offsets[t]; j < table_offsets[t + 1]; ++j) {
+          int i = table_idx[j];
+          auto it = table.map.find(h_keys[i]);
+          ValType* val = nullptr;
+          if (it == table.map.end()) {
+            val = table.alloc();
+            table.map.emplace(h_keys[i], val);
+          } else {
+            val = it->second;
+          }
+          *val = h_vals[i];
+        }
+      }
+    }));
+  }
+  for (auto& f : wait_futures) {
+    f.get();
+  }
+}
+
+template <typename KeyType, typename ValType, typename GradType>
+void HeterCommCpu<KeyType, ValType, GradType>::split_keys_to_tables(
+    const KeyType* keys,
+    size_t len,
+    std::vector<int>* idx,
+    std::vector<int>* offsets) const {
+  offsets->assign(thread_num_ + 1, 0);
+  for (size_t i = 0; i < len; ++i) {
+    ++(*offsets)[sub_index(keys[i]) + 1];
+  }
+  for (int t = 0; t < thread_num_; ++t) {
+    (*offsets)[t + 1] += (*offsets)[t];
+  }
+  std::vector<int> pos(offsets->begin(), offsets->end() - 1);
+  idx->resize(len);
+  for (size_t i = 0; i < len; ++i) {
+    (*idx)[pos[sub_index(keys[i])]++] = static_cast<int>(i);
+  }
+}
+
+template <typename KeyType, typename ValType, typename GradType>
+void HeterCommCpu<KeyType, ValType, GradType>::split_input_to_shard(
+    const KeyType* d_keys,
+    int* d_idx_ptr,
+    size_t len,
+    int* left,
+    int* right,
+    int num) {
+  int total_device = dev_num();
+  std::vector<int> count(total_device + 1, 0);
+  for (size_t i = 0; i < len; ++i) {
+    ++count[d_keys[i] % total_device + 1];
+  }
+  for (int i = 0; i < total_device; ++i) {
+    count[i + 1] += count[i];
+    left[i] = (count[i + 1] > count[i]) ? count[i] : -1;
+    right[i] = (count[i + 1] > count[i]) ? count[i + 1] - 1 : -1;
+  }
+  for (size_t i = 0; i < len; ++i) {
+    d_idx_ptr[count[d_keys[i] % total_device]++] = static_cast<int>(i);
+  }
+}
+
+template <typename KeyType, typename ValType, typename GradType>
+void HeterCommCpu<KeyType, ValType, GradType>::merge_grad(int num,
+                                                          KeyType* d_keys,
+                                                          GradType* d_grads,
+                                                          size_t len,
+                                                          int& uniq_len) {
+  auto& caller = callers_[num];
+  caller.idx.resize(len);
+  for (size_t i = 0; i < len; ++i) {
+    caller.idx[i] = static_cast<int>(i);
+  }
+  std::sort(caller.idx.begin(), caller.idx.end(), [d_keys](int a, int b) {
+    return d_keys[a] < d_keys[b];
+  });
+  std::vector<KeyType> keys;
+  std::vector<GradType> grads;
+  keys.reserve(len);
+  grads.reserve(len);
+  for (size_t i = 0; i < len; ++i) {
+    int k = caller.idx[i];
+    if (!keys.empty() && keys.back() == d_keys[k]) {
+      grads.back() = grads.back() + d_grads[k];
+    } else {
+      keys.push_back(d_keys[k]);
+      grads.push_back(d_grads[k]);
+    }
+  }
+  uniq_len = static_cast<int>(keys.size());
+  std::copy(keys.begin(), keys.end(), d_keys);
+  std::copy(grads.begin(), grads.end(), d_grads);
+}
+
+template <typename KeyType, typename ValType, typename GradType>
+template <typename Func>
+void HeterCommCpu<KeyType, ValType, GradType>::run_on_devices(
+    const std::vector<int>& left, int task_num, Func func) {
+  std::vector<std::future<void>> wait_futures;
+  for (int dev = 0; dev < dev_num(); ++dev) {
+    if (left[dev] == -1) {
+      continue;
+    }
+    for (int t = 0; t < task_num; ++t) {
+      wait_futures.emplace_back(
+          devices_[dev].pool->Run([&func, dev, t]() { func(dev, t); }));
+    }
+  }
+  for (auto& f : wait_futures) {
+    f.get();
+  }
+}
+
+template <typename KeyType, typename ValType, typename GradType>
+void HeterCommCpu<KeyType, ValType, GradType>::walk_to_dest(
+    int num,
+    const int* h_left,
+    const int* h_right,
+    const KeyType* src_key,
+    const GradType* src_grad) {
+  // the device threads copy, the storage stays on their numa node
+  run_on_devices(callers_[num].left, 1, [&](int dev, int t) {
+    auto& storage = devices_[dev].storage[num];
+    storage.keys.assign(src_key + h_left[dev], src_key + h_right[dev] + 1);
+    split_keys_to_tables(storage.keys.data(),
+                         storage.keys.size(),
+                         &storage.table_idx,
+                         &storage.table_offsets);
+    if (src_grad != nullptr) {
+      storage.grads.assign(src_grad + h_left[dev],
+                           src_grad + h_right[dev] + 1);
+    } else {
+      storage.vals.resize(storage.keys.size());
+    }
+  });
+}
+
+template <typename KeyType, typename ValType, typename GradType>
+void HeterCommCpu<KeyType, ValType, GradType>::walk_to_src(int num,
+                                                           const int* h_left,
+                                                           const int* h_right,
+                                                           ValType* src_val) {
+  run_on_devices(callers_[num].left, 1, [&](int dev, int t) {
+    auto& storage = devices_[dev].storage[num];
+    std::copy(storage.vals.begin(), storage.vals.end(), src_val + h_left[dev]);
+  });
+}
+
+template <typename KeyType, typename ValType, typename GradType>
+void HeterCommCpu<KeyType, ValType, GradType>::pull_sparse(int num,
+                                                           const KeyType* d_keys,
+                                                           ValType* d_vals,
+                                                           size_t len) {
+  if (len == 0) {
+    return;
+  }
+  auto& caller = callers_[num];
+  caller.idx.resize(len);
+  caller.left.resize(dev_num());
+  caller.right.resize(dev_num());
+  split_input_to_shard(d_keys,
+                       caller.idx.data(),
+                       len,
+                       caller.left.data(),
+                       caller.right.data(),
+                       num);
+  caller.keys.resize(len);
+  for (size_t i = 0; i < len; ++i) {
+    caller.keys[i] = d_keys[caller.idx[i]];
+  }
+  walk_to_dest(num,
+               caller.left.data(),
+               caller.right.data(),
+               caller.keys.data(),
+               nullptr);
+
+  run_on_devices(caller.left, thread_num_, [&](int dev, int t) {
+    auto& storage = devices_[dev].storage[num];
+    auto& table = *devices_[dev].tables[t];
+    std::lock_guard<std::mutex> lock(table.mutex);
+    for (int j = storage.table_offsets[t]; j < storage.table_offsets[t + 1];
+         ++j) {
+      int i = storage.table_idx[j];
+      auto it = table.map.find(storage.keys[i]);
+      storage.vals[i] = (it == table.map.end()) ? ValType() : *it->second;
+    }
+  });
+
+  caller.vals.resize(len);
+  walk_to_src(num, caller.left.data(), caller.right.data(), caller.vals.data());
+  for (size_t i = 0; i < len; ++i) {
+    d_vals[caller.idx[i]] = caller.vals[i];
+  }
+}
+
+template <typename KeyType, typename ValType, typename GradType>
+template <typename Sgd>
+void HeterCommCpu<KeyType, ValType, GradType>::push_sparse(
+    int num,
+    const KeyType* d_keys,
+    const GradType* d_grads,
+    size_t len,
+    Sgd& sgd) {  // NOLINT
+  if (len == 0) {
+    return;
+  }
+  auto& caller = callers_[num];
+  std::vector<KeyType> merged_keys(d_keys, d_keys + len);
+  std::vector<GradType> merged_grads(d_grads, d_grads + len);
+  int uniq_len = 0;
+  merge_grad(num, merged_keys.data(), merged_grads.data(), len, uniq_len);
+
+  caller.idx.resize(uniq_len);
+  caller.left.resize(dev_num());
+  caller.right.resize(dev_num());
+  split_input_to_shard(merged_keys.data(),
+                       caller.idx.data(),
+                       uniq_len,
+                       caller.left.data(),
+                       caller.right.data(),
+                       num);
+  caller.keys.resize(uniq_len);
+  caller.grads.resize(uniq_len);
+  for (int i = 0; i < uniq_len; ++i) {
+    caller.keys[i] = merged_keys[caller.idx[i]];
+    caller.grads[i] = merged_grads[caller.idx[i]];
+  }
+  walk_to_dest(num,
+               caller.left.data(),
+               caller.right.data(),
+               caller.keys.data(),
+               caller.grads.data());
+
+  run_on_devices(caller.left, thread_num_, [&](int dev, int t) {
+    auto& storage = devices_[dev].storage[num];
+    auto& table = *devices_[dev].tables[t];
+    std::lock_guard<std::mutex> lock(table.mutex);
+    for (int j = storage.table_offsets[t]; j < storage.table_offsets[t + 1];
+         ++j) {
+      int i = storage.table_idx[j];
+      auto it = table.map.find(storage.keys[i]);
+      if (it != table.map.end()) {
+        sgd.update_value(*it->second, storage.grads[i]);
+      }
+    }
+  });
+}
+
+template <typename KeyType, typename ValType, typename GradType>
+size_t HeterCommCpu<KeyType, ValType, GradType>::table_size(int num) {
+  size_t size = 0;
+  for (auto& table : devices_[num].tables) {
+    std::lock_guard<std::mutex> lock(table->mutex);
+    size += table->map.size();
+  }
+  return size;
+}
+
+template <typename KeyType, typename ValType, typename GradType>
+void HeterCommCpu<KeyType, ValType, GradType>::show_one_table(int num) {
+  size_t chunks = 0;
+  for (auto& table : devices_[num].tables) {
+    std::lock_guard<std::mutex> lock(table->mutex);
+    chunks += table->chunks.size();
+  }
+  VLOG(0) << "cpu device " << num << ": keys=" << table_size(num)
+          << ", pool chunks=" << chunks
+          << ", cores=" << device_cores(num, dev_num()).size();
+}
+
+}  // end namespace framework
+}  // end namespace paddle
@@ -0,0 +1,222 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+
+#include <chrono>  // NOLINT
+#include <map>
+#include <random>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "paddle/fluid/framework/fleet/heter_ps/heter_comm_cpu.h"
+
+namespace paddle {
+namespace framework {
+
+struct CpuValue {
+  float show = 0;
+  float clk = 0;
+  float lr = 0;
+};
+
+struct CpuPushValue {
+  float show = 0;
+  float clk = 0;
+  float lr_g = 0;
+};
+
+CpuPushValue operator+(const CpuPushValue& a, const CpuPushValue& b) {
+  CpuPushValue out;
+  out.show = a.show + b.show;
+  out.clk = a.clk + b.clk;
+  out.lr_g = a.lr_g + b.lr_g;
+  return out;
+}
+
+struct CpuSgd {
+  void update_value(CpuValue& val, const CpuPushValue& grad) {  // NOLINT
+    val.show += grad.show;
+    val.clk += grad.clk;
+    val.lr -= 0.1 * grad.lr_g;
+  }
+};
+
+using TestComm = HeterCommCpu<uint64_t, CpuValue, CpuPushValue>;
+
+// the keys of device i are the keys of key % dev_num == i
+static void BuildTables(TestComm* comm, uint64_t key_num) {
+  int dev_num = comm->dev_num();
+  std::vector<std::vector<uint64_t>> keys(dev_num);
+  std::vector<std::vector<CpuValue>> vals(dev_num);
+  for (uint64_t key = 0; key < key_num; ++key) {
+    CpuValue val;
+    val.lr = key;
+    keys[key % dev_num].push_back(key);
+    vals[key % dev_num].push_back(val);
+  }
+  for (int i = 0; i < dev_num; ++i) {
+    comm->build_ps(i, keys[i].data(), vals[i].data(), keys[i].size(), 10, 2);
+  }
+}
+
+TEST(TEST_FLEET, heter_comm_cpu_split) {
+  TestComm comm(100, 3, 1, false);
+  std::vector<uint64_t> keys = {2, 3, 9, 1, 6, 4, 7};
+  std::vector<int> idx(keys.size());
+  int left[3], right[3];
+  comm.split_input_to_shard(keys.data(), idx.data(), keys.size(), left,
+                            right, 0);
+  EXPECT_EQ(idx, std::vector<int>({1, 2, 4, 3, 5, 6, 0}));
+  EXPECT_EQ(left[0], 0);
+  EXPECT_EQ(right[0], 2);
+  EXPECT_EQ(left[1], 3);
+  EXPECT_EQ(right[1], 5);
+  EXPECT_EQ(left[2], 6);
+  EXPECT_EQ(right[2], 6);
+
+  std::vector<uint64_t> push_keys = {5, 3, 5, 1, 3, 5};
+  std::vector<CpuPushValue> grads(push_keys.size());
+  for (size_t i = 0; i < grads.size(); ++i) {
+    grads[i].show = 1;
+    grads[i].lr_g = i;
+  }
+  int uniq_len = 0;
+  comm.merge_grad(0, push_keys.data(), grads.data(), push_keys.size(),
+                  uniq_len);
+  ASSERT_EQ(uniq_len, 3);
+  EXPECT_EQ(push_keys[0], 1UL);
+  EXPECT_EQ(push_keys[1], 3UL);
+  EXPECT_EQ(push_keys[2], 5UL);
+  EXPECT_EQ(grads[1].show, 2);
+  EXPECT_EQ(grads[1].lr_g, 1 + 4);
+  EXPECT_EQ(grads[2].show, 3);
+  EXPECT_EQ(grads[2].lr_g, 0 + 2 + 5);
+}
+
+TEST(TEST_FLEET, heter_comm_cpu_pull_push) {
+  const int dev_num = 4;
+  const uint64_t key_num = 10000;
+  TestComm comm(key_num, dev_num, 2, false);
+  BuildTables(&comm, key_num);
+  size_t total = 0;
+  for (int i = 0; i < dev_num; ++i) {
+    total += comm.table_size(i);
+    comm.show_one_table(i);
+  }
+  EXPECT_EQ(total, key_num);
+
+  // every device pulls and pushes its batches concurrently, some keys are
+  // missing from the tables
+  const int batch_num = 20;
+  const size_t batch_size = 1000;
+  std::vector<std::map<uint64_t, CpuPushValue>> pushed(dev_num);
+  std::vector<std::thread> threads;
+  for (int dev = 0; dev < dev_num; ++dev) {
+    threads.emplace_back([&, dev]() {
+      std::mt19937_64 rng(dev);
+      std::vector<uint64_t> keys(batch_size);
+      std::vector<CpuValue> vals(batch_size);
+      std::vector<CpuPushValue> grads(batch_size);
+      for (int b = 0; b < batch_num; ++b) {
+        for (auto& key : keys) {
+          key = rng() % (key_num + 100);
+        }
+        comm.pull_sparse(dev, keys.data(), vals.data(), keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+          if (keys[i] >= key_num) {
+            EXPECT_EQ(vals[i].lr, 0);
+            EXPECT_EQ(vals[i].show, 0);
+          } else {
+            // other devices may have pushed, the show only grows
+            EXPECT_GE(vals[i].show, 0);
+          }
+          grads[i].show = 1;
+          grads[i].clk = keys[i] % 2;
+          grads[i].lr_g = 1;
+          if (keys[i] < key_num) {
+            pushed[dev][keys[i]] = pushed[dev][keys[i]] + grads[i];
+          }
+        }
+        CpuSgd sgd;
+        comm.push_sparse(dev, keys.data(), grads.data(), keys.size(), sgd);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  // the reference values of the pushed grads
+  std::vector<uint64_t> keys(key_num + 100);
+  for (uint64_t key = 0; key < keys.size(); ++key) {
+    keys[key] = key;
+  }
+  std::vector<CpuValue> vals(keys.size());
+  comm.pull_sparse(1, keys.data(), vals.data(), keys.size());
+  for (uint64_t key = 0; key < key_num; ++key) {
+    CpuPushValue sum;
+    for (auto& dev_pushed : pushed) {
+      auto it = dev_pushed.find(key);
+      if (it != dev_pushed.end()) {
+        sum = sum + it->second;
+      }
+    }
+    ASSERT_EQ(vals[key].show, sum.show) << key;
+    ASSERT_EQ(vals[key].clk, sum.clk) << key;
+    ASSERT_NEAR(vals[key].lr, key - 0.1 * sum.lr_g, 1e-2) << key;
+  }
+  for (uint64_t key = key_num; key < keys.size(); ++key) {
+    ASSERT_EQ(vals[key].show, 0);
+  }
+}
+
+TEST(TEST_FLEET, heter_comm_cpu_benchmark) {
+  const uint64_t key_num = 1000000;
+  const size_t batch_size = 100000;
+  for (int dev_num : {1, 2, 4, 8}) {
+    TestComm comm(key_num / dev_num, dev_num, 2, true);
+    BuildTables(&comm, key_num);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int dev = 0; dev < dev_num; ++dev) {
+      threads.emplace_back([&, dev]() {
+        std::mt19937_64 rng(dev);
+        std::vector<uint64_t> keys(batch_size);
+        std::vector<CpuValue> vals(batch_size);
+        std::vector<CpuPushValue> grads(batch_size);
+        for (auto& key : keys) {
+          key = rng() % key_num;
+        }
+        CpuSgd sgd;
+        for (int b = 0; b < 5; ++b) {
+          comm.pull_sparse(dev, keys.data(), vals.data(), keys.size());
+          comm.push_sparse(dev, keys.data(), grads.data(), keys.size(), sgd);
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    LOG(INFO) << dev_num << " cpu devices, "
+              << dev_num * 5 * batch_size / seconds
+              << " keys pulled and pushed per second";
+  }
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,270 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string.h>
+#include <xxhash.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+#include "paddle/fluid/framework/threadpool.h"
+#include "paddle/fluid/platform/enforce.h"
+#include "paddle/fluid/platform/timer.h"
+#if defined(PADDLE_WITH_CUDA)
+#include "paddle/fluid/memory/memory.h"
+#include "paddle/fluid/platform/device_context.h"
+#endif
+
+namespace paddle {
+namespace framework {
+
+// InputTable maps the string keys of the input index to rows of one
+// contiguous value matrix.
+//
+// Build phase: AddIndexData hashes the key to a 64 bit id and appends it to
+// a partial table picked by the calling thread, so loader threads do not
+// contend on one lock. Freeze merges the partials into the value matrix and a
+// sorted id index with a bucket directory on the high id bits. After that
+// GetIndexOffset and LookupInput are lock free. The offset returned to the
+// data feed is the float offset of the row, row 0 is the default all zero
+// vector for missed keys.
+class InputTable {
+ public:
+  explicit InputTable(uint64_t dim, int lookup_thread_num = 4)
+      : dim_(dim),
+        lookup_thread_num_(std::max(lookup_thread_num, 1)),
+        miss_(0),
+        partials_(kPartialNum) {}
+
+  void AddIndexData(const std::string& key, const std::vector<float>& vec) {
+    PADDLE_ENFORCE_EQ(vec.size(), dim_);
+    PADDLE_ENFORCE_EQ(frozen_.load(std::memory_order_acquire),
+                      false,
+                      platform::errors::PreconditionNotMet(
+                          "InputTable is frozen, can not add key %s", key));
+    auto& part = partials_[std::hash<std::thread::id>()(
+                               std::this_thread::get_id()) %
+                           kPartialNum];
+    std::lock_guard<std::mutex> lock(part.mutex);
+    part.ids.push_back(HashKey(key));
+    part.values.insert(part.values.end(), vec.begin(), vec.end());
+  }
+
+  // merge the partial tables into the lookup index, called once after all
+  // index data is added, lookups freeze the table on demand
+  void Freeze() {
+    std::lock_guard<std::mutex> lock(freeze_mutex_);
+    if (frozen_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    platform::Timer timer;
+    timer.Start();
+    size_t total = 0;
+    for (auto& part : partials_) {
+      total += part.ids.size();
+    }
+    // row 0 is the default vector
+    std::vector<std::pair<uint64_t, uint64_t>> id_rows;
+    id_rows.reserve(total + 1);
+    id_rows.emplace_back(HashKey("-"), 0);
+    table_.assign(dim_, 0);
+    table_.reserve((total + 1) * dim_);
+    for (auto& part : partials_) {
+      uint64_t row = table_.size() / dim_;
+      for (size_t i = 0; i < part.ids.size(); ++i) {
+        id_rows.emplace_back(part.ids[i], row + i);
+      }
+      table_.insert(table_.end(), part.values.begin(), part.values.end());
+      std::vector<uint64_t>().swap(part.ids);
+      std::vector<float>().swap(part.values);
+    }
+    // the first added row wins on duplicate keys
+    std::stable_sort(
+        id_rows.begin(),
+        id_rows.end(),
+        [](const std::pair<uint64_t, uint64_t>& a,
+           const std::pair<uint64_t, uint64_t>& b) { return a.first < b.first; });
+    ids_.clear();
+    offsets_.clear();
+    ids_.reserve(id_rows.size());
+    offsets_.reserve(id_rows.size());
+    for (auto& kv : id_rows) {
+      if (!ids_.empty() && ids_.back() == kv.first) {
+        continue;
+      }
+      ids_.push_back(kv.first);
+      offsets_.push_back(kv.second * dim_);
+    }
+    // buckets_[b] is the first index whose id high bits >= b
+    buckets_.assign(kBucketNum + 1, 0);
+    for (auto id : ids_) {
+      ++buckets_[(id >> (64 - kBucketBits)) + 1];
+    }
+    for (size_t b = 1; b <= kBucketNum; ++b) {
+      buckets_[b] += buckets_[b - 1];
+    }
+    frozen_.store(true, std::memory_order_release);
+    timer.Pause();
+    VLOG(0) << "input table freeze keys: " << ids_.size()
+            << ", cost: " << timer.ElapsedSec() << "s";
+  }
+
+  uint64_t GetIndexOffset(const std::string& key) {
+    CheckFrozen();
+    uint64_t id = HashKey(key);
+    size_t b = id >> (64 - kBucketBits);
+    auto begin = ids_.begin() + buckets_[b];
+    auto end = ids_.begin() + buckets_[b + 1];
+    auto it = std::lower_bound(begin, end, id);
+    if (it == end || *it != id) {
+      ++miss_;
+      return 0;
+    }
+    return offsets_[it - ids_.begin()];
+  }
+
+  // gather the rows of num offsets into values, both are host memory
+  void LookupInputCPU(const uint64_t* keys, float* values, uint64_t num) {
+    CheckFrozen();
+    auto gather = [this, keys, values](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        memcpy(&values[i * dim_],
+               &table_[keys[i]],
+               dim_ * sizeof(float));
+      }
+    };
+    int thread_num = lookup_thread_num_;
+    if (thread_num <= 1 || num * dim_ < kParallelGatherFloats) {
+      gather(0, num);
+      return;
+    }
+    parallel_run_range(
+        num,
+        [&gather](int tid, size_t begin, size_t end) { gather(begin, end); },
+        thread_num);
+  }
+
+  // keys and values are on device_id. Keys are copied to a pinned buffer,
+  // the rows are gathered chunk by chunk into pinned memory and each chunk is
+  // copied back asynchronously while the next one is gathered.
+  void LookupInput(uint64_t* keys,
+                   float* values,
+                   uint64_t num,
+                   size_t device_id) {
+    CheckFrozen();
+#if defined(PADDLE_WITH_CUDA)
+    if (num == 0) {
+      return;
+    }
+    cudaSetDevice(device_id);
+    platform::CUDAPlace place(device_id);
+    auto stream = dynamic_cast<phi::GPUContext*>(
+                      platform::DeviceContextPool::Instance().Get(place))
+                      ->stream();
+    auto h_keys_buf =
+        memory::Alloc(platform::CUDAPinnedPlace(), num * sizeof(uint64_t));
+    auto h_values_buf = memory::Alloc(platform::CUDAPinnedPlace(),
+                                      num * dim_ * sizeof(float));
+    uint64_t* h_keys = reinterpret_cast<uint64_t*>(h_keys_buf->ptr());
+    float* h_values = reinterpret_cast<float*>(h_values_buf->ptr());
+    PADDLE_ENFORCE_GPU_SUCCESS(cudaMemcpyAsync(h_keys,
+                                               keys,
+                                               num * sizeof(uint64_t),
+                                               cudaMemcpyDeviceToHost,
+                                               stream));
+    PADDLE_ENFORCE_GPU_SUCCESS(cudaStreamSynchronize(stream));
+    const uint64_t chunk = std::max<uint64_t>(kLookupChunkFloats / dim_, 1);
+    for (uint64_t begin = 0; begin < num; begin += chunk) {
+      uint64_t len = std::min(chunk, num - begin);
+      LookupInputCPU(h_keys + begin, h_values + begin * dim_, len);
+      PADDLE_ENFORCE_GPU_SUCCESS(
+          cudaMemcpyAsync(values + begin * dim_,
+                          h_values + begin * dim_,
+                          len * dim_ * sizeof(float),
+                          cudaMemcpyHostToDevice,
+                          stream));
+    }
+    // the pinned buffers are released on return
+    PADDLE_ENFORCE_GPU_SUCCESS(cudaStreamSynchronize(stream));
+#else
+    PADDLE_THROW(phi::errors::Unimplemented("not supported platform."));
+#endif
+  }
+
+  size_t size() const {
+    if (frozen_.load(std::memory_order_acquire)) {
+      return ids_.size();
+    }
+    size_t total = 1;
+    for (auto& part : partials_) {
+      total += part.ids.size();
+    }
+    return total;
+  }
+
+  size_t miss() const { return miss_; }
+
+  size_t dim() const { return dim_; }
+
+  double CpuMemUsed(void) {
+    return (size() * dim_ * sizeof(float)) / 1024.0 / 1024.0;
+  }
+
+ protected:
+  static constexpr size_t kPartialNum = 64;
+  static constexpr int kBucketBits = 16;
+  static constexpr size_t kBucketNum = 1UL << kBucketBits;
+  static constexpr uint64_t kParallelGatherFloats = 1UL << 16;
+  static constexpr uint64_t kLookupChunkFloats = 1UL << 18;
+
+  struct PartialTable {
+    std::mutex mutex;
+    std::vector<uint64_t> ids;
+    std::vector<float> values;
+  };
+
+  static uint64_t HashKey(const std::string& key) {
+    return XXH64(key.data(), key.size(), 0);
+  }
+
+  void CheckFrozen() {
+    if (!frozen_.load(std::memory_order_acquire)) {
+      Freeze();
+    }
+  }
+
+  uint64_t dim_;
+  int lookup_thread_num_;
+  std::atomic<size_t> miss_;
+  std::atomic<bool> frozen_{false};
+  std::mutex freeze_mutex_;
+  std::vector<PartialTable> partials_;
+  // sorted ids, the float offset of each id and the high bits directory
+  std::vector<uint64_t> ids_;
+  std::vector<uint64_t> offsets_;
+  std::vector<size_t> buckets_;
+  std::vector<float> table_;
+};
+
+}  // namespace framework
+}  // namespace paddle
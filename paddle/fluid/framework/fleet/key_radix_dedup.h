@@ -0,0 +1,176 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace paddle {
+namespace framework {
+
+// sort num 64bit keys by lsd radix in place, the passes on bytes all keys
+// share are skipped. tmp is a scratch buffer which can be reused across calls.
+inline void RadixSortKeys(uint64_t* keys,
+                          size_t num,
+                          std::vector<uint64_t>* tmp) {
+  if (num < 256) {
+    std::sort(keys, keys + num);
+    return;
+  }
+  tmp->resize(num);
+  uint64_t* src = keys;
+  uint64_t* dst = tmp->data();
+  size_t counts[256];
+  for (int shift = 0; shift < 64; shift += 8) {
+    memset(counts, 0, sizeof(counts));
+    for (size_t i = 0; i < num; ++i) {
+      ++counts[(src[i] >> shift) & 0xFF];
+    }
+    if (counts[(src[0] >> shift) & 0xFF] == num) {
+      continue;
+    }
+    size_t offset = 0;
+    for (int b = 0; b < 256; ++b) {
+      size_t cnt = counts[b];
+      counts[b] = offset;
+      offset += cnt;
+    }
+    for (size_t i = 0; i < num; ++i) {
+      dst[counts[(src[i] >> shift) & 0xFF]++] = src[i];
+    }
+    std::swap(src, dst);
+  }
+  if (src != keys) {
+    memcpy(keys, src, sizeof(uint64_t) * num);
+  }
+}
+
+// sort the keys and remove the duplicates in place
+inline void RadixSortUniqueKeys(std::vector<uint64_t>* keys,
+                                std::vector<uint64_t>* tmp) {
+  RadixSortKeys(keys->data(), keys->size(), tmp);
+  keys->erase(std::unique(keys->begin(), keys->end()), keys->end());
+}
+
+// the unique key num over the key num of a sample, the sample is sorted
+inline double SampleUniqueRatio(std::vector<uint64_t>* sample) {
+  if (sample->empty()) {
+    return 0.0;
+  }
+  size_t num = sample->size();
+  std::vector<uint64_t> tmp;
+  RadixSortUniqueKeys(sample, &tmp);
+  return static_cast<double>(sample->size()) / num;
+}
+
+// [begin, end) of sorted unique keys
+using KeyRun = std::pair<const uint64_t*, const uint64_t*>;
+
+// k-way merge of sorted unique runs, the keys in several runs are kept once
+inline void MergeUniqueRuns(const std::vector<KeyRun>& runs,
+                            std::vector<uint64_t>* out) {
+  size_t total = 0;
+  for (auto& run : runs) {
+    total += run.second - run.first;
+  }
+  out->clear();
+  out->reserve(total);
+  if (runs.size() == 1) {
+    out->assign(runs[0].first, runs[0].second);
+    return;
+  }
+  using HeapItem = std::pair<uint64_t, size_t>;
+  std::priority_queue<HeapItem, std::vector<HeapItem>, std::greater<HeapItem>>
+      heap;
+  std::vector<const uint64_t*> pos(runs.size());
+  for (size_t i = 0; i < runs.size(); ++i) {
+    pos[i] = runs[i].first;
+    if (pos[i] != runs[i].second) {
+      heap.emplace(*pos[i], i);
+    }
+  }
+  while (!heap.empty()) {
+    uint64_t key = heap.top().first;
+    size_t i = heap.top().second;
+    heap.pop();
+    if (out->empty() || out->back() != key) {
+      out->push_back(key);
+    }
+    if (++pos[i] != runs[i].second) {
+      heap.emplace(*pos[i], i);
+    }
+  }
+}
+
+// KeyAppendBuffer collects the keys of one (shard, dim) for one thread. Every
+// kRunSize appended keys are sorted and uniqued into a run which is never
+// touched again, the runs of all threads are merged once by MergeUniqueRuns.
+class KeyAppendBuffer {
+ public:
+  static constexpr size_t kRunSize = 1 << 20;
+
+  void Add(uint64_t key) {
+    keys_.push_back(key);
+    if (keys_.size() - run_begin_ >= kRunSize) {
+      SealRun();
+    }
+  }
+
+  // sort and unique the keys appended since the last run
+  void SealRun() {
+    if (run_begin_ == keys_.size()) {
+      return;
+    }
+    thread_local std::vector<uint64_t> tmp;
+    uint64_t* begin = keys_.data() + run_begin_;
+    size_t num = keys_.size() - run_begin_;
+    RadixSortKeys(begin, num, &tmp);
+    num = std::unique(begin, begin + num) - begin;
+    keys_.resize(run_begin_ + num);
+    run_begin_ = keys_.size();
+    run_ends_.push_back(run_begin_);
+  }
+
+  // the runs sealed, call SealRun first to take all keys
+  void GetRuns(std::vector<KeyRun>* runs) const {
+    size_t begin = 0;
+    for (size_t end : run_ends_) {
+      runs->emplace_back(keys_.data() + begin, keys_.data() + end);
+      begin = end;
+    }
+  }
+
+  size_t size() const { return keys_.size(); }
+
+  void Clear() {
+    std::vector<uint64_t>().swap(keys_);
+    std::vector<size_t>().swap(run_ends_);
+    run_begin_ = 0;
+  }
+
+ private:
+  size_t run_begin_ = 0;
+  std::vector<size_t> run_ends_;
+  std::vector<uint64_t> keys_;
+};
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,295 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/fleet/pass_key_stat.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "glog/logging.h"
+#include "paddle/fluid/platform/enforce.h"
+#include "paddle/fluid/platform/timer.h"
+
+namespace paddle {
+namespace framework {
+
+HyperLogLog::HyperLogLog(int precision) : precision_(precision) {
+  PADDLE_ENFORCE_EQ(
+      precision >= 4 && precision <= 18,
+      true,
+      platform::errors::InvalidArgument(
+          "HyperLogLog precision should be in [4, 18], but got %d.",
+          precision));
+  registers_.resize(1ULL << precision, 0);
+}
+
+void HyperLogLog::Merge(const HyperLogLog& other) {
+  PADDLE_ENFORCE_EQ(precision_,
+                    other.precision_,
+                    platform::errors::InvalidArgument(
+                        "Can not merge HyperLogLog of precision %d and %d.",
+                        precision_,
+                        other.precision_));
+  for (size_t i = 0; i < registers_.size(); ++i) {
+    registers_[i] = std::max(registers_[i], other.registers_[i]);
+  }
+}
+
+double HyperLogLog::Estimate() const {
+  const double m = static_cast<double>(registers_.size());
+  double sum = 0;
+  size_t zeros = 0;
+  for (auto reg : registers_) {
+    sum += std::ldexp(1.0, -static_cast<int>(reg));
+    zeros += (reg == 0);
+  }
+  double estimate = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+  // linear counting is more accurate while many registers are empty, the
+  // 64 bit hash needs no large range correction
+  if (estimate <= 2.5 * m && zeros > 0) {
+    estimate = m * std::log(m / static_cast<double>(zeros));
+  }
+  return estimate;
+}
+
+void HyperLogLog::Clear() {
+  std::fill(registers_.begin(), registers_.end(), 0);
+}
+
+constexpr int CountMinSketch::kDepth;
+
+CountMinSketch::CountMinSketch(int width_bits)
+    : width_(1U << width_bits), mask_(width_ - 1) {
+  counters_.resize(static_cast<size_t>(kDepth) * width_, 0);
+}
+
+uint32_t CountMinSketch::Count(uint64_t hash) const {
+  uint32_t h1 = static_cast<uint32_t>(hash);
+  uint32_t h2 = static_cast<uint32_t>(hash >> 32);
+  uint32_t count = UINT32_MAX;
+  for (int row = 0; row < kDepth; ++row) {
+    count =
+        std::min(count, counters_[row * width_ + ((h1 + row * h2) & mask_)]);
+  }
+  return count;
+}
+
+void CountMinSketch::Merge(const CountMinSketch& other) {
+  for (size_t i = 0; i < counters_.size(); ++i) {
+    counters_[i] += other.counters_[i];
+  }
+}
+
+void CountMinSketch::Clear() {
+  std::fill(counters_.begin(), counters_.end(), 0);
+}
+
+std::shared_ptr<const PassKeyHistory::Sketch> PassKeyHistory::Prev(
+    int pass_id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = sketches_.lower_bound(pass_id);
+  if (it == sketches_.begin()) {
+    return nullptr;
+  }
+  return (--it)->second;
+}
+
+void PassKeyHistory::Put(int pass_id, std::shared_ptr<const Sketch> sketch) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sketches_[pass_id] = std::move(sketch);
+  while (sketches_.size() > kMaxPassNum) {
+    sketches_.erase(sketches_.begin());
+  }
+}
+
+PassKeyStat::PassKeyStat(int hll_precision,
+                         int cms_width_bits,
+                         int topk,
+                         PassKeyHistory* history)
+    : hll_precision_(hll_precision),
+      cms_width_bits_(cms_width_bits),
+      topk_(std::max(topk, 1)),
+      history_(history) {
+  if (history_ == nullptr) {
+    own_history_.reset(new PassKeyHistory());
+    history_ = own_history_.get();
+  }
+}
+
+void PassKeyStat::BeginPass(int pass_id,
+                            const std::vector<std::string>& slot_names,
+                            int thread_num) {
+  slot_names_ = slot_names;
+  if (threads_.size() != static_cast<size_t>(thread_num) ||
+      (!threads_.empty() && threads_[0]->slots.size() != slot_names.size())) {
+    threads_.clear();
+    for (int i = 0; i < thread_num; ++i) {
+      threads_.emplace_back(
+          new ThreadStat(slot_names.size(), hll_precision_, cms_width_bits_));
+    }
+  } else {
+    // reuse the sketches of the last pass, they are large
+    for (auto& stat : threads_) {
+      for (auto& hll : stat->slots) {
+        hll.Clear();
+      }
+      stat->cms.Clear();
+      stat->candidates.clear();
+      stat->threshold = 1;
+      stat->keys = 0;
+      stat->seconds = 0;
+    }
+  }
+  pass_id_ = pass_id;
+}
+
+void PassKeyStat::AddKeys(int tid, int slot, const uint64_t* keys, size_t num) {
+  ThreadStat* stat = threads_[tid].get();
+  HyperLogLog& hll = stat->slots[slot];
+  for (size_t i = 0; i < num; ++i) {
+    uint64_t hash = Hash(keys[i]);
+    hll.Add(hash);
+    uint32_t count = stat->cms.Add(hash);
+    if (count >= stat->threshold) {
+      stat->candidates[keys[i]] = count;
+      if (stat->candidates.size() > static_cast<size_t>(2 * topk_)) {
+        PruneCandidates(stat);
+      }
+    }
+  }
+  stat->keys += num;
+}
+
+void PassKeyStat::PruneCandidates(ThreadStat* stat) {
+  std::vector<std::pair<uint64_t, uint32_t>> items(stat->candidates.begin(),
+                                                   stat->candidates.end());
+  std::nth_element(items.begin(),
+                   items.begin() + topk_ - 1,
+                   items.end(),
+                   [](const std::pair<uint64_t, uint32_t>& a,
+                      const std::pair<uint64_t, uint32_t>& b) {
+                     return a.second > b.second;
+                   });
+  // a new candidate has to beat the coldest kept key
+  stat->threshold = items[topk_ - 1].second + 1;
+  stat->candidates.clear();
+  for (int i = 0; i < topk_; ++i) {
+    stat->candidates.insert(items[i]);
+  }
+}
+
+void PassKeyStat::AddTime(int tid, double seconds) {
+  threads_[tid]->seconds += seconds;
+}
+
+PassKeyStat::Summary PassKeyStat::EndPass() {
+  platform::Timer timer;
+  timer.Start();
+  Summary summary;
+  summary.pass_id = pass_id_;
+  if (threads_.empty()) {
+    std::lock_guard<std::mutex> lock(summary_mutex_);
+    summary_ = summary;
+    return summary;
+  }
+  ThreadStat* total = threads_[0].get();
+  for (size_t t = 1; t < threads_.size(); ++t) {
+    ThreadStat* stat = threads_[t].get();
+    for (size_t s = 0; s < total->slots.size(); ++s) {
+      total->slots[s].Merge(stat->slots[s]);
+    }
+    total->cms.Merge(stat->cms);
+    for (auto& item : stat->candidates) {
+      total->candidates.insert(item);
+    }
+    total->keys += stat->keys;
+    total->seconds += stat->seconds;
+  }
+
+  std::shared_ptr<PassKeyHistory::Sketch> sketch(new PassKeyHistory::Sketch{
+      slot_names_, total->slots, HyperLogLog(hll_precision_)});
+  HyperLogLog& all = sketch->all;
+  for (size_t s = 0; s < total->slots.size(); ++s) {
+    all.Merge(total->slots[s]);
+    summary.slot_unique_keys[slot_names_[s]] = total->slots[s].Estimate();
+  }
+  summary.total_keys = total->keys;
+  summary.unique_keys = all.Estimate();
+
+  // |A and B| / |A or B| by inclusion and exclusion of the estimates
+  auto jaccard = [](const HyperLogLog& cur,
+                    double cur_num,
+                    const HyperLogLog& prev) {
+    HyperLogLog merged = prev;
+    merged.Merge(cur);
+    double union_num = merged.Estimate();
+    if (union_num <= 0) {
+      return 0.0;
+    }
+    double inter_num = cur_num + prev.Estimate() - union_num;
+    return std::min(std::max(inter_num / union_num, 0.0), 1.0);
+  };
+  auto prev = history_->Prev(pass_id_);
+  if (prev != nullptr) {
+    summary.jaccard_prev = jaccard(all, summary.unique_keys, prev->all);
+    auto& prev_names = prev->slot_names;
+    for (size_t s = 0; s < slot_names_.size(); ++s) {
+      auto it = std::find(prev_names.begin(), prev_names.end(), slot_names_[s]);
+      if (it == prev_names.end()) {
+        continue;
+      }
+      summary.slot_jaccard_prev[slot_names_[s]] =
+          jaccard(total->slots[s],
+                  summary.slot_unique_keys[slot_names_[s]],
+                  prev->slots[it - prev_names.begin()]);
+    }
+  }
+
+  // the candidates of every thread counted by the merged sketch
+  std::vector<std::pair<uint64_t, uint64_t>> hot_keys;
+  hot_keys.reserve(total->candidates.size());
+  for (auto& item : total->candidates) {
+    hot_keys.emplace_back(item.first, total->cms.Count(Hash(item.first)));
+  }
+  size_t k = std::min(hot_keys.size(), static_cast<size_t>(topk_));
+  std::partial_sort(hot_keys.begin(),
+                    hot_keys.begin() + k,
+                    hot_keys.end(),
+                    [](const std::pair<uint64_t, uint64_t>& a,
+                       const std::pair<uint64_t, uint64_t>& b) {
+                      return a.second > b.second;
+                    });
+  hot_keys.resize(k);
+  summary.hot_keys = std::move(hot_keys);
+
+  history_->Put(pass_id_, std::move(sketch));
+  timer.Pause();
+  summary.add_seconds = total->seconds;
+  summary.merge_seconds = timer.ElapsedSec();
+
+  VLOG(0) << "pass id=" << summary.pass_id
+          << ", key stat keys=" << summary.total_keys
+          << ", unique keys=" << summary.unique_keys
+          << ", jaccard with previous pass=" << summary.jaccard_prev
+          << ", hottest key count="
+          << (summary.hot_keys.empty() ? 0 : summary.hot_keys[0].second)
+          << ", sketch time=" << summary.add_seconds
+          << ", merge time=" << summary.merge_seconds;
+  std::lock_guard<std::mutex> lock(summary_mutex_);
+  summary_ = summary;
+  return summary;
+}
+
+}  // namespace framework
+}  // namespace paddle
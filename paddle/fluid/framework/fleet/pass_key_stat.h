@@ -0,0 +1,192 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace paddle {
+namespace framework {
+
+// HyperLogLog counts the unique keys of a stream with 2^precision one byte
+// registers, the standard error is about 1.04 / sqrt(2^precision).
+class HyperLogLog {
+ public:
+  explicit HyperLogLog(int precision = 10);
+
+  void Add(uint64_t hash) {
+    uint64_t idx = hash >> (64 - precision_);
+    // the guard bit bounds the rank when the remaining bits are all zero
+    uint64_t rest = (hash << precision_) | (1ULL << (precision_ - 1));
+    uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+    if (registers_[idx] < rank) {
+      registers_[idx] = rank;
+    }
+  }
+  void Merge(const HyperLogLog& other);
+  double Estimate() const;
+  void Clear();
+
+ private:
+  int precision_;
+  std::vector<uint8_t> registers_;
+};
+
+// CountMinSketch counts the keys of a stream in depth rows of width counters,
+// a count is over estimated by at most e * total / width with probability
+// 1 - exp(-depth).
+class CountMinSketch {
+ public:
+  static constexpr int kDepth = 4;
+
+  explicit CountMinSketch(int width_bits = 16);
+
+  // add the key and return its estimated count
+  uint32_t Add(uint64_t hash) {
+    uint32_t h1 = static_cast<uint32_t>(hash);
+    uint32_t h2 = static_cast<uint32_t>(hash >> 32);
+    uint32_t count = UINT32_MAX;
+    for (int row = 0; row < kDepth; ++row) {
+      uint32_t& c = counters_[row * width_ + ((h1 + row * h2) & mask_)];
+      ++c;
+      if (c < count) {
+        count = c;
+      }
+    }
+    return count;
+  }
+  uint32_t Count(uint64_t hash) const;
+  void Merge(const CountMinSketch& other);
+  void Clear();
+
+ private:
+  uint32_t width_;
+  uint32_t mask_;
+  std::vector<uint32_t> counters_;
+};
+
+// PassKeyHistory keeps the unique key sketches of the latest passes by pass
+// id. Pass ids are global, so it is shared by the datasets of the process and
+// a pass is compared with the previous pass whichever dataset fed it.
+class PassKeyHistory {
+ public:
+  static constexpr size_t kMaxPassNum = 4;
+
+  struct Sketch {
+    std::vector<std::string> slot_names;
+    std::vector<HyperLogLog> slots;
+    HyperLogLog all;
+  };
+
+  // the sketch of the latest pass before pass_id, nullptr for none
+  std::shared_ptr<const Sketch> Prev(int pass_id) const;
+  void Put(int pass_id, std::shared_ptr<const Sketch> sketch);
+
+ private:
+  mutable std::mutex mutex_;
+  std::map<int, std::shared_ptr<const Sketch>> sketches_;
+};
+
+// PassKeyStat collects the key statistics of one feed pass while the merge
+// threads add the keys to the ps: the unique keys of every slot, the hot keys
+// and the overlap with the previous pass. Every merge thread updates its own
+// sketches, EndPass merges them.
+class PassKeyStat {
+ public:
+  struct Summary {
+    int pass_id = 0;
+    uint64_t total_keys = 0;
+    double unique_keys = 0;
+    // jaccard similarity of the unique keys of the pass and the previous
+    // pass, -1 for the first pass
+    double jaccard_prev = -1;
+    std::map<std::string, double> slot_unique_keys;
+    std::map<std::string, double> slot_jaccard_prev;
+    // the hot keys and their estimated counts, the hottest first
+    std::vector<std::pair<uint64_t, uint64_t>> hot_keys;
+    // seconds spent on the sketches over all threads and on merging them
+    double add_seconds = 0;
+    double merge_seconds = 0;
+  };
+
+  // the previous passes are looked up in history, a history of its own is
+  // used when it is nullptr
+  PassKeyStat(int hll_precision,
+              int cms_width_bits,
+              int topk,
+              PassKeyHistory* history = nullptr);
+
+  // slot_names are the names of the slots added by their index
+  void BeginPass(int pass_id,
+                 const std::vector<std::string>& slot_names,
+                 int thread_num);
+  void AddKeys(int tid, int slot, const uint64_t* keys, size_t num);
+  // called by every thread after its last AddKeys
+  void AddTime(int tid, double seconds);
+  Summary EndPass();
+
+  // the summary of the last pass ended, safe while a pass is running
+  Summary summary() const {
+    std::lock_guard<std::mutex> lock(summary_mutex_);
+    return summary_;
+  }
+
+ private:
+  static uint64_t Hash(uint64_t key) {
+    // the finalizer of murmur3, the feasigns are not uniform enough for the
+    // sketches themselves
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+  }
+
+  struct ThreadStat {
+    std::vector<HyperLogLog> slots;
+    CountMinSketch cms;
+    // the keys counted above threshold, pruned to topk when it doubles
+    std::unordered_map<uint64_t, uint32_t> candidates;
+    uint32_t threshold = 1;
+    uint64_t keys = 0;
+    double seconds = 0;
+
+    ThreadStat(size_t slot_num, int hll_precision, int cms_width_bits)
+        : slots(slot_num, HyperLogLog(hll_precision)), cms(cms_width_bits) {}
+  };
+
+  void PruneCandidates(ThreadStat* stat);
+
+  int hll_precision_;
+  int cms_width_bits_;
+  int topk_;
+  int pass_id_ = 0;
+  std::vector<std::string> slot_names_;
+  std::vector<std::unique_ptr<ThreadStat>> threads_;
+  std::unique_ptr<PassKeyHistory> own_history_;
+  PassKeyHistory* history_;
+  mutable std::mutex summary_mutex_;
+  Summary summary_;
+};
+
+}  // namespace framework
+}  // namespace paddle
@@ -40,6 +40,8 @@ limitations under the License. */
 #endif
 
 DECLARE_int32(gpugraph_dedup_pull_push_mode);
+DECLARE_bool(gpups_prebuild_radix_dedup);
+DECLARE_double(gpups_prebuild_radix_dedup_max_unique_ratio);
 
 namespace paddle {
 namespace framework {
@@ -135,6 +137,45 @@ void PSGPUWrapper::PreBuildTask(std::shared_ptr<HeterContext> gpu_task) {
   size_t begin = 0;
 
   std::string data_set_name = std::string(typeid(*dataset_).name());
+  // radix dedup keeps sorted unique runs in per shard buffers, then merges
+  // the runs of each shard straight into feature_dim_keys_. Hash sets are
+  // kept when a sample of the pass keys is mostly unique.
+  bool radix_dedup =
+      FLAGS_gpups_prebuild_radix_dedup && !gpu_graph_mode_ &&
+      data_set_name.find("SlotRecordDataset") != std::string::npos;
+  if (radix_dedup) {
+    const std::deque<SlotRecord>& vec_data =
+        ((SlotRecordDataset*)(dataset_))->GetInputChannel()->GetData();
+    const size_t sample_ins_num = 10000;
+    size_t step = std::max(vec_data.size() / sample_ins_num, size_t(1));
+    std::vector<uint64_t> sample;
+    for (size_t i = 0; i < vec_data.size(); i += step) {
+      const auto& feasign_v = vec_data[i]->slot_uint64_feasigns_.slot_values;
+      const auto& slot_offset = vec_data[i]->slot_uint64_feasigns_.slot_offsets;
+      for (size_t slot_idx = 0; slot_idx < slot_offset_vector_.size();
+           slot_idx++) {
+        for (size_t j = slot_offset[slot_offset_vector_[slot_idx]];
+             j < slot_offset[slot_offset_vector_[slot_idx] + 1];
+             j++) {
+          sample.push_back(feasign_v[j]);
+        }
+      }
+    }
+    double unique_ratio = SampleUniqueRatio(&sample);
+    radix_dedup =
+        (unique_ratio <= FLAGS_gpups_prebuild_radix_dedup_max_unique_ratio);
+    VLOG(0) << "PreBuildTask sample unique ratio: " << unique_ratio
+            << ", radix dedup: " << radix_dedup;
+  }
+  if (radix_dedup) {
+    thread_dim_key_bufs_.resize(thread_keys_thread_num_);
+    for (int i = 0; i < thread_keys_thread_num_; i++) {
+      thread_dim_key_bufs_[i].resize(thread_keys_shard_num_);
+      for (int j = 0; j < thread_keys_shard_num_; j++) {
+        thread_dim_key_bufs_[i][j].resize(multi_mf_dim_);
+      }
+    }
+  }
 
   VLOG(0) << "gpu_graph_mode_:" << gpu_graph_mode_;
   if (!gpu_graph_mode_) {
@@ -175,13 +216,48 @@ void PSGPUWrapper::PreBuildTask(std::shared_ptr<HeterContext> gpu_task) {
           }
         }
       };
+      auto gen_dynamic_mf_radix_func =
+          [this](const std::deque<SlotRecord>& total_data,
+                 int begin_index,
+                 int end_index,
+                 int i) {
+            auto& shard_bufs = this->thread_dim_key_bufs_[i];
+            for (auto iter = total_data.begin() + begin_index;
+                 iter != total_data.begin() + end_index;
+                 iter++) {
+              const auto& ins = *iter;
+              const auto& feasign_v = ins->slot_uint64_feasigns_.slot_values;
+              const auto& slot_offset = ins->slot_uint64_feasigns_.slot_offsets;
+              for (size_t slot_idx = 0; slot_idx < slot_offset_vector_.size();
+                   slot_idx++) {
+                int dim_id = slot_index_vec_[slot_idx];
+                for (size_t j = slot_offset[slot_offset_vector_[slot_idx]];
+                     j < slot_offset[slot_offset_vector_[slot_idx] + 1];
+                     j++) {
+                  if (feasign_v[j] != 0) {
+                    int shard_id = feasign_v[j] % thread_keys_shard_num_;
+                    shard_bufs[shard_id][dim_id].Add(feasign_v[j]);
+                  }
+                }
+              }
+            }
+          };
       for (int i = 0; i < thread_keys_thread_num_; i++) {
-        threads.push_back(
-            std::thread(gen_dynamic_mf_func,
-                        std::ref(vec_data),
-                        begin,
-                        begin + len_per_thread + (i < remain ? 1 : 0),
-                        i));
+        if (radix_dedup) {
+          threads.push_back(
+              std::thread(gen_dynamic_mf_radix_func,
+                          std::ref(vec_data),
+                          begin,
+                          begin + len_per_thread + (i < remain ? 1 : 0),
+                          i));
+        } else {
+          threads.push_back(
+              std::thread(gen_dynamic_mf_func,
+                          std::ref(vec_data),
+                          begin,
+                          begin + len_per_thread + (i < remain ? 1 : 0),
+                          i));
+        }
 
         begin += len_per_thread + (i < remain ? 1 : 0);
       }
@@ -304,9 +380,34 @@ void PSGPUWrapper::PreBuildTask(std::shared_ptr<HeterContext> gpu_task) {
       thread_dim_keys_[i][shard_num][dim_id].clear();
     }
   };
+  // k-way merge the sorted runs of the thread buffers of one shard/dim
+  auto merge_ins_radix_func = [this, gpu_task](int shard_num, int dim_id) {
+    auto& dest = gpu_task->feature_dim_keys_[shard_num][dim_id];
+    std::vector<uint64_t> prev_keys;
+    std::vector<KeyRun> runs;
+    if (!dest.empty()) {
+      std::vector<uint64_t> tmp;
+      prev_keys.swap(dest);
+      RadixSortUniqueKeys(&prev_keys, &tmp);
+      runs.emplace_back(prev_keys.data(), prev_keys.data() + prev_keys.size());
+    }
+    for (int i = 0; i < thread_keys_thread_num_; ++i) {
+      auto& buf = thread_dim_key_bufs_[i][shard_num][dim_id];
+      buf.SealRun();
+      buf.GetRuns(&runs);
+    }
+    MergeUniqueRuns(runs, &dest);
+    for (int i = 0; i < thread_keys_thread_num_; ++i) {
+      thread_dim_key_bufs_[i][shard_num][dim_id].Clear();
+    }
+  };
   for (int i = 0; i < thread_keys_shard_num_; ++i) {
     for (int j = 0; j < multi_mf_dim_; j++) {
-      threads.push_back(std::thread(merge_ins_dynamic_mf_func, i, j));
+      if (radix_dedup) {
+        threads.push_back(std::thread(merge_ins_radix_func, i, j));
+      } else {
+        threads.push_back(std::thread(merge_ins_dynamic_mf_func, i, j));
+      }
     }
   }
   for (auto& t : threads) {
@@ -315,12 +416,15 @@ void PSGPUWrapper::PreBuildTask(std::shared_ptr<HeterContext> gpu_task) {
   timeline.Pause();
 
   VLOG(0) << "GpuPs task add keys cost " << timeline.ElapsedSec()
-          << " seconds.";
-  timeline.Start();
-  gpu_task->UniqueKeys();
-  timeline.Pause();
-
-  VLOG(0) << "GpuPs task unique cost " << timeline.ElapsedSec() << " seconds.";
+          << " seconds, radix dedup: " << radix_dedup;
+  if (!radix_dedup) {
+    timeline.Start();
+    gpu_task->UniqueKeys();
+    timeline.Pause();
+
+    VLOG(0) << "GpuPs task unique cost " << timeline.ElapsedSec()
+            << " seconds.";
+  }
   for (int i = 0; i < thread_keys_shard_num_; i++) {
     for (int j = 0; j < multi_mf_dim_; j++) {
       if (i == 0 && j == multi_mf_dim_ - 1) {
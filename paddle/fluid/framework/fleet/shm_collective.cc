@@ -0,0 +1,212 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/fleet/shm_collective.h"
+
+#include <errno.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <chrono>  // NOLINT
+#include <new>
+#include <thread>  // NOLINT
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DECLARE_int32(cpu_collective_local_rank);
+DECLARE_int32(cpu_collective_local_size);
+DECLARE_int32(cpu_collective_slot_mb);
+DECLARE_string(cpu_collective_shm_name);
+
+namespace paddle {
+namespace framework {
+
+static constexpr uint64_t kShmCollectiveMagic = 0x5041444453484d43UL;
+static constexpr size_t kShmHeaderBytes = 4096;
+
+// the control block at the head of the segment, the atomics are lock free
+// and so address free, they work across the processes mapping the segment
+struct ShmCollective::Header {
+  std::atomic<uint64_t> magic;
+  // set by the leader when all the local ranks attached, a segment left by a
+  // crashed job has it set and is skipped by the new followers
+  std::atomic<int> closed;
+  std::atomic<int> attached;
+  alignas(64) std::atomic<int> count;
+  alignas(64) std::atomic<int> sense;
+  // the nranks of the current collective, published by the local rank 0
+  std::atomic<int> nranks;
+};
+
+std::shared_ptr<ShmCollective> ShmCollective::GetInstance() {
+  static auto s_instance = std::make_shared<ShmCollective>(
+      FLAGS_cpu_collective_shm_name,
+      FLAGS_cpu_collective_local_rank,
+      FLAGS_cpu_collective_local_size,
+      static_cast<size_t>(FLAGS_cpu_collective_slot_mb) << 20);
+  return s_instance;
+}
+
+ShmCollective::ShmCollective(const std::string& name,
+                             int local_rank,
+                             int local_size,
+                             size_t slot_bytes)
+    : name_("/" + name),
+      local_rank_(local_rank),
+      local_size_(local_size),
+      slot_bytes_(slot_bytes) {
+  PADDLE_ENFORCE_GT(local_size_,
+                    0,
+                    platform::errors::InvalidArgument(
+                        "shm collective local size must be positive"));
+  PADDLE_ENFORCE_EQ(
+      local_rank_ >= 0 && local_rank_ < local_size_,
+      true,
+      platform::errors::InvalidArgument(
+          "shm collective local rank %d out of [0, %d)", local_rank_,
+          local_size_));
+  if (local_size_ == 1) {
+    return;
+  }
+#ifndef _WIN32
+  // slots and the result region, both local_size * slot_bytes
+  map_bytes_ = kShmHeaderBytes + 2 * slot_bytes_ * local_size_;
+  int fd = -1;
+  if (local_rank_ == 0) {
+    shm_unlink(name_.c_str());
+    fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    PADDLE_ENFORCE_NE(fd,
+                      -1,
+                      platform::errors::Unavailable(
+                          "shm_open %s failed: %s", name_, strerror(errno)));
+    PADDLE_ENFORCE_EQ(ftruncate(fd, map_bytes_),
+                      0,
+                      platform::errors::Unavailable(
+                          "ftruncate %s to %d bytes failed: %s",
+                          name_,
+                          map_bytes_,
+                          strerror(errno)));
+  }
+  while (true) {
+    if (local_rank_ != 0) {
+      fd = shm_open(name_.c_str(), O_RDWR, 0600);
+      struct stat st;
+      if (fd == -1 || fstat(fd, &st) != 0 ||
+          static_cast<size_t>(st.st_size) != map_bytes_) {
+        if (fd != -1) {
+          close(fd);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        continue;
+      }
+    }
+    void* ptr = mmap(
+        nullptr, map_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    PADDLE_ENFORCE_NE(ptr,
+                      MAP_FAILED,
+                      platform::errors::Unavailable(
+                          "mmap %s failed: %s", name_, strerror(errno)));
+    header_ = reinterpret_cast<Header*>(ptr);
+    if (local_rank_ == 0) {
+      new (header_) Header();
+      header_->closed.store(0);
+      header_->attached.store(0);
+      header_->count.store(0);
+      header_->sense.store(0);
+      header_->nranks.store(1);
+      header_->magic.store(kShmCollectiveMagic, std::memory_order_release);
+      break;
+    }
+    // wait for the leader to init the segment
+    while (header_->magic.load(std::memory_order_acquire) !=
+           kShmCollectiveMagic) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (header_->closed.load() == 0) {
+      break;
+    }
+    munmap(ptr, map_bytes_);
+    header_ = nullptr;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  data_ = reinterpret_cast<char*>(header_) + kShmHeaderBytes;
+  if (local_rank_ != 0) {
+    header_->attached.fetch_add(1);
+  } else {
+    while (header_->attached.load() != local_size_ - 1) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // the mapping outlives the name, nothing is left in /dev/shm
+    header_->closed.store(1);
+    shm_unlink(name_.c_str());
+  }
+  VLOG(0) << "shm collective " << name_ << " local rank " << local_rank_
+          << "/" << local_size_ << " attached, " << map_bytes_ << " bytes";
+#else
+  PADDLE_THROW(platform::errors::Unimplemented(
+      "shm collective is not supported on windows"));
+#endif
+}
+
+ShmCollective::~ShmCollective() {
+#ifndef _WIN32
+  if (header_ != nullptr) {
+    munmap(header_, map_bytes_);
+  }
+#endif
+}
+
+void ShmCollective::Barrier() {
+  if (local_size_ == 1) {
+    return;
+  }
+#ifndef _WIN32
+  // sense reversing barrier
+  sense_ = !sense_;
+  const int sense = sense_ ? 1 : 0;
+  if (header_->count.fetch_add(1, std::memory_order_acq_rel) ==
+      local_size_ - 1) {
+    header_->count.store(0, std::memory_order_relaxed);
+    header_->sense.store(sense, std::memory_order_release);
+    return;
+  }
+  int spin = 0;
+  while (header_->sense.load(std::memory_order_acquire) != sense) {
+    if (++spin > 1024) {
+      sched_yield();
+    }
+  }
+#endif
+}
+
+int ShmCollective::LeaderNRanks(int nranks) {
+  if (local_rank_ == 0) {
+    header_->nranks.store(nranks, std::memory_order_relaxed);
+  }
+  // the barrier orders the store before the loads of the other local ranks,
+  // the local rank 0 stores the next value only after they passed the
+  // barriers of this collective
+  Barrier();
+  return header_->nranks.load(std::memory_order_relaxed);
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,330 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "paddle/fluid/platform/enforce.h"
+
+namespace paddle {
+namespace framework {
+
+// FusedTensors is the concatenation of several tensor buffers, the collectives
+// copy ranges of it from and to a fused buffer without a staging tensor.
+template <typename T>
+class FusedTensors {
+ public:
+  void Add(T* ptr, int64_t len) {
+    ptrs_.push_back(ptr);
+    lens_.push_back(len);
+    numel_ += len;
+  }
+
+  int64_t numel() const { return numel_; }
+
+  // the buffer when the tensors are one buffer, otherwise nullptr
+  T* data() const { return ptrs_.size() == 1 ? ptrs_[0] : nullptr; }
+
+  // copy [begin, begin + len) of the fused tensors to dst
+  void CopyTo(int64_t begin, int64_t len, T* dst) const {
+    Walk(begin, len, [dst](T* ptr, int64_t off, int64_t n) {
+      if (ptr != dst + off) {
+        memcpy(dst + off, ptr, n * sizeof(T));
+      }
+    });
+  }
+
+  // copy len values of src to [begin, begin + len) of the fused tensors
+  void CopyFrom(int64_t begin, int64_t len, const T* src) const {
+    Walk(begin, len, [src](T* ptr, int64_t off, int64_t n) {
+      if (ptr != src + off) {
+        memcpy(ptr, src + off, n * sizeof(T));
+      }
+    });
+  }
+
+ private:
+  template <typename Func>
+  void Walk(int64_t begin, int64_t len, Func&& func) const {
+    int64_t pos = 0;
+    int64_t done = 0;
+    for (size_t i = 0; i < ptrs_.size() && done < len; ++i) {
+      int64_t end = pos + lens_[i];
+      if (end > begin + done) {
+        int64_t start = begin + done - pos;
+        int64_t n = std::min(lens_[i] - start, len - done);
+        func(ptrs_[i] + start, done, n);
+        done += n;
+      }
+      pos = end;
+    }
+  }
+
+  std::vector<T*> ptrs_;
+  std::vector<int64_t> lens_;
+  int64_t numel_ = 0;
+};
+
+// ShmCollective runs the fused collectives of the processes on one host
+// through a POSIX shared memory segment. Every local rank copies its inputs
+// into its slot of the segment, the local reduction is split among the local
+// ranks, and only the local rank 0 calls the cross host collective, in place
+// on the segment. The cross host functions are passed in by the caller, so the
+// transport between hosts (GlooWrapper in the ops) stays out of this class.
+//
+// The host collectives are in place: HostAllReduce sums num values of buf over
+// the hosts, HostAllGather gathers num values of every host into buf, the
+// values of this host are already at buf + host_rank * num.
+class ShmCollective {
+ public:
+  template <typename T>
+  using HostAllReduce = std::function<void(T* buf, int64_t num)>;
+  template <typename T>
+  using HostAllGather = std::function<void(T* buf, int64_t num)>;
+
+  // the instance configured by the cpu_collective_* flags
+  static std::shared_ptr<ShmCollective> GetInstance();
+
+  ShmCollective(const std::string& name,
+                int local_rank,
+                int local_size,
+                size_t slot_bytes);
+  ~ShmCollective();
+
+  int local_rank() const { return local_rank_; }
+  int local_size() const { return local_size_; }
+
+  // barrier of the local ranks
+  void Barrier();
+
+  // every process gets the sum of ins over all the processes in outs, the
+  // nranks of the local rank 0, which calls host_allreduce, is used by all the
+  // local ranks
+  template <typename T>
+  void AllReduce(const FusedTensors<T>& ins,
+                 const FusedTensors<T>& outs,
+                 int nranks,
+                 const HostAllReduce<T>& host_allreduce);
+
+  // out[r * numel, (r + 1) * numel) is the sum of ins over the local ranks of
+  // host r
+  template <typename T>
+  void MixAllGather(const FusedTensors<T>& ins,
+                    T* out,
+                    int nranks,
+                    int rank_id,
+                    const HostAllGather<T>& host_allgather);
+
+  // out[(r * local_size + l) * numel, ...) is ins of local rank l of host r
+  template <typename T>
+  void AllGather(const FusedTensors<T>& ins,
+                 T* out,
+                 int nranks,
+                 int rank_id,
+                 const HostAllGather<T>& host_allgather);
+
+ private:
+  struct Header;
+
+  template <typename T>
+  T* Slot(int local_rank, int64_t stride) const {
+    return reinterpret_cast<T*>(data_) + local_rank * stride;
+  }
+
+  // the nranks of the local rank 0 for all the local ranks, so they take the
+  // same barriers even if only the local rank 0 knows the host collective
+  int LeaderNRanks(int nranks);
+
+  template <typename T>
+  T* Result() const {
+    return reinterpret_cast<T*>(data_ + slot_bytes_ * local_size_);
+  }
+
+  // add the slots of the other local ranks into slot 0, every local rank sums
+  // its own part of [0, num)
+  template <typename T>
+  void ReduceSlots(int64_t num, int64_t stride) {
+    int64_t per = (num + local_size_ - 1) / local_size_;
+    int64_t begin = std::min(num, per * local_rank_);
+    int64_t end = std::min(num, begin + per);
+    T* dst = Slot<T>(0, stride);
+    for (int r = 1; r < local_size_; ++r) {
+      const T* src = Slot<T>(r, stride);
+      for (int64_t i = begin; i < end; ++i) {
+        dst[i] += src[i];
+      }
+    }
+  }
+
+  std::string name_;
+  int local_rank_;
+  int local_size_;
+  size_t slot_bytes_;
+  size_t map_bytes_ = 0;
+  Header* header_ = nullptr;
+  char* data_ = nullptr;
+  bool sense_ = false;
+};
+
+template <typename T>
+void ShmCollective::AllReduce(const FusedTensors<T>& ins,
+                              const FusedTensors<T>& outs,
+                              int nranks,
+                              const HostAllReduce<T>& host_allreduce) {
+  PADDLE_ENFORCE_EQ(ins.numel(),
+                    outs.numel(),
+                    platform::errors::InvalidArgument(
+                        "AllReduce input numel %d and output numel %d differ",
+                        ins.numel(),
+                        outs.numel()));
+  const int64_t numel = ins.numel();
+  if (local_size_ == 1) {
+    // no local peers, reduce in the output when it is one buffer
+    std::vector<T> staging;
+    T* buf = outs.data();
+    if (buf == nullptr) {
+      staging.resize(numel);
+      buf = staging.data();
+    }
+    ins.CopyTo(0, numel, buf);
+    if (nranks > 1) {
+      host_allreduce(buf, numel);
+    }
+    if (buf != outs.data()) {
+      outs.CopyFrom(0, numel, buf);
+    }
+    return;
+  }
+  nranks = LeaderNRanks(nranks);
+  const int64_t chunk = slot_bytes_ / sizeof(T);
+  for (int64_t off = 0; off < numel; off += chunk) {
+    int64_t num = std::min(chunk, numel - off);
+    ins.CopyTo(off, num, Slot<T>(local_rank_, num));
+    Barrier();
+    ReduceSlots<T>(num, num);
+    Barrier();
+    if (nranks > 1) {
+      if (local_rank_ == 0) {
+        host_allreduce(Slot<T>(0, num), num);
+      }
+      Barrier();
+    }
+    outs.CopyFrom(off, num, Slot<T>(0, num));
+    // the slots are reused by the next chunk
+    Barrier();
+  }
+}
+
+template <typename T>
+void ShmCollective::MixAllGather(const FusedTensors<T>& ins,
+                                 T* out,
+                                 int nranks,
+                                 int rank_id,
+                                 const HostAllGather<T>& host_allgather) {
+  const int64_t numel = ins.numel();
+  if (local_size_ == 1) {
+    ins.CopyTo(0, numel, out + rank_id * numel);
+    if (nranks > 1) {
+      host_allgather(out, numel);
+    }
+    return;
+  }
+  // the gathered chunks of all hosts fit the result region
+  const int64_t chunk = std::min<int64_t>(
+      slot_bytes_ / sizeof(T), slot_bytes_ * local_size_ / sizeof(T) / nranks);
+  PADDLE_ENFORCE_GT(chunk,
+                    0,
+                    platform::errors::PreconditionNotMet(
+                        "shm collective slot of %d bytes is too small for %d "
+                        "ranks",
+                        slot_bytes_,
+                        nranks));
+  for (int64_t off = 0; off < numel; off += chunk) {
+    int64_t num = std::min(chunk, numel - off);
+    ins.CopyTo(off, num, Slot<T>(local_rank_, num));
+    Barrier();
+    ReduceSlots<T>(num, num);
+    Barrier();
+    const T* result = Slot<T>(0, num);
+    if (nranks > 1) {
+      result = Result<T>();
+      if (local_rank_ == 0) {
+        memcpy(Result<T>() + rank_id * num, Slot<T>(0, num), num * sizeof(T));
+        host_allgather(Result<T>(), num);
+      }
+      Barrier();
+    }
+    for (int r = 0; r < nranks; ++r) {
+      memcpy(out + r * numel + off, result + r * num, num * sizeof(T));
+    }
+    Barrier();
+  }
+}
+
+template <typename T>
+void ShmCollective::AllGather(const FusedTensors<T>& ins,
+                              T* out,
+                              int nranks,
+                              int rank_id,
+                              const HostAllGather<T>& host_allgather) {
+  const int64_t numel = ins.numel();
+  if (local_size_ == 1) {
+    ins.CopyTo(0, numel, out + rank_id * numel);
+    if (nranks > 1) {
+      host_allgather(out, numel);
+    }
+    return;
+  }
+  const int64_t chunk = slot_bytes_ / sizeof(T) / nranks;
+  PADDLE_ENFORCE_GT(chunk,
+                    0,
+                    platform::errors::PreconditionNotMet(
+                        "shm collective slot of %d bytes is too small for %d "
+                        "ranks",
+                        slot_bytes_,
+                        nranks));
+  for (int64_t off = 0; off < numel; off += chunk) {
+    int64_t num = std::min(chunk, numel - off);
+    // the slots of this chunk are contiguous, the local gather is free
+    ins.CopyTo(off, num, Slot<T>(local_rank_, num));
+    Barrier();
+    const T* result = Slot<T>(0, num);
+    const int64_t host_num = num * local_size_;
+    if (nranks > 1) {
+      result = Result<T>();
+      if (local_rank_ == 0) {
+        memcpy(Result<T>() + rank_id * host_num,
+               Slot<T>(0, num),
+               host_num * sizeof(T));
+        host_allgather(Result<T>(), host_num);
+      }
+      Barrier();
+    }
+    for (int r = 0; r < nranks * local_size_; ++r) {
+      memcpy(out + r * numel + off, result + r * num, num * sizeof(T));
+    }
+    Barrier();
+  }
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,111 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/fleet/box_trace.h"
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "gflags/gflags.h"
+#include "paddle/fluid/platform/os_info.h"
+
+DECLARE_string(padbox_trace_dir);
+DECLARE_int32(padbox_trace_pass_interval);
+DECLARE_int32(padbox_trace_batch_interval);
+
+namespace paddle {
+namespace framework {
+
+static std::string TracePath(const std::string& dir, int pass_id) {
+  return dir + "/boxps_pass_" + std::to_string(pass_id) + "_pid_" +
+         std::to_string(platform::GetProcessId()) + ".json";
+}
+
+TEST(BoxTracer, SampledPasses) {
+  char tmpl[] = "/tmp/box_trace_XXXXXX";
+  ASSERT_NE(mkdtemp(tmpl), nullptr);
+  std::string dir(tmpl);
+  FLAGS_padbox_trace_dir = dir;
+  FLAGS_padbox_trace_pass_interval = 2;
+  FLAGS_padbox_trace_batch_interval = 2;
+
+  auto& tracer = BoxTracer::GetInstance();
+  for (int pass = 0; pass < 3; ++pass) {
+    tracer.BeginPass();
+    for (int64_t batch = 0; batch < 4; ++batch) {
+      BoxTracer::BatchScope trace_batch(batch);
+      EXPECT_EQ(BoxTracer::Level(),
+                batch % 2 == 0 ? BoxTracer::kBoxTraceLevel
+                               : BoxTracer::kNoTraceLevel);
+      platform::RecordEvent batch_event("BoxPSWorker::Batch",
+                                        platform::TracerEventType::ProfileStep,
+                                        BoxTracer::Level());
+    }
+    // the scope restores the level of the thread
+    EXPECT_EQ(BoxTracer::Level(), BoxTracer::kBoxTraceLevel);
+    tracer.EndPass();
+  }
+  // passes 0 and 2 are traced
+  EXPECT_EQ(access(TracePath(dir, 0).c_str(), F_OK), 0);
+  EXPECT_NE(access(TracePath(dir, 1).c_str(), F_OK), 0);
+  EXPECT_EQ(access(TracePath(dir, 2).c_str(), F_OK), 0);
+  for (int pass : {0, 2}) {
+    unlink(TracePath(dir, pass).c_str());
+  }
+  rmdir(dir.c_str());
+  FLAGS_padbox_trace_dir = "";
+}
+
+TEST(BoxTracer, FeedPhase) {
+  char tmpl[] = "/tmp/box_trace_XXXXXX";
+  ASSERT_NE(mkdtemp(tmpl), nullptr);
+  std::string dir(tmpl);
+  FLAGS_padbox_trace_dir = dir;
+  FLAGS_padbox_trace_pass_interval = 1;
+  FLAGS_padbox_trace_batch_interval = 2;
+
+  // passes 0 to 2 are begun by SampledPasses
+  auto& tracer = BoxTracer::GetInstance();
+  // the feed phase opens the trace of pass 3, BeginPass keeps it
+  tracer.BeginFeedPass();
+  tracer.BeginFeedPass();
+  tracer.BeginPass();
+  {
+    BoxTracer::BatchScope trace_batch(1);
+    EXPECT_EQ(BoxTracer::Level(1), BoxTracer::kNoTraceLevel);
+  }
+  EXPECT_EQ(BoxTracer::Level(1), 1U);
+  // a preload during the training is in the trace of pass 3
+  tracer.BeginFeedPass();
+  tracer.EndPass();
+  // waiting the preload opens the trace of pass 4
+  tracer.BeginFeedPass();
+  tracer.BeginPass();
+  tracer.EndPass();
+
+  EXPECT_EQ(access(TracePath(dir, 3).c_str(), F_OK), 0);
+  EXPECT_EQ(access(TracePath(dir, 4).c_str(), F_OK), 0);
+  EXPECT_NE(access(TracePath(dir, 5).c_str(), F_OK), 0);
+  for (int pass : {3, 4}) {
+    unlink(TracePath(dir, pass).c_str());
+  }
+  rmdir(dir.c_str());
+  FLAGS_padbox_trace_dir = "";
+}
+
+}  // namespace framework
+}  // namespace paddle
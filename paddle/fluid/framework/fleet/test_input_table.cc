@@ -0,0 +1,108 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/fleet/input_table.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "paddle/fluid/platform/timer.h"
+
+namespace paddle {
+namespace framework {
+
+static std::vector<float> MakeValue(int key, int dim) {
+  std::vector<float> vec(dim);
+  for (int k = 0; k < dim; ++k) {
+    vec[k] = static_cast<float>(key * dim + k);
+  }
+  return vec;
+}
+
+TEST(InputTable, LoadAndLookupCPU) {
+  const int dim = 8;
+  const int thread_num = 4;
+  const int key_num = 100000;
+  InputTable table(dim, 2);
+
+  platform::Timer timer;
+  timer.Start();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_num; ++t) {
+    threads.emplace_back([&table, t, thread_num, key_num, dim]() {
+      for (int i = t; i < key_num; i += thread_num) {
+        table.AddIndexData("key_" + std::to_string(i), MakeValue(i, dim));
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  table.Freeze();
+  timer.Pause();
+  ASSERT_EQ(table.size(), static_cast<size_t>(key_num + 1));
+  LOG(INFO) << "input table load: " << key_num / timer.ElapsedSec()
+            << " keys/s";
+
+  // offsets as the data feed stores them, the last one misses
+  std::vector<uint64_t> offsets(key_num + 1);
+  timer.Reset();
+  timer.Start();
+  for (int i = 0; i < key_num; ++i) {
+    offsets[i] = table.GetIndexOffset("key_" + std::to_string(i));
+  }
+  offsets[key_num] = table.GetIndexOffset("no_such_key");
+  timer.Pause();
+  ASSERT_EQ(table.miss(), 1UL);
+  ASSERT_EQ(table.GetIndexOffset("-"), 0UL);
+  LOG(INFO) << "input table offset: " << key_num / timer.ElapsedSec()
+            << " keys/s";
+
+  std::vector<float> values(offsets.size() * dim);
+  timer.Reset();
+  timer.Start();
+  table.LookupInputCPU(offsets.data(), values.data(), offsets.size());
+  timer.Pause();
+  LOG(INFO) << "input table lookup: " << offsets.size() / timer.ElapsedSec()
+            << " rows/s";
+  for (int i = 0; i < key_num; ++i) {
+    auto expect = MakeValue(i, dim);
+    for (int k = 0; k < dim; ++k) {
+      ASSERT_EQ(values[i * dim + k], expect[k]);
+    }
+  }
+  for (int k = 0; k < dim; ++k) {
+    ASSERT_EQ(values[key_num * dim + k], 0.0f);
+  }
+}
+
+TEST(InputTable, DuplicateKeyKeepsOneRow) {
+  InputTable table(2);
+  table.AddIndexData("a", {1, 2});
+  table.AddIndexData("a", {3, 4});
+  table.AddIndexData("b", {5, 6});
+  table.Freeze();
+  ASSERT_EQ(table.size(), 3UL);
+  uint64_t offset = table.GetIndexOffset("a");
+  std::vector<float> value(2);
+  table.LookupInputCPU(&offset, value.data(), 1);
+  ASSERT_EQ(value[0], 1.0f);
+  ASSERT_EQ(value[1], 2.0f);
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,154 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/fleet/key_radix_dedup.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "glog/logging.h"
+#include "paddle/fluid/distributed/ps/thirdparty/round_robin.h"
+#include "paddle/fluid/platform/timer.h"
+
+namespace paddle {
+namespace framework {
+
+static std::vector<uint64_t> MakeKeys(size_t num, uint64_t range) {
+  std::mt19937_64 rng(0);
+  std::vector<uint64_t> keys(num);
+  for (auto& key : keys) {
+    key = rng() % range;
+  }
+  return keys;
+}
+
+TEST(KeyRadixDedup, RadixSortUniqueKeys) {
+  for (size_t num : {0, 10, 255, 256, 100000}) {
+    auto keys = MakeKeys(num, num / 2 + 1);
+    auto expect = keys;
+    std::sort(expect.begin(), expect.end());
+    expect.erase(std::unique(expect.begin(), expect.end()), expect.end());
+    std::vector<uint64_t> tmp;
+    RadixSortUniqueKeys(&keys, &tmp);
+    ASSERT_EQ(keys, expect);
+  }
+}
+
+static std::vector<uint64_t> SortUnique(std::vector<uint64_t> keys) {
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  return keys;
+}
+
+// the keys are split over thread buffers as PreBuildTask does, the runs of
+// all buffers are merged once
+static void RadixDedup(const std::vector<uint64_t>& keys,
+                       int thread_num,
+                       std::vector<uint64_t>* out) {
+  std::vector<KeyAppendBuffer> bufs(thread_num);
+  size_t len = (keys.size() + thread_num - 1) / thread_num;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    bufs[i / len].Add(keys[i]);
+  }
+  std::vector<KeyRun> runs;
+  for (auto& buf : bufs) {
+    buf.SealRun();
+    buf.GetRuns(&runs);
+  }
+  MergeUniqueRuns(runs, out);
+}
+
+TEST(KeyRadixDedup, KeyAppendBuffer) {
+  const size_t run_size = KeyAppendBuffer::kRunSize;
+  auto keys = MakeKeys(run_size * 3 + 100, 1000);
+  KeyAppendBuffer buf;
+  for (auto key : keys) {
+    buf.Add(key);
+  }
+  buf.SealRun();
+  // each run is uniqued when sealed
+  std::vector<KeyRun> runs;
+  buf.GetRuns(&runs);
+  ASSERT_EQ(runs.size(), 4UL);
+  ASSERT_LE(buf.size(), 4000UL);
+  std::vector<uint64_t> merged;
+  MergeUniqueRuns(runs, &merged);
+  ASSERT_EQ(merged, SortUnique(keys));
+}
+
+TEST(KeyRadixDedup, MergeUniqueRuns) {
+  for (int thread_num : {1, 3, 16}) {
+    for (uint64_t range : {10UL, 100000UL, 1UL << 40}) {
+      auto keys = MakeKeys(200000, range);
+      std::vector<uint64_t> merged;
+      RadixDedup(keys, thread_num, &merged);
+      ASSERT_EQ(merged, SortUnique(keys));
+    }
+  }
+  std::vector<uint64_t> merged = {1, 2};
+  MergeUniqueRuns({}, &merged);
+  ASSERT_TRUE(merged.empty());
+}
+
+TEST(KeyRadixDedup, SampleUniqueRatio) {
+  std::vector<uint64_t> sample = {3, 1, 3, 2};
+  ASSERT_DOUBLE_EQ(SampleUniqueRatio(&sample), 0.75);
+  sample.clear();
+  ASSERT_DOUBLE_EQ(SampleUniqueRatio(&sample), 0.0);
+}
+
+// timing of PreBuildTask dedup of one shard from 16 threads: hash set per
+// thread then sort unique vs radix runs per thread then k-way merge
+TEST(KeyRadixDedup, Benchmark) {
+  const int thread_num = 16;
+  const size_t num = 10000000;
+  for (uint64_t range : {1000000UL, 10000000UL, 30000000UL, 100000000UL}) {
+    auto keys = MakeKeys(num, range);
+    size_t len = num / thread_num;
+
+    platform::Timer timer;
+    timer.Start();
+    std::vector<uint64_t> set_keys;
+    for (int t = 0; t < thread_num; ++t) {
+      robin_hood::unordered_set<uint64_t> set;
+      for (size_t i = t * len; i < (t + 1) * len; ++i) {
+        set.insert(keys[i]);
+      }
+      set_keys.insert(set_keys.end(), set.begin(), set.end());
+    }
+    std::sort(set_keys.begin(), set_keys.end());
+    set_keys.erase(std::unique(set_keys.begin(), set_keys.end()),
+                   set_keys.end());
+    timer.Pause();
+    double set_ms = timer.ElapsedMS();
+
+    timer.Reset();
+    timer.Start();
+    std::vector<uint64_t> radix_keys;
+    RadixDedup(keys, thread_num, &radix_keys);
+    timer.Pause();
+    double radix_ms = timer.ElapsedMS();
+
+    ASSERT_EQ(radix_keys, set_keys);
+    LOG(INFO) << "keys: " << keys.size() << ", unique: " << set_keys.size()
+              << ", hash set: " << set_ms << "ms, radix: " << radix_ms
+              << "ms";
+  }
+}
+
+}  // namespace framework
+}  // namespace paddle
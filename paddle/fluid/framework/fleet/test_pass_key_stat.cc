@@ -0,0 +1,199 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/fleet/pass_key_stat.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <random>
+#include <thread>  // NOLINT
+#include <unordered_set>
+
+#include "glog/logging.h"
+
+namespace paddle {
+namespace framework {
+
+TEST(PassKeyStat, HyperLogLog) {
+  for (uint64_t n : {100ULL, 10000ULL, 1000000ULL}) {
+    HyperLogLog hll(12);
+    std::mt19937_64 rng(n);
+    for (uint64_t i = 0; i < n; ++i) {
+      uint64_t hash = rng();
+      hll.Add(hash);
+      hll.Add(hash);
+    }
+    EXPECT_NEAR(hll.Estimate(), n, n * 0.05);
+  }
+}
+
+TEST(PassKeyStat, CountMinSketch) {
+  CountMinSketch cms(10);
+  std::mt19937_64 rng(0);
+  for (int i = 0; i < 10000; ++i) {
+    cms.Add(rng());
+  }
+  uint64_t hot = rng();
+  for (int i = 0; i < 500; ++i) {
+    cms.Add(hot);
+  }
+  EXPECT_GE(cms.Count(hot), 500U);
+  EXPECT_LE(cms.Count(hot), 600U);
+}
+
+// the keys of slot s are s * 1e9 + first_key + i, half of the keys are drawn
+// uniformly from key_num keys and half from a geometric distribution, the
+// first keys of every slot are the hottest
+static void AddPass(PassKeyStat* stat,
+                    int thread_num,
+                    uint64_t first_key,
+                    uint64_t key_num,
+                    size_t keys_per_thread) {
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < thread_num; ++tid) {
+    threads.emplace_back([=]() {
+      std::mt19937_64 rng(tid);
+      std::geometric_distribution<uint64_t> hot(0.05);
+      std::vector<uint64_t> keys(16);
+      for (size_t n = 0; n < keys_per_thread; n += keys.size()) {
+        int slot = (n / keys.size()) % 2;
+        for (auto& key : keys) {
+          uint64_t i = (rng() % 2 == 0) ? rng() % key_num : hot(rng) % key_num;
+          key = slot * 1000000000ULL + first_key + i;
+        }
+        stat->AddKeys(tid, slot, keys.data(), keys.size());
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+TEST(PassKeyStat, Passes) {
+  PassKeyStat stat(12, 16, 10);
+  stat.BeginPass(1, {"slot_a", "slot_b"}, 4);
+  AddPass(&stat, 4, 0, 5000, 200000);
+  auto summary = stat.EndPass();
+  EXPECT_EQ(summary.pass_id, 1);
+  EXPECT_EQ(summary.total_keys, 800000UL);
+  EXPECT_EQ(summary.jaccard_prev, -1);
+  // nearly every key of the 5000 of a slot shows up in 400000 draws
+  EXPECT_NEAR(summary.slot_unique_keys["slot_a"], 5000, 500);
+  EXPECT_NEAR(summary.unique_keys, 10000, 1000);
+  ASSERT_EQ(summary.hot_keys.size(), 10UL);
+  for (auto& item : summary.hot_keys) {
+    EXPECT_LT(item.first % 1000000000ULL, 20UL);
+  }
+  EXPECT_GE(summary.hot_keys[0].second, summary.hot_keys[9].second);
+
+  // half of the keys of the next pass are new
+  stat.BeginPass(2, {"slot_a", "slot_b"}, 4);
+  AddPass(&stat, 4, 2500, 5000, 200000);
+  summary = stat.EndPass();
+  EXPECT_NEAR(summary.jaccard_prev, 1.0 / 3, 0.1);
+  EXPECT_NEAR(summary.slot_jaccard_prev["slot_b"], 1.0 / 3, 0.1);
+}
+
+// the datasets of alternate passes compare with the pass just before
+TEST(PassKeyStat, SharedHistory) {
+  PassKeyHistory history;
+  PassKeyStat stat_a(12, 16, 10, &history);
+  PassKeyStat stat_b(12, 16, 10, &history);
+  stat_a.BeginPass(1, {"slot_a", "slot_b"}, 2);
+  AddPass(&stat_a, 2, 0, 5000, 200000);
+  EXPECT_EQ(stat_a.EndPass().jaccard_prev, -1);
+
+  stat_b.BeginPass(2, {"slot_a", "slot_b"}, 2);
+  AddPass(&stat_b, 2, 2500, 5000, 200000);
+  EXPECT_NEAR(stat_b.EndPass().jaccard_prev, 1.0 / 3, 0.1);
+
+  // pass 3 of the first dataset shares no keys with pass 2
+  stat_a.BeginPass(3, {"slot_a", "slot_b"}, 2);
+  AddPass(&stat_a, 2, 100000, 5000, 200000);
+  EXPECT_NEAR(stat_a.EndPass().jaccard_prev, 0.0, 0.05);
+  EXPECT_EQ(history.Prev(1), nullptr);
+  EXPECT_NE(history.Prev(3), nullptr);
+}
+
+// the summary is read while the next pass runs
+TEST(PassKeyStat, SummaryWhileRunning) {
+  PassKeyStat stat(10, 16, 10);
+  stat.BeginPass(1, {"slot_a", "slot_b"}, 2);
+  AddPass(&stat, 2, 0, 1000, 10000);
+  stat.EndPass();
+  stat.BeginPass(2, {"slot_a", "slot_b"}, 2);
+  std::atomic<bool> done{false};
+  std::thread reader([&]() {
+    while (!done) {
+      int pass_id = stat.summary().pass_id;
+      EXPECT_TRUE(pass_id == 1 || pass_id == 2);
+    }
+  });
+  AddPass(&stat, 2, 0, 1000, 10000);
+  stat.EndPass();
+  done = true;
+  reader.join();
+  EXPECT_EQ(stat.summary().pass_id, 2);
+}
+
+TEST(PassKeyStat, Benchmark) {
+  const int thread_num = 8;
+  const size_t keys_per_thread = 2000000;
+  PassKeyStat stat(10, 16, 100);
+  stat.BeginPass(1, {"slot_a", "slot_b"}, thread_num);
+  std::vector<std::unordered_set<uint64_t>> merged(thread_num);
+  for (auto& keys : merged) {
+    keys.reserve(1 << 20);
+  }
+
+  // an unordered set insert stands for the key merge of the ps
+  auto run = [&](bool with_stat) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int tid = 0; tid < thread_num; ++tid) {
+      threads.emplace_back([&, tid]() {
+        std::mt19937_64 rng(tid);
+        std::vector<uint64_t> keys(64);
+        for (size_t n = 0; n < keys_per_thread; n += keys.size()) {
+          for (auto& key : keys) {
+            key = rng() % 1000000;
+          }
+          if (with_stat) {
+            stat.AddKeys(tid, 0, keys.data(), keys.size());
+          } else {
+            merged[tid].insert(keys.begin(), keys.end());
+          }
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+  };
+  double merge_sec = run(false);
+  double stat_sec = run(true);
+  auto summary = stat.EndPass();
+  LOG(INFO) << thread_num * keys_per_thread << " keys, set merge "
+            << merge_sec << "s, key stat " << stat_sec << "s, sketch merge "
+            << summary.merge_seconds << "s";
+}
+
+}  // namespace framework
+}  // namespace paddle
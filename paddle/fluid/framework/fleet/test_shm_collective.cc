@@ -0,0 +1,261 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/fleet/shm_collective.h"
+
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+#include "paddle/fluid/platform/timer.h"
+
+namespace paddle {
+namespace framework {
+
+static const int kLocalSize = 4;
+// small slots, the collectives run in many chunks
+static const size_t kSlotBytes = 4096;
+
+// the value of element i of tensor t of local rank l
+static float Value(int l, int t, int i) {
+  return static_cast<float>(l * 1000 + t * 100 + i % 97);
+}
+
+static std::vector<int64_t> TensorLens() { return {1, 1000, 37, 2500, 0, 7}; }
+
+static std::vector<std::vector<float>> MakeInputs(int local_rank) {
+  std::vector<std::vector<float>> tensors;
+  auto lens = TensorLens();
+  for (size_t t = 0; t < lens.size(); ++t) {
+    std::vector<float> tensor(lens[t]);
+    for (int64_t i = 0; i < lens[t]; ++i) {
+      tensor[i] = Value(local_rank, t, i);
+    }
+    tensors.push_back(tensor);
+  }
+  return tensors;
+}
+
+static FusedTensors<float> Fuse(std::vector<std::vector<float>>* tensors) {
+  FusedTensors<float> fused;
+  for (auto& tensor : *tensors) {
+    fused.Add(tensor.data(), tensor.size());
+  }
+  return fused;
+}
+
+// the expected fused sum of all local ranks
+static std::vector<float> LocalSum() {
+  std::vector<float> sum;
+  auto lens = TensorLens();
+  for (size_t t = 0; t < lens.size(); ++t) {
+    for (int64_t i = 0; i < lens[t]; ++i) {
+      float v = 0;
+      for (int l = 0; l < kLocalSize; ++l) {
+        v += Value(l, t, i);
+      }
+      sum.push_back(v);
+    }
+  }
+  return sum;
+}
+
+// run func in kLocalSize processes, true when all of them return true
+static bool RunLocalRanks(const std::function<bool(ShmCollective*)>& func,
+                          size_t slot_bytes = kSlotBytes) {
+  std::string name = "paddle_test_shm_collective_" + std::to_string(getpid());
+  std::vector<pid_t> pids;
+  for (int l = 0; l < kLocalSize; ++l) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      ShmCollective shm(name, l, kLocalSize, slot_bytes);
+      _exit(func(&shm) ? 0 : 1);
+    }
+    pids.push_back(pid);
+  }
+  bool ok = true;
+  for (auto pid : pids) {
+    int status = 0;
+    waitpid(pid, &status, 0);
+    ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+  return ok;
+}
+
+// the other hosts hold the same values, so the host collectives are local
+static const int kNRanks = 3;
+static const int kRankId = 1;
+
+static void FakeHostAllReduce(float* buf, int64_t num) {
+  for (int64_t i = 0; i < num; ++i) {
+    buf[i] *= kNRanks;
+  }
+}
+
+static void FakeHostAllGather(float* buf, int64_t num) {
+  for (int r = 0; r < kNRanks; ++r) {
+    if (r != kRankId) {
+      memcpy(buf + r * num, buf + kRankId * num, num * sizeof(float));
+    }
+  }
+}
+
+TEST(ShmCollective, AllReduce) {
+  for (int nranks : {1, kNRanks}) {
+    ASSERT_TRUE(RunLocalRanks([nranks](ShmCollective* shm) {
+      auto inputs = MakeInputs(shm->local_rank());
+      // in place, the outputs are the inputs
+      auto fused = Fuse(&inputs);
+      shm->AllReduce<float>(fused, fused, nranks, FakeHostAllReduce);
+      auto expect = LocalSum();
+      std::vector<float> out(fused.numel());
+      fused.CopyTo(0, fused.numel(), out.data());
+      for (size_t i = 0; i < expect.size(); ++i) {
+        if (out[i] != expect[i] * nranks) {
+          return false;
+        }
+      }
+      return true;
+    }));
+  }
+}
+
+// only the local rank 0 initializes gloo, the other local ranks would see one
+// host, they follow the nranks of the local rank 0
+TEST(ShmCollective, AllReduceLocalRanksDisagree) {
+  ASSERT_TRUE(RunLocalRanks([](ShmCollective* shm) {
+    int nranks = shm->local_rank() == 0 ? kNRanks : 1;
+    auto expect = LocalSum();
+    // several calls, the published nranks is not overwritten too early
+    for (int round = 0; round < 3; ++round) {
+      auto inputs = MakeInputs(shm->local_rank());
+      auto fused = Fuse(&inputs);
+      shm->AllReduce<float>(fused, fused, nranks, FakeHostAllReduce);
+      std::vector<float> out(fused.numel());
+      fused.CopyTo(0, fused.numel(), out.data());
+      for (size_t i = 0; i < expect.size(); ++i) {
+        if (out[i] != expect[i] * kNRanks) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }));
+}
+
+TEST(ShmCollective, MixAllGather) {
+  for (int nranks : {1, kNRanks}) {
+    int rank_id = nranks > 1 ? kRankId : 0;
+    ASSERT_TRUE(RunLocalRanks([nranks, rank_id](ShmCollective* shm) {
+      auto inputs = MakeInputs(shm->local_rank());
+      auto fused = Fuse(&inputs);
+      std::vector<float> out(fused.numel() * nranks);
+      shm->MixAllGather<float>(
+          fused, out.data(), nranks, rank_id, FakeHostAllGather);
+      auto expect = LocalSum();
+      for (int r = 0; r < nranks; ++r) {
+        for (size_t i = 0; i < expect.size(); ++i) {
+          if (out[r * expect.size() + i] != expect[i]) {
+            return false;
+          }
+        }
+      }
+      return true;
+    }));
+  }
+}
+
+TEST(ShmCollective, AllGather) {
+  for (int nranks : {1, kNRanks}) {
+    int rank_id = nranks > 1 ? kRankId : 0;
+    ASSERT_TRUE(RunLocalRanks([nranks, rank_id](ShmCollective* shm) {
+      auto inputs = MakeInputs(shm->local_rank());
+      auto fused = Fuse(&inputs);
+      const int64_t numel = fused.numel();
+      std::vector<float> out(numel * nranks * kLocalSize);
+      shm->AllGather<float>(
+          fused, out.data(), nranks, rank_id, FakeHostAllGather);
+      for (int r = 0; r < nranks * kLocalSize; ++r) {
+        auto expect = MakeInputs(r % kLocalSize);
+        auto expect_fused = Fuse(&expect);
+        std::vector<float> values(numel);
+        expect_fused.CopyTo(0, numel, values.data());
+        for (int64_t i = 0; i < numel; ++i) {
+          if (out[r * numel + i] != values[i]) {
+            return false;
+          }
+        }
+      }
+      return true;
+    }));
+  }
+}
+
+TEST(ShmCollective, LocalSizeOne) {
+  ShmCollective shm("unused", 0, 1, kSlotBytes);
+  auto inputs = MakeInputs(0);
+  auto fused = Fuse(&inputs);
+  std::vector<float> out(fused.numel() * kNRanks);
+  shm.MixAllGather<float>(fused, out.data(), kNRanks, kRankId,
+                          FakeHostAllGather);
+  for (int r = 0; r < kNRanks; ++r) {
+    std::vector<float> values(fused.numel());
+    fused.CopyTo(0, fused.numel(), values.data());
+    for (int64_t i = 0; i < fused.numel(); ++i) {
+      ASSERT_EQ(out[r * fused.numel() + i], values[i]);
+    }
+  }
+}
+
+// dense params of a model are many small tensors, compare one fused
+// collective with one collective per tensor
+TEST(ShmCollective, Benchmark) {
+  ASSERT_TRUE(RunLocalRanks([](ShmCollective* shm) {
+    const int tensor_num = 500;
+    const int64_t len = 1000;
+    std::vector<std::vector<float>> tensors(tensor_num,
+                                            std::vector<float>(len, 1.0f));
+    auto fused = Fuse(&tensors);
+    ShmCollective::HostAllReduce<float> no_host;
+
+    platform::Timer timer;
+    timer.Start();
+    for (int t = 0; t < tensor_num; ++t) {
+      FusedTensors<float> one;
+      one.Add(tensors[t].data(), len);
+      shm->AllReduce<float>(one, one, 1, no_host);
+    }
+    timer.Pause();
+    double per_tensor_ms = timer.ElapsedMS();
+
+    timer.Reset();
+    timer.Start();
+    shm->AllReduce<float>(fused, fused, 1, no_host);
+    timer.Pause();
+    if (shm->local_rank() == 0) {
+      LOG(INFO) << "allreduce " << tensor_num << " tensors of " << len
+                << " floats, per tensor: " << per_tensor_ms
+                << "ms, fused: " << timer.ElapsedMS() << "ms";
+    }
+    return tensors[0][0] == kLocalSize * kLocalSize;
+  }, 4 << 20));
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,375 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/mapped_tensor_file.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "paddle/fluid/framework/convert_utils.h"
+#include "paddle/fluid/framework/data_type.h"
+#include "paddle/fluid/framework/tensor_util.h"
+#ifndef _WIN32
+#include "paddle/fluid/memory/allocation/mmap_allocator.h"
+#endif
+#include "paddle/phi/backends/dynload/port.h"
+
+namespace paddle {
+namespace framework {
+
+static const char kMappedTensorFileMagic[8] = {
+    'P', 'D', 'M', 'A', 'P', 'T', 'S', 'R'};
+static constexpr uint32_t kMappedTensorFileVersion = 1;
+
+struct MappedTensorFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t alignment;
+  uint64_t tensor_num;
+  uint64_t directory_bytes;
+};
+
+namespace {
+
+class DirectoryWriter {
+ public:
+  template <typename T>
+  void Put(const T& value) {
+    buf_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+  void PutString(const std::string& str) {
+    Put(static_cast<uint32_t>(str.size()));
+    buf_.append(str);
+  }
+  const std::string& buf() const { return buf_; }
+
+ private:
+  std::string buf_;
+};
+
+class DirectoryReader {
+ public:
+  DirectoryReader(const char* data, size_t size, const std::string& file_name)
+      : data_(data), size_(size), file_name_(file_name) {}
+
+  template <typename T>
+  T Get() {
+    T value;
+    Check(sizeof(T));
+    memcpy(&value, data_ + pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return value;
+  }
+  std::string GetString() {
+    uint32_t len = Get<uint32_t>();
+    Check(len);
+    std::string str(data_ + pos_, len);
+    pos_ += len;
+    return str;
+  }
+
+ private:
+  void Check(size_t len) {
+    PADDLE_ENFORCE_LE(pos_ + len,
+                      size_,
+                      platform::errors::InvalidArgument(
+                          "The directory of mapped tensor file (%s) is "
+                          "truncated, the file seems broken.",
+                          file_name_));
+  }
+
+  const char* data_;
+  size_t size_;
+  size_t pos_ = 0;
+  const std::string& file_name_;
+};
+
+}  // namespace
+
+static uint64_t AlignedOffset(uint64_t offset) {
+  uint64_t rem = offset % kMappedTensorFileAlignment;
+  return rem == 0 ? offset : offset + kMappedTensorFileAlignment - rem;
+}
+
+std::string TempFileName(const std::string& file_name) {
+#ifdef _WIN32
+  int pid = _getpid();
+#else
+  int pid = getpid();
+#endif
+  return file_name + ".tmp." + std::to_string(pid);
+}
+
+void ReplaceWithTempFile(const std::string& temp_name,
+                         const std::string& file_name) {
+#ifdef _WIN32
+  // rename does not replace an existing file on windows
+  std::remove(file_name.c_str());
+#endif
+  PADDLE_ENFORCE_EQ(std::rename(temp_name.c_str(), file_name.c_str()),
+                    0,
+                    platform::errors::Unavailable(
+                        "Rename the saved file (%s) to (%s) failed.",
+                        temp_name,
+                        file_name));
+}
+
+void SaveMappedTensorFile(const std::string& file_name,
+                          const std::vector<std::string>& names,
+                          const std::vector<const LoDTensor*>& tensors) {
+  PADDLE_ENFORCE_EQ(names.size(),
+                    tensors.size(),
+                    platform::errors::InvalidArgument(
+                        "The number of names (%d) and tensors (%d) to save "
+                        "differ.",
+                        names.size(),
+                        tensors.size()));
+  // the directory has a fixed size, the data offsets are known before the
+  // data is written
+  std::vector<uint64_t> bytes(tensors.size());
+  size_t directory_bytes = 0;
+  for (size_t i = 0; i < tensors.size(); ++i) {
+    PADDLE_ENFORCE_EQ(tensors[i]->IsInitialized(),
+                      true,
+                      platform::errors::InvalidArgument(
+                          "The tensor (%s) to save is not initialized.",
+                          names[i]));
+    bytes[i] = tensors[i]->numel() * phi::SizeOf(tensors[i]->dtype());
+    directory_bytes += sizeof(uint32_t) + names[i].size() + sizeof(int32_t) +
+                       sizeof(uint32_t) +
+                       tensors[i]->dims().size() * sizeof(int64_t) +
+                       sizeof(uint32_t) + 2 * sizeof(uint64_t);
+    for (auto& level : tensors[i]->lod()) {
+      directory_bytes += sizeof(uint64_t) + level.size() * sizeof(uint64_t);
+    }
+  }
+  std::vector<uint64_t> offsets(tensors.size());
+  uint64_t offset =
+      AlignedOffset(sizeof(MappedTensorFileHeader) + directory_bytes);
+  for (size_t i = 0; i < tensors.size(); ++i) {
+    offsets[i] = offset;
+    offset = AlignedOffset(offset + bytes[i]);
+  }
+
+  DirectoryWriter directory;
+  for (size_t i = 0; i < tensors.size(); ++i) {
+    const LoDTensor& tensor = *tensors[i];
+    directory.PutString(names[i]);
+    directory.Put(static_cast<int32_t>(TransToProtoVarType(tensor.dtype())));
+    auto dims = phi::vectorize(tensor.dims());
+    directory.Put(static_cast<uint32_t>(dims.size()));
+    for (auto dim : dims) {
+      directory.Put(static_cast<int64_t>(dim));
+    }
+    directory.Put(static_cast<uint32_t>(tensor.lod().size()));
+    for (auto& level : tensor.lod()) {
+      directory.Put(static_cast<uint64_t>(level.size()));
+      for (auto pos : level) {
+        directory.Put(static_cast<uint64_t>(pos));
+      }
+    }
+    directory.Put(offsets[i]);
+    directory.Put(bytes[i]);
+  }
+  PADDLE_ENFORCE_EQ(directory.buf().size(),
+                    directory_bytes,
+                    platform::errors::PreconditionNotMet(
+                        "Mapped tensor file directory size mismatch."));
+
+  MkDirRecursively(DirName(file_name).c_str());
+  // the tensors may be loaded from file_name and still read from its pages
+  std::string temp_name = TempFileName(file_name);
+  std::ofstream fout(temp_name, std::ios::binary);
+  PADDLE_ENFORCE_EQ(
+      static_cast<bool>(fout),
+      true,
+      platform::errors::Unavailable("File (%s) open failed.", temp_name));
+  MappedTensorFileHeader header;
+  memcpy(header.magic, kMappedTensorFileMagic, sizeof(header.magic));
+  header.version = kMappedTensorFileVersion;
+  header.alignment = kMappedTensorFileAlignment;
+  header.tensor_num = tensors.size();
+  header.directory_bytes = directory_bytes;
+  fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  fout.write(directory.buf().data(), directory.buf().size());
+
+  uint64_t pos = sizeof(header) + directory_bytes;
+  const std::string padding(kMappedTensorFileAlignment, '\0');
+  for (size_t i = 0; i < tensors.size(); ++i) {
+    fout.write(padding.data(), offsets[i] - pos);
+    const LoDTensor* tensor = tensors[i];
+    LoDTensor cpu_tensor;
+    if (!platform::is_cpu_place(tensor->place())) {
+      TensorCopySync(*tensor, platform::CPUPlace(), &cpu_tensor);
+      tensor = &cpu_tensor;
+    }
+    fout.write(static_cast<const char*>(tensor->data()), bytes[i]);
+    pos = offsets[i] + bytes[i];
+  }
+  // the last tensor ends at a page boundary too, every data range of the
+  // file is a whole number of pages
+  fout.write(padding.data(), AlignedOffset(pos) - pos);
+  PADDLE_ENFORCE_EQ(static_cast<bool>(fout),
+                    true,
+                    platform::errors::Unavailable(
+                        "Error when writing data into mapped tensor file (%s).",
+                        temp_name));
+  fout.close();
+  ReplaceWithTempFile(temp_name, file_name);
+}
+
+bool IsMappedTensorFile(const std::string& file_name) {
+  std::ifstream fin(file_name, std::ios::binary);
+  char magic[sizeof(kMappedTensorFileMagic)];
+  if (!fin.read(magic, sizeof(magic))) {
+    return false;
+  }
+  return memcmp(magic, kMappedTensorFileMagic, sizeof(magic)) == 0;
+}
+
+MappedTensorFile::MappedTensorFile(const std::string& file_name,
+                                   bool populate)
+    : file_name_(file_name) {
+#ifndef _WIN32
+  file_ = memory::allocation::AllocateMemoryMapFileAllocation(file_name,
+                                                              populate);
+  const char* base = static_cast<const char*>(file_->ptr());
+  const size_t file_size = file_->size();
+  PADDLE_ENFORCE_GE(
+      file_size,
+      sizeof(MappedTensorFileHeader),
+      platform::errors::InvalidArgument(
+          "File (%s) is too small to be a mapped tensor file.", file_name));
+  MappedTensorFileHeader header;
+  memcpy(&header, base, sizeof(header));
+  PADDLE_ENFORCE_EQ(
+      memcmp(header.magic, kMappedTensorFileMagic, sizeof(header.magic)),
+      0,
+      platform::errors::InvalidArgument(
+          "File (%s) is not a mapped tensor file.", file_name));
+  PADDLE_ENFORCE_EQ(header.version,
+                    kMappedTensorFileVersion,
+                    platform::errors::InvalidArgument(
+                        "Mapped tensor file version %u is not supported, "
+                        "only version %u is supported.",
+                        header.version,
+                        kMappedTensorFileVersion));
+  PADDLE_ENFORCE_LE(
+      sizeof(header) + header.directory_bytes,
+      file_size,
+      platform::errors::InvalidArgument(
+          "The directory of mapped tensor file (%s) is truncated.", file_name));
+
+  DirectoryReader reader(
+      base + sizeof(header), header.directory_bytes, file_name);
+  entries_.resize(header.tensor_num);
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    Entry& entry = entries_[i];
+    entry.name = reader.GetString();
+    entry.dtype = static_cast<proto::VarType::Type>(reader.Get<int32_t>());
+    entry.dims.resize(reader.Get<uint32_t>());
+    for (auto& dim : entry.dims) {
+      dim = reader.Get<int64_t>();
+    }
+    entry.lod.resize(reader.Get<uint32_t>());
+    for (auto& level : entry.lod) {
+      level.resize(reader.Get<uint64_t>());
+      for (size_t j = 0; j < level.size(); ++j) {
+        level[j] = reader.Get<uint64_t>();
+      }
+    }
+    entry.offset = reader.Get<uint64_t>();
+    entry.bytes = reader.Get<uint64_t>();
+    int64_t numel = 1;
+    for (auto dim : entry.dims) {
+      numel *= dim;
+    }
+    PADDLE_ENFORCE_EQ(
+        entry.bytes,
+        static_cast<uint64_t>(numel) * SizeOfType(entry.dtype),
+        platform::errors::InvalidArgument(
+            "The size of tensor (%s) in mapped tensor file (%s) does not "
+            "match its shape.",
+            entry.name,
+            file_name));
+    PADDLE_ENFORCE_LE(entry.offset + entry.bytes,
+                      file_size,
+                      platform::errors::InvalidArgument(
+                          "The data of tensor (%s) is out of mapped tensor "
+                          "file (%s), the file seems broken.",
+                          entry.name,
+                          file_name));
+    index_[entry.name] = i;
+  }
+  VLOG(3) << "mapped tensor file " << file_name << ", tensor num "
+          << entries_.size() << ", size " << file_size;
+#else
+  PADDLE_THROW(platform::errors::Unimplemented(
+      "Mapped tensor file is not supported on windows."));
+#endif
+}
+
+size_t MappedTensorFile::Index(const std::string& name) const {
+  auto it = index_.find(name);
+  PADDLE_ENFORCE_NE(it,
+                    index_.end(),
+                    platform::errors::NotFound(
+                        "Tensor (%s) not found in mapped tensor file (%s).",
+                        name,
+                        file_name_));
+  return it->second;
+}
+
+void MappedTensorFile::ShareTensor(size_t i, LoDTensor* tensor) const {
+#ifndef _WIN32
+  PADDLE_ENFORCE_LT(i,
+                    entries_.size(),
+                    platform::errors::OutOfRange(
+                        "Tensor index %d is out of mapped tensor file (%s) "
+                        "with %d tensors.",
+                        i,
+                        file_name_,
+                        entries_.size()));
+  const Entry& entry = entries_[i];
+  auto holder =
+      std::make_shared<memory::allocation::MemoryMapFileViewAllocation>(
+          file_, entry.offset, entry.bytes);
+  tensor->clear();
+  tensor->Resize(phi::make_ddim(entry.dims));
+  tensor->ResetHolderWithType(holder, TransToPhiDataType(entry.dtype));
+  tensor->set_lod(entry.lod);
+#endif
+}
+
+void MappedTensorFile::LoadTensor(size_t i,
+                                  const platform::Place& place,
+                                  LoDTensor* tensor) const {
+  if (platform::is_cpu_place(place)) {
+    ShareTensor(i, tensor);
+    return;
+  }
+  LoDTensor mapped;
+  ShareTensor(i, &mapped);
+  TensorCopySync(mapped, place, tensor);
+  tensor->set_lod(mapped.lod());
+}
+
+}  // namespace framework
+}  // namespace paddle
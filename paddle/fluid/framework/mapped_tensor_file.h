@@ -0,0 +1,108 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "paddle/fluid/framework/framework.pb.h"
+#include "paddle/fluid/framework/lod_tensor.h"
+
+namespace paddle {
+namespace memory {
+namespace allocation {
+class MemoryMapFileAllocation;
+}  // namespace allocation
+}  // namespace memory
+
+namespace framework {
+
+// The mapped tensor file keeps many tensors in one file that is loaded with
+// mmap instead of being read through a stream:
+//
+//   header     magic "PDMAPTSR", uint32 version, uint32 alignment,
+//              uint64 tensor number, uint64 directory bytes
+//   directory  for every tensor: uint32 name length, name, int32 data type,
+//              uint32 rank, int64 dims, uint32 lod level, for every level
+//              uint64 length and uint64 offsets, uint64 data offset,
+//              uint64 data bytes
+//   data       the data of every tensor at an offset aligned to alignment
+//
+// The data starts at a page boundary, so a cpu tensor can use the mapped
+// pages directly.
+static constexpr uint32_t kMappedTensorFileAlignment = 4096;
+
+// save the tensors into file_name, tensors on a device are copied to the cpu
+void SaveMappedTensorFile(const std::string& file_name,
+                          const std::vector<std::string>& names,
+                          const std::vector<const LoDTensor*>& tensors);
+
+// The temporary file a save to file_name writes, ReplaceWithTempFile renames
+// it over file_name. The renamed file is a new inode, the tensors still
+// mapped from the old file_name keep their pages, a save into the old inode
+// would truncate them under the mappings.
+std::string TempFileName(const std::string& file_name);
+void ReplaceWithTempFile(const std::string& temp_name,
+                         const std::string& file_name);
+
+// whether file_name starts with the mapped tensor file magic
+bool IsMappedTensorFile(const std::string& file_name);
+
+class MappedTensorFile {
+ public:
+  // populate reads the whole file ahead, otherwise the pages are read on
+  // their first access
+  explicit MappedTensorFile(const std::string& file_name,
+                            bool populate = false);
+
+  size_t size() const { return entries_.size(); }
+  const std::string& name(size_t i) const { return entries_[i].name; }
+  bool Has(const std::string& name) const {
+    return index_.find(name) != index_.end();
+  }
+  // the index of the tensor named name
+  size_t Index(const std::string& name) const;
+
+  // tensor i uses the mapped pages without a copy. The pages are private
+  // mappings of the file, a write to the tensor copies the written page and
+  // never changes the file.
+  void ShareTensor(size_t i, LoDTensor* tensor) const;
+
+  // tensor i on place, shared with the mapping on the cpu and copied from
+  // the mapping on other places
+  void LoadTensor(size_t i,
+                  const platform::Place& place,
+                  LoDTensor* tensor) const;
+
+ private:
+  struct Entry {
+    std::string name;
+    proto::VarType::Type dtype;
+    std::vector<int64_t> dims;
+    LoD lod;
+    uint64_t offset;
+    uint64_t bytes;
+  };
+
+  std::string file_name_;
+  std::shared_ptr<memory::allocation::MemoryMapFileAllocation> file_;
+  std::vector<Entry> entries_;
+  std::unordered_map<std::string, size_t> index_;
+};
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,188 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/mapped_tensor_file.h"
+
+#include <chrono>  // NOLINT
+#include <cstdlib>
+#include <fstream>
+
+#include "glog/logging.h"
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace framework {
+
+TEST(MappedTensorFile, SaveShare) {
+  platform::CPUPlace place;
+  LoDTensor t1;
+  t1.Resize({10, 3});
+  float* d1 = t1.mutable_data<float>(place);
+  for (int i = 0; i < 30; ++i) {
+    d1[i] = i * 0.5f;
+  }
+  t1.set_lod({{0, 4, 10}});
+  LoDTensor t2;
+  t2.Resize({7});
+  int64_t* d2 = t2.mutable_data<int64_t>(place);
+  for (int i = 0; i < 7; ++i) {
+    d2[i] = i * 1000;
+  }
+
+  const std::string file_name = "mapped_tensor_file_test.bin";
+  SaveMappedTensorFile(file_name, {"t1", "t2"}, {&t1, &t2});
+  ASSERT_TRUE(IsMappedTensorFile(file_name));
+
+  MappedTensorFile mapped(file_name);
+  ASSERT_EQ(mapped.size(), 2UL);
+  EXPECT_EQ(mapped.name(0), "t1");
+  EXPECT_TRUE(mapped.Has("t2"));
+  EXPECT_FALSE(mapped.Has("t3"));
+
+  LoDTensor r1;
+  mapped.ShareTensor(mapped.Index("t1"), &r1);
+  EXPECT_EQ(r1.dims(), t1.dims());
+  EXPECT_EQ(r1.lod(), t1.lod());
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(r1.data<float>()) %
+                kMappedTensorFileAlignment,
+            0UL);
+  for (int i = 0; i < 30; ++i) {
+    ASSERT_EQ(r1.data<float>()[i], d1[i]);
+  }
+
+  LoDTensor r2;
+  mapped.LoadTensor(mapped.Index("t2"), place, &r2);
+  for (int i = 0; i < 7; ++i) {
+    ASSERT_EQ(r2.data<int64_t>()[i], d2[i]);
+  }
+
+  // a write to the shared tensor stays in the process
+  r1.data<float>()[0] = -1.0f;
+  MappedTensorFile remapped(file_name);
+  LoDTensor r3;
+  remapped.ShareTensor(0, &r3);
+  EXPECT_EQ(r3.data<float>()[0], d1[0]);
+}
+
+TEST(MappedTensorFile, SaveOverMapped) {
+  platform::CPUPlace place;
+  LoDTensor t;
+  t.Resize({3 * 1024});
+  float* data = t.mutable_data<float>(place);
+  for (int i = 0; i < 3 * 1024; ++i) {
+    data[i] = i;
+  }
+  const std::string file_name = "mapped_tensor_file_overwrite_test.bin";
+  SaveMappedTensorFile(file_name, {"t"}, {&t});
+
+  LoDTensor loaded;
+  {
+    MappedTensorFile mapped(file_name);
+    mapped.LoadTensor(0, place, &loaded);
+  }
+  // the loaded tensor still reads the pages of file_name while it is saved
+  // over, then file_name is saved over with other values
+  SaveMappedTensorFile(file_name, {"t"}, {&loaded});
+  for (int i = 0; i < 3 * 1024; ++i) {
+    data[i] = -i;
+  }
+  SaveMappedTensorFile(file_name, {"t"}, {&t});
+
+  for (int i = 0; i < 3 * 1024; ++i) {
+    ASSERT_EQ(loaded.data<float>()[i], i);
+  }
+  MappedTensorFile remapped(file_name);
+  LoDTensor reloaded;
+  remapped.LoadTensor(0, place, &reloaded);
+  for (int i = 0; i < 3 * 1024; ++i) {
+    ASSERT_EQ(reloaded.data<float>()[i], -i);
+  }
+  std::ifstream temp(TempFileName(file_name));
+  EXPECT_FALSE(temp.good());
+}
+
+TEST(MappedTensorFile, NotMapped) {
+  const std::string file_name = "mapped_tensor_file_test.txt";
+  std::ofstream fout(file_name);
+  fout << "not a mapped tensor file";
+  fout.close();
+  EXPECT_FALSE(IsMappedTensorFile(file_name));
+  EXPECT_ANY_THROW(MappedTensorFile mapped(file_name));
+}
+
+// the size of the benchmark tensors is set by
+// FLAGS_mapped_tensor_file_bench_mb in the environment, 256MB by default
+TEST(MappedTensorFile, Benchmark) {
+  int64_t total_mb = 256;
+  if (const char* env = std::getenv("FLAGS_mapped_tensor_file_bench_mb")) {
+    total_mb = std::atoll(env);
+  }
+  const int tensor_num = 16;
+  const int64_t numel = (total_mb << 20) / sizeof(float) / tensor_num;
+  platform::CPUPlace place;
+  std::vector<LoDTensor> tensors(tensor_num);
+  std::vector<std::string> names;
+  std::vector<const LoDTensor*> ptrs;
+  for (int i = 0; i < tensor_num; ++i) {
+    tensors[i].Resize({numel});
+    float* data = tensors[i].mutable_data<float>(place);
+    for (int64_t j = 0; j < numel; ++j) {
+      data[j] = static_cast<float>(i + j);
+    }
+    names.push_back("w" + std::to_string(i));
+    ptrs.push_back(&tensors[i]);
+  }
+
+  const std::string stream_file = "mapped_tensor_file_bench.stream";
+  {
+    std::ofstream fout(stream_file, std::ios::binary);
+    for (auto& tensor : tensors) {
+      SerializeToStream(fout, tensor);
+    }
+  }
+  const std::string mapped_file = "mapped_tensor_file_bench.mapped";
+  SaveMappedTensorFile(mapped_file, names, ptrs);
+
+  auto start = std::chrono::steady_clock::now();
+  {
+    std::ifstream fin(stream_file, std::ios::binary);
+    for (int i = 0; i < tensor_num; ++i) {
+      LoDTensor tensor;
+      DeserializeFromStream(fin, &tensor);
+    }
+  }
+  double stream_ms = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+  start = std::chrono::steady_clock::now();
+  {
+    MappedTensorFile mapped(mapped_file);
+    for (int i = 0; i < tensor_num; ++i) {
+      LoDTensor tensor;
+      mapped.ShareTensor(i, &tensor);
+    }
+  }
+  double mapped_ms = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+  LOG(INFO) << "load " << total_mb << "MB in " << tensor_num
+            << " tensors, stream: " << stream_ms << "ms, mapped: " << mapped_ms
+            << "ms";
+  std::remove(stream_file.c_str());
+  std::remove(mapped_file.c_str());
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -21,6 +21,7 @@ limitations under the License. */
 #include "paddle/fluid/framework/data_transform.h"
 #include "paddle/fluid/framework/data_type_transform.h"
 #include "paddle/fluid/framework/details/nan_inf_utils.h"
+#include "paddle/fluid/framework/fleet/box_trace.h"
 #include "paddle/fluid/framework/op_call_stack.h"
 #include "paddle/fluid/framework/phi_utils.h"
 #include "paddle/fluid/framework/shape_inference.h"
@@ -265,13 +266,14 @@ void OperatorBase::Run(const Scope& scope, const platform::Place& place) {
       // TODO(wangchaochaohu) : refine code to use only one RecordEvent)
       // in order to record different op type cost time
       // and different op name cost time,we set two event.
+      // the ops of the batches BoxTracer does not sample are not recorded
       platform::RecordEvent op_type_record_event(
-          Type(), platform::TracerEventType::Operator, 1);
+          Type(), platform::TracerEventType::Operator, BoxTracer::Level(1));
       auto op_name = platform::OpName(outputs_, Type());
       platform::RecordEvent op_name_record_event(
           op_name,
           platform::TracerEventType::Operator,
-          FLAGS_enable_host_event_recorder_hook ? 20 : 1,
+          BoxTracer::Level(FLAGS_enable_host_event_recorder_hook ? 20 : 1),
           platform::EventRole::kUniqueOp);
       RunImpl(scope, place);
     }
@@ -1660,7 +1662,7 @@ void OperatorWithKernel::RunImpl(const Scope& scope,
   {
     platform::RecordEvent record_event("prepare_data",
                                        platform::TracerEventType::OperatorInner,
-                                       1,
+                                       BoxTracer::Level(1),
                                        platform::EventRole::kInnerOp);
     if (need_prepare_data_) {
       transfer_scope = PrepareData(
@@ -1674,7 +1676,7 @@ void OperatorWithKernel::RunImpl(const Scope& scope,
   if (!all_kernels_must_compute_runtime_shape_) {
     platform::RecordEvent record_event("infer_shape",
                                        platform::TracerEventType::OperatorInner,
-                                       1,
+                                       BoxTracer::Level(1),
                                        platform::EventRole::kInnerOp);
     RuntimeInferShapeContext infer_shape_ctx(*this, *runtime_ctx);
     this->Info().infer_shape_(&infer_shape_ctx);
@@ -1692,7 +1694,7 @@ void OperatorWithKernel::RunImpl(const Scope& scope,
   {
     platform::RecordEvent record_event("compute",
                                        platform::TracerEventType::OperatorInner,
-                                       1,
+                                       BoxTracer::Level(1),
                                        platform::EventRole::kInnerOp);
     if (run_phi_kernel_) {
       phi::KernelContext pt_kernel_context;
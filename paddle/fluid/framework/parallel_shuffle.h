@@ -0,0 +1,88 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace paddle {
+namespace framework {
+
+// Shuffles data in place with thread_num threads. Every thread shuffles its
+// own segment, the segments swap blocks like a matrix transpose, so every
+// segment gets a random block of every other segment, and every thread
+// shuffles its segment again. Thread t draws from an engine seeded with
+// (seed, t), the result only depends on the data, seed and thread_num.
+template <class T>
+void ParallelShuffle(std::vector<T>* data, int thread_num, uint64_t seed) {
+  size_t num = data->size();
+  // the blocks of fewer records than the threads are not worth the threads
+  if (thread_num <= 1 || num < static_cast<size_t>(thread_num) * thread_num) {
+    std::seed_seq sseq = {seed, 0UL};
+    std::default_random_engine engine(sseq);
+    std::shuffle(data->begin(), data->end(), engine);
+    return;
+  }
+  size_t seg_len = num / thread_num;
+  // segment t is [begin(t), begin(t + 1)), the first segments take one more
+  // record when num is not divisible
+  auto begin = [num, thread_num, seg_len](int t) {
+    size_t extra = num % thread_num;
+    return t * seg_len + std::min(static_cast<size_t>(t), extra);
+  };
+  // the first block_len * thread_num records of every segment are exchanged
+  size_t block_len = seg_len / thread_num;
+  auto run = [thread_num](const std::function<void(int)>& func) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_num; ++t) {
+      threads.emplace_back(func, t);
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  };
+  std::vector<std::default_random_engine> engines(thread_num);
+  for (int t = 0; t < thread_num; ++t) {
+    std::seed_seq sseq = {seed, static_cast<uint64_t>(t) + 1};
+    engines[t].seed(sseq);
+  }
+  auto shuffle_segment = [&](int t) {
+    std::shuffle(data->begin() + begin(t),
+                 data->begin() + begin(t + 1),
+                 engines[t]);
+  };
+  run(shuffle_segment);
+  // thread t swaps block j of segment i with block i of segment j for the
+  // pairs i < j of (i + j) % thread_num == t
+  run([&](int t) {
+    for (int i = 0; i < thread_num; ++i) {
+      for (int j = i + 1; j < thread_num; ++j) {
+        if ((i + j) % thread_num != t) {
+          continue;
+        }
+        auto a = data->begin() + begin(i) + j * block_len;
+        auto b = data->begin() + begin(j) + i * block_len;
+        std::swap_ranges(a, a + block_len, b);
+      }
+    }
+  });
+  run(shuffle_segment);
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,104 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/parallel_shuffle.h"
+
+#include <chrono>  // NOLINT
+#include <numeric>
+#include <string>
+
+#include "glog/logging.h"
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace framework {
+
+static std::vector<std::string> MakeData(size_t num) {
+  std::vector<std::string> data(num);
+  for (size_t i = 0; i < num; ++i) {
+    data[i] = std::to_string(i);
+  }
+  return data;
+}
+
+TEST(ParallelShuffle, Permutation) {
+  for (size_t num : {0UL, 5UL, 63UL, 64UL, 1000UL, 100003UL}) {
+    auto data = MakeData(num);
+    ParallelShuffle(&data, 8, 7);
+    auto sorted = data;
+    std::sort(sorted.begin(), sorted.end());
+    auto expect = MakeData(num);
+    std::sort(expect.begin(), expect.end());
+    EXPECT_EQ(sorted, expect) << num;
+  }
+}
+
+TEST(ParallelShuffle, Seed) {
+  auto a = MakeData(100000);
+  auto b = a;
+  auto c = a;
+  ParallelShuffle(&a, 4, 1);
+  ParallelShuffle(&b, 4, 1);
+  ParallelShuffle(&c, 4, 2);
+  EXPECT_EQ(a, b);
+  EXPECT_NE(a, c);
+}
+
+TEST(ParallelShuffle, Spread) {
+  // the records of the first segment end up in every segment
+  const int thread_num = 8;
+  const size_t num = 80000;
+  std::vector<size_t> data(num);
+  std::iota(data.begin(), data.end(), 0);
+  ParallelShuffle(&data, thread_num, 3);
+  std::vector<size_t> count(thread_num, 0);
+  for (size_t i = 0; i < num; ++i) {
+    if (data[i] < num / thread_num) {
+      ++count[i / (num / thread_num)];
+    }
+  }
+  for (int t = 0; t < thread_num; ++t) {
+    EXPECT_NEAR(count[t], num / thread_num / thread_num, 200) << t;
+  }
+  // the first segment is not kept in order
+  size_t in_place = 0;
+  for (size_t i = 0; i < num; ++i) {
+    in_place += data[i] == i;
+  }
+  EXPECT_LT(in_place, 100UL);
+}
+
+TEST(ParallelShuffle, Benchmark) {
+  const size_t num = 5000000;
+  std::vector<uint64_t> data(num);
+  std::iota(data.begin(), data.end(), 0);
+  auto start = std::chrono::steady_clock::now();
+  std::default_random_engine engine(0);
+  std::shuffle(data.begin(), data.end(), engine);
+  double std_sec = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  for (int thread_num : {1, 4, 16}) {
+    start = std::chrono::steady_clock::now();
+    ParallelShuffle(&data, thread_num, 0);
+    double sec = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+    LOG(INFO) << num << " records, std::shuffle " << std_sec << "s, "
+              << thread_num << " threads " << sec << "s";
+  }
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -17,6 +17,7 @@
 #include <fstream>
 
 #include "paddle/fluid/framework/convert_utils.h"
+#include "paddle/fluid/framework/mapped_tensor_file.h"
 #include "paddle/fluid/imperative/layer.h"
 
 namespace paddle {
@@ -261,6 +262,73 @@ bool LoadStaticNameListFromDisk(
   return true;
 }
 
+bool SaveStaticNameListToMappedFile(
+    const std::string& file_name,
+    const std::vector<std::string>& vec_tensor_name_list,
+    const Scope& scope) {
+  std::vector<const LoDTensor*> tensors;
+  tensors.reserve(vec_tensor_name_list.size());
+  for (auto& name : vec_tensor_name_list) {
+    auto var_ptr = scope.FindVar(name);
+    PADDLE_ENFORCE_NOT_NULL(
+        var_ptr,
+        platform::errors::NotFound("Variable (%s) is not found when "
+                                   "saving model, please make sure "
+                                   "that exe.run(startup_program) has "
+                                   "been executed.",
+                                   name));
+    tensors.push_back(&var_ptr->Get<LoDTensor>());
+  }
+  SaveMappedTensorFile(file_name, vec_tensor_name_list, tensors);
+  return true;
+}
+
+bool LoadStaticNameListFromMappedFile(
+    const std::string& file_name,
+    const std::vector<std::string>& vec_tensor_name_list,
+    const Scope& scope) {
+  MappedTensorFile mapped(file_name);
+  for (auto& name : vec_tensor_name_list) {
+    size_t index = mapped.Index(name);
+    auto var_ptr = scope.FindVar(name);
+    PADDLE_ENFORCE_NOT_NULL(
+        var_ptr,
+        platform::errors::PreconditionNotMet(
+            "Parameter (%s) is not created when loading model, "
+            "please make sure that exe.run(startup_program) has been executed.",
+            name));
+    LoDTensor* tensor = var_ptr->GetMutable<LoDTensor>();
+    PADDLE_ENFORCE_EQ(tensor->IsInitialized(),
+                      true,
+                      platform::errors::PreconditionNotMet(
+                          "Paramter [%s] is not initialzed, "
+                          "please make sure that exe.run(startup_program) has "
+                          "been executed.",
+                          name));
+    auto place = tensor->place();
+    auto dims = tensor->dims();
+    // a cpu parameter takes the mapped pages, the file stays mapped while
+    // the parameter holds them
+    mapped.LoadTensor(index, place, tensor);
+    PADDLE_ENFORCE_EQ(
+        tensor->dims(),
+        dims,
+        platform::errors::InvalidArgument(
+            "Shape does not match, the program requires a parameter with a "
+            "shape of (%s), while the loaded parameter (namely [ %s ]) has a "
+            "shape of (%s).",
+            dims,
+            name,
+            tensor->dims()));
+  }
+  if (mapped.size() > vec_tensor_name_list.size()) {
+    LOG(ERROR) << "There is [" << mapped.size() - vec_tensor_name_list.size()
+               << "] tensor in mapped model file " << file_name
+               << " not used";
+  }
+  return true;
+}
+
 bool SaveTensorToDisk(const std::string& file_name,
                       const std::map<std::string, Tensor*>& map_tensor) {
   MkDirRecursively(DirName(file_name).c_str());
@@ -40,6 +40,18 @@ bool LoadStaticNameListFromDisk(
     const std::vector<std::string>& vec_tensor_name_list,
     const Scope& scope);
 
+// the same as SaveStaticNameListToDisk and LoadStaticNameListFromDisk with
+// the mapped tensor file, the cpu parameters share the mapped pages
+bool SaveStaticNameListToMappedFile(
+    const std::string& file_name,
+    const std::vector<std::string>& vec_tensor_name_list,
+    const Scope& scope);
+
+bool LoadStaticNameListFromMappedFile(
+    const std::string& file_name,
+    const std::vector<std::string>& vec_tensor_name_list,
+    const Scope& scope);
+
 bool SaveDygraphVarBaseListToDisk(
     const std::string& file_name,
     const std::vector<std::shared_ptr<imperative::VarBase>>& vec_var_base_list);
@@ -0,0 +1,414 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "paddle/fluid/framework/data_feed.h"
+#include "paddle/fluid/framework/lod_tensor.h"
+#include "paddle/fluid/framework/scope.h"
+#include "paddle/fluid/platform/timer.h"
+
+namespace paddle {
+namespace framework {
+
+class TestSlotPaddleBoxDataFeed : public SlotPaddleBoxDataFeed {
+ public:
+  using SlotPaddleBoxDataFeed::PutToFeedSlotVec;
+};
+
+// uint64 slots "0".."n-1" with random feasign num, one dense float slot
+static DataFeedDesc MakeSlotDesc(int uint64_slot_num, int batch_size) {
+  DataFeedDesc desc;
+  desc.set_name("SlotPaddleBoxDataFeed");
+  desc.set_batch_size(batch_size);
+  auto* multi_slot_desc = desc.mutable_multi_slot_desc();
+  for (int i = 0; i < uint64_slot_num; ++i) {
+    auto* slot = multi_slot_desc->add_slots();
+    slot->set_name(std::to_string(i));
+    slot->set_type("uint64");
+    slot->set_is_used(true);
+    slot->set_is_dense(false);
+  }
+  auto* dense = multi_slot_desc->add_slots();
+  dense->set_name("dense");
+  dense->set_type("float");
+  dense->set_is_used(true);
+  dense->set_is_dense(true);
+  dense->add_shape(-1);
+  dense->add_shape(4);
+  return desc;
+}
+
+static void MakeSlotRecords(int uint64_slot_num,
+                            int ins_num,
+                            std::vector<SlotRecordObject>* objs,
+                            std::vector<SlotRecord>* recs) {
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int> fea_num(0, 6);
+  objs->resize(ins_num);
+  recs->resize(ins_num);
+  for (int i = 0; i < ins_num; ++i) {
+    std::vector<std::vector<uint64_t>> uint64_feas(uint64_slot_num);
+    uint32_t total = 0;
+    for (int j = 0; j < uint64_slot_num; ++j) {
+      int n = fea_num(rng);
+      for (int k = 0; k < n; ++k) {
+        uint64_feas[j].push_back(rng());
+      }
+      total += n;
+    }
+    (*objs)[i].slot_uint64_feasigns_.add_slot_feasigns(uint64_feas, total);
+    std::vector<std::vector<float>> float_feas(1);
+    for (int k = 0; k < 4; ++k) {
+      float_feas[0].push_back(static_cast<float>(i * 4 + k));
+    }
+    (*objs)[i].slot_float_feasigns_.add_slot_feasigns(float_feas, 4);
+    (*recs)[i] = &(*objs)[i];
+  }
+}
+
+static void CheckFeed(const Scope& scope,
+                      int uint64_slot_num,
+                      const std::vector<SlotRecord>& recs) {
+  int ins_num = static_cast<int>(recs.size());
+  for (int j = 0; j < uint64_slot_num; ++j) {
+    auto& tensor = scope.FindVar(std::to_string(j))->Get<LoDTensor>();
+    ASSERT_EQ(tensor.lod().size(), 1UL);
+    auto& lod = tensor.lod()[0];
+    ASSERT_EQ(lod.size(), static_cast<size_t>(ins_num + 1));
+    const int64_t* data = tensor.data<int64_t>();
+    for (int i = 0; i < ins_num; ++i) {
+      size_t fea_num = 0;
+      uint64_t* values =
+          recs[i]->slot_uint64_feasigns_.get_values(j, &fea_num);
+      ASSERT_EQ(lod[i + 1] - lod[i], fea_num);
+      for (size_t k = 0; k < fea_num; ++k) {
+        ASSERT_EQ(static_cast<uint64_t>(data[lod[i] + k]), values[k]);
+      }
+    }
+  }
+  auto& dense = scope.FindVar("dense")->Get<LoDTensor>();
+  ASSERT_EQ(dense.dims(), phi::make_ddim({ins_num, 4}));
+  const float* data = dense.data<float>();
+  for (int i = 0; i < ins_num; ++i) {
+    size_t fea_num = 0;
+    float* values = recs[i]->slot_float_feasigns_.get_values(0, &fea_num);
+    ASSERT_EQ(fea_num, 4UL);
+    for (int k = 0; k < 4; ++k) {
+      ASSERT_EQ(data[i * 4 + k], values[k]);
+    }
+  }
+}
+
+static void TestPutToFeedSlotVec(int fill_thread_num) {
+  const int slot_num = 32;
+  const int batch_size = 64;
+  FLAGS_padbox_slotfeed_fill_thread_num = fill_thread_num;
+  std::vector<SlotRecordObject> objs;
+  std::vector<SlotRecord> recs;
+  MakeSlotRecords(slot_num, batch_size * 3, &objs, &recs);
+
+  Scope scope;
+  TestSlotPaddleBoxDataFeed feed;
+  feed.Init(MakeSlotDesc(slot_num, batch_size));
+  for (auto& name : feed.GetUseSlotAlias()) {
+    scope.Var(name)->GetMutable<LoDTensor>();
+  }
+  feed.AssignFeedVar(scope);
+  feed.SetPlace(platform::CPUPlace());
+  feed.SetSlotRecord(recs.data());
+  for (int b = 0; b < 3; ++b) {
+    feed.AddBatchOffset(std::make_pair(b * batch_size, batch_size));
+  }
+  feed.SetFileList({});
+  feed.Start();
+  for (int b = 0; b < 3; ++b) {
+    ASSERT_EQ(feed.Next(), batch_size);
+    std::vector<SlotRecord> batch(recs.begin() + b * batch_size,
+                                  recs.begin() + (b + 1) * batch_size);
+    CheckFeed(scope, slot_num, batch);
+  }
+  ASSERT_EQ(feed.Next(), 0);
+  FLAGS_padbox_slotfeed_fill_thread_num = 0;
+}
+
+TEST(SlotPaddleBoxDataFeed, PutToFeedSlotVec) { TestPutToFeedSlotVec(0); }
+
+TEST(SlotPaddleBoxDataFeed, PutToFeedSlotVecParallel) {
+  TestPutToFeedSlotVec(4);
+}
+
+// batch assembly cost at production slot num and batch size
+TEST(SlotPaddleBoxDataFeed, PutToFeedSlotVecBenchmark) {
+  const int slot_num = 320;
+  const int repeat = 20;
+  for (int batch_size : {512, 2048}) {
+    std::vector<SlotRecordObject> objs;
+    std::vector<SlotRecord> recs;
+    MakeSlotRecords(slot_num, batch_size, &objs, &recs);
+    for (int thread_num : {0, 4, 8}) {
+      FLAGS_padbox_slotfeed_fill_thread_num = thread_num;
+      Scope scope;
+      TestSlotPaddleBoxDataFeed feed;
+      feed.Init(MakeSlotDesc(slot_num, batch_size));
+      for (auto& name : feed.GetUseSlotAlias()) {
+        scope.Var(name)->GetMutable<LoDTensor>();
+      }
+      feed.AssignFeedVar(scope);
+      feed.SetPlace(platform::CPUPlace());
+
+      platform::Timer timer;
+      timer.Start();
+      for (int r = 0; r < repeat; ++r) {
+        feed.PutToFeedSlotVec(recs.data(), batch_size);
+      }
+      timer.Pause();
+      LOG(INFO) << "slot num: " << slot_num << ", batch size: " << batch_size
+                << ", fill thread num: " << thread_num << ", per batch: "
+                << timer.ElapsedUS() / repeat << "us";
+    }
+  }
+  FLAGS_padbox_slotfeed_fill_thread_num = 0;
+}
+
+// the feed with the auc runner overlay given by the test
+class OverlaySlotPaddleBoxDataFeed : public TestSlotPaddleBoxDataFeed {
+ public:
+  explicit OverlaySlotPaddleBoxDataFeed(const SlotReplaceOverlay* overlay)
+      : overlay_(overlay) {}
+  void set_overlay(const SlotReplaceOverlay* overlay) { overlay_ = overlay; }
+
+ protected:
+  const SlotReplaceOverlay* GetSlotReplaceOverlay(void) const override {
+    return overlay_;
+  }
+
+ private:
+  const SlotReplaceOverlay* overlay_;
+};
+
+// the overlay serves the same feasigns and offsets as the records replaced in
+// place by FeasignValuesReplacer, to the gpu pack and to the cpu slot fill
+TEST(SlotPaddleBoxDataFeed, SlotReplaceOverlay) {
+  const int slot_num = 32;
+  const int ins_num = 128;
+  const std::set<uint16_t> slots = {0, 5, 6, 20, 31};
+  std::vector<SlotRecordObject> objs;
+  std::vector<SlotRecord> unused;
+  MakeSlotRecords(slot_num, ins_num, &objs, &unused);
+
+  // the records carry the AucRunnerInfo after the extend dims
+  size_t record_bytes = sizeof(SlotRecordObject) +
+                        sizeof(float) * FLAGS_padbox_slotrecord_extend_dim +
+                        sizeof(AucRunnerInfo);
+  std::vector<SlotRecord> recs(ins_num);
+  std::vector<FeasignValuesCandidate> candidates(ins_num);
+  SlotReplaceOverlay overlay;
+  overlay.Reset(slots, ins_num);
+  for (int i = 0; i < ins_num; ++i) {
+    recs[i] = make_slotrecord(record_bytes);
+    *recs[i] = objs[i];
+    get_auc_runner_info(recs[i])->record_id_ = i;
+    candidates[i] = FeasignValuesCandidate(
+        objs[(i * 7 + 3) % ins_num].slot_uint64_feasigns_, slots);
+    overlay.Set(i, candidates[i]);
+  }
+  std::vector<SlotRecordObject> replaced(objs);
+  std::vector<SlotRecord> replaced_recs(ins_num);
+  int del_num = 0;
+  int add_num = 0;
+  for (int i = 0; i < ins_num; ++i) {
+    FeasignValuesReplacer replacer;
+    replacer.replace(&replaced[i].slot_uint64_feasigns_,
+                     candidates[i].feasign_values_,
+                     slots,
+                     &del_num,
+                     &add_num);
+    replaced_recs[i] = &replaced[i];
+  }
+
+  for (int i = 0; i < ins_num; ++i) {
+    const auto& expect = replaced[i].slot_uint64_feasigns_;
+    ASSERT_EQ(overlay.ValueNum(recs[i]), expect.slot_values.size());
+    std::vector<uint64_t> keys(expect.slot_values.size());
+    std::vector<int> offsets(slot_num + 1);
+    overlay.CopyValues(recs[i], keys.data(), offsets.data());
+    EXPECT_EQ(keys, expect.slot_values);
+    for (int s = 0; s <= slot_num; ++s) {
+      ASSERT_EQ(static_cast<uint32_t>(offsets[s]), expect.slot_offsets[s]);
+    }
+  }
+
+  Scope scope;
+  OverlaySlotPaddleBoxDataFeed feed(&overlay);
+  feed.Init(MakeSlotDesc(slot_num, ins_num));
+  for (auto& name : feed.GetUseSlotAlias()) {
+    scope.Var(name)->GetMutable<LoDTensor>();
+  }
+  feed.AssignFeedVar(scope);
+  feed.SetPlace(platform::CPUPlace());
+  feed.PutToFeedSlotVec(recs.data(), ins_num);
+  CheckFeed(scope, slot_num, replaced_recs);
+
+  // the next batch offsets are counted ahead under no overlay, switching the
+  // overlay before the batch is taken must not reuse them
+  FLAGS_padbox_slotfeed_fill_thread_num = 4;
+  const int batch_size = ins_num / 2;
+  Scope next_scope;
+  OverlaySlotPaddleBoxDataFeed next_feed(nullptr);
+  next_feed.Init(MakeSlotDesc(slot_num, batch_size));
+  for (auto& name : next_feed.GetUseSlotAlias()) {
+    next_scope.Var(name)->GetMutable<LoDTensor>();
+  }
+  next_feed.AssignFeedVar(next_scope);
+  next_feed.SetPlace(platform::CPUPlace());
+  next_feed.SetSlotRecord(recs.data());
+  next_feed.AddBatchOffset(std::make_pair(0, batch_size));
+  next_feed.AddBatchOffset(std::make_pair(batch_size, batch_size));
+  next_feed.SetFileList({});
+  next_feed.Start();
+  ASSERT_EQ(next_feed.Next(), batch_size);
+  CheckFeed(next_scope,
+            slot_num,
+            std::vector<SlotRecord>(recs.begin(), recs.begin() + batch_size));
+  next_feed.set_overlay(&overlay);
+  ASSERT_EQ(next_feed.Next(), batch_size);
+  CheckFeed(next_scope,
+            slot_num,
+            std::vector<SlotRecord>(replaced_recs.begin() + batch_size,
+                                    replaced_recs.end()));
+  FLAGS_padbox_slotfeed_fill_thread_num = 0;
+
+  for (auto& rec : recs) {
+    free_slotrecord(rec);
+  }
+}
+
+// the even uint64 slots hold small ids under the slot id, the odd ones hashed
+// feasigns, the float feasigns are exact in float16
+static void MakeArchiveRecords(int uint64_slot_num,
+                               int ins_num,
+                               std::vector<SlotRecordObject>* objs,
+                               std::vector<SlotRecord>* recs) {
+  std::mt19937_64 rng(0);
+  std::uniform_int_distribution<int> fea_num(0, 6);
+  objs->resize(ins_num);
+  recs->resize(ins_num);
+  for (int i = 0; i < ins_num; ++i) {
+    auto& obj = (*objs)[i];
+    std::vector<std::vector<uint64_t>> uint64_feas(uint64_slot_num);
+    uint32_t total = 0;
+    for (int j = 0; j < uint64_slot_num; ++j) {
+      int n = fea_num(rng);
+      for (int k = 0; k < n; ++k) {
+        uint64_feas[j].push_back(
+            (j % 2 == 0) ? (static_cast<uint64_t>(j) << 48) | (rng() % 100000)
+                         : rng());
+      }
+      total += n;
+    }
+    obj.slot_uint64_feasigns_.add_slot_feasigns(uint64_feas, total);
+    std::vector<std::vector<float>> float_feas(2);
+    for (int k = 0; k < 4; ++k) {
+      float_feas[k % 2].push_back(static_cast<float>(rng() % 64) * 0.25f);
+    }
+    obj.slot_float_feasigns_.add_slot_feasigns(float_feas, 4);
+    obj.ins_id_ = "ins_" + std::to_string(rng());
+    obj.search_id = rng();
+    obj.rank = i % 7;
+    obj.cmatch = 222;
+    (*recs)[i] = &obj;
+  }
+}
+
+template <class T>
+static void CheckSameSlotValues(const SlotValues<T>& a,
+                                const SlotValues<T>& b) {
+  EXPECT_EQ(a.slot_values, b.slot_values);
+  EXPECT_EQ(a.slot_offsets, b.slot_offsets);
+}
+
+TEST(SlotPaddleBoxDataFeed, SlotRecordArchive) {
+  const int ins_num = 300;
+  std::vector<SlotRecordObject> objs;
+  std::vector<SlotRecord> recs;
+  MakeArchiveRecords(16, ins_num, &objs, &recs);
+  // one record without any slot
+  objs[0].clear(true);
+  objs[0].ins_id_.clear();
+  // the encodings are mixed in one archive like the messages of senders of
+  // different encodings
+  BinaryArchive ar;
+  for (int i = 0; i < ins_num; ++i) {
+    WriteSlotRecord(ar, recs[i], i % 3);
+  }
+  std::vector<SlotRecordObject> outs(ins_num);
+  for (int i = 0; i < ins_num; ++i) {
+    SlotRecord out = &outs[i];
+    ASSERT_LT(ar.Cursor(), ar.Finish());
+    ar >> out;
+    CheckSameSlotValues(out->slot_uint64_feasigns_,
+                        recs[i]->slot_uint64_feasigns_);
+    CheckSameSlotValues(out->slot_float_feasigns_,
+                        recs[i]->slot_float_feasigns_);
+    EXPECT_EQ(out->ins_id_, recs[i]->ins_id_);
+    EXPECT_EQ(out->search_id, recs[i]->search_id);
+    EXPECT_EQ(out->rank, recs[i]->rank);
+    EXPECT_EQ(out->cmatch, recs[i]->cmatch);
+  }
+  EXPECT_EQ(ar.Cursor(), ar.Finish());
+}
+
+// bytes per record and encode / decode cost of every encoding
+TEST(SlotPaddleBoxDataFeed, SlotRecordArchiveBenchmark) {
+  const int ins_num = 20000;
+  std::vector<SlotRecordObject> objs;
+  std::vector<SlotRecord> recs;
+  MakeArchiveRecords(100, ins_num, &objs, &recs);
+  std::vector<SlotRecordObject> outs(ins_num);
+  for (int encoding : {kSlotRecordLegacy,
+                       kSlotRecordCompact,
+                       kSlotRecordCompactHalf}) {
+    BinaryArchive ar;
+    platform::Timer encode_timer;
+    encode_timer.Start();
+    for (auto& rec : recs) {
+      WriteSlotRecord(ar, rec, encoding);
+    }
+    encode_timer.Pause();
+    size_t bytes = ar.Length();
+    platform::Timer decode_timer;
+    decode_timer.Start();
+    for (auto& obj : outs) {
+      SlotRecord out = &obj;
+      ar >> out;
+    }
+    decode_timer.Pause();
+    EXPECT_EQ(ar.Cursor(), ar.Finish());
+    LOG(INFO) << "encoding: " << encoding
+              << ", bytes per record: " << bytes / ins_num
+              << ", encode: " << encode_timer.ElapsedUS() / ins_num
+              << "us, decode: " << decode_timer.ElapsedUS() / ins_num
+              << "us per record";
+  }
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,569 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <queue>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+#include "paddle/fluid/framework/archive.h"
+#include "paddle/fluid/platform/enforce.h"
+
+namespace paddle {
+namespace framework {
+
+// SortedRunMerger groups the records of the same key produced by many
+// threads with bounded memory. Every thread adds its records as one run
+// sorted by a 64-bit hash of the key, ties broken by the key itself. Every
+// run is cut into the same partitions of the hash space, so the partitions
+// are merged by their own threads. A run is spilled to a local file in the
+// binary archive format when the runs kept in memory would exceed the
+// memory budget. The runs are merged at most MaxMergeRuns() at a time, more
+// runs are first merged in groups into larger spilled runs, so the files
+// open and the read buffers of the partition threads stay bounded.
+template <class T>
+class SortedRunMerger {
+ public:
+  struct Funcs {
+    std::function<uint64_t(const T&)> hash;
+    // orders the records of the same hash, records neither less than the
+    // other have the same key
+    std::function<bool(const T&, const T&)> less;
+    // approximate memory bytes of a record
+    std::function<size_t(const T&)> bytes;
+    std::function<void(BinaryArchive&, const T&)> write;
+    std::function<void(BinaryArchive&, T*)> read;
+  };
+
+  // memory_budget < 0 keeps every run in memory, 0 spills every run
+  SortedRunMerger(const Funcs& funcs,
+                  int partition_num,
+                  int64_t memory_budget,
+                  const std::string& spill_dir)
+      : funcs_(funcs),
+        partition_num_(partition_num),
+        memory_budget_(memory_budget),
+        spill_dir_(spill_dir) {
+    PADDLE_ENFORCE_GT(partition_num,
+                      0,
+                      platform::errors::InvalidArgument(
+                          "The partition num of SortedRunMerger should be "
+                          "greater than 0, but got %d.",
+                          partition_num));
+    set_max_merge_runs(kMaxOpenRuns / partition_num);
+  }
+  ~SortedRunMerger() { Clear(); }
+
+  // sorts the records and keeps or spills them as one run, thread safe
+  void AddRun(std::vector<T>* records);
+
+  // adds the records one of thread_num threads reads in blocks, read returns
+  // 0 at the end. The records are cut into a run every budget / thread_num
+  // bytes while they are read, so the records of all the threads waiting for
+  // their sort stay within the memory budget, thread safe
+  void AddRuns(const std::function<size_t(std::vector<T>*)>& read,
+               int thread_num);
+
+  // merges every partition in its own thread, func is called with the
+  // partition and the records of one key in the order the runs are added.
+  // Runs beyond MaxMergeRuns() are merged in groups first, so at most
+  // partition num times MaxMergeRuns() spill files are open at once
+  void Merge(const std::function<void(int, std::vector<T>*)>& func);
+
+  // removes the runs and the spill files
+  void Clear();
+
+  size_t RunNum() const { return runs_.size(); }
+  size_t SpilledRunNum() const { return spilled_run_num_; }
+  size_t SpilledBytes() const { return spilled_bytes_; }
+  size_t MaxMergeRuns() const { return max_merge_runs_; }
+
+  // the spill chunk, read whole by the cursors, is sized so the cursors of
+  // all the partitions merged at once stay within the memory budget
+  void set_max_merge_runs(size_t num) {
+    max_merge_runs_ = std::max(num, static_cast<size_t>(2));
+    chunk_bytes_ = kMaxChunkBytes;
+    if (memory_budget_ >= 0) {
+      chunk_bytes_ = static_cast<size_t>(memory_budget_) /
+                     (partition_num_ * max_merge_runs_);
+      chunk_bytes_ =
+          std::min(std::max(chunk_bytes_, kMinChunkBytes), kMaxChunkBytes);
+    }
+  }
+
+ private:
+  static constexpr size_t kMaxOpenRuns = 4096;
+  static constexpr size_t kMinChunkBytes = 4 << 10;
+  static constexpr size_t kMaxChunkBytes = 1 << 20;
+
+  struct Run {
+    // records of partition p are [offsets[p], offsets[p + 1]) of records
+    // in memory, or the bytes [offsets[p], offsets[p + 1]) of the spill file
+    std::vector<T> records;
+    std::vector<uint64_t> hashes;
+    std::vector<size_t> offsets;
+    std::string path;
+  };
+
+  // reads the records of one partition of one run in order
+  class Cursor {
+   public:
+    Cursor(const Funcs* funcs, Run* run, int partition, int run_index)
+        : funcs_(funcs), run_(run), run_index_(run_index) {
+      begin_ = run->offsets[partition];
+      end_ = run->offsets[partition + 1];
+      if (!run->path.empty() && begin_ < end_) {
+        fp_ = fopen(run->path.c_str(), "rb");
+        PADDLE_ENFORCE_NOT_NULL(
+            fp_,
+            platform::errors::Unavailable("Failed to open spill file %s.",
+                                          run->path));
+        PADDLE_ENFORCE_EQ(fseek(fp_, begin_, SEEK_SET),
+                          0,
+                          platform::errors::Unavailable(
+                              "Failed to seek spill file %s.", run->path));
+      }
+      Next();
+    }
+    ~Cursor() {
+      if (fp_ != nullptr) {
+        fclose(fp_);
+      }
+    }
+
+    bool Valid() const { return valid_; }
+    uint64_t Hash() const { return hash_; }
+    T& Value() { return value_; }
+    int RunIndex() const { return run_index_; }
+
+    void Next() {
+      if (run_->path.empty()) {
+        valid_ = begin_ < end_;
+        if (valid_) {
+          hash_ = run_->hashes[begin_];
+          value_ = std::move(run_->records[begin_]);
+          ++begin_;
+        }
+        return;
+      }
+      if (ar_.Cursor() == ar_.Finish()) {
+        if (begin_ >= end_) {
+          valid_ = false;
+          return;
+        }
+        uint64_t len = 0;
+        PADDLE_ENFORCE_EQ(fread(&len, sizeof(len), 1, fp_),
+                          1UL,
+                          platform::errors::Unavailable(
+                              "Failed to read spill file %s.", run_->path));
+        ar_.Clear();
+        ar_.Resize(len);
+        PADDLE_ENFORCE_EQ(fread(ar_.Buffer(), 1, len, fp_),
+                          len,
+                          platform::errors::Unavailable(
+                              "Failed to read spill file %s.", run_->path));
+        begin_ += sizeof(len) + len;
+      }
+      ar_ >> hash_;
+      funcs_->read(ar_, &value_);
+      valid_ = true;
+    }
+
+   private:
+    const Funcs* funcs_;
+    Run* run_;
+    int run_index_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+    FILE* fp_ = nullptr;
+    BinaryArchive ar_;
+    bool valid_ = false;
+    uint64_t hash_ = 0;
+    T value_;
+  };
+
+  int Partition(uint64_t hash) const {
+    return static_cast<int>(
+        hash / (std::numeric_limits<uint64_t>::max() / partition_num_ + 1));
+  }
+  bool Less(uint64_t ha, const T& a, uint64_t hb, const T& b) const {
+    if (ha != hb) {
+      return ha < hb;
+    }
+    return funcs_.less(a, b);
+  }
+
+  // writes the records of a run partition by partition in chunks
+  class RunWriter {
+   public:
+    RunWriter(const Funcs* funcs, const std::string& path, size_t chunk_bytes)
+        : funcs_(funcs), path_(path), chunk_bytes_(chunk_bytes) {
+      fp_ = fopen(path.c_str(), "wb");
+      PADDLE_ENFORCE_NOT_NULL(
+          fp_,
+          platform::errors::Unavailable("Failed to create spill file %s.",
+                                        path));
+    }
+    ~RunWriter() {
+      if (fp_ != nullptr) {
+        fclose(fp_);
+      }
+    }
+
+    // call before the records of every partition are written
+    void BeginPartition() {
+      Flush();
+      offsets_.push_back(file_bytes_);
+    }
+    void Write(uint64_t hash, const T& record) {
+      ar_ << hash;
+      funcs_->write(ar_, record);
+      if (ar_.Length() >= chunk_bytes_) {
+        Flush();
+      }
+    }
+    // the file offsets of the partitions, the last one is the file bytes
+    std::vector<size_t> Close() {
+      Flush();
+      offsets_.push_back(file_bytes_);
+      fclose(fp_);
+      fp_ = nullptr;
+      return std::move(offsets_);
+    }
+
+   private:
+    // a chunk never crosses the partitions
+    void Flush() {
+      if (ar_.Length() == 0) {
+        return;
+      }
+      uint64_t len = ar_.Length();
+      PADDLE_ENFORCE_EQ(
+          fwrite(&len, sizeof(len), 1, fp_) == 1 &&
+              fwrite(ar_.Buffer(), 1, len, fp_) == len,
+          true,
+          platform::errors::Unavailable("Failed to write spill file %s.",
+                                        path_));
+      file_bytes_ += sizeof(len) + len;
+      ar_.Clear();
+    }
+
+    const Funcs* funcs_;
+    std::string path_;
+    size_t chunk_bytes_;
+    FILE* fp_ = nullptr;
+    BinaryArchive ar_;
+    size_t file_bytes_ = 0;
+    std::vector<size_t> offsets_;
+  };
+
+  std::string NewSpillPath();
+  void Spill(Run* run, std::vector<T>* records);
+  // calls func with the records of partition p of the runs in order, the
+  // records of the same key in the order of the runs
+  void MergeRuns(const std::vector<Run*>& runs,
+                 int p,
+                 const std::function<void(uint64_t, T*)>& func);
+  // merges the runs into one spilled run
+  std::unique_ptr<Run> MergeToSpill(const std::vector<Run*>& runs);
+  // merges groups of adjacent runs until at most max_merge_runs_ spilled
+  // runs are left
+  void ReduceRuns();
+
+  Funcs funcs_;
+  int partition_num_;
+  int64_t memory_budget_;
+  std::string spill_dir_;
+  size_t max_merge_runs_ = 2;
+  size_t chunk_bytes_ = kMaxChunkBytes;
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Run>> runs_;
+  int64_t kept_bytes_ = 0;
+  size_t spill_id_ = 0;
+  std::atomic<size_t> spilled_run_num_{0};
+  std::atomic<size_t> spilled_bytes_{0};
+};
+
+template <class T>
+void SortedRunMerger<T>::AddRun(std::vector<T>* records) {
+  std::unique_ptr<Run> run(new Run());
+  size_t num = records->size();
+  std::vector<std::pair<uint64_t, size_t>> order(num);
+  int64_t run_bytes = 0;
+  for (size_t i = 0; i < num; ++i) {
+    order[i].first = funcs_.hash((*records)[i]);
+    order[i].second = i;
+    run_bytes += funcs_.bytes((*records)[i]);
+  }
+  std::sort(order.begin(),
+            order.end(),
+            [this, records](const std::pair<uint64_t, size_t>& a,
+                            const std::pair<uint64_t, size_t>& b) {
+              return Less(a.first,
+                          (*records)[a.second],
+                          b.first,
+                          (*records)[b.second]);
+            });
+  run->offsets.assign(partition_num_ + 1, 0);
+  for (auto& item : order) {
+    ++run->offsets[Partition(item.first) + 1];
+  }
+  for (int p = 0; p < partition_num_; ++p) {
+    run->offsets[p + 1] += run->offsets[p];
+  }
+  run->hashes.resize(num);
+  std::vector<T> sorted(num);
+  for (size_t i = 0; i < num; ++i) {
+    run->hashes[i] = order[i].first;
+    sorted[i] = std::move((*records)[order[i].second]);
+  }
+  std::vector<T>().swap(*records);
+  std::vector<std::pair<uint64_t, size_t>>().swap(order);
+
+  bool spill = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (memory_budget_ >= 0 && kept_bytes_ + run_bytes > memory_budget_) {
+      spill = true;
+    } else {
+      kept_bytes_ += run_bytes;
+    }
+  }
+  if (spill) {
+    run->path = NewSpillPath();
+    Spill(run.get(), &sorted);
+  } else {
+    run->records = std::move(sorted);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  runs_.push_back(std::move(run));
+}
+
+template <class T>
+void SortedRunMerger<T>::AddRuns(
+    const std::function<size_t(std::vector<T>*)>& read, int thread_num) {
+  const int64_t run_bytes =
+      memory_budget_ < 0 ? -1 : memory_budget_ / std::max(thread_num, 1);
+  std::vector<T> records;
+  std::vector<T> block;
+  int64_t bytes = 0;
+  while (read(&block) > 0) {
+    for (auto& rec : block) {
+      bytes += funcs_.bytes(rec);
+      records.push_back(std::move(rec));
+    }
+    block.clear();
+    if (run_bytes >= 0 && bytes >= run_bytes) {
+      AddRun(&records);
+      bytes = 0;
+    }
+  }
+  if (!records.empty()) {
+    AddRun(&records);
+  }
+}
+
+template <class T>
+std::string SortedRunMerger<T>::NewSpillPath() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return spill_dir_ + "/sorted_run_" + std::to_string(getpid()) + "_" +
+         std::to_string(reinterpret_cast<uintptr_t>(this)) + "_" +
+         std::to_string(spill_id_++);
+}
+
+template <class T>
+void SortedRunMerger<T>::Spill(Run* run, std::vector<T>* records) {
+  RunWriter writer(&funcs_, run->path, chunk_bytes_);
+  for (int p = 0; p < partition_num_; ++p) {
+    writer.BeginPartition();
+    for (size_t i = run->offsets[p]; i < run->offsets[p + 1]; ++i) {
+      writer.Write(run->hashes[i], (*records)[i]);
+      // the records are freed while they are spilled
+      (*records)[i] = T();
+    }
+  }
+  std::vector<size_t> file_offsets = writer.Close();
+  std::vector<T>().swap(*records);
+  std::vector<uint64_t>().swap(run->hashes);
+  run->offsets.swap(file_offsets);
+  ++spilled_run_num_;
+  spilled_bytes_ += run->offsets[partition_num_];
+  VLOG(3) << "spill sorted run " << run->path << ", "
+          << run->offsets[partition_num_] << " bytes";
+}
+
+template <class T>
+void SortedRunMerger<T>::MergeRuns(
+    const std::vector<Run*>& runs,
+    int p,
+    const std::function<void(uint64_t, T*)>& func) {
+  std::vector<std::unique_ptr<Cursor>> cursors;
+  for (size_t r = 0; r < runs.size(); ++r) {
+    cursors.emplace_back(new Cursor(&funcs_, runs[r], p, r));
+  }
+  // the run index keeps the records of one key in the order of the runs
+  auto greater = [this](Cursor* a, Cursor* b) {
+    if (Less(a->Hash(), a->Value(), b->Hash(), b->Value())) {
+      return false;
+    }
+    if (Less(b->Hash(), b->Value(), a->Hash(), a->Value())) {
+      return true;
+    }
+    return a->RunIndex() > b->RunIndex();
+  };
+  std::priority_queue<Cursor*, std::vector<Cursor*>, decltype(greater)> heap(
+      greater);
+  for (auto& cursor : cursors) {
+    if (cursor->Valid()) {
+      heap.push(cursor.get());
+    }
+  }
+  while (!heap.empty()) {
+    Cursor* top = heap.top();
+    heap.pop();
+    func(top->Hash(), &top->Value());
+    top->Next();
+    if (top->Valid()) {
+      heap.push(top);
+    }
+  }
+}
+
+template <class T>
+std::unique_ptr<typename SortedRunMerger<T>::Run>
+SortedRunMerger<T>::MergeToSpill(const std::vector<Run*>& runs) {
+  std::unique_ptr<Run> run(new Run());
+  run->path = NewSpillPath();
+  RunWriter writer(&funcs_, run->path, chunk_bytes_);
+  for (int p = 0; p < partition_num_; ++p) {
+    writer.BeginPartition();
+    MergeRuns(runs, p, [&writer](uint64_t hash, T* value) {
+      writer.Write(hash, *value);
+    });
+  }
+  run->offsets = writer.Close();
+  return run;
+}
+
+template <class T>
+void SortedRunMerger<T>::ReduceRuns() {
+  // only the spilled runs hold files and read buffers
+  auto spilled_num = [this]() {
+    return std::count_if(
+        runs_.begin(), runs_.end(), [](const std::unique_ptr<Run>& run) {
+          return !run->path.empty();
+        });
+  };
+  while (static_cast<size_t>(spilled_num()) > max_merge_runs_) {
+    size_t group_num =
+        (runs_.size() + max_merge_runs_ - 1) / max_merge_runs_;
+    std::vector<std::unique_ptr<Run>> merged(group_num);
+    // a group merge reads max_merge_runs_ runs, at most partition_num_
+    // groups are merged at once like the partitions of the final merge
+    std::atomic<size_t> next_group{0};
+    auto merge_groups = [this, &merged, &next_group, group_num]() {
+      for (size_t g = next_group++; g < group_num; g = next_group++) {
+        size_t begin = g * max_merge_runs_;
+        size_t end = std::min(begin + max_merge_runs_, runs_.size());
+        if (end - begin == 1) {
+          merged[g] = std::move(runs_[begin]);
+          continue;
+        }
+        std::vector<Run*> group;
+        for (size_t r = begin; r < end; ++r) {
+          group.push_back(runs_[r].get());
+        }
+        merged[g] = MergeToSpill(group);
+        for (size_t r = begin; r < end; ++r) {
+          if (!runs_[r]->path.empty()) {
+            unlink(runs_[r]->path.c_str());
+          }
+          runs_[r].reset();
+        }
+      }
+    };
+    std::vector<std::thread> threads;
+    size_t thread_num =
+        std::min(group_num, static_cast<size_t>(partition_num_));
+    for (size_t t = 0; t < thread_num; ++t) {
+      threads.emplace_back(merge_groups);
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    VLOG(3) << "merge " << runs_.size() << " sorted runs into " << group_num;
+    runs_.swap(merged);
+  }
+}
+
+template <class T>
+void SortedRunMerger<T>::Merge(
+    const std::function<void(int, std::vector<T>*)>& func) {
+  ReduceRuns();
+  std::vector<Run*> runs;
+  for (auto& run : runs_) {
+    runs.push_back(run.get());
+  }
+  auto merge_partition = [this, &runs, &func](int p) {
+    std::vector<T> group;
+    uint64_t group_hash = 0;
+    MergeRuns(runs, p, [&](uint64_t hash, T* value) {
+      if (!group.empty() &&
+          (hash != group_hash || funcs_.less(group[0], *value))) {
+        func(p, &group);
+        group.clear();
+      }
+      group_hash = hash;
+      group.push_back(std::move(*value));
+    });
+    if (!group.empty()) {
+      func(p, &group);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int p = 0; p < partition_num_; ++p) {
+    threads.emplace_back(merge_partition, p);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  Clear();
+}
+
+template <class T>
+void SortedRunMerger<T>::Clear() {
+  for (auto& run : runs_) {
+    if (!run->path.empty()) {
+      unlink(run->path.c_str());
+    }
+  }
+  runs_.clear();
+  kept_bytes_ = 0;
+}
+
+}  // namespace framework
+}  // namespace paddle
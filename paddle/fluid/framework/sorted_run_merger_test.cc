@@ -0,0 +1,251 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/sorted_run_merger.h"
+
+#include <chrono>  // NOLINT
+#include <fstream>
+#include <map>
+#include <random>
+
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace framework {
+
+struct TestRecord {
+  std::string id;
+  std::vector<uint64_t> values;
+};
+
+static SortedRunMerger<TestRecord>::Funcs TestFuncs(bool collide) {
+  SortedRunMerger<TestRecord>::Funcs funcs;
+  // colliding hashes leave the order to the tiebreak
+  funcs.hash = [collide](const TestRecord& r) {
+    return collide ? std::hash<std::string>()(r.id) % 7
+                   : std::hash<std::string>()(r.id);
+  };
+  funcs.less = [](const TestRecord& a, const TestRecord& b) {
+    return a.id < b.id;
+  };
+  funcs.bytes = [](const TestRecord& r) {
+    return sizeof(r) + r.id.size() + r.values.size() * sizeof(uint64_t);
+  };
+  funcs.write = [](BinaryArchive& ar, const TestRecord& r) {
+    ar << r.id;
+    ar << r.values;
+  };
+  funcs.read = [](BinaryArchive& ar, TestRecord* r) {
+    ar >> r->id;
+    ar >> r->values;
+  };
+  return funcs;
+}
+
+// the value of a record is thread * record_num + i, thread t writes every id
+// of id_num once in a random order plus some ids of its own, as one run or
+// in blocks cut into runs by the merger
+static void AddRuns(SortedRunMerger<TestRecord>* merger,
+                    int thread_num,
+                    size_t id_num,
+                    bool read_blocks) {
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_num; ++t) {
+    threads.emplace_back([=]() {
+      std::vector<TestRecord> records;
+      for (size_t i = 0; i < id_num; ++i) {
+        TestRecord rec;
+        rec.id = "ins_" + std::to_string(i);
+        rec.values = {static_cast<uint64_t>(t), i};
+        records.push_back(std::move(rec));
+      }
+      for (size_t i = 0; i < 10; ++i) {
+        TestRecord rec;
+        rec.id = "own_" + std::to_string(t) + "_" + std::to_string(i);
+        rec.values = {static_cast<uint64_t>(t)};
+        records.push_back(std::move(rec));
+      }
+      std::shuffle(records.begin(), records.end(), std::mt19937_64(t));
+      if (!read_blocks) {
+        merger->AddRun(&records);
+        EXPECT_TRUE(records.empty());
+        return;
+      }
+      size_t pos = 0;
+      merger->AddRuns(
+          [&](std::vector<TestRecord>* block) {
+            size_t end = std::min(pos + 128, records.size());
+            for (; pos < end; ++pos) {
+              block->push_back(std::move(records[pos]));
+            }
+            return block->size();
+          },
+          thread_num);
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+static void CheckMerge(bool collide,
+                       int64_t budget,
+                       bool read_blocks = false,
+                       size_t max_merge_runs = 0) {
+  const int thread_num = 4;
+  const size_t id_num = 5000;
+  SortedRunMerger<TestRecord> merger(TestFuncs(collide), 3, budget, "/tmp");
+  if (max_merge_runs > 0) {
+    merger.set_max_merge_runs(max_merge_runs);
+  }
+  AddRuns(&merger, thread_num, id_num, read_blocks);
+  if (max_merge_runs > 0) {
+    // the runs are merged in groups before the partitions
+    EXPECT_GT(merger.SpilledRunNum(), merger.MaxMergeRuns());
+  }
+  if (read_blocks) {
+    // the runs are cut while they are read
+    EXPECT_GT(merger.RunNum(), static_cast<size_t>(thread_num));
+  } else {
+    EXPECT_EQ(merger.RunNum(), static_cast<size_t>(thread_num));
+  }
+  if (budget == 0) {
+    EXPECT_EQ(merger.SpilledRunNum(), merger.RunNum());
+  } else if (budget < 0) {
+    EXPECT_EQ(merger.SpilledRunNum(), 0UL);
+  }
+
+  std::mutex mutex;
+  std::map<std::string, std::vector<uint64_t>> groups;
+  merger.Merge([&](int partition, std::vector<TestRecord>* group) {
+    ASSERT_FALSE(group->empty());
+    std::vector<uint64_t> threads;
+    for (auto& rec : *group) {
+      ASSERT_EQ(rec.id, (*group)[0].id);
+      threads.push_back(rec.values[0]);
+      if (rec.id.find("ins_") == 0) {
+        ASSERT_EQ(rec.values[1], std::stoul(rec.id.substr(4)));
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(groups.count((*group)[0].id), 0UL) << (*group)[0].id;
+    groups[(*group)[0].id] = threads;
+  });
+  EXPECT_EQ(merger.RunNum(), 0UL);
+  ASSERT_EQ(groups.size(), id_num + thread_num * 10);
+  for (auto& group : groups) {
+    if (group.first.find("ins_") == 0) {
+      EXPECT_EQ(group.second.size(), static_cast<size_t>(thread_num));
+      std::sort(group.second.begin(), group.second.end());
+      for (int t = 0; t < thread_num; ++t) {
+        EXPECT_EQ(group.second[t], static_cast<uint64_t>(t));
+      }
+    } else {
+      EXPECT_EQ(group.second.size(), 1UL);
+    }
+  }
+}
+
+TEST(SortedRunMerger, InMemory) {
+  CheckMerge(false, -1);
+  CheckMerge(true, -1);
+}
+
+TEST(SortedRunMerger, Spill) {
+  CheckMerge(false, 0);
+  CheckMerge(true, 0);
+  // some of the runs are spilled
+  CheckMerge(false, 400000);
+}
+
+TEST(SortedRunMerger, CutRunsWhileReading) {
+  CheckMerge(false, 0, true);
+  CheckMerge(true, 400000, true);
+  // one run per thread without a budget
+  const int thread_num = 4;
+  SortedRunMerger<TestRecord> merger(TestFuncs(false), 3, -1, "/tmp");
+  AddRuns(&merger, thread_num, 1000, true);
+  EXPECT_EQ(merger.RunNum(), static_cast<size_t>(thread_num));
+}
+
+TEST(SortedRunMerger, BoundedFanIn) {
+  SortedRunMerger<TestRecord> merger(TestFuncs(false), 32, 4L << 30, "/tmp");
+  EXPECT_EQ(merger.MaxMergeRuns(), 128UL);
+  // one pass of group merges
+  CheckMerge(false, 0, true, 16);
+  // several passes, the groups mix spilled and kept runs
+  CheckMerge(true, 0, true, 2);
+  CheckMerge(false, 400000, true, 3);
+}
+
+static size_t PeakRssKB() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.find("VmHWM:") == 0) {
+      return std::stoul(line.substr(6));
+    }
+  }
+  return 0;
+}
+
+TEST(SortedRunMerger, Benchmark) {
+  const int thread_num = 8;
+  const size_t record_num = 250000;
+  for (int64_t budget : {0, -1}) {
+    SortedRunMerger<TestRecord> merger(
+        TestFuncs(false), thread_num, budget, "/tmp");
+    auto start = std::chrono::steady_clock::now();
+    // every id is written by two threads
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_num; ++t) {
+      threads.emplace_back([&, t]() {
+        std::vector<TestRecord> records(record_num);
+        for (size_t i = 0; i < record_num; ++i) {
+          records[i].id = std::to_string(t / 2) + "_" + std::to_string(i);
+          records[i].values.assign(16, i);
+        }
+        merger.AddRun(&records);
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    // the merged records are kept like the dataset keeps them
+    std::vector<std::vector<TestRecord>> merged(thread_num);
+    merger.Merge([&](int partition, std::vector<TestRecord>* group) {
+      TestRecord rec = std::move((*group)[0]);
+      for (size_t i = 1; i < group->size(); ++i) {
+        rec.values.insert(rec.values.end(),
+                          (*group)[i].values.begin(),
+                          (*group)[i].values.end());
+      }
+      merged[partition].push_back(std::move(rec));
+    });
+    size_t group_num = 0;
+    for (auto& records : merged) {
+      group_num += records.size();
+    }
+    EXPECT_EQ(group_num, thread_num / 2 * record_num);
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    LOG(INFO) << "memory budget " << budget << ", "
+              << thread_num * record_num << " records merged in " << seconds
+              << "s, peak rss " << PeakRssKB() << "KB";
+  }
+}
+
+}  // namespace framework
+}  // namespace paddle
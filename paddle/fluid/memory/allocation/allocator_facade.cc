@@ -19,6 +19,7 @@
 #include "paddle/fluid/memory/allocation/allocator.h"
 #include "paddle/fluid/memory/allocation/allocator_strategy.h"
 #include "paddle/fluid/memory/allocation/auto_growth_best_fit_allocator.h"
+#include "paddle/fluid/memory/allocation/batch_arena_allocator.h"
 #include "paddle/fluid/memory/allocation/cpu_allocator.h"
 #include "paddle/fluid/memory/allocation/naive_best_fit_allocator.h"
 #include "paddle/fluid/memory/allocation/retry_allocator.h"
@@ -338,6 +339,7 @@ class AllocatorFacadePrivate {
     }
     InitZeroSizeAllocators();
     InitSystemAllocators();
+    WrapBatchArenaAllocator();
 
     if (strategy_ != AllocatorStrategy::kSamplePool &&
 		FLAGS_gpu_allocator_retry_time > 0) {
@@ -979,6 +981,14 @@ class AllocatorFacadePrivate {
     }
   }
 
+  // the worker threads may install a per batch arena for the cpu temporaries
+  void WrapBatchArenaAllocator() {
+    auto iter = allocators_.find(platform::CPUPlace());
+    if (iter != allocators_.end()) {
+      iter->second = std::make_shared<BatchArenaAllocator>(iter->second);
+    }
+  }
+
   void WrapStatAllocator() {
     for (auto& pair : allocators_) {
       // Now memory stats is only supported for CPU and GPU
@@ -0,0 +1,140 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/memory/allocation/batch_arena_allocator.h"
+
+#include <algorithm>
+
+#include "paddle/fluid/platform/enforce.h"
+
+namespace paddle {
+namespace memory {
+namespace allocation {
+
+static constexpr size_t kBatchArenaAlignment = 64;
+
+static thread_local BatchArena* tls_batch_arena = nullptr;
+
+BatchArena::BatchArena(std::shared_ptr<Allocator> underlying,
+                       const platform::Place& place,
+                       size_t chunk_size,
+                       size_t max_alloc_size)
+    : underlying_(std::move(underlying)),
+      place_(place),
+      chunk_size_(chunk_size),
+      max_alloc_size_(std::min(max_alloc_size, chunk_size)) {
+  PADDLE_ENFORCE_GT(chunk_size_,
+                    kBatchArenaAlignment,
+                    platform::errors::InvalidArgument(
+                        "batch arena chunk size %d is too small", chunk_size_));
+}
+
+BatchArena* BatchArena::Current() { return tls_batch_arena; }
+
+void BatchArena::NextChunk() {
+  if (!free_.empty() && cur_ + 1 < free_.size()) {
+    ++cur_;
+    return;
+  }
+  // the chunk itself must not come from the arena
+  BatchArena* current = tls_batch_arena;
+  tls_batch_arena = nullptr;
+  std::unique_ptr<Chunk> chunk(new Chunk());
+  chunk->mem = underlying_->Allocate(chunk_size_);
+  chunk->offset = AlignedPtrOffset(chunk->mem->ptr(), kBatchArenaAlignment);
+  tls_batch_arena = current;
+  ++stat_.chunk_allocs;
+  free_.push_back(std::move(chunk));
+  cur_ = free_.size() - 1;
+}
+
+BatchArenaAllocation* BatchArena::AllocateImpl(size_t size) {
+  size_t aligned = AlignedSize(size, kBatchArenaAlignment);
+  if (free_.empty() || free_[cur_]->offset + aligned > chunk_size_) {
+    NextChunk();
+  }
+  auto& chunk = free_[cur_];
+  void* ptr = static_cast<char*>(chunk->mem->ptr()) + chunk->offset;
+  chunk->offset += aligned;
+  chunk->live.fetch_add(1, std::memory_order_relaxed);
+  ++stat_.arena_allocs;
+  stat_.arena_bytes += aligned;
+  return new BatchArenaAllocation(
+      ptr, size, place_, shared_from_this(), &chunk->live);
+}
+
+void BatchArena::FreeImpl(BatchArenaAllocation* allocation) {
+  // the memory is reclaimed by Reset
+  allocation->live()->fetch_sub(1, std::memory_order_release);
+  delete allocation;
+}
+
+BatchArena::Stat BatchArena::Reset() {
+  // chunks used by this batch, the others are released
+  size_t used = free_.empty() ? 0 : cur_ + 1;
+  std::vector<std::unique_ptr<Chunk>> chunks;
+  chunks.reserve(free_.size() + pinned_.size());
+  for (size_t i = 0; i < used; ++i) {
+    chunks.push_back(std::move(free_[i]));
+  }
+  for (auto& chunk : pinned_) {
+    chunks.push_back(std::move(chunk));
+  }
+  free_.clear();
+  pinned_.clear();
+  for (auto& chunk : chunks) {
+    // no allocation can be added concurrently, only the owner thread
+    // allocates, so no live allocation now means none later
+    if (chunk->live.load(std::memory_order_acquire) == 0) {
+      chunk->offset = AlignedPtrOffset(chunk->mem->ptr(), kBatchArenaAlignment);
+      free_.push_back(std::move(chunk));
+    } else {
+      pinned_.push_back(std::move(chunk));
+    }
+  }
+  cur_ = 0;
+  Stat stat = stat_;
+  stat_ = Stat();
+  return stat;
+}
+
+BatchArenaGuard::BatchArenaGuard(BatchArena* arena) : prev_(tls_batch_arena) {
+  tls_batch_arena = arena;
+}
+
+BatchArenaGuard::~BatchArenaGuard() { tls_batch_arena = prev_; }
+
+phi::Allocation* BatchArenaAllocator::AllocateImpl(size_t size) {
+  BatchArena* arena = tls_batch_arena;
+  if (arena != nullptr) {
+    if (arena->Fit(size)) {
+      return arena->AllocateImpl(size);
+    }
+    arena->AddFallback();
+  }
+  return underlying_allocator_->Allocate(size).release();
+}
+
+void BatchArenaAllocator::FreeImpl(phi::Allocation* allocation) {
+  auto* arena_allocation = dynamic_cast<BatchArenaAllocation*>(allocation);
+  if (arena_allocation != nullptr) {
+    arena_allocation->arena()->FreeImpl(arena_allocation);
+  } else {
+    underlying_allocator_->Free(allocation);
+  }
+}
+
+}  // namespace allocation
+}  // namespace memory
+}  // namespace paddle
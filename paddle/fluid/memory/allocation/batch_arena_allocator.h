@@ -0,0 +1,149 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "paddle/fluid/memory/allocation/allocator.h"
+
+namespace paddle {
+namespace memory {
+namespace allocation {
+
+class BatchArena;
+
+class BatchArenaAllocation : public Allocation {
+ public:
+  BatchArenaAllocation(void* ptr,
+                       size_t size,
+                       const platform::Place& place,
+                       std::shared_ptr<BatchArena> arena,
+                       std::atomic<int64_t>* live)
+      : Allocation(ptr, size, place), arena_(std::move(arena)), live_(live) {}
+
+  BatchArena* arena() const { return arena_.get(); }
+  std::atomic<int64_t>* live() const { return live_; }
+
+ private:
+  // keeps the chunks alive while the allocation is alive
+  std::shared_ptr<BatchArena> arena_;
+  std::atomic<int64_t>* live_;
+};
+
+// BatchArena serves the temporaries of the batches of one worker thread by
+// bumping a pointer in large chunks of the underlying allocator. A chunk
+// counts its live allocations and is rewound at the end of the batch when
+// none is left, so tensors that outlive the batch only pin their own chunks.
+// Requests larger than max_alloc_size go to the underlying allocator.
+//
+// Only the thread that installed the arena allocates from it, the
+// allocations may be freed by any thread.
+class BatchArena : public std::enable_shared_from_this<BatchArena> {
+ public:
+  struct Stat {
+    // allocations served by the arena and by the underlying allocator
+    int64_t arena_allocs = 0;
+    int64_t fallback_allocs = 0;
+    int64_t arena_bytes = 0;
+    // chunks requested from the underlying allocator
+    int64_t chunk_allocs = 0;
+  };
+
+  BatchArena(std::shared_ptr<Allocator> underlying,
+             const platform::Place& place,
+             size_t chunk_size,
+             size_t max_alloc_size);
+
+  // the arena of the calling thread, nullptr outside of a batch
+  static BatchArena* Current();
+
+  bool Fit(size_t size) const { return size <= max_alloc_size_; }
+
+  BatchArenaAllocation* AllocateImpl(size_t size);
+  void FreeImpl(BatchArenaAllocation* allocation);
+
+  // count an allocation that did not fit
+  void AddFallback() { ++stat_.fallback_allocs; }
+
+  // rewind the chunks without live allocations, release the chunks not used
+  // by the last batch and return the stat of the batch
+  Stat Reset();
+
+  size_t chunk_num() const { return free_.size() + pinned_.size(); }
+
+ private:
+  struct Chunk {
+    AllocationPtr mem;
+    size_t offset = 0;
+    std::atomic<int64_t> live{0};
+  };
+
+  void NextChunk();
+
+  std::shared_ptr<Allocator> underlying_;
+  platform::Place place_;
+  size_t chunk_size_;
+  size_t max_alloc_size_;
+
+  // free_[0, cur_] are used by the batch, free_[cur_] is the current chunk
+  std::vector<std::unique_ptr<Chunk>> free_;
+  size_t cur_ = 0;
+  // chunks holding allocations of earlier batches
+  std::vector<std::unique_ptr<Chunk>> pinned_;
+  Stat stat_;
+};
+
+// BatchArenaGuard installs the arena for the calling thread during one batch,
+// the owner calls Reset once the temporaries of the batch are dropped.
+class BatchArenaGuard {
+ public:
+  explicit BatchArenaGuard(BatchArena* arena);
+  ~BatchArenaGuard();
+
+  BatchArenaGuard(const BatchArenaGuard&) = delete;
+  BatchArenaGuard& operator=(const BatchArenaGuard&) = delete;
+
+ private:
+  BatchArena* prev_;
+};
+
+// BatchArenaAllocator wraps the cpu allocator of the facade. It allocates
+// from the arena of the calling thread if there is one, otherwise from the
+// underlying allocator.
+class BatchArenaAllocator : public Allocator {
+ public:
+  explicit BatchArenaAllocator(std::shared_ptr<Allocator> underlying_allocator)
+      : underlying_allocator_(std::move(underlying_allocator)) {}
+
+  bool IsAllocThreadSafe() const override {
+    return underlying_allocator_->IsAllocThreadSafe();
+  }
+
+ protected:
+  phi::Allocation* AllocateImpl(size_t size) override;
+  void FreeImpl(phi::Allocation* allocation) override;
+  uint64_t ReleaseImpl(const platform::Place& place) override {
+    return underlying_allocator_->Release(place);
+  }
+
+ private:
+  std::shared_ptr<Allocator> underlying_allocator_;
+};
+
+}  // namespace allocation
+}  // namespace memory
+}  // namespace paddle
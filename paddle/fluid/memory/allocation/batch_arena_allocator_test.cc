@@ -0,0 +1,172 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/memory/allocation/batch_arena_allocator.h"
+
+#include <chrono>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "glog/logging.h"
+#include "gtest/gtest.h"
+#include "paddle/fluid/memory/allocation/cpu_allocator.h"
+
+namespace paddle {
+namespace memory {
+namespace allocation {
+
+static const size_t kChunkSize = 1 << 16;
+static const size_t kMaxAllocSize = 1 << 14;
+
+TEST(BatchArenaAllocator, NoArena) {
+  auto cpu = std::make_shared<CPUAllocator>();
+  BatchArenaAllocator allocator(cpu);
+  auto allocation = allocator.Allocate(100);
+  ASSERT_NE(allocation->ptr(), nullptr);
+  EXPECT_EQ(dynamic_cast<BatchArenaAllocation*>(allocation.get()), nullptr);
+}
+
+TEST(BatchArenaAllocator, Batches) {
+  auto cpu = std::make_shared<CPUAllocator>();
+  BatchArenaAllocator allocator(cpu);
+  auto arena = std::make_shared<BatchArena>(
+      cpu, platform::CPUPlace(), kChunkSize, kMaxAllocSize);
+
+  std::vector<void*> first;
+  for (int batch = 0; batch < 3; ++batch) {
+    std::vector<AllocationPtr> allocations;
+    {
+      BatchArenaGuard guard(arena.get());
+      EXPECT_EQ(BatchArena::Current(), arena.get());
+      for (int i = 0; i < 20; ++i) {
+        allocations.push_back(allocator.Allocate(1000 + i));
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(allocations.back()->ptr()) % 64,
+                  0UL);
+        memset(allocations.back()->ptr(), i, 1000 + i);
+      }
+      allocations.push_back(allocator.Allocate(kMaxAllocSize + 1));
+    }
+    EXPECT_EQ(BatchArena::Current(), nullptr);
+    if (batch == 0) {
+      for (auto& allocation : allocations) {
+        first.push_back(allocation->ptr());
+      }
+    } else {
+      // the rewound chunks serve the same addresses again
+      for (size_t i = 0; i + 1 < allocations.size(); ++i) {
+        EXPECT_EQ(allocations[i]->ptr(), first[i]);
+      }
+    }
+    allocations.clear();
+    auto stat = arena->Reset();
+    EXPECT_EQ(stat.arena_allocs, 20);
+    EXPECT_EQ(stat.fallback_allocs, 1);
+    EXPECT_EQ(stat.chunk_allocs, batch == 0 ? 1 : 0);
+    EXPECT_EQ(arena->chunk_num(), 1UL);
+  }
+}
+
+TEST(BatchArenaAllocator, PinnedChunk) {
+  auto cpu = std::make_shared<CPUAllocator>();
+  BatchArenaAllocator allocator(cpu);
+  auto arena = std::make_shared<BatchArena>(
+      cpu, platform::CPUPlace(), kChunkSize, kMaxAllocSize);
+
+  AllocationPtr kept;
+  {
+    BatchArenaGuard guard(arena.get());
+    kept = allocator.Allocate(256);
+    memset(kept->ptr(), 7, 256);
+  }
+  arena->Reset();
+
+  // a tensor kept across the batch pins its chunk, the next batch gets a
+  // new one
+  {
+    BatchArenaGuard guard(arena.get());
+    auto other = allocator.Allocate(256);
+    EXPECT_NE(other->ptr(), kept->ptr());
+    memset(other->ptr(), 1, 256);
+  }
+  auto stat = arena->Reset();
+  EXPECT_EQ(stat.chunk_allocs, 1);
+  EXPECT_EQ(arena->chunk_num(), 2UL);
+  for (int i = 0; i < 256; ++i) {
+    ASSERT_EQ(static_cast<char*>(kept->ptr())[i], 7);
+  }
+
+  // freed by another thread, the chunk is rewound by the next reset
+  std::thread([&kept]() { kept.reset(); }).join();
+  arena->Reset();
+  {
+    BatchArenaGuard guard(arena.get());
+    allocator.Allocate(256);
+  }
+  stat = arena->Reset();
+  EXPECT_EQ(stat.chunk_allocs, 0);
+}
+
+TEST(BatchArenaAllocator, OutliveArena) {
+  auto cpu = std::make_shared<CPUAllocator>();
+  BatchArenaAllocator allocator(cpu);
+  auto arena = std::make_shared<BatchArena>(
+      cpu, platform::CPUPlace(), kChunkSize, kMaxAllocSize);
+  AllocationPtr kept;
+  {
+    BatchArenaGuard guard(arena.get());
+    kept = allocator.Allocate(128);
+  }
+  // the allocation keeps the chunks alive
+  arena.reset();
+  memset(kept->ptr(), 1, 128);
+  kept.reset();
+}
+
+TEST(BatchArenaAllocator, Benchmark) {
+  auto cpu = std::make_shared<CPUAllocator>();
+  BatchArenaAllocator allocator(cpu);
+  auto arena = std::make_shared<BatchArena>(
+      cpu, platform::CPUPlace(), 8 << 20, 1 << 20);
+  const int batch_num = 200;
+  const int tensor_num = 300;
+
+  auto run = [&](bool use_arena) {
+    auto start = std::chrono::steady_clock::now();
+    for (int b = 0; b < batch_num; ++b) {
+      std::vector<AllocationPtr> allocations;
+      {
+        BatchArenaGuard guard(use_arena ? arena.get() : nullptr);
+        for (int t = 0; t < tensor_num; ++t) {
+          allocations.push_back(allocator.Allocate(512 + (t % 17) * 1024));
+        }
+      }
+      allocations.clear();
+      if (use_arena) {
+        arena->Reset();
+      }
+    }
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  };
+  double direct_ms = run(false);
+  double arena_ms = run(true);
+  LOG(INFO) << batch_num << " batches of " << tensor_num
+            << " temporaries, cpu allocator: " << direct_ms
+            << "ms, batch arena: " << arena_ms << "ms";
+}
+
+}  // namespace allocation
+}  // namespace memory
+}  // namespace paddle
@@ -19,6 +19,8 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <random>
 #include <string>
@@ -268,6 +270,49 @@ std::shared_ptr<MemoryMapReaderAllocation> RebuildMemoryMapReaderAllocation(
   return std::make_shared<MemoryMapReaderAllocation>(ptr, size, ipc_name);
 }
 
+MemoryMapFileAllocation::~MemoryMapFileAllocation() {
+  if (this->size() > 0) {
+    PADDLE_ENFORCE_NE(munmap(this->ptr(), this->size()),
+                      -1,
+                      platform::errors::Unavailable(
+                          "could not unmap the file %s", this->file_name()));
+  }
+  VLOG(3) << "~MemoryMapFileAllocation: " << this->file_name();
+}
+
+std::shared_ptr<MemoryMapFileAllocation> AllocateMemoryMapFileAllocation(
+    const std::string &file_name, bool populate) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  PADDLE_ENFORCE_NE(
+      fd,
+      -1,
+      platform::errors::Unavailable("File (%s) open failed.", file_name));
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == -1) {
+    close(fd);
+    PADDLE_THROW(
+        platform::errors::Unavailable("File (%s) stat failed.", file_name));
+  }
+  size_t size = static_cast<size_t>(file_stat.st_size);
+  void *ptr = nullptr;
+  if (size > 0) {
+    // writable private pages, a write copies the page instead of failing
+    ptr = mmap(nullptr,
+               size,
+               PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | (populate ? MAP_POPULATE : 0),
+               fd,
+               0);
+  }
+  close(fd);
+  PADDLE_ENFORCE_NE(
+      ptr,
+      MAP_FAILED,
+      platform::errors::Unavailable("Memory map file (%s) failed.", file_name));
+  VLOG(3) << "map file " << file_name << ", size " << size;
+  return std::make_shared<MemoryMapFileAllocation>(ptr, size, file_name);
+}
+
 MemoryMapFdSet &MemoryMapFdSet::Instance() {  // NOLINT
   static MemoryMapFdSet set;
   return set;
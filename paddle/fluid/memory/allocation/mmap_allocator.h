@@ -134,6 +134,45 @@ std::shared_ptr<MemoryMapWriterAllocation> AllocateMemoryMapWriterAllocation(
 std::shared_ptr<MemoryMapReaderAllocation> RebuildMemoryMapReaderAllocation(
     const std::string &ipc_name, size_t size);
 
+// A regular file mapped with MAP_PRIVATE. The pages are shared with the page
+// cache and with every tensor viewing them until a tensor writes a page, which
+// then gets a private copy, the file is never modified.
+class MemoryMapFileAllocation : public Allocation {
+ public:
+  explicit MemoryMapFileAllocation(void *ptr,
+                                   size_t size,
+                                   std::string file_name)
+      : Allocation(ptr, size, platform::CPUPlace()),
+        file_name_(std::move(file_name)) {}
+
+  inline const std::string &file_name() const { return file_name_; }
+
+  ~MemoryMapFileAllocation() override;
+
+ private:
+  std::string file_name_;
+};
+
+// [offset, offset + size) of a mapped file, keeps the mapping alive
+class MemoryMapFileViewAllocation : public Allocation {
+ public:
+  MemoryMapFileViewAllocation(std::shared_ptr<MemoryMapFileAllocation> file,
+                              size_t offset,
+                              size_t size)
+      : Allocation(static_cast<char *>(file->ptr()) + offset,
+                   size,
+                   platform::CPUPlace()),
+        file_(std::move(file)) {}
+
+ private:
+  std::shared_ptr<MemoryMapFileAllocation> file_;
+};
+
+// map the whole file, populate reads the file ahead instead of faulting the
+// pages in on the first access
+std::shared_ptr<MemoryMapFileAllocation> AllocateMemoryMapFileAllocation(
+    const std::string &file_name, bool populate = false);
+
 class MemoryMapFdSet {
  public:
   static MemoryMapFdSet &Instance();  // NOLINT
@@ -16,6 +16,9 @@
 
 #include "paddle/fluid/memory/allocation/mmap_allocator.h"
 
+#include <fstream>
+#include <vector>
+
 #include "gtest/gtest.h"
 
 namespace paddle {
@@ -45,6 +48,36 @@ TEST(MemoryMapAllocation, test_allocation_base) {
   }
 }
 
+TEST(MemoryMapFileAllocation, test_private_file_map) {
+  std::string file_name = "test_mmap_file_allocation";
+  std::vector<int32_t> data(2048);
+  for (int32_t i = 0; i < 2048; ++i) {
+    data[i] = i;
+  }
+  {
+    std::ofstream fout(file_name, std::ios::binary);
+    fout.write(reinterpret_cast<const char*>(data.data()),
+               data.size() * sizeof(int32_t));
+  }
+  {
+    auto file = AllocateMemoryMapFileAllocation(file_name);
+    ASSERT_EQ(file->size(), data.size() * sizeof(int32_t));
+    auto view = std::make_shared<MemoryMapFileViewAllocation>(
+        file, 1024 * sizeof(int32_t), 1024 * sizeof(int32_t));
+    file.reset();
+    // the view keeps the mapping alive
+    auto* view_ptr = static_cast<int32_t*>(view->ptr());
+    for (int32_t i = 0; i < 1024; ++i) {
+      ASSERT_EQ(view_ptr[i], 1024 + i);
+    }
+    // a write goes to a private copy of the page
+    view_ptr[0] = -1;
+  }
+  auto file = AllocateMemoryMapFileAllocation(file_name, true);
+  ASSERT_EQ(static_cast<int32_t*>(file->ptr())[1024], 1024);
+  remove(file_name.c_str());
+}
+
 }  // namespace allocation
 }  // namespace memory
 }  // namespace paddle
@@ -25,6 +25,12 @@ limitations under the License. */
 #if defined(PADDLE_WITH_BOX_PS)
 #include "paddle/fluid/framework/fleet/box_wrapper.h"
 #endif
+#include "paddle/fluid/framework/fleet/shm_collective.h"
+#if defined(PADDLE_WITH_GLOO)
+#include <gloo/allreduce.h>
+
+#include "paddle/fluid/framework/fleet/gloo_wrapper.h"
+#endif
 namespace paddle {
 namespace operators {
 
@@ -161,6 +167,82 @@ class CAllReduceXOpKernel : public framework::OpKernel<T> {
 #endif
   }
 };
+// The CPU kernel sums the fused X over all the processes in one pass, the
+// processes on one host through shared memory, the hosts with gloo, whose
+// context spans the local rank 0 of every host.
+template <typename T>
+class CAllReduceXOpCPUKernel : public framework::OpKernel<T> {
+ public:
+  void Compute(const framework::ExecutionContext &ctx) const override {
+    auto in_tensors = ctx.MultiInput<framework::LoDTensor>("X");
+    auto out_tensors = ctx.MultiOutput<framework::LoDTensor>("Out");
+
+    PADDLE_ENFORCE_EQ(in_tensors.size(),
+        out_tensors.size(),
+        platform::errors::InvalidArgument(
+            "The number of CReduceX operator's input and "
+            "output is not match, "
+            "input number is %u, output number is %u.",
+            in_tensors.size(),
+            out_tensors.size()));
+    auto place = ctx.GetPlace();
+
+    framework::FusedTensors<T> ins;
+    framework::FusedTensors<T> outs;
+    for (size_t i = 0; i < in_tensors.size(); ++i) {
+      auto &out_tensor = out_tensors[i];
+      if (out_tensor->IsInitialized()) {
+        PADDLE_ENFORCE_EQ(out_tensor->numel(),
+            in_tensors[i]->numel(),
+            platform::errors::InvalidArgument(
+            "The number of CReduceX operator's X[%u] and "
+            "Out[%u] is not match, "
+            "input numel is %u, output numel is %u.",
+            i,
+            i,
+            out_tensor->numel(),
+            in_tensors[i]->numel()));
+      } else {
+        out_tensor->Resize(in_tensors[i]->dims());
+      }
+      int64_t numel = in_tensors[i]->numel();
+      ins.Add(const_cast<T *>(in_tensors[i]->data<T>()), numel);
+      outs.Add(out_tensor->mutable_data<T>(place), numel);
+    }
+
+    // the host num comes from the attr, only the local rank 0 initializes
+    // gloo, so the gloo state differs among the local ranks
+    int nranks = ctx.Attr<int>("nranks");
+    auto shm = framework::ShmCollective::GetInstance();
+    shm->AllReduce<T>(ins, outs, nranks, [nranks](T *buf, int64_t num) {
+#if defined(PADDLE_WITH_GLOO)
+      auto gloo = paddle::framework::GlooWrapper::GetInstance();
+      PADDLE_ENFORCE_EQ(
+          gloo->IsInitialized(),
+          true,
+          platform::errors::PreconditionNotMet(
+              "You must initialize the gloo environment first to use it."));
+      PADDLE_ENFORCE_EQ(gloo->Size(),
+                        nranks,
+                        platform::errors::PreconditionNotMet(
+                            "The gloo size %d of the cpu c_allreduce_xsum "
+                            "must be the node num %d",
+                            gloo->Size(),
+                            nranks));
+      gloo::AllreduceOptions opts(gloo->GetContext());
+      opts.setOutput(buf, num);
+      opts.setReduceFunction(
+          static_cast<void (*)(void *, const void *, const void *, size_t)>(
+              &gloo::sum<T>));
+      gloo::allreduce(opts);
+#else
+      PADDLE_THROW(platform::errors::Unavailable(
+          "PaddlePaddle should compile with GLOO by setting WITH_GLOO=ON"));
+#endif
+    });
+  }
+};
+
 class CAllReduceXOpMaker : public framework::OpProtoAndCheckerMaker {
  public:
   void Make() {
@@ -177,6 +259,9 @@ class CAllReduceXOpMaker : public framework::OpProtoAndCheckerMaker {
         "use_calc_stream",
         "(bool default false) eject CUDA operations to calculation stream.")
         .SetDefault(false);
+    AddAttr<int>("nranks",
+                 "(int default 1) communication node num of the cpu kernel.")
+        .SetDefault(1);
     AddComment(string::Sprintf(R"DOC(
 CAllReduceX %s Operator
 
@@ -198,11 +283,11 @@ namespace plat = paddle::platform;
 
 REGISTER_OPERATOR(c_allreduce_xsum, ops::CAllReduceXOp,
                   ops::CAllReduceXOpMaker);
-REGISTER_OP_CPU_KERNEL(c_allreduce_xsum, ops::CAllReduceXOpKernel<float>,
-                       ops::CAllReduceXOpKernel<double>,
-                       ops::CAllReduceXOpKernel<int>,
-                       ops::CAllReduceXOpKernel<int64_t>,
-                       ops::CAllReduceXOpKernel<plat::float16>);
+REGISTER_OP_CPU_KERNEL(c_allreduce_xsum, ops::CAllReduceXOpCPUKernel<float>,
+                       ops::CAllReduceXOpCPUKernel<double>,
+                       ops::CAllReduceXOpCPUKernel<int>,
+                       ops::CAllReduceXOpCPUKernel<int64_t>,
+                       ops::CAllReduceXOpCPUKernel<plat::float16>);
 #if defined(PADDLE_WITH_NCCL)
 REGISTER_OP_CUDA_KERNEL(c_allreduce_xsum, ops::CAllReduceXOpKernel<float>,
                         ops::CAllReduceXOpKernel<double>,
@@ -11,7 +11,9 @@ distributed under the License is distributed on an "AS IS" BASIS,
 WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License. */
+#include <memory>
 #include <string>
+#include <vector>
 #include "paddle/fluid/framework/data_type.h"
 #include "paddle/fluid/framework/lod_tensor.h"
 #include "paddle/fluid/framework/op_registry.h"
@@ -27,6 +29,13 @@ limitations under the License. */
 #include "paddle/fluid/framework/fleet/box_wrapper.h"
 #include "paddle/fluid/platform/collective_helper.h"
 #endif
+#include "paddle/fluid/framework/fleet/shm_collective.h"
+#if defined(PADDLE_WITH_GLOO)
+#include <gloo/allgather.h>
+#include <gloo/allreduce.h>
+
+#include "paddle/fluid/framework/fleet/gloo_wrapper.h"
+#endif
 #include "paddle/fluid/operators/tensor_formatter.h"
 namespace paddle {
 namespace operators {
@@ -47,12 +56,105 @@ class CMixAllGatherOp : public framework::OperatorWithKernel {
   }
 };
 
+// The CPU kernel follows the single network card path of the CUDA kernel,
+// the processes on one host take the place of the devices. They are fused
+// through shared memory by ShmCollective and the local rank 0 of every host
+// runs the node collective with gloo, so the gloo context spans one process
+// per host, nranks in all. multi_nccl and use_boxps_nccl do not apply.
 template <typename T>
 class CMixAllGatherOpCPUKernel : public framework::OpKernel<T> {
+  static const int NCCL_ALLREDUCE = 0;
+  static const int NCCL_MIXALLGATHER = 1;
+  static const int NCCL_ALLGATHER = 2;
+
  public:
   void Compute(const framework::ExecutionContext &ctx) const override {
-    PADDLE_THROW("CMixAllGather op do not support CPUKernel for now.");
+    auto in_tensors = ctx.MultiInput<framework::LoDTensor>("Input");
+    auto fused_tensor = ctx.Output<framework::LoDTensor>("Output");
+
+    int nranks = ctx.Attr<int>("nranks");
+    int rank_id = ctx.Attr<int>("rankid");
+    int nccl_mode = ctx.Attr<int>("nccl_mode");
+    auto place = ctx.GetPlace();
+
+    auto shm = framework::ShmCollective::GetInstance();
+    framework::FusedTensors<T> ins;
+    for (size_t i = 0; i < in_tensors.size(); ++i) {
+      CHECK(in_tensors[i]->IsInitialized());
+      ins.Add(const_cast<T *>(in_tensors[i]->data<T>()),
+              in_tensors[i]->numel());
+    }
+    int64_t numel = ins.numel();
+
+    if (nccl_mode == NCCL_ALLGATHER) {
+      T *recvbuff = fused_tensor->mutable_data<T>(
+          {numel * nranks * shm->local_size(), 1}, place);
+      shm->AllGather<T>(ins, recvbuff, nranks, rank_id, HostAllGather(nranks));
+    } else if (nccl_mode == NCCL_MIXALLGATHER) {
+      T *recvbuff =
+          fused_tensor->mutable_data<T>({numel * nranks, 1}, place);
+      shm->MixAllGather<T>(
+          ins, recvbuff, nranks, rank_id, HostAllGather(nranks));
+    } else {
+      framework::FusedTensors<T> outs;
+      outs.Add(fused_tensor->mutable_data<T>({numel, 1}, place), numel);
+      shm->AllReduce<T>(ins, outs, nranks, HostAllReduce(nranks));
+    }
+  }
+
+ protected:
+  // node collectives of the local rank 0, in place on buf
+  static framework::ShmCollective::HostAllReduce<T> HostAllReduce(
+      int nranks) {
+    return [nranks](T *buf, int64_t num) {
+#if defined(PADDLE_WITH_GLOO)
+      auto gloo = CheckGloo(nranks);
+      gloo::AllreduceOptions opts(gloo->GetContext());
+      opts.setOutput(buf, num);
+      opts.setReduceFunction(
+          static_cast<void (*)(void *, const void *, const void *, size_t)>(
+              &gloo::sum<T>));
+      gloo::allreduce(opts);
+#else
+      PADDLE_THROW(platform::errors::Unavailable(
+          "PaddlePaddle should compile with GLOO by setting WITH_GLOO=ON"));
+#endif
+    };
   }
+
+  static framework::ShmCollective::HostAllGather<T> HostAllGather(
+      int nranks) {
+    return [nranks](T *buf, int64_t num) {
+#if defined(PADDLE_WITH_GLOO)
+      auto gloo = CheckGloo(nranks);
+      gloo::AllgatherOptions opts(gloo->GetContext());
+      opts.setOutput(buf, num * nranks);
+      gloo::allgather(opts);
+#else
+      PADDLE_THROW(platform::errors::Unavailable(
+          "PaddlePaddle should compile with GLOO by setting WITH_GLOO=ON"));
+#endif
+    };
+  }
+
+#if defined(PADDLE_WITH_GLOO)
+  static std::shared_ptr<framework::GlooWrapper> CheckGloo(int nranks) {
+    auto gloo = framework::GlooWrapper::GetInstance();
+    PADDLE_ENFORCE_EQ(
+        gloo->IsInitialized(),
+        true,
+        platform::errors::PreconditionNotMet(
+            "You must initialize the gloo environment first to use it."));
+    PADDLE_ENFORCE_EQ(gloo->Size(),
+                      nranks,
+                      platform::errors::PreconditionNotMet(
+                          "The gloo size %d of the cpu c_mixallgather must "
+                          "be the node num %d",
+                          gloo->Size(),
+                          nranks));
+    return gloo;
+  }
+#endif
 };
 
 // template<typename T>
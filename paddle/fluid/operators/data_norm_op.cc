@@ -332,85 +332,76 @@ class DataNormKernel<phi::CPUContext, T> : public framework::OpKernel<T> {
 
     const T *scales_data = scales->data<T>();
     const int slot_dim = ctx.Attr<int>("slot_dim");
+    const bool enable_scale_and_shift =
+        ctx.Attr<bool>("enable_scale_and_shift");
+    const T *scale_w_data = nullptr;
+    const T *bias_data = nullptr;
+    Eigen::Array<T, Eigen::Dynamic, 1> new_scale;
+    Eigen::Array<T, Eigen::Dynamic, 1> new_bias;
+    if (enable_scale_and_shift) {
+      const auto *scale_w = ctx.Input<Tensor>("scale_w");
+      const auto *bias = ctx.Input<Tensor>("bias");
+      scale_w_data = scale_w->data<T>();
+      bias_data = bias->data<T>();
+      ConstEigenVectorArrayMap<T> scale_w_arr(scale_w_data, C);
+      ConstEigenVectorArrayMap<T> bias_arr(bias_data, C);
+      new_scale = scales_arr * scale_w_arr;
+      new_bias = bias_arr - means_arr * scales_arr * scale_w_arr;
+    }
     T min_precision = 1e-7f;
     switch (data_layout) {
       case DataLayout::kNCHW:  // It's two dimensions, so make no difference
       case DataLayout::kNHWC: {
-        // if slot_dim is set and batch size is larger than zero, we choose
-        // to check if show number is zero, if so, skip normalization.
-        if (slot_dim > 0 && N > 0 &&
-            (!ctx.Attr<bool>("enable_scale_and_shift"))) {
-          const int item_size = x->numel() / N;
-          // location of show number in one embedding
-          int offset = 0;
-          for (int k = 0; k < N; ++k) {
-            for (int i = 0; i < item_size; i += slot_dim) {
-              if (x_data[offset + i] > -min_precision &&
-                  x_data[offset + i] < min_precision) {
-                // show = 0
-                memset(y_data + offset + i, 0, sizeof(T) * slot_dim);
-              } else {
-                for (int j = i; j < i + slot_dim; ++j) {
-                  y_data[offset + j] =
-                      (x_data[offset + j] - means_data[j]) * scales_data[j];
+        const int item_size = N > 0 ? x->numel() / N : 0;
+        // normalize the rows [begin, end)
+        auto norm_rows = [&](size_t block, int begin, int end) {
+          const int rows = end - begin;
+          if (slot_dim > 0) {
+            // if slot_dim is set, we choose to check if show number is zero,
+            // if so, skip normalization.
+            for (int k = begin; k < end; ++k) {
+              const T *x_row = x_data + static_cast<int64_t>(k) * item_size;
+              T *y_row = y_data + static_cast<int64_t>(k) * item_size;
+              for (int i = 0; i < item_size; i += slot_dim) {
+                if (x_row[i] > -min_precision && x_row[i] < min_precision) {
+                  // show = 0
+                  memset(y_row + i, 0, sizeof(T) * slot_dim);
+                } else if (!enable_scale_and_shift) {
+                  for (int j = i; j < i + slot_dim; ++j) {
+                    y_row[j] = (x_row[j] - means_data[j]) * scales_data[j];
+                  }
+                } else {
+                  for (int j = i; j < i + slot_dim; ++j) {
+                    y_row[j] = ((x_row[j] - means_data[j]) * scales_data[j]) *
+                                   scale_w_data[j] +
+                               bias_data[j];
+                  }
                 }
               }
             }
-
-            offset += item_size;
-          }
-        } else {
-          if (!ctx.Attr<bool>("enable_scale_and_shift") && slot_dim <= 0) {
-            EigenArrayMap<T>(y_data, C, N) =
-                (ConstEigenArrayMap<T>(x->data<T>(), C, N).colwise() -
+          } else if (!enable_scale_and_shift) {
+            EigenArrayMap<T>(y_data + static_cast<int64_t>(begin) * C,
+                             C,
+                             rows) =
+                (ConstEigenArrayMap<T>(
+                     x_data + static_cast<int64_t>(begin) * C, C, rows)
+                     .colwise() -
                  means_arr)
                     .colwise() *
                 scales_arr;
-          } else if (ctx.Attr<bool>("enable_scale_and_shift") &&
-                     slot_dim <= 0) {
-            const auto *scale_w = ctx.Input<Tensor>("scale_w");
-            const auto *bias = ctx.Input<Tensor>("bias");
-            ConstEigenVectorArrayMap<T> scale_w_arr(scale_w->data<T>(), C);
-            ConstEigenVectorArrayMap<T> bias_arr(bias->data<T>(), C);
-
-            Eigen::Array<T, Eigen::Dynamic, 1> new_scale =
-                scales_arr * scale_w_arr;
-            Eigen::Array<T, Eigen::Dynamic, 1> new_bias =
-                bias_arr - means_arr * scales_arr * scale_w_arr;
-            EigenArrayMap<T>(y_data, C, N) =
-                (ConstEigenArrayMap<T>(x->data<T>(), C, N).colwise() *
+          } else {
+            EigenArrayMap<T>(y_data + static_cast<int64_t>(begin) * C,
+                             C,
+                             rows) =
+                (ConstEigenArrayMap<T>(
+                     x_data + static_cast<int64_t>(begin) * C, C, rows)
+                     .colwise() *
                  new_scale)
                     .colwise() +
                 new_bias;
-
-          } else {
-            const int item_size = x->numel() / N;
-            const auto *scale_w = ctx.Input<Tensor>("scale_w");
-            const auto *bias = ctx.Input<Tensor>("bias");
-            const T *scale_w_data = scale_w->data<T>();
-            const T *bias_data = bias->data<T>();
-            // location of show number in one embedding
-            int offset = 0;
-            for (int k = 0; k < N; ++k) {
-              for (int i = 0; i < item_size; i += slot_dim) {
-                if (x_data[offset + i] > -min_precision &&
-                    x_data[offset + i] < min_precision) {
-                  // show = 0
-                  memset(y_data + offset + i, 0, sizeof(T) * slot_dim);
-                } else {
-                  for (int j = i; j < i + slot_dim; ++j) {
-                    y_data[offset + j] = ((x_data[offset + j] - means_data[j]) *
-                                          scales_data[j]) *
-                                             scale_w_data[j] +
-                                         bias_data[j];
-                  }
-                }
-              }  // end for i
-
-              offset += item_size;
-            }  // end for k
           }
-        }
+        };
+        DataNormRunRowBlocks(N, DataNormRowBlockNum(N, C), norm_rows);
         break;
       }
       default:
@@ -595,143 +586,148 @@ class DataNormGradKernel<phi::CPUContext, T> : public framework::OpKernel<T> {
       case DataLayout::kNHWC: {
         ConstEigenVectorArrayMap<T> scales_arr(scales->data<T>(), C);
         ConstEigenVectorArrayMap<T> means_arr(means->data<T>(), C);
-        ConstEigenArrayMap<T> x_arr(x->data<T>(), C, N);
-        ConstEigenArrayMap<T> d_y_arr(d_y->data<T>(), C, N);
+        const bool enable_scale_and_shift =
+            ctx.Attr<bool>("enable_scale_and_shift");
+        const int item_size = N > 0 ? x->numel() / N : 0;
+        const T *dy_data = d_y->data<T>();
+        T *d_x_data = nullptr;
+        const T *scale_w_data = nullptr;
+        T *d_scale_data = nullptr;
+        T *d_bias_data = nullptr;
         if (d_x != nullptr) {
-          EigenArrayMap<T> d_x_arr(d_x->mutable_data<T>(ctx.GetPlace()), C, N);
-          d_x_arr.setZero();
-          if (!ctx.Attr<bool>("enable_scale_and_shift")) {
-            for (int nc = 0; nc < N; ++nc) {
-              d_x_arr.col(nc) = d_y_arr.col(nc) * scales_arr;
-            }
-          } else {
-            const auto *scale_w = ctx.Input<Tensor>("scale_w");
-            auto *d_scale =
-                ctx.Output<Tensor>(framework::GradVarName("scale_w"));
-            auto *d_bias = ctx.Output<Tensor>(framework::GradVarName("bias"));
-            ConstEigenVectorArrayMap<T> scale_arr(scale_w->data<T>(), C);
-            T *d_bias_data = nullptr;
-            T *d_scale_data = nullptr;
-
-            d_scale->mutable_data<T>(ctx.GetPlace());
-            d_bias->mutable_data<T>(ctx.GetPlace());
-            d_bias_data = d_bias->mutable_data<T>(ctx.GetPlace());
-            d_scale_data = d_scale->mutable_data<T>(ctx.GetPlace());
-
-            EigenVectorArrayMap<T> d_bias_arr(d_bias_data, C);
-            EigenVectorArrayMap<T> d_scale_arr(d_scale_data, C);
-            Tensor dy_sum;
-            dy_sum.Resize({C});
-            dy_sum.mutable_data<T>(ctx.GetPlace());
-            EigenVectorArrayMap<T> dy_sum_arr(
-                dy_sum.mutable_data<T>(ctx.GetPlace()), C);
-            Tensor dy_mul_x_sub_mean_mul_invstd_sum;
-            dy_mul_x_sub_mean_mul_invstd_sum.Resize({C});
-            dy_mul_x_sub_mean_mul_invstd_sum.mutable_data<T>(ctx.GetPlace());
-            EigenVectorArrayMap<T> dy_mul_x_sub_mean_mul_invstd_sum_arr(
-                dy_mul_x_sub_mean_mul_invstd_sum.mutable_data<T>(
-                    ctx.GetPlace()),
-                C);
-
-            dy_sum_arr.setZero();
-            dy_mul_x_sub_mean_mul_invstd_sum_arr.setZero();
-
-            if (slot_dim <= 0) {
-              for (int n = 0; n < N; ++n) {
+          d_x_data = d_x->mutable_data<T>(ctx.GetPlace());
+          if (enable_scale_and_shift) {
+            scale_w_data = ctx.Input<Tensor>("scale_w")->data<T>();
+            d_scale_data = ctx.Output<Tensor>(framework::GradVarName("scale_w"))
+                               ->mutable_data<T>(ctx.GetPlace());
+            d_bias_data = ctx.Output<Tensor>(framework::GradVarName("bias"))
+                              ->mutable_data<T>(ctx.GetPlace());
+          }
+        }
+        const bool scale_grad = d_x != nullptr && enable_scale_and_shift;
+        // if slot_dim is set and batch size is larger than zero, we choose
+        // to check if show number is zero, if so, skip update statistics.
+        const bool slot_stats = slot_dim > 0 && N > 0;
+
+        // every row block writes its partial sums, they are reduced below
+        const int block_num = DataNormRowBlockNum(N, C);
+        const size_t part_size = static_cast<size_t>(block_num) * C;
+        std::vector<T> part_count(slot_stats ? part_size : 0);
+        std::vector<T> part_sum(part_size);
+        std::vector<T> part_square_sum(part_size);
+        std::vector<T> part_dy_sum(scale_grad ? part_size : 0);
+        std::vector<T> part_dy_x_sum(scale_grad ? part_size : 0);
+
+        auto grad_rows = [&](size_t block, int begin, int end) {
+          const int rows = end - begin;
+          const int64_t offset = static_cast<int64_t>(begin) * C;
+          const size_t part_offset = block * C;
+          ConstEigenArrayMap<T> x_arr(x_data + offset, C, rows);
+          ConstEigenArrayMap<T> d_y_arr(dy_data + offset, C, rows);
+          if (d_x != nullptr) {
+            EigenArrayMap<T> d_x_arr(d_x_data + offset, C, rows);
+            if (!enable_scale_and_shift) {
+              d_x_arr = d_y_arr.colwise() * scales_arr;
+            } else if (slot_dim <= 0) {
+              ConstEigenVectorArrayMap<T> scale_arr(scale_w_data, C);
+              EigenVectorArrayMap<T> dy_sum_arr(
+                  part_dy_sum.data() + part_offset, C);
+              EigenVectorArrayMap<T> dy_mul_x_sub_mean_mul_invstd_sum_arr(
+                  part_dy_x_sum.data() + part_offset, C);
+              dy_sum_arr.setZero();
+              dy_mul_x_sub_mean_mul_invstd_sum_arr.setZero();
+              for (int n = 0; n < rows; ++n) {
                 dy_sum_arr += d_y_arr.col(n);
                 dy_mul_x_sub_mean_mul_invstd_sum_arr +=
                     ((x_arr.col(n) - mean_arr) * inv_var_arr * d_y_arr.col(n));
               }
-              if (d_scale && d_bias) {
-                d_bias_arr = dy_sum_arr;
-                d_scale_arr = dy_mul_x_sub_mean_mul_invstd_sum_arr;
-              }
-              for (int nc = 0; nc < N; ++nc) {
-                d_x_arr.col(nc) = d_y_arr.col(nc) * scales_arr * scale_arr;
-              }
+              d_x_arr = (d_y_arr.colwise() * scales_arr).colwise() * scale_arr;
             } else {
-              int offset = 0;
-              const int item_size = x->numel() / N;
-              T *d_x_data = d_x->mutable_data<T>(ctx.GetPlace());
-              T *d_scale_data = d_scale->mutable_data<T>(ctx.GetPlace());
-              T *d_bias_data = d_bias->mutable_data<T>(ctx.GetPlace());
-              const T *dy_data = d_y->data<T>();
-              const T *scales_data = scales->data<T>();
-              const T *scale_w_data = scale_w->data<T>();
-              const T *x_data = x->data<T>();
-              for (int i = 0; i < item_size; i++) {
-                d_bias_data[i] = 0;
-                d_scale_data[i] = 0;
-              }
-              for (int k = 0; k < N; ++k) {
+              T *d_bias_part = part_dy_sum.data() + part_offset;
+              T *d_scale_part = part_dy_x_sum.data() + part_offset;
+              std::fill(d_bias_part, d_bias_part + C, static_cast<T>(0));
+              std::fill(d_scale_part, d_scale_part + C, static_cast<T>(0));
+              d_x_arr.setZero();
+              for (int k = begin; k < end; ++k) {
+                const int64_t row = static_cast<int64_t>(k) * item_size;
+                const T *x_row = x_data + row;
+                const T *dy_row = dy_data + row;
+                T *d_x_row = d_x_data + row;
                 for (int i = 0; i < item_size; i += slot_dim) {
-                  if (!(x_data[offset + i] > -min_precision &&
-                        x_data[offset + i] < min_precision)) {
+                  if (!(x_row[i] > -min_precision &&
+                        x_row[i] < min_precision)) {
                     // show != 0
                     for (int j = i; j < i + slot_dim; ++j) {
-                      d_x_data[offset + j] = dy_data[offset + j] *
-                                             scales_data[j] * scale_w_data[j];
-                      d_bias_data[j] += dy_data[offset + j];
-                      d_scale_data[j] += (x_data[offset + j] - mean_data[j]) *
-                                         inv_var_data[j] * dy_data[offset + j];
+                      d_x_row[j] =
+                          dy_row[j] * inv_var_data[j] * scale_w_data[j];
+                      d_bias_part[j] += dy_row[j];
+                      d_scale_part[j] += (x_row[j] - mean_data[j]) *
+                                         inv_var_data[j] * dy_row[j];
                     }
                   }
                 }
-                offset += item_size;
               }
             }
           }
-        }
 
-        if (slot_dim > 0 && N > 0) {
-          // if slot_dim is set and batch size is larger than zero, we choose
-          // to check if show number is zero, if so, skip update statistics.
-          int offset = 0;
-          const int item_size = x->numel() / N;
-          for (int k = 0; k < N; ++k) {
-            for (int i = 0; i < item_size; i += slot_dim) {
-              if (!(x_data[offset + i] > -min_precision &&
-                    x_data[offset + i] < min_precision)) {
-                // show != 0
-                for (int j = i; j < i + slot_dim; ++j) {
-                  d_batch_size_data[j] += 1;
-                  d_batch_sum_data[j] += x_data[offset + j];
-                  d_batch_square_sum_data[j] +=
-                      (x_data[offset + j] - means_data[j]) *
-                      (x_data[offset + j] - means_data[j]);
+          if (slot_stats) {
+            T *count = part_count.data() + part_offset;
+            T *sum = part_sum.data() + part_offset;
+            T *square_sum = part_square_sum.data() + part_offset;
+            std::fill(count, count + C, static_cast<T>(0));
+            std::fill(sum, sum + C, static_cast<T>(0));
+            std::fill(square_sum, square_sum + C, static_cast<T>(0));
+            for (int k = begin; k < end; ++k) {
+              const T *x_row = x_data + static_cast<int64_t>(k) * item_size;
+              for (int i = 0; i < item_size; i += slot_dim) {
+                if (!(x_row[i] > -min_precision && x_row[i] < min_precision)) {
+                  // show != 0
+                  for (int j = i; j < i + slot_dim; ++j) {
+                    count[j] += 1;
+                    sum[j] += x_row[j];
+                    square_sum[j] +=
+                        (x_row[j] - means_data[j]) * (x_row[j] - means_data[j]);
+                  }
                 }
               }
             }
-            offset += item_size;
+          } else {
+            // calculate data sample sum and square sum
+            EigenVectorArrayMap<T> sample_sum(part_sum.data() + part_offset, C);
+            EigenVectorArrayMap<T> sample_square_sum(
+                part_square_sum.data() + part_offset, C);
+            sample_sum.setZero();
+            sample_square_sum.setZero();
+            for (int n = 0; n < rows; ++n) {
+              sample_sum += x_arr.col(n);
+              sample_square_sum += (x_arr.col(n) - means_arr).square();
+            }
           }
+        };
+        DataNormRunRowBlocks(N, block_num, grad_rows);
 
-          for (int i = 0; i < item_size; i += slot_dim) {
-            for (int j = i; j < i + slot_dim; ++j) {
-              if (d_batch_size_data[j] >= 1) {
-                d_batch_sum_data[j] /= d_batch_size_data[j];
-                d_batch_square_sum_data[j] =
-                    d_batch_square_sum_data[j] / d_batch_size_data[j] +
-                    d_batch_size_data[j] * epsilon;
-                d_batch_size_data[j] = 1;
-              }
+        if (scale_grad) {
+          DataNormReduceBlocks(part_dy_sum, block_num, C, d_bias_data);
+          DataNormReduceBlocks(part_dy_x_sum, block_num, C, d_scale_data);
+        }
+        DataNormReduceBlocks(part_sum, block_num, C, d_batch_sum_data);
+        DataNormReduceBlocks(
+            part_square_sum, block_num, C, d_batch_square_sum_data);
+        if (slot_stats) {
+          DataNormReduceBlocks(part_count, block_num, C, d_batch_size_data);
+          for (int j = 0; j < item_size; ++j) {
+            if (d_batch_size_data[j] >= 1) {
+              d_batch_sum_data[j] /= d_batch_size_data[j];
+              d_batch_square_sum_data[j] =
+                  d_batch_square_sum_data[j] / d_batch_size_data[j] +
+                  d_batch_size_data[j] * epsilon;
+              d_batch_size_data[j] = 1;
             }
           }
         } else {
-          // calculate data sum and squre sum
-          Eigen::Array<T, Eigen::Dynamic, 1> sample_sum(C);
-          Eigen::Array<T, Eigen::Dynamic, 1> sample_square_sum(C);
-          // calculate data sample sum and square sum
-          sample_sum.setZero();
-          sample_square_sum.setZero();
-          for (int nc = 0; nc < N; ++nc) {
-            sample_sum += x_arr.col(nc);
-            sample_square_sum += (x_arr.col(nc) - means_arr).square();
-          }
           // calculate gradient
           d_batch_size_arr.setConstant(N);
-          d_batch_sum_arr = sample_sum;
-          d_batch_square_sum_arr =
-              sample_square_sum + d_batch_size_arr * epsilon;
+          d_batch_square_sum_arr += d_batch_size_arr * epsilon;
         }
         break;
       }
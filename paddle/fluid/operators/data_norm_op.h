@@ -13,12 +13,65 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 #pragma once
+#include <algorithm>
+#include <vector>
+
+#include "gflags/gflags.h"
 #include "paddle/fluid/framework/eigen.h"
 #include "paddle/fluid/framework/op_registry.h"
+#include "paddle/fluid/framework/threadpool.h"
+
+DECLARE_int32(data_norm_cpu_thread_num);
 
 namespace paddle {
 namespace operators {
 
+// a cpu row block holds at least this many elements
+constexpr int64_t kDataNormMinBlockSize = 1 << 15;
+
+// The CPU kernels of data_norm and masked_data_norm split the N rows into
+// blocks. Each block writes its own partial statistics, the blocks run on the
+// cpu thread pool when the batch is large enough.
+inline int DataNormRowBlockNum(int n, int c) {
+  int64_t num = std::min<int64_t>(FLAGS_data_norm_cpu_thread_num,
+                                  static_cast<int64_t>(n) * c /
+                                      kDataNormMinBlockSize);
+  return static_cast<int>(std::max<int64_t>(std::min<int64_t>(num, n), 1));
+}
+
+// func(block, begin_row, end_row)
+template <typename Func>
+void DataNormRunRowBlocks(int n, int block_num, Func&& func) {
+  if (block_num <= 1) {
+    func(0, 0, n);
+    return;
+  }
+  framework::parallel_run_dynamic(
+      block_num,
+      [n, block_num, &func](const size_t& block) {
+        size_t begin = 0;
+        size_t end = 0;
+        framework::split_region(n, block_num, block, &begin, &end);
+        func(block, static_cast<int>(begin), static_cast<int>(end));
+      },
+      block_num);
+}
+
+// sum the block_num partials of size c into out
+template <typename T>
+void DataNormReduceBlocks(const std::vector<T>& partials,
+                          int block_num,
+                          int c,
+                          T* out) {
+  std::copy(partials.begin(), partials.begin() + c, out);
+  for (int b = 1; b < block_num; ++b) {
+    const T* part = partials.data() + static_cast<size_t>(b) * c;
+    for (int i = 0; i < c; ++i) {
+      out[i] += part[i];
+    }
+  }
+}
+
 template <typename DeviceContext, typename T>
 class DataNormKernel : public framework::OpKernel<T> {
  public:
@@ -0,0 +1,309 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "paddle/fluid/framework/op_registry.h"
+#include "paddle/fluid/framework/operator.h"
+#include "paddle/fluid/framework/scope.h"
+#include "paddle/fluid/platform/timer.h"
+
+namespace f = paddle::framework;
+namespace p = paddle::platform;
+
+USE_OP_ITSELF(data_norm);
+USE_OP_ITSELF(masked_data_norm);
+
+DECLARE_int32(data_norm_cpu_thread_num);
+
+static void SetTensor(f::Scope* scope,
+                      const std::string& name,
+                      const std::vector<int64_t>& dims,
+                      const std::vector<float>& data) {
+  auto* tensor = scope->Var(name)->GetMutable<f::LoDTensor>();
+  tensor->Resize(phi::make_ddim(dims));
+  float* ptr = tensor->mutable_data<float>(p::CPUPlace());
+  std::copy(data.begin(), data.end(), ptr);
+}
+
+static std::vector<float> GetTensor(const f::Scope& scope,
+                                    const std::string& name) {
+  auto& tensor = scope.FindVar(name)->Get<f::LoDTensor>();
+  const float* ptr = tensor.data<float>();
+  return std::vector<float>(ptr, ptr + tensor.numel());
+}
+
+static std::vector<float> RandomVec(size_t n, float lower, float upper) {
+  static std::mt19937 rng(0);
+  std::uniform_real_distribution<float> dist(lower, upper);
+  std::vector<float> vec(n);
+  for (auto& v : vec) {
+    v = dist(rng);
+  }
+  return vec;
+}
+
+static void ExpectNear(const std::vector<float>& a,
+                       const std::vector<float>& b,
+                       float eps) {
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    ASSERT_NEAR(a[i], b[i], eps * std::max(1.f, std::fabs(b[i])))
+        << " at index: " << i;
+  }
+}
+
+struct DataNormCase {
+  int n;
+  int c;
+  std::vector<float> x;
+  std::vector<float> dy;
+  std::vector<bool> mask;
+  std::vector<float> batch_size;
+  std::vector<float> batch_sum;
+  std::vector<float> batch_square_sum;
+};
+
+static DataNormCase MakeCase(int n, int c, int slot_dim) {
+  DataNormCase dn;
+  dn.n = n;
+  dn.c = c;
+  dn.x = RandomVec(n * c, -1.f, 1.f);
+  dn.dy = RandomVec(n * c, -1.f, 1.f);
+  auto mask = RandomVec(n, 0.f, 1.f);
+  for (int k = 0; k < n; ++k) {
+    dn.mask.push_back(mask[k] > 0.3f);
+    // zero shows of some slots
+    if (slot_dim > 0 && mask[k] < 0.2f) {
+      for (int i = 0; i < c; i += slot_dim) {
+        dn.x[k * c + i] = 0.f;
+      }
+    }
+  }
+  dn.batch_size = RandomVec(c, 1000.f, 2000.f);
+  dn.batch_sum = RandomVec(c, -100.f, 100.f);
+  dn.batch_square_sum = RandomVec(c, 1000.f, 2000.f);
+  return dn;
+}
+
+static void PrepareScope(const DataNormCase& dn, f::Scope* scope) {
+  SetTensor(scope, "X", {dn.n, dn.c}, dn.x);
+  SetTensor(scope, "Y@GRAD", {dn.n, dn.c}, dn.dy);
+  SetTensor(scope, "BatchSize", {dn.c}, dn.batch_size);
+  SetTensor(scope, "BatchSum", {dn.c}, dn.batch_sum);
+  SetTensor(scope, "BatchSquareSum", {dn.c}, dn.batch_square_sum);
+  auto* mask = scope->Var("Mask")->GetMutable<f::LoDTensor>();
+  mask->Resize({dn.n, 1});
+  bool* mask_data = mask->mutable_data<bool>(p::CPUPlace());
+  for (int k = 0; k < dn.n; ++k) {
+    mask_data[k] = dn.mask[k];
+  }
+  for (auto name : {"Y",
+                    "Means",
+                    "Scales",
+                    "X@GRAD",
+                    "BatchSize@GRAD",
+                    "BatchSum@GRAD",
+                    "BatchSquareSum@GRAD"}) {
+    scope->Var(name)->GetMutable<f::LoDTensor>();
+  }
+}
+
+static f::AttributeMap DataNormAttrs(int slot_dim) {
+  f::AttributeMap attrs;
+  attrs["epsilon"] = 1e-4f;
+  attrs["slot_dim"] = slot_dim;
+  attrs["summary_decay_rate"] = 0.9999999f;
+  attrs["enable_scale_and_shift"] = false;
+  attrs["data_layout"] = std::string("NCHW");
+  attrs["sync_stats"] = false;
+  attrs["update_norm"] = true;
+  attrs["use_mkldnn"] = false;
+  return attrs;
+}
+
+static void RunDataNorm(const std::string& type,
+                        int slot_dim,
+                        f::Scope* scope) {
+  f::VariableNameMap inputs = {{"X", {"X"}},
+                               {"BatchSize", {"BatchSize"}},
+                               {"BatchSum", {"BatchSum"}},
+                               {"BatchSquareSum", {"BatchSquareSum"}}};
+  if (type == "masked_data_norm") {
+    inputs["Mask"] = {"Mask"};
+  }
+  auto attrs = DataNormAttrs(slot_dim);
+  auto op = f::OpRegistry::CreateOp(
+      type,
+      inputs,
+      {{"Y", {"Y"}}, {"Means", {"Means"}}, {"Scales", {"Scales"}}},
+      attrs);
+  op->Run(*scope, p::CPUPlace());
+
+  inputs["Y@GRAD"] = {"Y@GRAD"};
+  inputs["Means"] = {"Means"};
+  inputs["Scales"] = {"Scales"};
+  auto grad_op = f::OpRegistry::CreateOp(
+      type + "_grad",
+      inputs,
+      {{"X@GRAD", {"X@GRAD"}},
+       {"BatchSize", {"BatchSize"}},
+       {"BatchSum", {"BatchSum"}},
+       {"BatchSquareSum", {"BatchSquareSum"}},
+       {"BatchSize@GRAD", {"BatchSize@GRAD"}},
+       {"BatchSum@GRAD", {"BatchSum@GRAD"}},
+       {"BatchSquareSum@GRAD", {"BatchSquareSum@GRAD"}}},
+      attrs);
+  grad_op->Run(*scope, p::CPUPlace());
+}
+
+// reference of the forward and the statistics grads
+static void DataNormRef(const DataNormCase& dn,
+                        int slot_dim,
+                        bool masked,
+                        std::vector<float>* y,
+                        std::vector<float>* dx,
+                        std::vector<float>* d_size,
+                        std::vector<float>* d_sum,
+                        std::vector<float>* d_square_sum) {
+  const int n = dn.n;
+  const int c = dn.c;
+  const float eps = 1e-4f;
+  std::vector<float> means(c), scales(c);
+  for (int j = 0; j < c; ++j) {
+    means[j] = dn.batch_sum[j] / dn.batch_size[j];
+    scales[j] = std::sqrt(dn.batch_size[j] / dn.batch_square_sum[j]);
+  }
+  y->assign(n * c, 0.f);
+  dx->assign(n * c, 0.f);
+  std::vector<double> cnt(c, 0), sum(c, 0), sq(c, 0);
+  for (int k = 0; k < n; ++k) {
+    for (int j = 0; j < c; ++j) {
+      bool keep = true;
+      if (masked) {
+        keep = dn.mask[k];
+      } else if (slot_dim > 0) {
+        float show = dn.x[k * c + j / slot_dim * slot_dim];
+        keep = !(show > -1e-7f && show < 1e-7f);
+      }
+      float x = dn.x[k * c + j];
+      // data_norm without slot_dim normalizes all rows, its x grad never
+      // skips zero shows
+      if (keep || (!masked && slot_dim <= 0)) {
+        (*y)[k * c + j] = (x - means[j]) * scales[j];
+      }
+      if (keep || !masked) {
+        (*dx)[k * c + j] = dn.dy[k * c + j] * scales[j];
+      }
+      if (keep) {
+        cnt[j] += 1;
+        sum[j] += x;
+        sq[j] += (x - means[j]) * (x - means[j]);
+      }
+    }
+  }
+  d_size->resize(c);
+  d_sum->resize(c);
+  d_square_sum->resize(c);
+  for (int j = 0; j < c; ++j) {
+    if (!masked && slot_dim <= 0) {
+      (*d_size)[j] = n;
+      (*d_sum)[j] = sum[j];
+      (*d_square_sum)[j] = sq[j] + n * eps;
+    } else if (cnt[j] > 0) {
+      (*d_size)[j] = 1;
+      (*d_sum)[j] = sum[j] / cnt[j];
+      (*d_square_sum)[j] = sq[j] / cnt[j] + (masked ? eps : cnt[j] * eps);
+    } else {
+      (*d_size)[j] = 0;
+      (*d_sum)[j] = 0;
+      (*d_square_sum)[j] = 0;
+    }
+  }
+}
+
+static void TestDataNorm(const std::string& type, int slot_dim) {
+  const bool masked = type == "masked_data_norm";
+  // the large case runs in several row blocks
+  for (int n : {1, 37, 4096}) {
+    const int c = 40;
+    auto dn = MakeCase(n, c, slot_dim);
+    std::vector<float> y, dx, d_size, d_sum, d_square_sum;
+    DataNormRef(dn, slot_dim, masked, &y, &dx, &d_size, &d_sum, &d_square_sum);
+    for (int thread_num : {1, 4}) {
+      FLAGS_data_norm_cpu_thread_num = thread_num;
+      f::Scope scope;
+      PrepareScope(dn, &scope);
+      RunDataNorm(type, slot_dim, &scope);
+      ExpectNear(GetTensor(scope, "Y"), y, 1e-5f);
+      ExpectNear(GetTensor(scope, "X@GRAD"), dx, 1e-5f);
+      ExpectNear(GetTensor(scope, "BatchSize@GRAD"), d_size, 1e-5f);
+      ExpectNear(GetTensor(scope, "BatchSum@GRAD"), d_sum, 1e-4f);
+      ExpectNear(GetTensor(scope, "BatchSquareSum@GRAD"), d_square_sum, 1e-4f);
+      if (masked) {
+        // update_norm decays the summary in place
+        auto batch_size = GetTensor(scope, "BatchSize");
+        for (int j = 0; j < c; ++j) {
+          float expect = d_size[j] > 0
+                             ? dn.batch_size[j] * 0.9999999f + d_size[j]
+                             : dn.batch_size[j];
+          ASSERT_NEAR(batch_size[j], expect, 1e-3f);
+        }
+      }
+    }
+  }
+  FLAGS_data_norm_cpu_thread_num = 4;
+}
+
+TEST(DataNorm, CPU) { TestDataNorm("data_norm", -1); }
+
+TEST(DataNorm, CPUSlotDim) { TestDataNorm("data_norm", 4); }
+
+TEST(MaskedDataNorm, CPU) { TestDataNorm("masked_data_norm", -1); }
+
+// forward and backward cost of one CTR sized batch
+TEST(DataNorm, CPUBenchmark) {
+  const int n = 2048;
+  const int c = 1024;
+  const int repeat = 10;
+  for (auto type : {"data_norm", "masked_data_norm"}) {
+    for (int slot_dim : {-1, 8}) {
+      if (std::string(type) == "masked_data_norm" && slot_dim > 0) {
+        continue;
+      }
+      auto dn = MakeCase(n, c, slot_dim);
+      for (int thread_num : {1, 4, 8}) {
+        FLAGS_data_norm_cpu_thread_num = thread_num;
+        f::Scope scope;
+        PrepareScope(dn, &scope);
+        RunDataNorm(type, slot_dim, &scope);
+        p::Timer timer;
+        timer.Start();
+        for (int r = 0; r < repeat; ++r) {
+          RunDataNorm(type, slot_dim, &scope);
+        }
+        timer.Pause();
+        LOG(INFO) << type << " slot_dim: " << slot_dim << ", batch: " << n
+                  << "x" << c << ", thread num: " << thread_num
+                  << ", forward and backward: " << timer.ElapsedUS() / repeat
+                  << "us";
+      }
+    }
+  }
+  FLAGS_data_norm_cpu_thread_num = 4;
+}
@@ -18,6 +18,7 @@ limitations under the License. */
 #else
 #include "paddle/fluid/framework/threadpool.h"
 #endif
+#include "paddle/fluid/operators/jit/kernels.h"
 #include <string>
 namespace paddle {
 namespace operators {
@@ -242,32 +243,6 @@ class FusedSeqpoolCVMGradOpMaker : public framework::SingleGradOpMaker<T> {
 
 using LoDTensor = framework::LoDTensor;
 
-#define CHECK_USE_QUANT  \
-    if (need_filter && quant_ratio > 0) { \
-     auto &show = input_data[k * embedding_size]; \
-     auto &click = input_data[k * embedding_size + 1]; \
-     if ((show - click) * show_coeff + click * clk_coeff < threshold) { \
-        continue; \
-     } \
-    }
-
-#define QUANT_VALUE(val)  \
-    (static_cast<int>(val * quant_ratio + 0.5) / static_cast<float>(quant_ratio));
-
-#define CHECK_QUANT_AND_GETVAL(in_val)  \
-    if (quant_ratio > 0) {  \
-      if (need_filter) { \
-        auto &show = input_data[k * embedding_size]; \
-        auto &click = input_data[k * embedding_size + 1]; \
-        if ((show - click) * show_coeff + click * clk_coeff < threshold) {  \
-           continue;  \
-        }  \
-      } \
-      val += QUANT_VALUE(in_val); \
-    } else { \
-      val += in_val; \
-    }
-
 template <typename T>
 class FusedSeqpoolCVMOpCPUKernel : public framework::OpKernel<T> {
  public:
@@ -290,6 +265,28 @@ class FusedSeqpoolCVMOpCPUKernel : public framework::OpKernel<T> {
 
     int batch_size = -1;
     int embedding_size = inputs[0]->numel() / inputs[0]->dims()[0];
+    int dim_size = embedding_size;
+    if (use_cvm) {
+      if (clk_filter) {
+        dim_size = embedding_size - 1;
+      }
+    } else {
+      dim_size = embedding_size - cvm_offset;
+    }
+    // pool and cvm of one ins in one jit kernel call, h is set per ins
+    const jit::seq_pool_cvm_attr_t attr(embedding_size,
+                                        cvm_offset,
+                                        use_cvm,
+                                        clk_filter,
+                                        quant_ratio,
+                                        need_filter,
+                                        show_coeff,
+                                        clk_coeff,
+                                        threshold,
+                                        padding_value);
+    auto seqpool_cvm =
+        jit::KernelFuncs<jit::SeqPoolCVMTuple<T>, platform::CPUPlace>::Cache()
+            .At(attr);
 #ifdef PADDLE_WITH_BOX_PS
     auto box_ptr = paddle::framework::BoxWrapper::GetInstance();
     box_ptr->ExecuteFunc(place, slot_size, [&](const size_t &i) {
@@ -310,82 +307,15 @@ class FusedSeqpoolCVMOpCPUKernel : public framework::OpKernel<T> {
 
       const T *input_data = reinterpret_cast<const T*>(input->data<T>());
       auto *output = outputs[i];
-      if (use_cvm) {
-        if (clk_filter) {
-          int dim_size = embedding_size - 1;
-          output->Resize({cur_batch, dim_size});
-          T *out_data = reinterpret_cast<T*>(output->mutable_data<T>(place));
-          // ins
-          for (int j = 0; j < cur_batch; ++j) {
-            auto &start = lod_data[j];
-            auto &end = lod_data[j + 1];
-            // show, embed, embedx
-            for (int dimx = 0; dimx < dim_size; ++dimx) {
-              double val = padding_value;
-              if (dimx == 0) { // show
-                for (auto k = start; k < end; ++k) {
-                  CHECK_USE_QUANT;
-                  val += input_data[k * embedding_size + dimx];
-                }
-                out_data[j * dim_size + dimx] = log(val + 1);
-              } else {
-                for (auto k = start; k < end; ++k) {
-                  CHECK_QUANT_AND_GETVAL(input_data[k * embedding_size + 1 + dimx]);
-                }
-                out_data[j * dim_size + dimx] = val;
-              }
-            }
-          }
-        } else {
-          output->Resize({cur_batch, embedding_size});
-          T *out_data = reinterpret_cast<T*>(output->mutable_data<T>(place));
-          // ins
-          for (int j = 0; j < cur_batch; ++j) {
-            auto &start = lod_data[j];
-            auto &end = lod_data[j + 1];
-            // show, click, embed, embedx
-            for (int dimx = 0; dimx < embedding_size; ++dimx) {
-              double val = padding_value;
-              if (dimx == 0) { // show
-                for (auto k = start; k < end; ++k) {
-                  CHECK_USE_QUANT;
-                  val += input_data[k * embedding_size + dimx];
-                }
-                out_data[j * embedding_size + dimx] = log(val + 1);
-              } else if (dimx == 1) { // ctr log(click) - log(show)
-                for (auto k = start; k < end; ++k) {
-                  CHECK_USE_QUANT;
-                  val += input_data[k * embedding_size + dimx];
-                }
-                out_data[j * embedding_size + dimx] = log(val + 1)
-                    - out_data[j * embedding_size];
-              } else {
-                for (auto k = start; k < end; ++k) {
-                  CHECK_QUANT_AND_GETVAL(input_data[k * embedding_size + dimx]);
-                }
-                out_data[j * embedding_size + dimx] = val;
-              }
-            }
-          }
-        }
-      } else {
-        int dim_size = embedding_size - cvm_offset;
-        output->Resize({cur_batch, dim_size});
-        // no cvm
-        T *out_data = reinterpret_cast<T*>(output->mutable_data<T>(place));
-        // ins
-        for (int j = 0; j < cur_batch; ++j) {
-          auto &start = lod_data[j];
-          auto &end = lod_data[j + 1];
-          // show, click, embed, embedx
-          for (int dimx = 0; dimx < dim_size; ++dimx) {
-            double val = padding_value;
-            for (auto k = start; k < end; ++k) {
-              CHECK_QUANT_AND_GETVAL(input_data[k * embedding_size + cvm_offset + dimx]);
-            }
-            out_data[j * dim_size + dimx] = val;
-          }
-        }
+      output->Resize({cur_batch, dim_size});
+      T *out_data = reinterpret_cast<T*>(output->mutable_data<T>(place));
+      jit::seq_pool_cvm_attr_t ins_attr = attr;
+      // ins
+      for (int j = 0; j < cur_batch; ++j) {
+        ins_attr.h = static_cast<int>(lod_data[j + 1] - lod_data[j]);
+        seqpool_cvm(input_data + lod_data[j] * embedding_size,
+                    out_data + j * dim_size,
+                    &ins_attr);
       }
     });
   }
@@ -281,6 +281,27 @@ void BenchKernelSeqPool() {
   }
 }
 
+template <typename KernelTuple, typename PlaceType>
+void BenchKernelSeqPoolCVM() {
+  using T = typename KernelTuple::data_type;
+  // the embedding width of BoxPS slots with show and click
+  for (int w : {11, 19, 67, 131}) {
+    for (bool clk_filter : {false, true}) {
+      jit::seq_pool_cvm_attr_t attr(w, 2, true, clk_filter);
+      for (int h : {1, 4, 16, 64}) {
+        attr.h = h;
+        Tensor x, y;
+        x.Resize({h * w});
+        y.Resize({w});
+        RandomVec<T>(h * w, x.mutable_data<T>(PlaceType()), 0.f, 2.f);
+        const T* x_data = x.data<T>();
+        T* y_data = y.mutable_data<T>(PlaceType());
+        BenchAllImpls<KernelTuple, PlaceType>(attr, x_data, y_data, &attr);
+      }
+    }
+  }
+}
+
 template <typename KernelTuple, typename PlaceType>
 void BenchKernelEmbSeqPool() {
   using T = typename KernelTuple::data_type;
@@ -569,6 +590,7 @@ BENCH_FP32_CPU(LayerNorm);
 BENCH_FP32_CPU(CRFDecoding);
 
 BENCH_FP32_CPU(SeqPool);
+BENCH_FP32_CPU(SeqPoolCVM);
 BENCH_FP32_CPU(EmbSeqPool);
 BENCH_FP32_CPU(MatMul);
 BENCH_FP32_CPU(Softmax);
@@ -0,0 +1,198 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "paddle/fluid/operators/jit/gen/seqpool_cvm.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "paddle/fluid/operators/jit/registry.h"
+#include "paddle/fluid/platform/cpu_info.h"
+
+namespace paddle {
+namespace operators {
+namespace jit {
+namespace gen {
+
+constexpr int kSeqPoolCVMPadReg = 15;
+constexpr int kSeqPoolCVMMaxRegs = 8;
+
+// called with a tail jump from the jitcode, y holds the summed show and click
+static void SeqPoolCVMShowClick(float* y) {
+  y[0] = std::log(y[0] + 1.f);
+  y[1] = std::log(y[1] + 1.f) - y[0];
+}
+
+static void SeqPoolCVMShow(float* y) { y[0] = std::log(y[0] + 1.f); }
+
+void SeqPoolCVMJitCode::pool_blocks(int src_offset,
+                                    int dst_offset,
+                                    int num_regs) {
+  for (int i = 0; i < num_regs; ++i) {
+    vmovaps(ymm_t(i), ymm_t(kSeqPoolCVMPadReg));
+  }
+  Label l_next_h, l_h_done;
+  cmp(reg32_int_h, 0);
+  jle(l_h_done, T_NEAR);
+  mov(reg32_h_i, 0);
+  mov(reg_ptr_src_i, param_src);
+  L(l_next_h);
+  {
+    for (int i = 0; i < num_regs; ++i) {
+      vaddps(ymm_t(i),
+             ymm_t(i),
+             ptr[reg_ptr_src_i + src_offset + i * YMM_FLOAT_BLOCK * 4]);
+    }
+    inc(reg32_h_i);
+    add(reg_ptr_src_i, w_ * sizeof(float));
+    cmp(reg32_h_i, reg32_int_h);
+    jl(l_next_h, T_NEAR);
+  }
+  L(l_h_done);
+  for (int i = 0; i < num_regs; ++i) {
+    vmovups(ptr[param_dst + dst_offset + i * YMM_FLOAT_BLOCK * 4], ymm_t(i));
+  }
+}
+
+void SeqPoolCVMJitCode::pool_rest(int src_offset, int dst_offset, int rest) {
+  const bool has_block4 = rest / 4 > 0;
+  const bool has_block2 = (rest % 4) / 2 > 0;
+  const bool has_block1 = (rest % 2) == 1;
+  // xmm0 for block4, xmm1 for block2 and xmm2 for block1, the unused upper
+  // lanes are never stored
+  for (int i = 0; i < 3; ++i) {
+    vmovaps(xmm_t(i), xmm_t(kSeqPoolCVMPadReg));
+  }
+  Label l_next_h, l_h_done;
+  cmp(reg32_int_h, 0);
+  jle(l_h_done, T_NEAR);
+  mov(reg32_h_i, 0);
+  mov(reg_ptr_src_i, param_src);
+  L(l_next_h);
+  {
+    int offset = src_offset;
+    if (has_block4) {
+      vmovups(xmm_t(8), ptr[reg_ptr_src_i + offset]);
+      vaddps(xmm_t(0), xmm_t(0), xmm_t(8));
+      offset += sizeof(float) * 4;
+    }
+    if (has_block2) {
+      vmovq(xmm_t(9), ptr[reg_ptr_src_i + offset]);
+      vaddps(xmm_t(1), xmm_t(1), xmm_t(9));
+      offset += sizeof(float) * 2;
+    }
+    if (has_block1) {
+      vmovss(xmm_t(10), ptr[reg_ptr_src_i + offset]);
+      vaddss(xmm_t(2), xmm_t(2), xmm_t(10));
+    }
+    inc(reg32_h_i);
+    add(reg_ptr_src_i, w_ * sizeof(float));
+    cmp(reg32_h_i, reg32_int_h);
+    jl(l_next_h, T_NEAR);
+  }
+  L(l_h_done);
+  int offset = dst_offset;
+  if (has_block4) {
+    vmovups(ptr[param_dst + offset], xmm_t(0));
+    offset += sizeof(float) * 4;
+  }
+  if (has_block2) {
+    vmovq(ptr[param_dst + offset], xmm_t(1));
+    offset += sizeof(float) * 2;
+  }
+  if (has_block1) {
+    vmovss(ptr[param_dst + offset], xmm_t(2));
+  }
+}
+
+void SeqPoolCVMJitCode::pool_columns(int src_col, int dst_col, int num) {
+  constexpr int block = YMM_FLOAT_BLOCK;
+  const int num_block = num / block;
+  int col = 0;
+  for (int b = 0; b < num_block; b += kSeqPoolCVMMaxRegs) {
+    int num_regs = std::min(kSeqPoolCVMMaxRegs, num_block - b);
+    pool_blocks((src_col + col) * sizeof(float),
+                (dst_col + col) * sizeof(float),
+                num_regs);
+    col += num_regs * block;
+  }
+  const int rest = num % block;
+  if (rest > 0) {
+    pool_rest(
+        (src_col + col) * sizeof(float), (dst_col + col) * sizeof(float), rest);
+  }
+}
+
+void SeqPoolCVMJitCode::genCode() {
+  mov(reg32_int_h, dword[param_attr]);
+  vbroadcastss(ymm_t(kSeqPoolCVMPadReg),
+               ptr[param_attr + offsetof(seq_pool_cvm_attr_t, pad_value)]);
+  if (use_cvm_) {
+    if (clk_filter_) {
+      // show, then skip click
+      pool_columns(0, 0, 1);
+      pool_columns(2, 1, w_ - 2);
+    } else {
+      pool_columns(0, 0, w_);
+    }
+  } else {
+    pool_columns(cvm_offset_, 0, w_ - cvm_offset_);
+  }
+  vzeroupper();
+  if (use_cvm_) {
+    // the C function returns to our caller, dst is its only argument
+    mov(param1, param_dst);
+    mov(reg_tmp,
+        reinterpret_cast<size_t>(clk_filter_ ? SeqPoolCVMShow
+                                             : SeqPoolCVMShowClick));
+    jmp(reg_tmp);
+  } else {
+    ret();
+  }
+}
+
+class SeqPoolCVMCreator : public JitCodeCreator<seq_pool_cvm_attr_t> {
+ public:
+  bool CanBeUsed(const seq_pool_cvm_attr_t& attr) const override {
+    return platform::MayIUse(platform::avx) && attr.quant_ratio <= 0;
+  }
+  size_t CodeSize(const seq_pool_cvm_attr_t& attr) const override {
+    return 96 + ((attr.w / YMM_FLOAT_BLOCK + 8 /* for rest */) *
+                     4 /* init, add and save */
+                 + 256) *
+                    16;
+  }
+  std::unique_ptr<GenBase> CreateJitCode(
+      const seq_pool_cvm_attr_t& attr) const override {
+    const int min_w = attr.use_cvm ? 2 : attr.cvm_offset + 1;
+    PADDLE_ENFORCE_GE(attr.w,
+                      min_w,
+                      platform::errors::InvalidArgument(
+                          "The attribute width of SeqPoolCVM should "
+                          "be at least %d. But it is %d.",
+                          min_w,
+                          attr.w));
+    return make_unique<SeqPoolCVMJitCode>(attr, CodeSize(attr));
+  }
+};
+
+}  // namespace gen
+}  // namespace jit
+}  // namespace operators
+}  // namespace paddle
+
+namespace gen = paddle::operators::jit::gen;
+
+REGISTER_JITKERNEL_GEN(kSeqPoolCVM, gen::SeqPoolCVMCreator);
@@ -0,0 +1,82 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#pragma once
+
+#include <string>
+
+#include "glog/logging.h"
+#include "paddle/fluid/operators/jit/gen/jitcode.h"
+#include "paddle/fluid/platform/enforce.h"
+
+namespace paddle {
+namespace operators {
+namespace jit {
+namespace gen {
+
+// Only the sum pool without quantization and show click filter is generated.
+// The columns are summed on top of the pad value straight into dst, then the
+// code jumps to a C function for the log of show and click.
+class SeqPoolCVMJitCode : public JitCode {
+ public:
+  explicit SeqPoolCVMJitCode(const seq_pool_cvm_attr_t& attr,
+                             size_t code_size = 256 * 1024,
+                             void* code_ptr = nullptr)
+      : JitCode(code_size, code_ptr),
+        w_(attr.w),
+        cvm_offset_(attr.cvm_offset),
+        use_cvm_(attr.use_cvm),
+        clk_filter_(attr.clk_filter) {
+    this->genCode();
+  }
+
+  std::string name() const override {
+    std::string base = "SeqPoolCVMJitCode";
+    if (use_cvm_) {
+      base += clk_filter_ ? "_ClkFilter" : "_CVM";
+    } else {
+      base += ("_NoCVM" + std::to_string(cvm_offset_));
+    }
+    base += ("_W" + std::to_string(w_));
+    return base;
+  }
+  void genCode() override;
+
+ protected:
+  // sum num columns from src_col of every row into num columns from dst_col
+  void pool_columns(int src_col, int dst_col, int num);
+  // sum num_regs ymm blocks, the offsets are in bytes
+  void pool_blocks(int src_offset, int dst_offset, int num_regs);
+  // sum the rest columns less than one ymm block
+  void pool_rest(int src_offset, int dst_offset, int rest);
+
+ private:
+  int w_;
+  int cvm_offset_;
+  bool use_cvm_;
+  bool clk_filter_;
+  reg64_t param_src{abi_param1};
+  reg64_t param_dst{abi_param2};
+  reg64_t param_attr{abi_param3};
+  reg64_t reg_tmp{rax};
+
+  reg32_t reg32_int_h{r8d};
+  reg32_t reg32_h_i{r10d};
+  reg64_t reg_ptr_src_i{r11};
+};
+
+}  // namespace gen
+}  // namespace jit
+}  // namespace operators
+}  // namespace paddle
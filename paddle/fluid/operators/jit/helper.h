@@ -271,6 +271,17 @@ inline std::ostream& operator<<(std::ostream& os, const seq_pool_attr_t& attr) {
   return os;
 }
 
+inline std::ostream& operator<<(std::ostream& os,
+                                const seq_pool_cvm_attr_t& attr) {
+  os << "height_size[" << attr.h << "],width_size[" << attr.w
+     << "],cvm_offset[" << attr.cvm_offset << "],use_cvm["
+     << (attr.use_cvm ? "True" : "False") << "],clk_filter["
+     << (attr.clk_filter ? "True" : "False") << "],quant_ratio["
+     << attr.quant_ratio << "],need_filter["
+     << (attr.need_filter ? "True" : "False") << "]";
+  return os;
+}
+
 inline std::ostream& operator<<(std::ostream& os,
                                 const emb_seq_pool_attr_t& attr) {
   os << "table_height[" << attr.table_height << "],table_width["
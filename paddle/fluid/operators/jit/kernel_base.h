@@ -40,6 +40,7 @@ typedef enum {
   kMatMul,
   kNCHW16CMulNC,
   kSeqPool,
+  kSeqPoolCVM,
   kSoftmax,
   kStrideASum,
   kStrideScal,
@@ -225,6 +226,50 @@ struct SeqPoolTuple {
   typedef void (*func_type)(const T*, T*, const seq_pool_attr_t*);
 };
 
+// sum pool of h rows with the cvm transform of fused_seqpool_cvm, the
+// output width is w with use_cvm, w - 1 with clk_filter and w - cvm_offset
+// without use_cvm
+typedef struct seq_pool_cvm_attr_s {
+  int h, w;  // h should always be the first one
+  int cvm_offset;
+  bool use_cvm, clk_filter;
+  int quant_ratio;
+  bool need_filter;
+  float show_coeff, clk_coeff, threshold;
+  float pad_value;
+  seq_pool_cvm_attr_s() = default;
+  explicit seq_pool_cvm_attr_s(int width,
+                               int cvm_off,
+                               bool cvm,
+                               bool clk_flt,
+                               int quant = 0,
+                               bool filter = false,
+                               float show_c = 0.f,
+                               float clk_c = 0.f,
+                               float thres = 0.f,
+                               float pad = 0.f,
+                               int height = 1)
+      : h(height),
+        w(width),
+        cvm_offset(cvm_off),
+        use_cvm(cvm),
+        clk_filter(clk_flt),
+        quant_ratio(quant),
+        need_filter(filter),
+        show_coeff(show_c),
+        clk_coeff(clk_c),
+        threshold(thres),
+        pad_value(pad) {}
+} seq_pool_cvm_attr_t;
+
+template <typename T>
+struct SeqPoolCVMTuple {
+  static constexpr KernelType kernel_type = kSeqPoolCVM;
+  typedef T data_type;
+  typedef seq_pool_cvm_attr_t attr_type;
+  typedef void (*func_type)(const T*, T*, const seq_pool_cvm_attr_t*);
+};
+
 typedef struct emb_seq_pool_attr_s {
   int64_t table_height, table_width;
   int64_t index_height, index_width;
@@ -51,6 +51,17 @@ int64_t JitCodeKey<seq_pool_attr_t>(const seq_pool_attr_t& attr) {
   return XXH64(keys, sizeof(int) * 2, 0);
 }
 
+template <>
+int64_t JitCodeKey<seq_pool_cvm_attr_t>(const seq_pool_cvm_attr_t& attr) {
+  int keys[6] = {attr.w,
+                 attr.cvm_offset,
+                 static_cast<int>(attr.use_cvm),
+                 static_cast<int>(attr.clk_filter),
+                 attr.quant_ratio,
+                 static_cast<int>(attr.need_filter)};
+  return XXH64(keys, sizeof(int) * 6, 0);
+}
+
 template <>
 int64_t JitCodeKey<matmul_attr_t>(const matmul_attr_t& attr) {
   return XXH64(&attr, sizeof(int) * 3, 0);  // m, n, k
@@ -0,0 +1,108 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "paddle/fluid/operators/jit/more/intrinsic/seqpool_cvm.h"
+
+#include <cmath>
+
+#include "paddle/fluid/operators/jit/refer/refer.h"
+#include "paddle/fluid/operators/jit/registry.h"
+#include "paddle/fluid/platform/cpu_info.h"
+
+namespace paddle {
+namespace operators {
+namespace jit {
+namespace more {
+namespace intrinsic {
+
+void SeqPoolCVM(const float* x, float* y, const seq_pool_cvm_attr_t* attr) {
+  constexpr int block = YMM_FLOAT_BLOCK;
+  int in_off = 0, out_off = 0;
+  refer::SeqPoolCVMOffsets(attr, &in_off, &out_off);
+  const int w = attr->w;
+  const int n = w - in_off;
+  const int end = n - n % block;
+  const bool use_quant = attr->quant_ratio > 0;
+  const bool use_filter = use_quant && attr->need_filter;
+  const float quant = static_cast<float>(attr->quant_ratio);
+  const float pad = attr->pad_value;
+  const __m256 quant_vec = _mm256_set1_ps(quant);
+  const __m256 half_vec = _mm256_set1_ps(0.5f);
+  const __m256 pad_vec = _mm256_set1_ps(pad);
+
+  float* dst = y + out_off;
+  int d = 0;
+  for (d = 0; d < end; d += block) {
+    _mm256_storeu_ps(dst + d, pad_vec);
+  }
+  for (; d < n; ++d) {
+    dst[d] = pad;
+  }
+  float show = pad, click = pad;
+  for (int h = 0; h < attr->h; ++h) {
+    const float* row = x + h * w;
+    if (use_filter && (row[0] - row[1]) * attr->show_coeff +
+                              row[1] * attr->clk_coeff <
+                          attr->threshold) {
+      continue;
+    }
+    if (attr->use_cvm) {
+      show += row[0];
+      click += row[1];
+    }
+    const float* src = row + in_off;
+    if (use_quant) {
+      // the same rounding as the refer: int(v * quant + 0.5) / quant
+      for (d = 0; d < end; d += block) {
+        __m256 tmp = _mm256_add_ps(
+            _mm256_mul_ps(_mm256_loadu_ps(src + d), quant_vec), half_vec);
+        tmp = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvttps_epi32(tmp)),
+                            quant_vec);
+        _mm256_storeu_ps(dst + d, _mm256_add_ps(_mm256_loadu_ps(dst + d), tmp));
+      }
+      for (; d < n; ++d) {
+        dst[d] += static_cast<int>(src[d] * quant + 0.5f) / quant;
+      }
+    } else {
+      for (d = 0; d < end; d += block) {
+        _mm256_storeu_ps(dst + d,
+                         _mm256_add_ps(_mm256_loadu_ps(dst + d),
+                                       _mm256_loadu_ps(src + d)));
+      }
+      for (; d < n; ++d) {
+        dst[d] += src[d];
+      }
+    }
+  }
+  if (attr->use_cvm) {
+    y[0] = std::log(show + 1.f);
+    if (!attr->clk_filter) {
+      y[1] = std::log(click + 1.f) - y[0];
+    }
+  }
+}
+
+bool SeqPoolCVMKernel::CanBeUsed(const seq_pool_cvm_attr_t& attr) const {
+  return platform::MayIUse(platform::avx);
+}
+
+}  // namespace intrinsic
+}  // namespace more
+}  // namespace jit
+}  // namespace operators
+}  // namespace paddle
+
+namespace intrinsic = paddle::operators::jit::more::intrinsic;
+
+REGISTER_JITKERNEL_MORE(kSeqPoolCVM, intrinsic, intrinsic::SeqPoolCVMKernel);
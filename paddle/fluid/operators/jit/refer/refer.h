@@ -389,6 +389,59 @@ void SeqPool(const T* x, T* y, const seq_pool_attr_t* attr) {
   }
 }
 
+// The pooled columns start from in_off of x and out_off of y, the columns
+// before out_off are the cvm of the summed show and click.
+inline void SeqPoolCVMOffsets(const seq_pool_cvm_attr_t* attr,
+                              int* in_off,
+                              int* out_off) {
+  if (attr->use_cvm) {
+    *in_off = 2;
+    *out_off = attr->clk_filter ? 1 : 2;
+  } else {
+    *in_off = attr->cvm_offset;
+    *out_off = 0;
+  }
+}
+
+// Every column is summed in double like the former fused_seqpool_cvm cpu
+// kernel, the faster kernels sum in T and differ by the rounding of the sum.
+template <typename T>
+void SeqPoolCVM(const T* x, T* y, const seq_pool_cvm_attr_t* attr) {
+  int in_off = 0, out_off = 0;
+  SeqPoolCVMOffsets(attr, &in_off, &out_off);
+  const int w = attr->w;
+  const int n = w - in_off;
+  const bool use_quant = attr->quant_ratio > 0;
+  const bool use_filter = use_quant && attr->need_filter;
+  const T quant = static_cast<T>(attr->quant_ratio);
+  auto pool = [&](int col, bool quant_col) {
+    double val = attr->pad_value;
+    for (int h = 0; h < attr->h; ++h) {
+      const T* row = x + h * w;
+      if (use_filter && (row[0] - row[1]) * attr->show_coeff +
+                                row[1] * attr->clk_coeff <
+                            attr->threshold) {
+        continue;
+      }
+      if (quant_col && use_quant) {
+        val += static_cast<int>(row[col] * quant + 0.5) / quant;
+      } else {
+        val += row[col];
+      }
+    }
+    return val;
+  };
+  for (int d = 0; d < n; ++d) {
+    y[out_off + d] = static_cast<T>(pool(in_off + d, true));
+  }
+  if (attr->use_cvm) {
+    y[0] = static_cast<T>(std::log(pool(0, false) + 1));
+    if (!attr->clk_filter) {
+      y[1] = static_cast<T>(std::log(pool(1, false) + 1) - y[0]);
+    }
+  }
+}
+
 // A(M,K) * B(K,N) = C(M,N)
 template <typename T>
 void MatMul(const T* A, const T* B, T* C, const matmul_attr_t* attr) {
@@ -686,6 +739,7 @@ DECLARE_REFER_KERNEL(CRFDecoding);
 DECLARE_REFER_KERNEL(LayerNorm);
 DECLARE_REFER_KERNEL(NCHW16CMulNC);
 DECLARE_REFER_KERNEL(SeqPool);
+DECLARE_REFER_KERNEL(SeqPoolCVM);
 DECLARE_REFER_KERNEL(MatMul);
 DECLARE_REFER_KERNEL(Softmax);
 DECLARE_REFER_KERNEL(EmbSeqPool);
@@ -14,6 +14,7 @@ limitations under the License. */
 
 #include <iostream>
 #include <random>
+#include <tuple>
 
 #include "gflags/gflags.h"
 #include "glog/logging.h"
@@ -665,6 +666,159 @@ void TestKernelSeqPool() {
   }
 }
 
+template <typename KernelTuple, typename PlaceType>
+void TestKernelSeqPoolCVM() {
+  using T = typename KernelTuple::data_type;
+  VLOG(10) << "Test JITKernel: " << jit::to_string(KernelTuple::kernel_type);
+  // use_cvm, clk_filter, quant_ratio, need_filter
+  std::vector<std::tuple<bool, bool, int, bool>> configs = {
+      std::make_tuple(true, false, 0, false),
+      std::make_tuple(true, true, 0, false),
+      std::make_tuple(false, false, 0, false),
+      std::make_tuple(true, false, 128, true),
+      std::make_tuple(false, false, 128, false)};
+  const int cvm_offset = 2;
+  for (auto& config : configs) {
+    for (int w : {3, 4, 11, 19, 40, 131}) {
+      jit::seq_pool_cvm_attr_t attr(w,
+                                    cvm_offset,
+                                    std::get<0>(config),
+                                    std::get<1>(config),
+                                    std::get<2>(config),
+                                    std::get<3>(config),
+                                    0.2f,
+                                    1.f,
+                                    0.5f,
+                                    0.1f);
+      int out_w = w - cvm_offset;
+      if (attr.use_cvm) {
+        out_w = attr.clk_filter ? w - 1 : w;
+      }
+      for (int h : {0, 1, 2, 7, 16, 100}) {
+        attr.h = h;
+        auto ref = jit::GetReferFunc<KernelTuple>();
+        EXPECT_TRUE(ref != nullptr);
+        // show and click are not negative
+        std::vector<T> x(h * w), yref(out_w);
+        RandomVec<T>(h * w, x.data(), 0.f, 2.f);
+        ref(x.data(), yref.data(), &attr);
+        VLOG(10) << attr;
+        // the refer sums in double, the others in T
+        auto verifier = [](const typename KernelTuple::func_type tgt,
+                           const std::vector<T>& x,
+                           const std::vector<T>& yref,
+                           const typename KernelTuple::attr_type& attr) {
+          EXPECT_TRUE(tgt != nullptr);
+          std::vector<T> y(yref.size());
+          tgt(x.data(), y.data(), &attr);
+          for (size_t i = 0; i < yref.size(); ++i) {
+            EXPECT_NEAR(y[i],
+                        yref[i],
+                        FLAGS_acc * std::max<T>(1, std::abs(yref[i])))
+                << " at index : " << i;
+          }
+        };
+        TestAllImpls<KernelTuple, PlaceType>(attr, verifier, x, yref, attr);
+      }
+    }
+  }
+}
+
+// the pooling of one ins of the fused_seqpool_cvm cpu kernel before the jit
+// kernel, summed in double
+static void FormerSeqPoolCVM(const float* x,
+                             float* y,
+                             const jit::seq_pool_cvm_attr_t& attr) {
+  auto filtered = [&](const float* row) {
+    return attr.need_filter && attr.quant_ratio > 0 &&
+           (row[0] - row[1]) * attr.show_coeff + row[1] * attr.clk_coeff <
+               attr.threshold;
+  };
+  auto pool = [&](int col, bool quant_col) {
+    double val = attr.pad_value;
+    for (int k = 0; k < attr.h; ++k) {
+      const float* row = x + k * attr.w;
+      if (filtered(row)) {
+        continue;
+      }
+      if (quant_col && attr.quant_ratio > 0) {
+        val += static_cast<int>(row[col] * attr.quant_ratio + 0.5) /
+               static_cast<float>(attr.quant_ratio);
+      } else {
+        val += row[col];
+      }
+    }
+    return val;
+  };
+  if (!attr.use_cvm) {
+    for (int d = 0; d < attr.w - attr.cvm_offset; ++d) {
+      y[d] = pool(attr.cvm_offset + d, true);
+    }
+  } else if (attr.clk_filter) {
+    y[0] = log(pool(0, false) + 1);
+    for (int d = 1; d < attr.w - 1; ++d) {
+      y[d] = pool(1 + d, true);
+    }
+  } else {
+    y[0] = log(pool(0, false) + 1);
+    y[1] = log(pool(1, false) + 1) - y[0];
+    for (int d = 2; d < attr.w; ++d) {
+      y[d] = pool(d, true);
+    }
+  }
+}
+
+// the refer kernel gives the values of the former cpu kernel, the kernel the
+// op picks is within the float rounding of the sums
+TEST(JITKernel_SeqPoolCVM, former_cpu_kernel) {
+  // use_cvm, clk_filter, quant_ratio, need_filter
+  std::vector<std::tuple<bool, bool, int, bool>> configs = {
+      std::make_tuple(true, false, 0, false),
+      std::make_tuple(true, true, 0, false),
+      std::make_tuple(false, false, 0, false),
+      std::make_tuple(true, false, 128, true),
+      std::make_tuple(true, true, 128, false),
+      std::make_tuple(false, false, 128, true)};
+  auto ref = jit::GetReferFunc<jit::SeqPoolCVMTuple<float>>();
+  EXPECT_TRUE(ref != nullptr);
+  for (auto& config : configs) {
+    for (int w : {3, 11, 40, 131}) {
+      jit::seq_pool_cvm_attr_t attr(w,
+                                    2,
+                                    std::get<0>(config),
+                                    std::get<1>(config),
+                                    std::get<2>(config),
+                                    std::get<3>(config),
+                                    0.2f,
+                                    1.f,
+                                    0.5f,
+                                    0.1f);
+      int out_w = w - 2;
+      if (attr.use_cvm) {
+        out_w = attr.clk_filter ? w - 1 : w;
+      }
+      auto tgt =
+          jit::KernelFuncs<jit::SeqPoolCVMTuple<float>, CPUPlace>::Cache().At(
+              attr);
+      for (int h : {0, 1, 7, 100, 1000}) {
+        attr.h = h;
+        std::vector<float> x(h * w), former(out_w), yref(out_w), y(out_w);
+        RandomVec<float>(h * w, x.data(), 0.f, 2.f);
+        FormerSeqPoolCVM(x.data(), former.data(), attr);
+        ref(x.data(), yref.data(), &attr);
+        tgt(x.data(), y.data(), &attr);
+        for (int i = 0; i < out_w; ++i) {
+          EXPECT_EQ(yref[i], former[i]) << " at index : " << i;
+          EXPECT_NEAR(y[i],
+                      former[i],
+                      FLAGS_acc * std::max(1.f, std::abs(former[i])))
+              << " at index : " << i;
+        }
+      }
+    }
+  }
+}
+
 template <typename KernelTuple, typename PlaceType>
 void TestKernelEmbSeqPool() {
   using T = typename KernelTuple::data_type;
@@ -1428,7 +1582,8 @@ TEST(JITKernel_helper, attr) {
       << jit::to_string(jit::kLSTMCtHt) << jit::to_string(jit::kLSTMC1H1)
       << jit::to_string(jit::kLayerNorm) << jit::to_string(jit::kMatMul)
       << jit::to_string(jit::kNCHW16CMulNC) << jit::to_string(jit::kSeqPool)
-      << jit::to_string(jit::kSoftmax) << jit::to_string(jit::kVAdd)
+      << jit::to_string(jit::kSeqPoolCVM) << jit::to_string(jit::kSoftmax)
+      << jit::to_string(jit::kVAdd)
       << jit::to_string(jit::kVAddBias) << jit::to_string(jit::kVAddRelu)
       << jit::to_string(jit::kVBroadcast) << jit::to_string(jit::kVCopy)
       << jit::to_string(jit::kVExp) << jit::to_string(jit::kVIdentity)
@@ -1437,7 +1592,7 @@ TEST(JITKernel_helper, attr) {
       << jit::to_string(jit::kAdam) << jit::to_string(jit::kVSigmoid)
       << jit::to_string(jit::kVSquare) << jit::to_string(jit::kVSub)
       << jit::to_string(jit::kVTanh);
-  EXPECT_EQ(out.str().size(), 239UL);
+  EXPECT_EQ(out.str().size(), 250UL);
 
   // SeqPoolTypes
   out.str("");
@@ -1463,6 +1618,10 @@ TEST(JITKernel_helper, attr) {
   out << jit::seq_pool_attr_t(8, jit::SeqPoolType::kSum);
   EXPECT_EQ(out.str().size(), 44UL);
 
+  out.str("");
+  out << jit::seq_pool_cvm_attr_t(8, 2, true, false);
+  EXPECT_EQ(out.str().size(), 108UL);
+
   out.str("");
   out << jit::emb_seq_pool_attr_t(1, 2, 3, 4, 5, jit::SeqPoolType::kAvg);
   EXPECT_EQ(out.str().size(), 93UL);
@@ -1547,6 +1706,26 @@ TEST(JITKernel_key, seq_pool) {
   EXPECT_TRUE(key3 != key4);
 }
 
+TEST(JITKernel_key, seq_pool_cvm) {
+  jit::seq_pool_cvm_attr_t attr1(11, 2, true, false);
+  jit::seq_pool_cvm_attr_t attr2(11, 2, true, false, 0, false, 1.f, 2.f, 3.f);
+  jit::seq_pool_cvm_attr_t attr3(11, 2, true, true);
+  jit::seq_pool_cvm_attr_t attr4(11, 2, true, false, 128, true);
+  jit::seq_pool_cvm_attr_t attr5(12, 2, true, false);
+
+  auto key1 = jit::JitCodeKey<jit::seq_pool_cvm_attr_t>(attr1);
+  auto key2 = jit::JitCodeKey<jit::seq_pool_cvm_attr_t>(attr2);
+  auto key3 = jit::JitCodeKey<jit::seq_pool_cvm_attr_t>(attr3);
+  auto key4 = jit::JitCodeKey<jit::seq_pool_cvm_attr_t>(attr4);
+  auto key5 = jit::JitCodeKey<jit::seq_pool_cvm_attr_t>(attr5);
+
+  EXPECT_TRUE(key1 == key2);
+  EXPECT_TRUE(key1 != key3);
+  EXPECT_TRUE(key1 != key4);
+  EXPECT_TRUE(key1 != key5);
+  EXPECT_TRUE(key3 != key4);
+}
+
 TEST(JITKernel_key, matmul) {
   jit::matmul_attr_t attr1(1, 2, 3);
   jit::matmul_attr_t attr2(1, 2, 3);
@@ -1681,6 +1860,7 @@ TEST_CPU_KERNEL(LayerNorm);
 TEST_CPU_KERNEL(CRFDecoding);
 
 TEST_CPU_KERNEL(SeqPool);
+TEST_CPU_KERNEL(SeqPoolCVM);
 TEST_CPU_KERNEL(EmbSeqPool);
 TEST_CPU_KERNEL(MatMul);
 TEST_CPU_KERNEL(Softmax);
@@ -21,6 +21,7 @@ limitations under the License. */
 #include "paddle/fluid/framework/convert_utils.h"
 #include "paddle/fluid/framework/data_type.h"
 #include "paddle/fluid/framework/data_type_transform.h"
+#include "paddle/fluid/framework/mapped_tensor_file.h"
 #include "paddle/fluid/framework/op_registry.h"
 #include "paddle/fluid/framework/string_array.h"
 #include "paddle/fluid/framework/tensor_util.h"
@@ -44,7 +45,9 @@ class LoadCombineOpKernel : public framework::OpKernel<T> {
                           "The number of variables to be loaded is %d, expect "
                           "it to be greater than 0.",
                           out_var_names.size()));
-    if (!model_from_memory) {
+    if (!model_from_memory && framework::IsMappedTensorFile(filename)) {
+      LoadParamsFromMappedFile(ctx, place, filename, load_as_fp16);
+    } else if (!model_from_memory) {
       std::ifstream fin(filename, std::ios::binary);
       PADDLE_ENFORCE_EQ(
           static_cast<bool>(fin),
@@ -115,27 +118,7 @@ class LoadCombineOpKernel : public framework::OpKernel<T> {
 
         // Get data from fin to tensor
         paddle::framework::DeserializeFromStream(*buffer, tensor, dev_ctx);
-
-        auto in_dtype = framework::TransToProtoVarType(tensor->dtype());
-        auto out_dtype =
-            load_as_fp16 ? framework::proto::VarType::FP16 : in_dtype;
-
-        if (in_dtype != out_dtype) {
-          // convert to float16 tensor
-          auto in_kernel_type = framework::OpKernelType(in_dtype, place);
-          auto out_kernel_type = framework::OpKernelType(out_dtype, place);
-          framework::LoDTensor fp16_tensor;
-          // copy LoD info to the new tensor
-          fp16_tensor.set_lod(tensor->lod());
-          framework::TransDataType(
-              in_kernel_type, out_kernel_type, *tensor, &fp16_tensor);
-
-          // reset output tensor
-          out_vars[i]->Clear();
-          tensor = out_vars[i]->GetMutable<framework::LoDTensor>();
-          tensor->set_lod(fp16_tensor.lod());
-          tensor->ShareDataWith(fp16_tensor);
-        }
+        ConvertLoadedTensor(place, load_as_fp16, out_vars[i]);
       }
     }
     buffer->peek();
@@ -145,6 +128,69 @@ class LoadCombineOpKernel : public framework::OpKernel<T> {
                           "Not allowed to load partial data via "
                           "load_combine_op, please use load_op instead."));
   }
+
+  // the tensors of the mapped file are loaded by position as the stream
+  // format does, the cpu tensors use the mapped pages without a copy
+  void LoadParamsFromMappedFile(const framework::ExecutionContext &context,
+                                const platform::Place &place,
+                                const std::string &filename,
+                                bool load_as_fp16) const {
+    auto out_var_names = context.OutputNames("Out");
+    auto out_vars = context.MultiOutputVar("Out");
+    framework::MappedTensorFile mapped(filename);
+    PADDLE_ENFORCE_EQ(mapped.size(),
+                      out_var_names.size(),
+                      platform::errors::Unavailable(
+                          "Not allowed to load partial data via "
+                          "load_combine_op, the mapped file %s has %d "
+                          "tensors but %d variables are to be loaded.",
+                          filename,
+                          mapped.size(),
+                          out_var_names.size()));
+    for (size_t i = 0; i < out_var_names.size(); i++) {
+      VLOG(4) << "loading mapped tensor: " << out_var_names[i];
+      PADDLE_ENFORCE_NOT_NULL(
+          out_vars[i],
+          platform::errors::InvalidArgument(
+              "The variable %s to be loaded cannot be found.",
+              out_var_names[i]));
+      PADDLE_ENFORCE_EQ(out_vars[i]->IsType<framework::Vocab>(),
+                        false,
+                        platform::errors::InvalidArgument(
+                            "The mapped file %s only holds LoDTensor, the "
+                            "Vocab variable %s can not be loaded from it.",
+                            filename,
+                            out_var_names[i]));
+      auto *tensor = out_vars[i]->GetMutable<framework::LoDTensor>();
+      mapped.LoadTensor(i, place, tensor);
+      ConvertLoadedTensor(place, load_as_fp16, out_vars[i]);
+    }
+  }
+
+  void ConvertLoadedTensor(const platform::Place &place,
+                           bool load_as_fp16,
+                           framework::Variable *out_var) const {
+    auto *tensor = out_var->GetMutable<framework::LoDTensor>();
+    auto in_dtype = framework::TransToProtoVarType(tensor->dtype());
+    auto out_dtype = load_as_fp16 ? framework::proto::VarType::FP16 : in_dtype;
+
+    if (in_dtype != out_dtype) {
+      // convert to float16 tensor
+      auto in_kernel_type = framework::OpKernelType(in_dtype, place);
+      auto out_kernel_type = framework::OpKernelType(out_dtype, place);
+      framework::LoDTensor fp16_tensor;
+      // copy LoD info to the new tensor
+      fp16_tensor.set_lod(tensor->lod());
+      framework::TransDataType(
+          in_kernel_type, out_kernel_type, *tensor, &fp16_tensor);
+
+      // reset output tensor
+      out_var->Clear();
+      tensor = out_var->GetMutable<framework::LoDTensor>();
+      tensor->set_lod(fp16_tensor.lod());
+      tensor->ShareDataWith(fp16_tensor);
+    }
+  }
 };
 
 }  // namespace operators
@@ -16,8 +16,10 @@ limitations under the License. */
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "paddle/fluid/framework/data_layout.h"
+#include "paddle/fluid/operators/data_norm_op.h"
 #ifdef PADDLE_WITH_MKLDNN
 #include "paddle/fluid/platform/mkldnn_helper.h"
 #endif
@@ -305,9 +307,53 @@ template <typename T>
 class MaskedDataNormKernel<phi::CPUContext, T> : public framework::OpKernel<T> {
  public:
   void Compute(const framework::ExecutionContext &ctx) const override {
-    PADDLE_THROW(platform::errors::Unimplemented(
-        "Unimplemented kernel for MaskedDataNorm, only support GPU "
-        "now."));
+    const auto *x = ctx.Input<Tensor>("X");
+    const auto *mask = ctx.Input<Tensor>("Mask");
+    const auto &x_dims = x->dims();
+    PADDLE_ENFORCE_EQ(
+        x_dims.size(),
+        2,
+        platform::errors::PreconditionNotMet("The Input dim size should be 2"));
+    const int N = x_dims[0];
+    const int C = x_dims[1];
+    PADDLE_ENFORCE_EQ(
+        N,
+        mask->numel(),
+        platform::errors::InvalidArgument(
+            "Mask's numbers must be equal to X's N, "
+            "when X's N is %d. But Mask's numbers %d",
+            N, mask->numel()));
+
+    ConstEigenVectorArrayMap<T> b_size_arr(
+        ctx.Input<Tensor>("BatchSize")->data<T>(), C);
+    ConstEigenVectorArrayMap<T> b_sum_arr(
+        ctx.Input<Tensor>("BatchSum")->data<T>(), C);
+    ConstEigenVectorArrayMap<T> b_square_sum_arr(
+        ctx.Input<Tensor>("BatchSquareSum")->data<T>(), C);
+    EigenVectorArrayMap<T> means_arr(
+        ctx.Output<Tensor>("Means")->mutable_data<T>(ctx.GetPlace()), C);
+    EigenVectorArrayMap<T> scales_arr(
+        ctx.Output<Tensor>("Scales")->mutable_data<T>(ctx.GetPlace()), C);
+    means_arr = b_sum_arr / b_size_arr;
+    scales_arr = (b_size_arr / b_square_sum_arr).sqrt();
+
+    const T *x_data = x->data<T>();
+    const bool *mask_data = mask->data<bool>();
+    T *y_data = ctx.Output<Tensor>("Y")->mutable_data<T>(ctx.GetPlace());
+    DataNormRunRowBlocks(
+        N, DataNormRowBlockNum(N, C), [&](size_t block, int begin, int end) {
+          for (int k = begin; k < end; ++k) {
+            const int64_t offset = static_cast<int64_t>(k) * C;
+            EigenVectorArrayMap<T> y_row(y_data + offset, C);
+            if (mask_data[k]) {
+              y_row = (ConstEigenVectorArrayMap<T>(x_data + offset, C) -
+                       means_arr) *
+                      scales_arr;
+            } else {
+              y_row.setZero();
+            }
+          }
+        });
   }
 };
 
@@ -433,9 +479,116 @@ class MaskedDataNormGradKernel<phi::CPUContext, T>
     : public framework::OpKernel<T> {
  public:
   void Compute(const framework::ExecutionContext &ctx) const override {
-    PADDLE_THROW(platform::errors::Unimplemented(
-        "Unimplemented kernel for MaskedDataNorm, only support GPU "
-        "now."));
+    const auto *x = ctx.Input<Tensor>("X");
+    const auto *mask = ctx.Input<Tensor>("Mask");
+    const auto *d_y = ctx.Input<Tensor>(framework::GradVarName("Y"));
+    const auto *scales = ctx.Input<Tensor>("Scales");
+    const auto *means = ctx.Input<Tensor>("Means");
+    const float epsilon = ctx.Attr<float>("epsilon");
+    const float dr = ctx.Attr<float>("summary_decay_rate");
+    const bool update_norm = ctx.Attr<bool>("update_norm");
+
+    const auto &x_dims = x->dims();
+    PADDLE_ENFORCE_EQ(
+        x_dims.size(),
+        2,
+        platform::errors::PreconditionNotMet("The Input dim size should be 2"));
+    const int N = x_dims[0];
+    const int C = x_dims[1];
+
+    // init output
+    Tensor *d_x = nullptr;
+    if (ctx.HasOutput(framework::GradVarName("X"))) {
+      d_x = ctx.Output<Tensor>(framework::GradVarName("X"));
+    }
+    T *d_batch_size = ctx.Output<Tensor>(framework::GradVarName("BatchSize"))
+                          ->mutable_data<T>(ctx.GetPlace());
+    T *d_batch_sum = ctx.Output<Tensor>(framework::GradVarName("BatchSum"))
+                         ->mutable_data<T>(ctx.GetPlace());
+    T *d_batch_square_sum =
+        ctx.Output<Tensor>(framework::GradVarName("BatchSquareSum"))
+            ->mutable_data<T>(ctx.GetPlace());
+
+    ConstEigenVectorArrayMap<T> scales_arr(scales->data<T>(), C);
+    ConstEigenVectorArrayMap<T> means_arr(means->data<T>(), C);
+    const T *x_data = x->data<T>();
+    const T *dy_data = d_y->data<T>();
+    const bool *mask_data = mask->data<bool>();
+    T *d_x_data =
+        d_x != nullptr ? d_x->mutable_data<T>(ctx.GetPlace()) : nullptr;
+
+    // every row block writes its partial sums, they are reduced below
+    const int block_num = DataNormRowBlockNum(N, C);
+    std::vector<int> part_mask_num(block_num, 0);
+    std::vector<T> part_sum(static_cast<size_t>(block_num) * C);
+    std::vector<T> part_square_sum(static_cast<size_t>(block_num) * C);
+    DataNormRunRowBlocks(
+        N, block_num, [&](size_t block, int begin, int end) {
+          EigenVectorArrayMap<T> sum(part_sum.data() + block * C, C);
+          EigenVectorArrayMap<T> square_sum(
+              part_square_sum.data() + block * C, C);
+          sum.setZero();
+          square_sum.setZero();
+          int mask_num = 0;
+          for (int k = begin; k < end; ++k) {
+            const int64_t offset = static_cast<int64_t>(k) * C;
+            if (!mask_data[k]) {
+              if (d_x_data != nullptr) {
+                EigenVectorArrayMap<T>(d_x_data + offset, C).setZero();
+              }
+              continue;
+            }
+            if (d_x_data != nullptr) {
+              EigenVectorArrayMap<T>(d_x_data + offset, C) =
+                  ConstEigenVectorArrayMap<T>(dy_data + offset, C) *
+                  scales_arr;
+            }
+            ConstEigenVectorArrayMap<T> x_row(x_data + offset, C);
+            ++mask_num;
+            sum += x_row;
+            square_sum += (x_row - means_arr).square();
+          }
+          part_mask_num[block] = mask_num;
+        });
+
+    int mask_num = 0;
+    for (int b = 0; b < block_num; ++b) {
+      mask_num += part_mask_num[b];
+    }
+    DataNormReduceBlocks(part_sum, block_num, C, d_batch_sum);
+    DataNormReduceBlocks(part_square_sum, block_num, C, d_batch_square_sum);
+    EigenVectorArrayMap<T> d_batch_size_arr(d_batch_size, C);
+    EigenVectorArrayMap<T> d_batch_sum_arr(d_batch_sum, C);
+    EigenVectorArrayMap<T> d_batch_square_sum_arr(d_batch_square_sum, C);
+    if (mask_num > 0) {
+      d_batch_size_arr.setConstant(1);
+      d_batch_sum_arr /= static_cast<T>(mask_num);
+      d_batch_square_sum_arr =
+          d_batch_square_sum_arr / static_cast<T>(mask_num) +
+          static_cast<T>(epsilon);
+    } else {
+      d_batch_size_arr.setZero();
+      d_batch_sum_arr.setZero();
+      d_batch_square_sum_arr.setZero();
+    }
+    // sync_stats only applies to multi-GPU training, there is nothing to
+    // sync between the CPU kernels of one process
+
+    if (update_norm && mask_num > 0) {  // avoid empty decay
+      EigenVectorArrayMap<T> batch_size_arr(
+          ctx.Output<Tensor>("BatchSize")->mutable_data<T>(ctx.GetPlace()),
+          C);
+      EigenVectorArrayMap<T> batch_sum_arr(
+          ctx.Output<Tensor>("BatchSum")->mutable_data<T>(ctx.GetPlace()), C);
+      EigenVectorArrayMap<T> batch_square_sum_arr(
+          ctx.Output<Tensor>("BatchSquareSum")
+              ->mutable_data<T>(ctx.GetPlace()),
+          C);
+      batch_size_arr = batch_size_arr * static_cast<T>(dr) + d_batch_size_arr;
+      batch_sum_arr = batch_sum_arr * static_cast<T>(dr) + d_batch_sum_arr;
+      batch_square_sum_arr =
+          batch_square_sum_arr * static_cast<T>(dr) + d_batch_square_sum_arr;
+    }  // if !update_norm, will update norm param use BoxPSAsynDenseTable
   }
 };
 
@@ -14,6 +14,8 @@ limitations under the License. */
 
 #include "paddle/fluid/operators/math/selected_rows_functor.h"
 
+#include <algorithm>
+
 #include "paddle/fluid/framework/mixed_vector.h"
 #include "paddle/fluid/platform/device/device_wrapper.h"
 
@@ -21,6 +23,10 @@ limitations under the License. */
 #include "paddle/fluid/operators/mkldnn/axpy_handler.h"
 #endif
 
+#ifdef PADDLE_WITH_MKLML
+#include <omp.h>
+#endif
+
 namespace paddle {
 namespace operators {
 namespace math {
@@ -354,16 +360,106 @@ typename std::enable_if<std::is_integral<T>::value>::type elementwise_add_to(
   }
 }
 
+// The output rows of the distinct input rows of MergeAdd, in a flat open
+// addressing table with linear probing that is at most half full.
+class MergeRowMap {
+ public:
+  explicit MergeRowMap(size_t row_num) {
+    int bits = 4;
+    while ((static_cast<size_t>(1) << bits) < 2 * row_num) {
+      ++bits;
+    }
+    shift_ = 64 - bits;
+    mask_ = (static_cast<size_t>(1) << bits) - 1;
+    rows_.resize(mask_ + 1);
+    ids_.assign(mask_ + 1, static_cast<size_t>(kEmpty));
+  }
+
+  // returns false if row is inserted already
+  bool Insert(int64_t row) {
+    size_t slot = Find(row);
+    if (ids_[slot] != kEmpty) {
+      return false;
+    }
+    rows_[slot] = row;
+    ids_[slot] = 0;
+    return true;
+  }
+
+  // the output row of an inserted row
+  size_t& operator[](int64_t row) { return ids_[Find(row)]; }
+
+ private:
+  static constexpr size_t kEmpty = static_cast<size_t>(-1);
+
+  size_t Find(int64_t row) const {
+    size_t slot =
+        (static_cast<uint64_t>(row) * 0x9E3779B97F4A7C15ULL) >> shift_;
+    while (ids_[slot] != kEmpty && rows_[slot] != row) {
+      slot = (slot + 1) & mask_;
+    }
+    return slot;
+  }
+
+  int shift_;
+  size_t mask_;
+  std::vector<int64_t> rows_;
+  std::vector<size_t> ids_;
+};
+
+// Sorts the merged rows, by LSD radix sort of 16 bit digits when there are
+// many. A digit all the rows share is skipped, the rows of an embedding
+// table only differ in the low ones.
+static void SortMergedRows(std::vector<int64_t>* rows) {
+  const size_t kRadixSortMinSize = 1 << 16;
+  if (rows->size() < kRadixSortMinSize) {
+    std::sort(rows->begin(), rows->end());
+    return;
+  }
+  // the flipped sign bit puts the negative rows first
+  const uint64_t kSignBit = static_cast<uint64_t>(1) << 63;
+  std::vector<uint64_t> keys(rows->size());
+  std::vector<uint64_t> buffer(rows->size());
+  for (size_t i = 0; i < rows->size(); ++i) {
+    keys[i] = static_cast<uint64_t>((*rows)[i]) ^ kSignBit;
+  }
+  std::vector<size_t> offsets(1 << 16);
+  for (int shift = 0; shift < 64; shift += 16) {
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for (auto key : keys) {
+      ++offsets[(key >> shift) & 0xFFFF];
+    }
+    if (offsets[(keys[0] >> shift) & 0xFFFF] == keys.size()) {
+      continue;
+    }
+    size_t sum = 0;
+    for (auto& offset : offsets) {
+      size_t count = offset;
+      offset = sum;
+      sum += count;
+    }
+    for (auto key : keys) {
+      buffer[offsets[(key >> shift) & 0xFFFF]++] = key;
+    }
+    keys.swap(buffer);
+  }
+  for (size_t i = 0; i < rows->size(); ++i) {
+    (*rows)[i] = static_cast<int64_t>(keys[i] ^ kSignBit);
+  }
+}
+
+// out_ids holds the output row of every row of the inputs in turn
 template <typename T, typename DeviceContext>
 typename std::enable_if<std::is_same<T, platform::bfloat16>::value>::type
 add_sparse_inputs(const std::vector<const phi::SelectedRows*>& inputs,
-                  const std::unordered_map<int64_t, size_t>& rows_to_id,
+                  const std::vector<size_t>& out_ids,
                   int64_t input_width,
                   const DeviceContext& context,
                   T* out_data) {
 #ifndef PADDLE_WITH_MKLDNN
   auto blas = phi::funcs::GetBlas<DeviceContext, T>(context);
 #endif
+  size_t offset = 0;
   for (auto* input : inputs) {
     if (input->rows().size() == 0) {
       continue;
@@ -374,44 +470,63 @@ add_sparse_inputs(const std::vector<const phi::SelectedRows*>& inputs,
 #ifdef PADDLE_WITH_MKLDNN
     OneDNNAXPYHandler<T> axpy_handler(input_width, T(1.f));
     for (size_t i = 0; i < input_rows.size(); i++) {
-      size_t out_i = rows_to_id.at(input_rows[i]);
+      size_t out_i = out_ids[offset + i];
       axpy_handler(&input_data[i * input_width],
                    &out_data[out_i * input_width]);
     }
 #else
     for (size_t i = 0; i < input_rows.size(); i++) {
-      size_t out_i = rows_to_id.at(input_rows[i]);
+      size_t out_i = out_ids[offset + i];
       elementwise_add_to<T, DeviceContext>(&blas,
                                            static_cast<size_t>(input_width),
                                            &input_data[i * input_width],
                                            &out_data[out_i * input_width]);
     }
 #endif
+    offset += input_rows.size();
   }
 }
 
 template <typename T, typename DeviceContext>
 typename std::enable_if<!std::is_same<T, platform::bfloat16>::value>::type
 add_sparse_inputs(const std::vector<const phi::SelectedRows*>& inputs,
-                  const std::unordered_map<int64_t, size_t>& rows_to_id,
+                  const std::vector<size_t>& out_ids,
                   int64_t input_width,
                   const DeviceContext& context,
                   T* out_data) {
   VLOG(4) << "[CPU] add_sparse_inputs <" << typeid(T).name();
   auto blas = phi::funcs::GetBlas<DeviceContext, T>(context);
-  for (auto* input : inputs) {
-    if (input->rows().size() == 0) {
-      continue;
-    }
-    auto* input_data = input->value().data<T>();
-    auto& input_rows = input->rows();
+  // thread part adds to the output rows of out_i % part_num == part, so the
+  // threads never add to one row and a row adds its inputs in order
+  int part_num = 1;
+#ifdef PADDLE_WITH_MKLML
+  const int64_t kParallelMinNumel = 1 << 16;
+  if (static_cast<int64_t>(out_ids.size()) * input_width >=
+      kParallelMinNumel) {
+    part_num = omp_get_max_threads();
+  }
+#pragma omp parallel for
+#endif
+  for (int part = 0; part < part_num; ++part) {
+    size_t offset = 0;
+    for (auto* input : inputs) {
+      if (input->rows().size() == 0) {
+        continue;
+      }
+      auto* input_data = input->value().data<T>();
+      auto& input_rows = input->rows();
 
-    for (size_t i = 0; i < input_rows.size(); i++) {
-      size_t out_i = rows_to_id.at(input_rows[i]);
-      elementwise_add_to<T, DeviceContext>(&blas,
-                                           static_cast<size_t>(input_width),
-                                           &input_data[i * input_width],
-                                           &out_data[out_i * input_width]);
+      for (size_t i = 0; i < input_rows.size(); i++) {
+        size_t out_i = out_ids[offset + i];
+        if (out_i % part_num != static_cast<size_t>(part)) {
+          continue;
+        }
+        elementwise_add_to<T, DeviceContext>(&blas,
+                                             static_cast<size_t>(input_width),
+                                             &input_data[i * input_width],
+                                             &out_data[out_i * input_width]);
+      }
+      offset += input_rows.size();
     }
   }
 }
@@ -457,7 +572,6 @@ struct MergeAddImpl {
     auto input_width = has_value_input->value().dims()[1];
     auto input_height = has_value_input->height();
     phi::SelectedRows& out = *output;
-    std::set<int64_t> merged_row_set;
     size_t row_num = 0;
     for (auto* input : inputs) {
       if (input->rows().size() == 0) {
@@ -473,25 +587,25 @@ struct MergeAddImpl {
                         platform::errors::InvalidArgument(
                             "All inputs should have same height."));
       row_num += input->rows().size();
-      merged_row_set.insert(input->rows().begin(), input->rows().end());
+    }
+    MergeRowMap row_map(row_num);
+    std::vector<int64_t> merge_rows;
+    for (auto* input : inputs) {
+      for (auto row : input->rows()) {
+        if (row_map.Insert(row)) {
+          merge_rows.push_back(row);
+        }
+      }
     }
 
     out.set_height(input_height);
     out.mutable_value()->mutable_data<T>(
-        phi::make_ddim(
-            {static_cast<int64_t>(merged_row_set.size()), input_width}),
+        phi::make_ddim({static_cast<int64_t>(merge_rows.size()), input_width}),
         context.GetPlace());
     auto* out_data = out.mutable_value()->data<T>();
 
-    if (merged_row_set.size() == row_num && !sorted_result) {
+    if (merge_rows.size() == row_num && !sorted_result) {
       // no duplicated ids, just concat the result together
-      std::vector<int64_t> merge_rows;
-      merge_rows.reserve(row_num);
-      // concat rows
-      for (auto* in : inputs) {
-        merge_rows.insert(
-            merge_rows.end(), in->rows().begin(), in->rows().end());
-      }
       out.set_rows(merge_rows);
       auto in_place = inputs[0]->place();
       auto out_place = out.place();
@@ -507,11 +621,17 @@ struct MergeAddImpl {
         copied_numel += in_numel;
       }
     } else {
-      std::vector<int64_t> merge_rows(merged_row_set.begin(),
-                                      merged_row_set.end());
-
-      if (sorted_result) {
-        std::sort(merge_rows.begin(), merge_rows.end());
+      // the merged rows are sorted like the std::set they were kept in
+      SortMergedRows(&merge_rows);
+      for (size_t i = 0; i < merge_rows.size(); ++i) {
+        row_map[merge_rows[i]] = i;
+      }
+      std::vector<size_t> out_ids;
+      out_ids.reserve(row_num);
+      for (auto* input : inputs) {
+        for (auto row : input->rows()) {
+          out_ids.push_back(row_map[row]);
+        }
       }
 
       out.set_rows(merge_rows);
@@ -519,13 +639,8 @@ struct MergeAddImpl {
       phi::funcs::SetConstant<DeviceContext, T> constant_functor;
       constant_functor(context, out.mutable_value(), static_cast<T>(0.f));
 
-      std::unordered_map<int64_t, size_t> rows_to_id;
-      for (size_t i = 0; i < merge_rows.size(); ++i) {
-        rows_to_id[merge_rows[i]] = i;
-      }
-
       add_sparse_inputs<T, DeviceContext>(
-          inputs, rows_to_id, input_width, context, out_data);
+          inputs, out_ids, input_width, context, out_data);
     }
   }
 };
@@ -14,6 +14,10 @@ limitations under the License. */
 
 #include "paddle/fluid/operators/math/selected_rows_functor.h"
 
+#include <chrono>  // NOLINT
+#include <map>
+#include <random>
+
 #include "gtest/gtest.h"
 #include "paddle/phi/kernels/funcs/math_function.h"
 
@@ -498,3 +502,85 @@ TEST(selected_rows_functor, cpu_sum_to) {
   // row9: 2.0 + 3.0
   EXPECT_EQ(tensor1_data[9 * row_numel + 6], 5.0);
 }
+
+// inputs of row_num random rows of [0, height) each, row r of input k is
+// filled with k + r % 7
+static std::vector<std::unique_ptr<phi::SelectedRows>> RandomSelectedRows(
+    int input_num, size_t row_num, int64_t height, int64_t row_numel) {
+  paddle::platform::CPUPlace cpu_place;
+  std::mt19937_64 engine(input_num * row_num + height);
+  std::vector<std::unique_ptr<phi::SelectedRows>> inputs;
+  for (int k = 0; k < input_num; ++k) {
+    std::vector<int64_t> rows(row_num);
+    for (auto& row : rows) {
+      row = engine() % height;
+    }
+    inputs.emplace_back(new phi::SelectedRows(rows, height));
+    auto* data = inputs.back()->mutable_value()->mutable_data<float>(
+        phi::make_ddim({static_cast<int64_t>(row_num), row_numel}),
+        cpu_place);
+    for (size_t i = 0; i < row_num; ++i) {
+      for (int64_t j = 0; j < row_numel; ++j) {
+        data[i * row_numel + j] = k + rows[i] % 7;
+      }
+    }
+  }
+  return inputs;
+}
+
+TEST(selected_rows_functor, cpu_merge_add_many_rows) {
+  paddle::platform::CPUPlace cpu_place;
+  phi::CPUContext ctx(cpu_place);
+  const int64_t row_numel = 16;
+  // few rows, and enough of them for the radix sort and the threads
+  for (size_t row_num : {100, 100000}) {
+    auto inputs = RandomSelectedRows(3, row_num, row_num, row_numel);
+    std::vector<const phi::SelectedRows*> input_ptrs;
+    std::map<int64_t, float> expected;
+    for (size_t k = 0; k < inputs.size(); ++k) {
+      input_ptrs.push_back(inputs[k].get());
+      for (auto row : inputs[k]->rows()) {
+        expected[row] += k + row % 7;
+      }
+    }
+    for (bool sorted_result : {false, true}) {
+      phi::SelectedRows output;
+      paddle::operators::math::scatter::MergeAdd<phi::CPUContext, float>
+          merge_add_functor;
+      merge_add_functor(ctx, input_ptrs, &output, sorted_result);
+      ASSERT_EQ(output.rows().size(), expected.size());
+      auto* out_data = output.value().data<float>();
+      size_t i = 0;
+      for (auto& row : expected) {
+        ASSERT_EQ(output.rows()[i], row.first);
+        for (int64_t j = 0; j < row_numel; ++j) {
+          ASSERT_EQ(out_data[i * row_numel + j], row.second);
+        }
+        ++i;
+      }
+    }
+  }
+}
+
+TEST(selected_rows_functor, cpu_merge_add_benchmark) {
+  paddle::platform::CPUPlace cpu_place;
+  phi::CPUContext ctx(cpu_place);
+  for (size_t row_num : {10000, 100000, 1000000}) {
+    for (int64_t row_numel : {8, 64, 256}) {
+      // about a quarter of the rows are distinct
+      auto inputs = RandomSelectedRows(1, row_num, row_num / 4, row_numel);
+      phi::SelectedRows output;
+      paddle::operators::math::scatter::MergeAdd<phi::CPUContext, float>
+          merge_add_functor;
+      auto start = std::chrono::steady_clock::now();
+      merge_add_functor(ctx, *inputs[0], &output, false);
+      LOG(INFO) << "merge add of " << row_num << " rows of width "
+                << row_numel << " into " << output.rows().size()
+                << " rows: "
+                << std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count()
+                << "s";
+    }
+  }
+}
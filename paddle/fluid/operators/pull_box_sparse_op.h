@@ -82,6 +82,11 @@ static void LookupInputFunctor(const framework::ExecutionContext &ctx) {
       const_cast<float *>(output->mutable_data<float>(ctx.GetPlace()));
 
   auto box_ptr = paddle::framework::BoxWrapper::GetInstance();
+  if (platform::is_cpu_place(ctx.GetPlace())) {
+    box_ptr->input_table_deque_.front().LookupInputCPU(
+        input_data, output_data, batch_size);
+    return;
+  }
   size_t device_id = ctx.GetPlace().GetDeviceId();
   box_ptr->input_table_deque_.front().LookupInput(input_data, output_data,
                                                   batch_size, device_id);
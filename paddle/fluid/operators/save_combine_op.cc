@@ -16,6 +16,8 @@ limitations under the License. */
 
 #include <string>
 
+#include "paddle/fluid/framework/op_version_registry.h"
+
 namespace paddle {
 namespace operators {
 
@@ -77,6 +79,12 @@ to a file on disk.
                   "(boolean, default false)"
                   "If true, the variables will be saved to binary strings.")
         .SetDefault(false);
+    AddAttr<bool>("save_as_mapped",
+                  "(boolean, default false)"
+                  "If true, the variables will be saved as a mapped tensor "
+                  "file that load_combine loads with mmap, the cpu tensors "
+                  "use the mapped pages without a copy.")
+        .SetDefault(false);
     AddOutput("Y",
               "(RAW, default empty)."
               "This output is used when saving variables to binary strings.")
@@ -102,6 +110,14 @@ REGISTER_OPERATOR(save_combine,
                   ops::SaveCombineOpProtoMaker,
                   ops::SaveCombineOpInferVarType);
 
+REGISTER_OP_VERSION(save_combine)
+    .AddCheckpoint(
+        R"ROC(Upgrade save_combine, add a new attribute [save_as_mapped].)ROC",
+        paddle::framework::compatible::OpVersionDesc().NewAttr(
+            "save_as_mapped",
+            "Whether to save the variables as a mapped tensor file.",
+            false));
+
 REGISTER_OP_CPU_KERNEL(
     save_combine,
     ops::SaveCombineOpKernel<phi::CPUContext, float>,
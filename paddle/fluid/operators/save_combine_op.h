@@ -26,6 +26,7 @@ limitations under the License. */
 #include "paddle/fluid/framework/data_type.h"
 #include "paddle/fluid/framework/data_type_transform.h"
 #include "paddle/fluid/framework/lod_tensor.h"
+#include "paddle/fluid/framework/mapped_tensor_file.h"
 #include "paddle/fluid/framework/op_registry.h"
 #include "paddle/fluid/framework/string_array.h"
 #include "paddle/fluid/platform/device_context.h"
@@ -40,6 +41,7 @@ class SaveCombineOpKernel : public framework::OpKernel<T> {
     auto filename = ctx.Attr<std::string>("file_path");
     auto overwrite = ctx.Attr<bool>("overwrite");
     auto save_to_memory = ctx.Attr<bool>("save_to_memory");
+    auto save_as_mapped = ctx.Attr<bool>("save_as_mapped");
 
     bool is_present = FileExists(filename);
     if (is_present && !overwrite) {
@@ -49,7 +51,14 @@ class SaveCombineOpKernel : public framework::OpKernel<T> {
           filename,
           overwrite));
     }
-    if (save_to_memory) {
+    if (save_as_mapped) {
+      PADDLE_ENFORCE_EQ(save_to_memory,
+                        false,
+                        platform::errors::InvalidArgument(
+                            "save_as_mapped and save_to_memory of "
+                            "save_combine_op can not be both true."));
+      SaveCombineMappedVars(ctx, filename);
+    } else if (save_to_memory) {
       auto output = ctx.Output<std::string>("Y");
       PADDLE_ENFORCE_NE(output,
                         nullptr,
@@ -60,13 +69,17 @@ class SaveCombineOpKernel : public framework::OpKernel<T> {
       *output = ss.str();
     } else {
       MkDirRecursively(DirName(filename).c_str());
-      std::ofstream fout(filename, std::ios::binary);
+      // the variables may be loaded from a mapped filename and still use
+      // its pages, write a new file and rename it over filename
+      std::string temp_name = framework::TempFileName(filename);
+      std::ofstream fout(temp_name, std::ios::binary);
       PADDLE_ENFORCE_EQ(static_cast<bool>(fout),
                         true,
                         platform::errors::Unavailable(
-                            "Cannot open %s to save variables.", filename));
+                            "Cannot open %s to save variables.", temp_name));
       SaveCombineVars(ctx, reinterpret_cast<std::ostream *>(&fout));
       fout.close();
+      framework::ReplaceWithTempFile(temp_name, filename);
     }
   }
 
@@ -138,6 +151,57 @@ class SaveCombineOpKernel : public framework::OpKernel<T> {
       }
     }
   }
+
+  void SaveCombineMappedVars(const framework::ExecutionContext &ctx,
+                             const std::string &filename) const {
+    auto place = ctx.GetPlace();
+    auto save_as_fp16 = ctx.Attr<bool>("save_as_fp16");
+    auto inp_var_names = ctx.InputNames("X");
+    auto &inp_vars = ctx.MultiInputVar("X");
+    PADDLE_ENFORCE_GT(inp_var_names.size(),
+                      0UL,
+                      platform::errors::InvalidArgument(
+                          "The number of variables to be saved is %d, expect "
+                          "it to be greater than 0.",
+                          inp_var_names.size()));
+
+    std::vector<framework::LoDTensor> converted(inp_var_names.size());
+    std::vector<const framework::LoDTensor *> tensors;
+    for (size_t i = 0; i < inp_var_names.size(); i++) {
+      PADDLE_ENFORCE_NOT_NULL(
+          inp_vars[i],
+          platform::errors::InvalidArgument("Cannot find variable %s to save.",
+                                            inp_var_names[i]));
+      PADDLE_ENFORCE_EQ(inp_vars[i]->IsType<framework::LoDTensor>(),
+                        true,
+                        platform::errors::InvalidArgument(
+                            "SaveCombine operator only supports saving "
+                            "LoDTensor variable as mapped file, %s has wrong "
+                            "type.",
+                            inp_var_names[i]));
+      auto &tensor = inp_vars[i]->Get<framework::LoDTensor>();
+      PADDLE_ENFORCE_EQ(
+          tensor.IsInitialized(),
+          true,
+          platform::errors::InvalidArgument(
+              "The Tensor of Variable(%s) to be saved is not initialized.",
+              inp_var_names[i]));
+      auto in_dtype = framework::TransToProtoVarType(tensor.dtype());
+      auto out_dtype =
+          save_as_fp16 ? framework::proto::VarType::FP16 : in_dtype;
+      if (in_dtype != out_dtype) {
+        auto in_kernel_type = framework::OpKernelType(in_dtype, place);
+        auto out_kernel_type = framework::OpKernelType(out_dtype, place);
+        converted[i].set_lod(tensor.lod());
+        framework::TransDataType(
+            in_kernel_type, out_kernel_type, tensor, &converted[i]);
+        tensors.push_back(&converted[i]);
+      } else {
+        tensors.push_back(&tensor);
+      }
+    }
+    framework::SaveMappedTensorFile(filename, inp_var_names, tensors);
+  }
 };
 
 }  // namespace operators
@@ -84,7 +84,7 @@ void CheckValues(T* expect,
 // Here, we create 4 LoDTensors and use save_combine_op to first save these
 // in a single file. Then, we use load_combine_op to load these sequentially
 template <typename T, typename U>
-void SaveLoadCombineOp() {
+void SaveLoadCombineOp(bool save_as_mapped = false) {
   paddle::framework::Scope scope;
   paddle::platform::CPUPlace place;
 
@@ -113,9 +113,11 @@ void SaveLoadCombineOp() {
       20, 50, lod4, "test_var4", place, &scope, &expect_lod4);
 
   // Set attributes
-  std::string filename = "check_tensor.ls";
+  std::string filename =
+      save_as_mapped ? "check_tensor_mapped.ls" : "check_tensor.ls";
   paddle::framework::AttributeMap attrs;
   attrs.insert({"file_path", std::string(filename)});
+  attrs.insert({"save_as_mapped", save_as_mapped});
 
   // Run the save_combine_op
   auto save_combine_op = paddle::framework::OpRegistry::CreateOp(
@@ -157,6 +159,10 @@ TEST(SaveLoadCombineBF16Op, CPU) {
   SaveLoadCombineOp<paddle::platform::bfloat16, paddle::platform::bfloat16>();
 }
 
+#ifndef _WIN32
+TEST(SaveLoadCombineMappedOp, CPU) { SaveLoadCombineOp<int, int>(true); }
+#endif
+
 // FP16 version of SaveLoadCombineOp Test, only altering the saving aspect
 // to save as FP16.
 TEST(SaveCombineFP16Op, CPU) {
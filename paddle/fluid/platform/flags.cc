@@ -355,6 +355,24 @@ PADDLE_DEFINE_EXPORTED_bool(
 PADDLE_DEFINE_EXPORTED_int32(communicator_send_queue_size,
                              20,
                              "queue size to recv gradient before send");
+/**
+ * Distributed related FLAG
+ * Name: FLAGS_communicator_sparse_coalesce
+ * Since Version: 2.4.0
+ * Value Range: bool, default=false
+ * Example:
+ * Note: Coalesce the async sparse pushes of each table, both the pushes
+ *       from tensor and the sparse vars merged from the send queues.
+ *       Duplicate keys across vars and steps are merged on the trainer, and
+ *       one batched push per table is sent every
+ *       FLAGS_communicator_sparse_coalesce_interval_ms.
+ */
+PADDLE_DEFINE_EXPORTED_bool(communicator_sparse_coalesce,
+                            false,
+                            "merge async sparse push by table before send");
+PADDLE_DEFINE_EXPORTED_int32(communicator_sparse_coalesce_interval_ms,
+                             10,
+                             "interval(ms) to send the coalesced sparse push");
 #endif
 
 /**
@@ -960,6 +978,32 @@ PADDLE_DEFINE_EXPORTED_int32(padbox_slotrecord_extend_dim,
 PADDLE_DEFINE_EXPORTED_int32(fix_dayid, 0, "Whether fix dayid in PaddleBox");
 PADDLE_DEFINE_EXPORTED_int32(padbox_slotpool_thread_num, 1,
              "PadBoxSlotDataset slot pool thread num");
+PADDLE_DEFINE_EXPORTED_int32(padbox_input_table_lookup_thread_num, 4,
+             "BoxPS input table lookup gather thread num");
+PADDLE_DEFINE_EXPORTED_int32(padbox_slotfeed_fill_thread_num, 0,
+             "SlotPaddleBoxDataFeed cpu batch fill thread num, 0 fills in "
+             "the reader thread and disables next batch prepare");
+PADDLE_DEFINE_EXPORTED_int32(data_norm_cpu_thread_num, 4,
+             "data_norm and masked_data_norm cpu kernel thread num, the rows "
+             "are split into at most this many blocks, 1 runs in the caller");
+PADDLE_DEFINE_EXPORTED_int32(cpu_collective_local_size, 1,
+             "cpu c_mixallgather and c_allreduce_xsum process num on one host, "
+             "more than 1 reduces the local processes through shared memory");
+PADDLE_DEFINE_EXPORTED_int32(cpu_collective_local_rank, 0,
+             "cpu collective process rank on its host, 0 talks to other hosts");
+PADDLE_DEFINE_EXPORTED_int32(cpu_collective_slot_mb, 64,
+             "cpu collective shared memory slot size of each local process");
+PADDLE_DEFINE_EXPORTED_string(cpu_collective_shm_name, "paddle_cpu_collective",
+             "cpu collective shared memory name, unique for the job on a host");
+PADDLE_DEFINE_EXPORTED_string(padbox_trace_dir, "",
+             "BoxPS pass timeline directory, a chrome tracing file is saved "
+             "there for every traced pass, empty disables the tracing");
+PADDLE_DEFINE_EXPORTED_int32(padbox_trace_level, 0,
+             "BoxPS timeline host trace level, 0 BoxPS stages, 1 adds ops");
+PADDLE_DEFINE_EXPORTED_int32(padbox_trace_pass_interval, 1,
+             "BoxPS timeline traces one pass in this many passes");
+PADDLE_DEFINE_EXPORTED_int32(padbox_trace_batch_interval, 1,
+             "BoxPS timeline traces one batch in this many batches of a pass");
 PADDLE_DEFINE_EXPORTED_bool(use_gpu_replica_cache, false,
             "if true ,will open use_gpu_replica_cache");
 PADDLE_DEFINE_EXPORTED_int32(gpu_replica_cache_dim, 8, "use_gpu_replica_cache,the dim");
@@ -969,17 +1013,59 @@ PADDLE_DEFINE_EXPORTED_int32(padbox_dataset_merge_thread_num, 20,
              "PadBoxSlotDataset shuffle thread num");
 PADDLE_DEFINE_EXPORTED_bool(padbox_dataset_disable_shuffle, false,
             "if true ,will disable data shuffle");
+PADDLE_DEFINE_EXPORTED_int32(padbox_shuffle_slotrecord_encoding, 0,
+             "SlotRecord encoding of the PadBoxSlotDataset shuffle messages, "
+             "0 legacy, 1 compact varint, 2 compact varint with float16 "
+             "float feasigns, the receivers read every encoding");
+PADDLE_DEFINE_EXPORTED_int32(padbox_archive_slotrecord_encoding, 0,
+             "SlotRecord encoding of the PadBoxSlotDataset binary archive "
+             "files, 0 legacy, 1 compact varint, 2 compact varint with "
+             "float16 float feasigns, the readers read every encoding");
 PADDLE_DEFINE_EXPORTED_bool(padbox_auc_runner_mode, false, "auc runner mode");
+PADDLE_DEFINE_EXPORTED_bool(padbox_auc_runner_slot_overlay, false,
+            "if true, the auc runner feeds the replaced slots from a side "
+            "table instead of rewriting the records of the pass");
 PADDLE_DEFINE_EXPORTED_bool(padbox_dataset_disable_polling, false,
             "if true ,will disable input file list polling");
 PADDLE_DEFINE_EXPORTED_bool(padbox_dataset_enable_unrollinstance, false,
             "if true ,will enable unrollinstance");
+PADDLE_DEFINE_EXPORTED_bool(padbox_dataset_key_stat, false,
+            "if true, the merge threads sketch the keys of every feed pass, "
+            "the unique keys per slot, the hot keys and the overlap with "
+            "the previous pass");
+PADDLE_DEFINE_EXPORTED_int32(padbox_dataset_key_stat_precision, 10,
+            "hyperloglog precision of the pass key statistics, every slot "
+            "of every merge thread takes 2^precision bytes");
+PADDLE_DEFINE_EXPORTED_int32(padbox_dataset_key_stat_topk, 100,
+            "number of hot keys kept by the pass key statistics");
+PADDLE_DEFINE_EXPORTED_bool(padbox_dataset_block_channel, false,
+            "if true, the input and shuffle channels of PadBoxSlotDataset "
+            "pass blocks of records through a lock free ring");
 PADDLE_DEFINE_EXPORTED_bool(lineid_have_extend_info, false,
             "if true , will split line id by space into 2 part, the second "
             "part will dump at the last of line");
 PADDLE_DEFINE_EXPORTED_bool(dump_filed_same_as_aibox, false,
             "if true , will change dump format from abc.tmp0:2:1:1 into "
             "abc:1:1, which same as aibox");
+PADDLE_DEFINE_EXPORTED_int32(dataset_merge_by_insid_memory_mb, -1,
+            "memory budget in MB of the sorted runs kept in memory by "
+            "MultiSlotDataset::MergeByInsId, the channels are cut into runs "
+            "within it while they are read and the other runs are spilled to "
+            "dataset_merge_by_insid_spill_dir, -1 keeps every run in memory");
+PADDLE_DEFINE_EXPORTED_string(dataset_merge_by_insid_spill_dir, "/tmp",
+            "local directory of the runs spilled by "
+            "MultiSlotDataset::MergeByInsId");
+PADDLE_DEFINE_EXPORTED_uint64(dataset_shuffle_seed, 0,
+            "if not 0, the local shuffles of the datasets use this seed and "
+            "the global shuffle sends a record to the trainer picked by the "
+            "hash of its ins id, so runs of the same data and thread num "
+            "are reproducible");
+PADDLE_DEFINE_EXPORTED_int32(downpour_sparse_prefetch_staleness, -1,
+            "if >= 0, DownpourWorker reads the next batch and pulls its "
+            "sparse values while the current batch runs. 0 pulls again the "
+            "keys pushed by the current batch before the next batch uses "
+            "them, 1 allows the values to miss one step of updates, "
+            "-1 disables the prefetch");
 
 PADDLE_DEFINE_EXPORTED_bool(
     gpugraph_enable_hbm_table_collision_stat,
@@ -1004,6 +1090,16 @@ PADDLE_DEFINE_EXPORTED_int32(
     gpugraph_dedup_pull_push_mode,
     0,
     "enable dedup keys while pull push sparse, default 0");
+PADDLE_DEFINE_EXPORTED_bool(
+    gpups_prebuild_radix_dedup,
+    false,
+    "dedup the pass keys of SlotRecordDataset by per shard append buffers "
+    "and radix sort instead of hash sets in PreBuildTask, default false");
+PADDLE_DEFINE_EXPORTED_double(
+    gpups_prebuild_radix_dedup_max_unique_ratio,
+    0.9,
+    "radix dedup is used only when the unique ratio of a sample of the pass "
+    "keys is not above this, default 0.9");
 PADDLE_DEFINE_EXPORTED_bool(gpugraph_load_node_list_into_hbm,
                             true,
                             "enable load_node_list_into_hbm, default true");
@@ -381,8 +381,28 @@ void BindDataset(py::module *m) {
            py::call_guard<py::gil_scoped_release>())
       .def("set_gpu_graph_mode",
            &framework::Dataset::SetGpuGraphMode,
+           py::call_guard<py::gil_scoped_release>())
+      .def("get_pass_key_stat",
+           &framework::Dataset::GetPassKeyStat,
            py::call_guard<py::gil_scoped_release>());
 
+  py::class_<framework::PassKeyStat::Summary>(*m, "PassKeyStat")
+      .def_readonly("pass_id", &framework::PassKeyStat::Summary::pass_id)
+      .def_readonly("total_keys", &framework::PassKeyStat::Summary::total_keys)
+      .def_readonly("unique_keys",
+                    &framework::PassKeyStat::Summary::unique_keys)
+      .def_readonly("jaccard_prev",
+                    &framework::PassKeyStat::Summary::jaccard_prev)
+      .def_readonly("slot_unique_keys",
+                    &framework::PassKeyStat::Summary::slot_unique_keys)
+      .def_readonly("slot_jaccard_prev",
+                    &framework::PassKeyStat::Summary::slot_jaccard_prev)
+      .def_readonly("hot_keys", &framework::PassKeyStat::Summary::hot_keys)
+      .def_readonly("add_seconds",
+                    &framework::PassKeyStat::Summary::add_seconds)
+      .def_readonly("merge_seconds",
+                    &framework::PassKeyStat::Summary::merge_seconds);
+
   py::class_<IterableDatasetWrapper>(*m, "IterableDatasetWrapper")
       .def(py::init<framework::Dataset *,
                     const std::vector<std::string> &,
@@ -179,6 +179,7 @@ void BindDistCommunicator(py::module* m) {
       .def("create_client_to_client_connection",
            &Communicator::CreateC2CConnection)
       .def("get_client_info", &Communicator::GetClientInfo)
+      .def("get_sparse_coalesce_stat", &Communicator::GetSparseCoalesceStat)
       .def("set_clients", &Communicator::SetClients)
       .def("start_coordinator", &Communicator::StartCoordinator)
       .def("query_fl_clients_info", &Communicator::QueryFLClientsInfo)
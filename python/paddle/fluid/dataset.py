@@ -1449,6 +1449,15 @@ class PadBoxSlotDataset(BoxPSDataset):
         """
         self.dataset.set_archivefile(archive)
 
+    def get_pass_key_stat(self):
+        """
+            key statistics of the last loaded pass, collected while merging
+            the keys when FLAGS_padbox_dataset_key_stat is set: unique_keys,
+            slot_unique_keys, hot_keys as (feasign, count), and jaccard_prev,
+            slot_jaccard_prev with the previous pass
+        """
+        return self.dataset.get_pass_key_stat()
+
 
 class InputTableDataset(PadBoxSlotDataset):
     def __init__(self):